@@ -79,6 +79,9 @@ MDL_AVG_CHANGES_OFFSETS = xmipp.MDL_AVG_CHANGES_OFFSETS
 MDL_AVG_CHANGES_CLASSES = xmipp.MDL_AVG_CHANGES_CLASSES
 
 MDL_BGMEAN = xmipp.MDL_BGMEAN
+MDL_BLOB_ALPHA = xmipp.MDL_BLOB_ALPHA
+MDL_BLOB_ORDER = xmipp.MDL_BLOB_ORDER
+MDL_BLOB_RADIUS = xmipp.MDL_BLOB_RADIUS
 MDL_BLOCK_NUMBER = xmipp.MDL_BLOCK_NUMBER
 
 MDL_CLASS_COUNT = xmipp.MDL_CLASS_COUNT
@@ -206,6 +209,7 @@ MDL_MAGNIFICATION = xmipp.MDL_MAGNIFICATION
 MDL_MASK = xmipp.MDL_MASK
 MDL_MAXCC = xmipp.MDL_MAXCC
 MDL_MAX = xmipp.MDL_MAX
+MDL_MAX_RESOLUTION = xmipp.MDL_MAX_RESOLUTION
 MDL_MICROGRAPH = xmipp.MDL_MICROGRAPH
 MDL_MICROGRAPH_ID = xmipp.MDL_MICROGRAPH_ID
 MDL_MICROGRAPH_MOVIE = xmipp.MDL_MICROGRAPH_MOVIE
@@ -330,6 +334,7 @@ MDL_SCORE_BY_ZSCORE=xmipp.MDL_SCORE_BY_ZSCORE
 
 MDL_SUM = xmipp.MDL_SUM
 MDL_SUMWEIGHT = xmipp.MDL_SUMWEIGHT
+MDL_SYMMETRY = xmipp.MDL_SYMMETRY
 MDL_SYMNO = xmipp.MDL_SYMNO
 
 MDL_TIME = xmipp.MDL_TIME
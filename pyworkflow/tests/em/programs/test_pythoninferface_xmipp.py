@@ -258,6 +258,24 @@ class TestXmippPythonInterface(unittest.TestCase):
         img1 += img2
         self.assertNotEqual(sum, img1)
 
+    def test_Image_operatorsResult(self):
+        # Operators return new images with the values of the operation
+        stackPath = testFile("smallStack.stk")
+        img1 = Image("1@" + stackPath)
+        img2 = Image("2@" + stackPath)
+        data1 = img1.getData(True)
+        data2 = img2.getData(True)
+        self.assertTrue(abs((img1 + img2).getData() - (data1 + data2)).max() < 1e-5)
+        self.assertTrue(abs((img1 - img2).getData() - (data1 - data2)).max() < 1e-5)
+        self.assertTrue(abs((img1 * 2).getData() - data1 * 2).max() < 1e-5)
+        self.assertTrue(abs((img1 / 2).getData() - data1 / 2).max() < 1e-5)
+        # In place operators change the image and keep the other one
+        img1 += img2
+        self.assertTrue(abs(img1.getData() - (data1 + data2)).max() < 1e-5)
+        self.assertTrue(abs(img2.getData() - data2).max() < 1e-5)
+        img1 -= img2
+        self.assertTrue(abs(img1.getData() - data1).max() < 1e-5)
+
     def test_Image_multiplyDivide(self):
         imgPath = testFile("singleImage.spi")
         img1 = Image(imgPath)
@@ -359,6 +377,36 @@ class TestXmippPythonInterface(unittest.TestCase):
                       [ 0.90717429, 0.6812411, -0.09380955]])
         self.assertEqual(Z.all(), Zref.all())
 
+    def test_Image_getDataView(self):
+        imgPath = testFile("singleImage.spi")
+        img = Image(imgPath)
+        Z = img.getData()
+        Zcopy = img.getData(True)
+        # The view shares the image memory, the copy does not
+        Z[0, 0] = 5.
+        self.assertAlmostEqual(img.getPixel(0, 0, 0, 0), 5.)
+        self.assertNotAlmostEqual(Zcopy[0, 0], 5.)
+        # The view keeps its data when the image is read again or deleted
+        img.read("1@" + testFile("smallStack.stk"))
+        self.assertAlmostEqual(Z[0, 0], 5.)
+        del img
+        self.assertAlmostEqual(Z[0, 0], 5.)
+
+    def test_xmipp_readStack(self):
+        from numpy import empty, float64
+        stackPath = testFile("smallStack.stk")
+        x, y, z, n = getImageSize(stackPath)
+        stack = readStack(stackPath)
+        self.assertEqual(stack.shape, (n, y, x))
+        img = Image()
+        for i in range(n):
+            img.read("%d@%s" % (i + 1, stackPath))
+            self.assertTrue((stack[i] == img.getData()).all())
+        # Fill a preallocated array starting at the second image
+        out = empty((n - 1, y, x), dtype=float64)
+        self.assertTrue(readStack(stackPath, out, 2) is out)
+        self.assertTrue((out == stack[1:]).all())
+
     def test_Image_initConstant(self):
         imgPath = testFile("tinyImage.spi")
         img = Image(imgPath)
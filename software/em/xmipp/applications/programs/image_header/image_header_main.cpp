@@ -26,6 +26,7 @@
 
 #include <data/xmipp_image.h>
 #include <data/metadata.h>
+#include <data/metadata_extension.h>
 #include <data/xmipp_program.h>
 #include <data/xmipp_hdf5.h>
 
@@ -40,6 +41,9 @@ protected:
     MDRow row;
     ApplyGeoParams params;
     double sampling;
+    // Headers of the input images, read at once to show the sampling rate
+    std::vector<ImageHeaderInfo> headers;
+    size_t headerIndex;
 
     void defineParams()
     {
@@ -149,6 +153,15 @@ protected:
 
     }
 
+    void preProcess()
+    {
+        if (operation == HEADER_SAMPLINGRATE && sampling < 0)
+        {
+            getImageHeaders(*getInputMd(), headers, image_label);
+            headerIndex = 0;
+        }
+    }
+
     void roundShifts(MDRow &row)
     {
         double aux = 0.;
@@ -197,15 +210,11 @@ protected:
             break;
         case HEADER_SAMPLINGRATE:
             {
-                img.read(fnImg, _HEADER_ALL);
                 if (sampling < 0)
-                {
-                    double samplingRead;
-                    img.image->MDMainHeader.getValue(MDL_SAMPLINGRATE_X, samplingRead);
-                    std::cout << samplingRead << std::endl;
-                }
+                    std::cout << headers[headerIndex++].sampling << std::endl;
                 else
                 {
+                    img.read(fnImg, _HEADER_ALL);
                     img.image->MDMainHeader.setValue(MDL_SAMPLINGRATE_X, sampling);
                     img.image->MDMainHeader.setValue(MDL_SAMPLINGRATE_Y, sampling);
                     img.image->MDMainHeader.setValue(MDL_SAMPLINGRATE_Z, sampling);
@@ -29,6 +29,7 @@
 #include <data/xmipp_program.h>
 #include <data/xmipp_image_generic.h>
 #include <data/metadata.h>
+#include <data/xmipp_image_extension.h>
 #include <data/mask.h>
 
 /* PROGRAM ----------------------------------------------------------------- */
@@ -120,8 +121,20 @@ protected:
           }
         }
 
-        // get xdim, ydim,zdim
-        //getImageSize(mdIn, xDim, yDim, zDim, nDim, image_label);
+        // The mask and the average images need all the images of the same size.
+        // Check it before processing, all the headers are read in parallel
+        if (apply_mask || save_image_stats)
+        {
+            std::vector<FileName> fnImgs;
+            std::vector<ImageHeaderInfo> headers;
+            getInputMd()->getColumnValues(image_label, fnImgs);
+            readImageHeaders(fnImgs, headers);
+            for (size_t n = 0; n < headers.size(); ++n)
+                if (headers[n].Xdim != xdimOut || headers[n].Ydim != ydimOut || headers[n].Zdim != zdimOut)
+                    REPORT_ERROR(ERR_MULTIDIM_SIZE, formatString("%s is not of the size of the first image",
+                                 fnImgs[n].c_str()));
+        }
+
         averageArray.resize(ndimOut, zdimOut, ydimOut, xdimOut);
         stdArray.resize(ndimOut,zdimOut,ydimOut,xdimOut);
         averageArray.setXmippOrigin();
@@ -0,0 +1,249 @@
+#include <classification/svm_classifier.h>
+#include <classification/knn_classifier.h>
+#include <classification/feature_matrix.h>
+#include <classification/vector_ops.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ClassificationTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        init_random_generator(1);
+    }
+
+    // Two Gaussian classes (labels 1 and 2) with some zero features, as
+    // in the training sets of the picking
+    void generateSamples(size_t N, size_t dim, double separation,
+                         MultidimArray<double> &samples, MultidimArray<double> &labels)
+    {
+        samples.initZeros(N,dim);
+        labels.initZeros(N);
+        for (size_t i=0; i<N; i++)
+        {
+            int label=1+(i%2);
+            DIRECT_A1D_ELEM(labels,i)=label;
+            for (size_t j=0; j<dim; j++)
+                if (j%4!=3)
+                    DIRECT_A2D_ELEM(samples,i,j)=rnd_gaus()+(label==2 ? separation : 0.);
+        }
+    }
+
+    // Batch prediction must give the labels and scores of the single one
+    void checkSVMBatch(SVMClassifier &classifier, const MultidimArray<double> &samples)
+    {
+        MultidimArray<double> labels, scores;
+        classifier.predict(samples,labels,scores);
+        ASSERT_EQ(YSIZE(samples),XSIZE(labels));
+        ASSERT_EQ(YSIZE(samples),XSIZE(scores));
+        MultidimArray<double> sample;
+        double score;
+        for (size_t i=0; i<YSIZE(samples); i++)
+        {
+            samples.getRow(i,sample);
+            double label=classifier.predict(sample,score);
+            EXPECT_EQ(label,DIRECT_A1D_ELEM(labels,i));
+            EXPECT_NEAR(score,DIRECT_A1D_ELEM(scores,i),1e-10);
+        }
+
+        // Only some rows
+        std::vector<size_t> rows;
+        for (size_t i=1; i<YSIZE(samples); i+=3)
+            rows.push_back(i);
+        MultidimArray<double> labelsRows, scoresRows;
+        classifier.predict(samples,labelsRows,scoresRows,&rows);
+        for (size_t i=0; i<YSIZE(samples); i++)
+            if (i%3==1)
+            {
+                EXPECT_EQ(DIRECT_A1D_ELEM(labels,i),DIRECT_A1D_ELEM(labelsRows,i));
+                EXPECT_NEAR(DIRECT_A1D_ELEM(scores,i),DIRECT_A1D_ELEM(scoresRows,i),1e-10);
+            }
+            else
+            {
+                EXPECT_EQ(0,DIRECT_A1D_ELEM(labelsRows,i));
+                EXPECT_EQ(0,DIRECT_A1D_ELEM(scoresRows,i));
+            }
+    }
+};
+
+TEST_F( ClassificationTest, svmBatchPredict)
+{
+    XMIPP_TRY
+    MultidimArray<double> trainSet, trainLabels, samples, sampleLabels;
+    generateSamples(200,10,1.5,trainSet,trainLabels);
+    generateSamples(101,10,1.5,samples,sampleLabels);
+
+    SVMClassifier classifier;
+    classifier.setParameters(1,0.1);
+    classifier.SVMTrain(trainSet,trainLabels);
+    checkSVMBatch(classifier,samples);
+
+    // The dense support vectors of the previous model must not be reused
+    // after retraining or loading another model
+    MultidimArray<double> trainSet2, trainLabels2;
+    generateSamples(150,10,0.5,trainSet2,trainLabels2);
+    classifier.SVMTrain(trainSet2,trainLabels2);
+    checkSVMBatch(classifier,samples);
+
+    FileName fnModel;
+    fnModel.initUniqueName("/tmp/test_svm_XXXXXX");
+    SVMClassifier classifier2;
+    classifier2.setParameters(1,0.1);
+    classifier2.SVMTrain(trainSet,trainLabels);
+    classifier2.SaveModel(fnModel);
+    classifier.LoadModel(fnModel);
+    checkSVMBatch(classifier,samples);
+    fnModel.deleteFile();
+    XMIPP_CATCH
+}
+
+// The neighbors of the search tree must be those of a brute-force search
+TEST_F( ClassificationTest, knnSearchTree)
+{
+    XMIPP_TRY
+    MultidimArray<double> trainSet, trainLabels, samples, sampleLabels, labelSet;
+    generateSamples(500,6,1.,trainSet,trainLabels);
+    generateSamples(60,6,1.,samples,sampleLabels);
+    labelSet.initZeros(2);
+    labelSet(0)=1;
+    labelSet(1)=2;
+
+    int K=7;
+    for (int d=0; d<2; d++)
+    {
+        KNN knn(K);
+        knn.setDistance(d==0 ? KNN::EUCLIDEAN : KNN::CITYBLOCK);
+        knn.train(trainSet,trainLabels,labelSet);
+        MultidimArray<int> idx;
+        MultidimArray<double> dist;
+        knn.KNearestNeighbors(samples,idx,dist);
+        ASSERT_EQ(YSIZE(samples),YSIZE(idx));
+        ASSERT_EQ((size_t)K,XSIZE(idx));
+        for (size_t i=0; i<YSIZE(samples); i++)
+        {
+            std::vector< std::pair<double,int> > all(YSIZE(trainSet));
+            for (size_t n=0; n<YSIZE(trainSet); n++)
+            {
+                double dn=0;
+                for (size_t j=0; j<XSIZE(trainSet); j++)
+                {
+                    double diff=DIRECT_A2D_ELEM(samples,i,j)-DIRECT_A2D_ELEM(trainSet,n,j);
+                    dn+=(d==0) ? diff*diff : fabs(diff);
+                }
+                all[n]=std::make_pair(d==0 ? sqrt(dn) : dn,(int)n);
+            }
+            std::sort(all.begin(),all.end());
+            for (int k=0; k<K; k++)
+            {
+                EXPECT_EQ(all[k].second,DIRECT_A2D_ELEM(idx,i,k));
+                EXPECT_NEAR(all[k].first,DIRECT_A2D_ELEM(dist,i,k),1e-10);
+            }
+        }
+
+        // Batch and single predictions
+        MultidimArray<double> labels, scores, sample;
+        knn.predict(samples,labels,scores);
+        double score;
+        for (size_t i=0; i<YSIZE(samples); i++)
+        {
+            samples.getRow(i,sample);
+            int label=knn.predict(sample,score);
+            EXPECT_EQ(label,DIRECT_A1D_ELEM(labels,i));
+            EXPECT_DOUBLE_EQ(score,DIRECT_A1D_ELEM(scores,i));
+        }
+    }
+    XMIPP_CATCH
+}
+
+// The distance kernels must give the results of the per-vector functions
+// they replaced in the SOM and fuzzy c-means algorithms
+TEST_F( ClassificationTest, featureMatrixKernels)
+{
+    XMIPP_TRY
+    // A number of vectors and features that are not multiple of the blocks
+    size_t N=37, dim=13, Ncodes=5;
+    std::vector<FeatureVector> x(N, FeatureVector(dim)), c(Ncodes, FeatureVector(dim));
+    for (size_t i=0; i<N; i++)
+        for (size_t j=0; j<dim; j++)
+            x[i][j]=(floatFeature)rnd_gaus();
+    for (size_t i=0; i<Ncodes; i++)
+        for (size_t j=0; j<dim; j++)
+            c[i][j]=(floatFeature)rnd_gaus();
+    // A vector that coincides with a code vector
+    x[5]=c[2];
+    FeatureMatrix X, C;
+    X.fromVectors(x);
+    C.fromVectors(c);
+
+    std::vector<double> D(N*Ncodes);
+    squaredDistances(X,0,N-1,C,&D[0]);
+    for (size_t i=0; i<N; i++)
+        for (size_t k=0; k<Ncodes; k++)
+        {
+            double d=euclideanDistance(x[i],c[k]);
+            EXPECT_NEAR(d*d,D[i*Ncodes+k],1e-12*(1+d*d));
+        }
+    // Subset of rows
+    std::vector<double> Dsub(3*Ncodes);
+    squaredDistances(X,10,12,C,&Dsub[0]);
+    for (size_t i=0; i<3*Ncodes; i++)
+        EXPECT_EQ(D[10*Ncodes+i],Dsub[i]);
+
+    // Weighted sums with memberships as weights
+    std::vector< std::vector<floatFeature> > U(N, std::vector<floatFeature>(Ncodes));
+    for (size_t i=0; i<N; i++)
+        for (size_t k=0; k<Ncodes; k++)
+            U[i][k]=(floatFeature)rnd_unif();
+    double m=1.5;
+    std::vector< std::vector<double> > S;
+    std::vector<double> dens;
+    weightedSums(X,U,m,S,dens);
+    ASSERT_EQ(Ncodes,S.size());
+    ASSERT_EQ(Ncodes,dens.size());
+    for (size_t k=0; k<Ncodes; k++)
+    {
+        double expectedDens=0;
+        std::vector<double> expectedS(dim,0.);
+        for (size_t i=0; i<N; i++)
+        {
+            double w=pow((double)U[i][k],m);
+            expectedDens+=w;
+            for (size_t j=0; j<dim; j++)
+                expectedS[j]+=w*x[i][j];
+        }
+        EXPECT_NEAR(expectedDens,dens[k],1e-10);
+        for (size_t j=0; j<dim; j++)
+            EXPECT_NEAR(expectedS[j],S[k][j],1e-10);
+    }
+
+    // Fuzzy memberships (with fuzzy c-means exponent 2/(m-1) of the distances)
+    std::vector< std::vector<floatFeature> > memb(N, std::vector<floatFeature>(Ncodes));
+    FuzzyMembershipBody membBody;
+    membBody.memb=&memb;
+    membBody.exponent=1/(m-1);
+    membBody.run(X,C);
+    for (size_t i=0; i<N; i++)
+        for (size_t k=0; k<Ncodes; k++)
+        {
+            double expected;
+            if (i==5)
+                expected=(k==2) ? 1. : 0.;
+            else
+            {
+                double auxDist=0;
+                for (size_t j=0; j<Ncodes; j++)
+                    auxDist+=pow(euclideanDistance(c[k],x[i])/euclideanDistance(c[j],x[i]),2/(m-1));
+                expected=1/auxDist;
+            }
+            EXPECT_NEAR(expected,memb[i][k],1e-6);
+        }
+    XMIPP_CATCH
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -89,6 +89,51 @@ TEST_F( DimRedTest, intrinsic_dimensionality)
 	EXPECT_LT(fabs(dimCorrDim-expectedDim),	5e-2);
 }
 
+// Squared Euclidean distance given as a function, so that kNearestNeighbours compares all pairs
+double squaredDistanceAllPairs(const Matrix2D<double> &X, size_t i1, size_t i2)
+{
+	double d=0;
+	for (size_t j=0; j<MAT_XSIZE(X); ++j)
+	{
+		double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
+		d+=diff*diff;
+	}
+	return d;
+}
+
+TEST_F( DimRedTest, kNearestNeighbours)
+{
+	GenerateData generator;
+	generator.generateNewDataset("swiss",1000,0.05);
+	const Matrix2D<double> &X=generator.X;
+	int K=12;
+
+	// kd-tree
+	Matrix2D<int> idx, expectedIdx;
+	Matrix2D<double> distance, expectedDistance;
+	kNearestNeighbours(X,K,idx,distance);
+
+	// All pairs
+	kNearestNeighbours(X,K,expectedIdx,expectedDistance,&squaredDistanceAllPairs);
+	ASSERT_EQ(expectedIdx,idx);
+	ASSERT_TRUE(expectedDistance.equal(distance,1e-12));
+
+	// Sorted rows of the distance matrix
+	Matrix2D<double> D;
+	computeDistance(X,D);
+	std::vector<double> row;
+	for (size_t i=0; i<MAT_YSIZE(X); ++i)
+	{
+		row.clear();
+		for (size_t j=0; j<MAT_XSIZE(D); ++j)
+			if (j!=i)
+				row.push_back(MAT_ELEM(D,i,j));
+		std::sort(row.begin(),row.end());
+		for (int k=0; k<K; ++k)
+			EXPECT_NEAR(row[k],MAT_ELEM(distance,i,k),1e-12);
+	}
+}
+
 #define INCOMPLETE_TEST(method,DimredClass,dataset,Npoints,file) \
 	TEST_F( DimRedTest, method) \
 { \
@@ -108,6 +108,48 @@ TEST_F( FftwTest, fft_IDX2DIGFREQ)
     EXPECT_EQ(-1.0/256.0,w);
 }
 
+// Windowing the transform of an image must give the transform of the image
+// scaled in real space, as movie alignment did before
+TEST_F( FftwTest, windowFourierTransform)
+{
+    int sizes[][4]={ {48,64,25,33}, {49,63,27,31}, {50,60,32,40} };
+    for (int s=0; s<3; ++s)
+    {
+        int Ydim=sizes[s][0], Xdim=sizes[s][1], newYdim=sizes[s][2], newXdim=sizes[s][3];
+        MultidimArray<double> I(Ydim,Xdim), Iscaled;
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(I)
+        DIRECT_A2D_ELEM(I,i,j)=sin(0.3*i)+cos(0.17*j*i)+0.01*j;
+
+        MultidimArray< std::complex<double> > FFTI, FFTscaled, FFTwindowed;
+        FourierTransformer transformer1, transformer2;
+        transformer1.FourierTransform(I,FFTI,true);
+        FFTwindowed.resizeNoCopy(newYdim,newXdim/2+1);
+        windowFourierTransform(FFTI,FFTwindowed);
+
+        // Every frequency of the smaller image comes from the same frequency
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(FFTwindowed)
+        {
+            int freq=((int)i<=newYdim/2) ? (int)i : (int)i-newYdim;
+            int ip=(freq>=0) ? freq : Ydim+freq;
+            EXPECT_EQ(DIRECT_A2D_ELEM(FFTwindowed,i,j),DIRECT_A2D_ELEM(FFTI,ip,j));
+        }
+
+        scaleToSizeFourier(1,newYdim,newXdim,I,Iscaled);
+        transformer2.FourierTransform(Iscaled,FFTscaled,false);
+        ASSERT_TRUE(FFTscaled.sameShape(FFTwindowed));
+
+        // The real space round trip makes the Nyquist frequencies Hermitian
+        double maxVal=std::abs(DIRECT_A2D_ELEM(FFTscaled,0,0));
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(FFTscaled)
+        {
+            if ((newYdim%2!=0 || (int)i!=newYdim/2) && (newXdim%2!=0 || (int)j!=newXdim/2))
+            {
+                EXPECT_NEAR(std::abs(DIRECT_A2D_ELEM(FFTscaled,i,j)-DIRECT_A2D_ELEM(FFTwindowed,i,j)),0,1e-12*maxVal);
+            }
+        }
+    }
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
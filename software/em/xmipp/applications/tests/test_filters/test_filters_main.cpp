@@ -1,6 +1,7 @@
 #include <data/xmipp_image.h>
 #include <data/filters.h>
 #include <data/xmipp_fftw.h>
+#include <reconstruction/fourier_filter.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -91,6 +92,50 @@ TEST_F( FiltersTest, correlation_matrix)
 
 }
 
+// Band pass filter of the correlation in Fourier space (as in the
+// automatic picking) and after the correlation
+TEST_F( FiltersTest, correlationInFourier)
+{
+    MultidimArray<double> I, T, R, Rfourier;
+    I.initZeros(64,48);
+    T.initZeros(64,48);
+    I.setXmippOrigin();
+    T.setXmippOrigin();
+    FOR_ALL_ELEMENTS_IN_ARRAY2D(I)
+    {
+        A2D_ELEM(I,i,j)=exp(-((i-5)*(i-5)+(j+8)*(j+8))/20.)+0.3*cos(0.7*i+0.2*j);
+        A2D_ELEM(T,i,j)=exp(-(i*i+j*j)/20.);
+    }
+
+    FourierFilter filter;
+    filter.raised_w=0.02;
+    filter.FilterShape=RAISED_COSINE;
+    filter.FilterBand=BANDPASS;
+    filter.w1=1.0/20;
+    filter.w2=1.0/(20/3.);
+    filter.do_generate_3dmask=true;
+
+    CorrelationAux aux;
+    correlation_matrix(I,T,R,aux,false);
+    filter.generateMask(R);
+    filter.applyMaskSpace(R);
+
+    MultidimArray<std::complex<double> > FFTI, FFTT;
+    FourierTransformer transformerI, transformerT;
+    transformerI.FourierTransform(I,FFTI,false);
+    Rfourier=T;
+    transformerT.FourierTransform(Rfourier,FFTT,false);
+    correlationInFourier(FFTI,FFTT,MULTIDIM_SIZE(Rfourier));
+    filter.applyMaskFourierSpace(Rfourier,FFTT);
+    transformerT.inverseFourierTransform();
+
+    ASSERT_TRUE(R.sameShape(Rfourier));
+    double maxR=R.computeMax();
+    EXPECT_GT(maxR,0);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(R)
+    EXPECT_NEAR(DIRECT_A2D_ELEM(R,i,j),DIRECT_A2D_ELEM(Rfourier,i,j),1e-9*maxR);
+}
+
 TEST_F( FiltersTest, correlation)
 {
     MultidimArray<  double  > auxMul,auxMul2;
@@ -170,6 +215,69 @@ TEST_F( FiltersTest, alignImages)
 
     fileTemp.deleteFile();
 }
+
+TEST_F( FiltersTest, multireferenceAligner)
+{
+    Image<double> I;
+    I.read("filters/test2.spi");
+    I().setXmippOrigin();
+
+    // Experimental image: mirror of a shifted and rotated reference
+    MultidimArray<double> Iexp=I();
+    Matrix2D<double> A;
+    rotation2DMatrix(15,A,true);
+    MAT_ELEM(A,0,2)=-4;
+    MAT_ELEM(A,1,2)= 6;
+    selfApplyGeometry(BSPLINE3,Iexp,A,IS_NOT_INV,DONT_WRAP);
+    Iexp.selfReverseX();
+    Iexp.setXmippOrigin();
+
+    // References: noise and the original image
+    std::vector< MultidimArray<double> > refs(4);
+    MultireferenceAligner aligner;
+    aligner.wrap=DONT_WRAP;
+    for (size_t k=0; k<refs.size(); ++k)
+    {
+        if (k==2)
+            refs[k]=I();
+        else
+        {
+            refs[k].resize(I());
+            refs[k].initRandom(0,1,RND_GAUSSIAN);
+        }
+        refs[k].setXmippOrigin();
+        aligner.addReference(refs[k]);
+    }
+
+    // Same result as the pairwise alignment
+    std::vector<MultireferenceAlignment> alignments;
+    aligner.align(Iexp,alignments,0);
+    ASSERT_EQ(alignments.size(),refs.size());
+    EXPECT_EQ(alignments[0].refno,(size_t)2);
+    EXPECT_TRUE(alignments[0].mirror);
+    for (size_t k=1; k<alignments.size(); ++k)
+        EXPECT_GE(alignments[k-1].corr,alignments[k].corr);
+
+    MultidimArray<double> Ialigned=Iexp;
+    Matrix2D<double> M;
+    AlignmentAux aux;
+    CorrelationAux aux2;
+    RotationalCorrelationAux aux3;
+    double corr=alignImagesConsideringMirrors(refs[2],Ialigned,M,aux,aux2,aux3,DONT_WRAP);
+    EXPECT_NEAR(alignments[0].corr,corr,1e-6);
+    EXPECT_NEAR(MAT_ELEM(alignments[0].M,0,2),MAT_ELEM(M,0,2),1e-3);
+    EXPECT_NEAR(MAT_ELEM(alignments[0].M,1,2),MAT_ELEM(M,1,2),1e-3);
+
+    // The rotational screening keeps the right reference. The rotational
+    // correlation depends on the shift, so the direct and the mirror pairs
+    // of that reference are both kept
+    aligner.Ncandidates=2;
+    aligner.align(Iexp,alignments,1);
+    ASSERT_EQ(alignments.size(),(size_t)1);
+    EXPECT_EQ(alignments[0].refno,(size_t)2);
+    EXPECT_NEAR(alignments[0].corr,corr,1e-6);
+}
+
 TEST_F( FiltersTest, regionGrowing3DEqualValue)
 {
     Image<double> img;
@@ -198,6 +306,34 @@ TEST_F( FiltersTest, regionGrowing3DEqualValue)
     EXPECT_DOUBLE_EQ(result,1.);
 
 }
+TEST_F( FiltersTest, labelImage2D)
+{
+    MultidimArray<double> I(64,64), label;
+    // A U shape whose two arms only meet at the bottom
+    for (int i=2; i<=60; i++)
+        DIRECT_A2D_ELEM(I,i,5) = DIRECT_A2D_ELEM(I,i,10) = 1;
+    for (int j=5; j<=10; j++)
+        DIRECT_A2D_ELEM(I,60,j) = 1;
+    // A square
+    for (int i=10; i<=12; i++)
+        for (int j=30; j<=32; j++)
+            DIRECT_A2D_ELEM(I,i,j) = 1;
+    // Two pixels only connected through their corners
+    DIRECT_A2D_ELEM(I,20,50) = DIRECT_A2D_ELEM(I,21,51) = 1;
+    I.setXmippOrigin();
+
+    EXPECT_EQ(3, labelImage2D(I, label, 8));
+    EXPECT_DOUBLE_EQ(1, DIRECT_A2D_ELEM(label,2,10));
+    EXPECT_DOUBLE_EQ(1, DIRECT_A2D_ELEM(label,60,7));
+    EXPECT_DOUBLE_EQ(2, DIRECT_A2D_ELEM(label,11,31));
+    EXPECT_DOUBLE_EQ(3, DIRECT_A2D_ELEM(label,21,51));
+    EXPECT_DOUBLE_EQ(0, DIRECT_A2D_ELEM(label,30,7));
+    EXPECT_EQ(STARTINGX(I), STARTINGX(label));
+
+    EXPECT_EQ(4, labelImage2D(I, I, 4));
+    EXPECT_DOUBLE_EQ(3, DIRECT_A2D_ELEM(I,20,50));
+    EXPECT_DOUBLE_EQ(4, DIRECT_A2D_ELEM(I,21,51));
+}
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,80 @@
+#include <reconstruction/fourier_projection.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class FourierProjectionTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        // Three Gaussian blobs at different positions
+        V.initZeros(32,32,32);
+        V.setXmippOrigin();
+        FOR_ALL_ELEMENTS_IN_ARRAY3D(V)
+        A3D_ELEM(V,k,i,j)=exp(-(k*k+i*i+j*j)/18.)+
+                          0.5*exp(-((k-5)*(k-5)+(i+3)*(i+3)+(j-7)*(j-7))/8.)+
+                          0.3*exp(-((k+6)*(k+6)+(i-8)*(i-8)+j*j)/4.);
+
+        rot.push_back(0);   tilt.push_back(0);   psi.push_back(0);
+        rot.push_back(30);  tilt.push_back(45);  psi.push_back(10);
+        rot.push_back(-70); tilt.push_back(90);  psi.push_back(120);
+        rot.push_back(150); tilt.push_back(135); psi.push_back(-45);
+        rot.push_back(12);  tilt.push_back(170); psi.push_back(200);
+    }
+
+    MultidimArray<double> V;
+    std::vector<double> rot, tilt, psi;
+};
+
+// The batch methods must give the projections of the single-orientation ones
+TEST_F( FourierProjectionTest, batchVsSingleProject)
+{
+    for (int degree=0; degree<=3; degree+=3)
+    {
+        // The projector clears the volume it is given
+        MultidimArray<double> Vaux=V;
+        FourierProjector projector(Vaux,2,0.5,degree);
+        std::vector< MultidimArray<double> > projections;
+        projector.project(rot,tilt,psi,projections);
+        ASSERT_EQ(rot.size(),projections.size());
+        for (size_t n=0; n<rot.size(); ++n)
+        {
+            projector.project(rot[n],tilt[n],psi[n]);
+            const MultidimArray<double> &single=projector.projection();
+            ASSERT_TRUE(single.sameShape(projections[n]));
+            EXPECT_GT(single.computeMax(),1.);
+            FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(single)
+            EXPECT_NEAR(DIRECT_A2D_ELEM(single,i,j),DIRECT_A2D_ELEM(projections[n],i,j),1e-9);
+        }
+    }
+}
+
+TEST_F( FourierProjectionTest, batchVsSingleProjectFourier)
+{
+    FourierProjector projector(V,2,0.25,1);
+    MultidimArray<double> ctf;
+    ctf.initZeros(YSIZE(projector.projectionFourier),XSIZE(projector.projectionFourier));
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(ctf)
+    DIRECT_A2D_ELEM(ctf,i,j)=cos(0.1*(i+j));
+
+    std::vector< MultidimArray< std::complex<double> > > projectionsFourier;
+    projector.projectFourier(rot,tilt,psi,projectionsFourier,&ctf);
+    ASSERT_EQ(rot.size(),projectionsFourier.size());
+    MultidimArray< std::complex<double> > single;
+    for (size_t n=0; n<rot.size(); ++n)
+    {
+        projector.projectFourier(rot[n],tilt[n],psi[n],single,&ctf);
+        ASSERT_TRUE(single.sameShape(projectionsFourier[n]));
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(single)
+        {
+            EXPECT_NEAR(DIRECT_A2D_ELEM(single,i,j).real(),DIRECT_A2D_ELEM(projectionsFourier[n],i,j).real(),1e-9);
+            EXPECT_NEAR(DIRECT_A2D_ELEM(single,i,j).imag(),DIRECT_A2D_ELEM(projectionsFourier[n],i,j).imag(),1e-9);
+        }
+    }
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
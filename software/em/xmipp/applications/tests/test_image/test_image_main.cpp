@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <data/xmipp_image.h>
 #include <data/xmipp_image_extension.h>
+#include <data/xmipp_hdf5.h>
+#include <data/xmipp_movie_reader.h>
 #include <iostream>
 #include <gtest/gtest.h>
 #include <data/metadata.h>
@@ -261,6 +263,411 @@ TEST_F( ImageTest, writeMRCstack)
     XMIPP_CATCH
 }
 
+TEST_F( ImageTest, readMRCstackImages)
+{
+    XMIPP_TRY
+    FileName auxFn, sliceFn;
+    auxFn.initUniqueName("/tmp/temp_mrcstk_XXXXXX");
+    auxFn = auxFn + ":mrcs";
+    myStack.write(auxFn);
+    Image<double> img;
+    MultidimArray<double> slice;
+    // Images are read twice, the second time from the open stack
+    for (int k = 0; k < 2; k++)
+        for (size_t n = 0; n < NSIZE(myStack()); n++)
+        {
+            sliceFn.compose(n + 1, auxFn);
+            img.read(sliceFn);
+            slice.aliasImageInStack(myStack(), n);
+            EXPECT_TRUE(img() == slice);
+        }
+    // Writing the stack removes it from the registry
+    img().initConstant(1.);
+    sliceFn.compose(1, auxFn);
+    img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE);
+    Image<double> img2;
+    img2.read(sliceFn);
+    EXPECT_TRUE(img() == img2());
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+TEST_F( ImageTest, readImageHeaders)
+{
+    XMIPP_TRY
+    FileName auxFn;
+    auxFn.initUniqueName("/tmp/temp_mrcstk_XXXXXX");
+    auxFn = auxFn + ":mrcs";
+    myStack.write(auxFn);
+
+    // Dimensions of the test files (X, Y, Z, N)
+    std::vector<FileName> filenames;
+    std::vector< std::vector<size_t> > dims;
+    size_t known[][4] = { {3, 3, 1, 1}, {64, 64, 1, 4}, {64, 64, 4, 1}, {64, 64, 4, 4},
+                          {3, 3, 1, 1}, {64, 64, 1, 4}, {64, 64, 1, 1}, {64, 64, 1, 4} };
+    filenames.push_back(imageName);
+    filenames.push_back(stackName);
+    filenames.push_back("image/smallVolume.vol");
+    filenames.push_back(stackVolName);
+    filenames.push_back("image/singleImage.mrc");
+    filenames.push_back("image/smallStack.mrcs");
+    filenames.push_back("3@" + stackName);
+    filenames.push_back(auxFn);
+    for (size_t n = 0; n < filenames.size(); n++)
+        dims.push_back(std::vector<size_t>(known[n], known[n] + 4));
+
+    std::vector<ImageHeaderInfo> headers;
+    readImageHeaders(filenames, headers);
+    ASSERT_EQ(filenames.size(), headers.size());
+    for (size_t n = 0; n < filenames.size(); n++)
+    {
+        EXPECT_EQ(dims[n][0], headers[n].Xdim) << filenames[n];
+        EXPECT_EQ(dims[n][1], headers[n].Ydim) << filenames[n];
+        EXPECT_EQ(dims[n][2], headers[n].Zdim) << filenames[n];
+        EXPECT_EQ(dims[n][3], headers[n].Ndim) << filenames[n];
+        EXPECT_EQ(DT_Float, headers[n].datatype) << filenames[n];
+    }
+    EXPECT_DOUBLE_EQ(1., headers[4].sampling);
+
+    // The error of a missing file is reported after reading the others
+    filenames.push_back("image/missing.mrc");
+    EXPECT_THROW(readImageHeaders(filenames, headers), XmippError);
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+/* Window, dark/gain correction and binning of a movie frame done by hand */
+static void correctMovieFrame(const MultidimArray<double> &raw, int y0, int x0, int yF, int xF,
+                              const MultidimArray<double> &dark, const MultidimArray<double> &gain,
+                              int bin, MultidimArray<double> &result)
+{
+    MultidimArray<double> window;
+    raw.window(window, y0, x0, yF, xF);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(window)
+    DIRECT_MULTIDIM_ELEM(window,n)=(DIRECT_MULTIDIM_ELEM(window,n)-DIRECT_MULTIDIM_ELEM(dark,n))*
+                                   DIRECT_MULTIDIM_ELEM(gain,n);
+    result.initZeros(YSIZE(window)/bin, XSIZE(window)/bin);
+    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(result)
+    {
+        for (int ii=0; ii<bin; ii++)
+            for (int jj=0; jj<bin; jj++)
+                DIRECT_A2D_ELEM(result,i,j)+=DIRECT_A2D_ELEM(window,i*bin+ii,j*bin+jj);
+        DIRECT_A2D_ELEM(result,i,j)/=bin*bin;
+    }
+}
+
+/* Compare the frames of the movie reader with those corrected by hand */
+static void checkMovieReader(const FileName &fnMovie, const std::vector< MultidimArray<double> > &rawFrames)
+{
+    int y0=-2, x0=3, yF=33, xF=38;
+    MultidimArray<double> dark(yF-y0+1,xF-x0+1), gain(dark), expected;
+    dark.initRandom(0,3);
+    gain.initRandom(0.5,1.5);
+
+    MovieReader reader;
+    reader.open(fnMovie);
+    size_t Xdim, Ydim;
+    reader.getFrameSize(Xdim, Ydim);
+    EXPECT_EQ(XSIZE(rawFrames[0]), Xdim);
+    EXPECT_EQ(YSIZE(rawFrames[0]), Ydim);
+    ASSERT_EQ(rawFrames.size(), reader.getNumberOfFrames());
+    reader.setWindow(y0, x0, yF, xF);
+    reader.setCorrection(&dark, &gain);
+    std::vector<size_t> frameNumbers;
+    for (size_t n=0; n<rawFrames.size(); n++)
+        frameNumbers.push_back(n);
+
+    MultidimArray<float> frame;
+    std::vector< MultidimArray<float> > frames;
+    for (int bin=1; bin<=3; bin+=2)
+    {
+        reader.setBinning(bin);
+        reader.readFrames(frameNumbers, frames);
+        ASSERT_EQ(rawFrames.size(), frames.size());
+        for (size_t n=0; n<rawFrames.size(); n++)
+        {
+            correctMovieFrame(rawFrames[n], y0, x0, yF, xF, dark, gain, bin, expected);
+            reader.readFrame(n, frame);
+            ASSERT_EQ(YSIZE(expected), YSIZE(frame));
+            ASSERT_EQ(XSIZE(expected), XSIZE(frame));
+            EXPECT_EQ(bin==1 ? y0 : 0, STARTINGY(frame));
+            EXPECT_EQ(bin==1 ? x0 : 0, STARTINGX(frame));
+            FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(expected)
+            {
+                EXPECT_NEAR(DIRECT_A2D_ELEM(expected,i,j), DIRECT_A2D_ELEM(frame,i,j), 1e-4);
+                EXPECT_EQ(DIRECT_A2D_ELEM(frame,i,j), DIRECT_A2D_ELEM(frames[n],i,j));
+            }
+        }
+    }
+}
+
+TEST_F( ImageTest, readMovieFrames)
+{
+    XMIPP_TRY
+    // Movie of 3 frames of 37x40 pixels, with values that fit in 4 bits
+    std::vector< MultidimArray<double> > rawFrames(3);
+    Image<double> movie(37, 40, 1, rawFrames.size());
+    for (size_t n=0; n<rawFrames.size(); n++)
+    {
+        rawFrames[n].resizeNoCopy(40, 37);
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(rawFrames[n])
+        DIRECT_A2D_ELEM(rawFrames[n],i,j)=(3*n+5*i+7*j)%16;
+        memcpy(&DIRECT_NZYX_ELEM(movie(),n,0,0,0), MULTIDIM_ARRAY(rawFrames[n]),
+               MULTIDIM_SIZE(rawFrames[n])*sizeof(double));
+    }
+
+    // MRC stack written by Image, compared with Image::read
+    FileName auxFn;
+    auxFn.initUniqueName("/tmp/temp_movie_XXXXXX");
+    auxFn = auxFn + ".mrcs";
+    movie.write(auxFn);
+    Image<double> img;
+    std::vector< MultidimArray<double> > readFrames(rawFrames.size());
+    for (size_t n=0; n<rawFrames.size(); n++)
+    {
+        img.read(formatString("%lu@%s", (unsigned long) n+1, auxFn.c_str()));
+        readFrames[n]=img();
+        STARTINGY(readFrames[n])=STARTINGX(readFrames[n])=0;
+        EXPECT_TRUE(readFrames[n]==rawFrames[n]);
+    }
+    checkMovieReader(auxFn, readFrames);
+    auxFn.deleteFile();
+
+    // 4 bit MRC (mode 101): odd rows are padded to a byte and the first
+    // pixel of each byte is in the low order bits
+    auxFn.initUniqueName("/tmp/temp_movie4_XXXXXX");
+    auxFn = auxFn + ".mrcs";
+    int header[256];
+    memset(header, 0, sizeof(header));
+    header[0]=37;
+    header[1]=40;
+    header[2]=rawFrames.size();
+    header[3]=101;
+    size_t rowBytes=(37+1)/2;
+    std::vector<unsigned char> data(rawFrames.size()*40*rowBytes, 0);
+    for (size_t n=0; n<rawFrames.size(); n++)
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(rawFrames[n])
+        {
+            unsigned char value=(unsigned char)DIRECT_A2D_ELEM(rawFrames[n],i,j);
+            data[(n*40+i)*rowBytes+j/2] |= (j%2==0) ? value : (value<<4);
+        }
+    FILE *fh=fopen(auxFn.c_str(), "wb");
+    ASSERT_TRUE(fh!=NULL);
+    fwrite(header, sizeof(header), 1, fh);
+    fwrite(&data[0], data.size(), 1, fh);
+    fclose(fh);
+    checkMovieReader(auxFn, rawFrames);
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+TEST_F( ImageTest, writeXCSstack)
+{
+    XMIPP_TRY
+    FileName auxFn, sliceFn;
+    auxFn.initUniqueName("/tmp/temp_xcs_XXXXXX");
+    auxFn = auxFn + ":xcs";
+    myStack.write(auxFn);
+    Image<double> auxStack;
+    auxStack.read(auxFn);
+    EXPECT_EQ(myStack,auxStack);
+    // Random access to the images and replacement of one of them
+    Image<double> img;
+    MultidimArray<double> slice;
+    for (size_t n = 0; n < NSIZE(myStack()); n++)
+    {
+        sliceFn.compose(n + 1, auxFn);
+        img.read(sliceFn);
+        slice.aliasImageInStack(myStack(), n);
+        EXPECT_TRUE(img() == slice);
+    }
+    img().initConstant(1.);
+    sliceFn.compose(2, auxFn);
+    img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE);
+    Image<double> img2;
+    img2.read(sliceFn);
+    EXPECT_TRUE(img() == img2());
+    sliceFn.compose(1, auxFn);
+    img2.read(sliceFn);
+    slice.aliasImageInStack(myStack(), 0);
+    EXPECT_TRUE(img2() == slice);
+    // Half precision floats
+    myStack.write(auxFn + "%float16");
+    auxStack.read(auxFn);
+    ASSERT_TRUE(myStack().sameShape(auxStack()));
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(myStack())
+    {
+        double value = DIRECT_MULTIDIM_ELEM(myStack(), n);
+        EXPECT_NEAR(value, DIRECT_MULTIDIM_ELEM(auxStack(), n), fabs(value) * 1e-3 + 1e-4);
+    }
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+// Stacks written image by image, as when converting a metadata
+TEST_F( ImageTest, writeXCSimageByImage)
+{
+    XMIPP_TRY
+    FileName auxFn, sliceFn;
+    auxFn.initUniqueName("/tmp/temp_xcs_XXXXXX");
+    auxFn = auxFn + ".xcs";
+    size_t Xdim, Ydim, Zdim, Ndim;
+    myStack.getDimensions(Xdim, Ydim, Zdim, Ndim);
+    createEmptyFile(auxFn, Xdim, Ydim, Zdim, Ndim, true, WRITE_OVERWRITE);
+    Image<double> img;
+    MultidimArray<double> slice;
+    for (size_t n = Ndim; n > 0; n--)
+    {
+        slice.aliasImageInStack(myStack(), n - 1);
+        img() = slice;
+        sliceFn.compose(n, auxFn);
+        img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE);
+    }
+    // Appended images move the index when it has no room
+    for (size_t n = 0; n < Ndim; n++)
+    {
+        slice.aliasImageInStack(myStack(), n);
+        img() = slice;
+        img.write(auxFn, ALL_IMAGES, true, WRITE_APPEND);
+    }
+    Image<double> auxStack;
+    auxStack.read(auxFn);
+    ASSERT_EQ(2 * Ndim, NSIZE(auxStack()));
+    for (size_t n = 0; n < 2 * Ndim; n++)
+    {
+        sliceFn.compose(n + 1, auxFn);
+        img.read(sliceFn);
+        slice.aliasImageInStack(myStack(), n % Ndim);
+        EXPECT_TRUE(img() == slice);
+    }
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+TEST_F( ImageTest, writeHDF5stack)
+{
+    XMIPP_TRY
+    FileName auxFn, sliceFn;
+    auxFn.initUniqueName("/tmp/temp_h5_XXXXXX");
+    auxFn = auxFn + ":h5";
+    myStack.write(auxFn + "%deflate");
+    Image<double> auxStack;
+    auxStack.read(auxFn);
+    EXPECT_EQ(myStack,auxStack);
+    // Random access to the chunks of the images and replacement of one of them
+    Image<double> img;
+    MultidimArray<double> slice;
+    for (size_t n = 0; n < NSIZE(myStack()); n++)
+    {
+        sliceFn.compose(n + 1, auxFn);
+        img.read(sliceFn);
+        slice.aliasImageInStack(myStack(), n);
+        EXPECT_TRUE(img() == slice);
+    }
+    img().initConstant(1.);
+    sliceFn.compose(2, auxFn);
+    img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE);
+    Image<double> img2;
+    img2.read(sliceFn);
+    EXPECT_TRUE(img() == img2());
+    img.write(auxFn, ALL_IMAGES, true, WRITE_APPEND);
+    size_t Xdim, Ydim, Zdim, Ndim;
+    getImageSize(auxFn, Xdim, Ydim, Zdim, Ndim);
+    EXPECT_EQ(NSIZE(myStack()) + 1, Ndim);
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+// Stacks in a dataset given by the block name are read back as stacks
+TEST_F( ImageTest, writeHDF5blockStack)
+{
+    XMIPP_TRY
+    FileName auxFn, blockFn, sliceFn;
+    auxFn.initUniqueName("/tmp/temp_h5_XXXXXX");
+    auxFn = auxFn + ".h5";
+    blockFn = (String)"particles@" + auxFn;
+    myStack.write(blockFn);
+    Image<double> auxStack;
+    auxStack.read(blockFn);
+    EXPECT_EQ(myStack,auxStack);
+    size_t Xdim, Ydim, Zdim, Ndim;
+    getImageSize(blockFn, Xdim, Ydim, Zdim, Ndim);
+    EXPECT_EQ(1, Zdim);
+    EXPECT_EQ(NSIZE(myStack()), Ndim);
+
+    Image<double> img;
+    MultidimArray<double> slice;
+    sliceFn.compose(NSIZE(myStack()), blockFn);
+    img.read(sliceFn);
+    slice.aliasImageInStack(myStack(), NSIZE(myStack()) - 1);
+    EXPECT_TRUE(img() == slice);
+
+    // Replace and append in the same dataset
+    img().initConstant(1.);
+    sliceFn.compose(2, blockFn);
+    img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE);
+    Image<double> img2;
+    img2.read(sliceFn);
+    EXPECT_TRUE(img() == img2());
+    img.write(blockFn, ALL_IMAGES, true, WRITE_APPEND);
+    getImageSize(blockFn, Xdim, Ydim, Zdim, Ndim);
+    EXPECT_EQ(NSIZE(myStack()) + 1, Ndim);
+
+    // Stacks of volumes
+    myVolStack.write(blockFn);
+    auxStack.read(blockFn);
+    EXPECT_EQ(myVolStack,auxStack);
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
+// Contiguous datasets (as written by other packages) are read directly from
+// the file, also when the HDF5 file is taken from the pool
+TEST_F( ImageTest, readHDF5contiguousStack)
+{
+    XMIPP_TRY
+    FileName auxFn, sliceFn;
+    auxFn.initUniqueName("/tmp/temp_h5_XXXXXX");
+    auxFn = auxFn + ".h5";
+    hsize_t dims[3];
+    dims[0] = NSIZE(myStack());
+    dims[1] = YSIZE(myStack());
+    dims[2] = XSIZE(myStack());
+    hid_t fhdf5 = H5Fcreate(auxFn.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+    H5Pset_create_intermediate_group(lcpl, 1);
+    hid_t filespace = H5Screate_simple(3, dims, NULL);
+    hid_t dataset = H5Dcreate2(fhdf5, XMIPP_H5_DATASET, H5T_NATIVE_DOUBLE, filespace, lcpl, H5P_DEFAULT, H5P_DEFAULT);
+    H5Dwrite(dataset, H5T_NATIVE_DOUBLE, H5S_ALL, H5S_ALL, H5P_DEFAULT, MULTIDIM_ARRAY(myStack()));
+    H5Dclose(dataset);
+    H5Sclose(filespace);
+    H5Pclose(lcpl);
+    H5Fclose(fhdf5);
+
+    Image<double> auxStack;
+    auxStack.read(auxFn);
+    EXPECT_TRUE(myStack() == auxStack());
+    Image<double> img;
+    MultidimArray<double> slice;
+    for (size_t n = 0; n < NSIZE(myStack()); n++)
+    {
+        sliceFn.compose(n + 1, auxFn);
+        img.read(sliceFn);
+        slice.aliasImageInStack(myStack(), n);
+        EXPECT_TRUE(img() == slice);
+    }
+
+    // A file being read cannot be written
+    hid_t pooled = H5FilePool::getInstance().acquire(auxFn);
+    ASSERT_GE(pooled, 0);
+    sliceFn.compose(1, auxFn);
+    EXPECT_THROW(img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE), XmippError);
+    H5FilePool::getInstance().release(pooled);
+    img.write(sliceFn, ALL_IMAGES, true, WRITE_REPLACE);
+    auxFn.deleteFile();
+    XMIPP_CATCH
+}
+
 TEST_F( ImageTest, writeMRCVOLstack)
 {
     XMIPP_TRY
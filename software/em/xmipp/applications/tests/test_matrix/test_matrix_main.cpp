@@ -1,4 +1,6 @@
 #include <data/matrix2d.h>
+#include <data/basic_pca.h>
+#include <data/sparse_matrix2d.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -322,6 +324,239 @@ TEST_F( MatrixTest, matrixOperation_AtA)
     EXPECT_EQ(expectedB,B) << "matrixOperation_AtA failed";
 }
 
+TEST_F( MatrixTest, matrixOperation_AB)
+{
+    // Large enough to be computed by blocks
+    Matrix2D<double> A, B, At, Bt, C, expectedC;
+    A.initGaussian(300,130,1);
+    B.initGaussian(130,270,1);
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(A)
+        MAT_ELEM(A,i,j)+=0.01*i-0.02*j;
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(B)
+        MAT_ELEM(B,i,j)+=0.03*i+0.01*j;
+    At=A.transpose();
+    Bt=B.transpose();
+
+    expectedC.initZeros(300,270);
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(expectedC)
+        for (size_t k=0; k<MAT_XSIZE(A); ++k)
+            MAT_ELEM(expectedC,i,j)+=MAT_ELEM(A,i,k)*MAT_ELEM(B,k,j);
+
+    matrixOperation_AB(A,B,C);
+    EXPECT_EQ(expectedC,C) << "matrixOperation_AB failed";
+    matrixOperation_ABt(A,Bt,C);
+    EXPECT_EQ(expectedC,C) << "matrixOperation_ABt failed";
+    matrixOperation_AtB(At,B,C);
+    EXPECT_EQ(expectedC,C) << "matrixOperation_AtB failed";
+    matrixOperation_AtBt(At,Bt,C);
+    EXPECT_EQ(expectedC,C) << "matrixOperation_AtBt failed";
+    EXPECT_EQ(expectedC,A*B) << "operator* failed";
+}
+
+TEST_F( MatrixTest, streamingRandomizedPCA)
+{
+    // Vectors with 3 dominant directions, noise and a non-zero mean
+    size_t dim=100, N=500;
+    Matrix2D<double> basis, X;
+    basis.initGaussian(3,dim,0,1);
+    X.initGaussian(N,dim,0,0.01);
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(X)
+        MAT_ELEM(X,i,j)+=2;
+    for (size_t n=0; n<N; n++)
+        for (size_t k=0; k<3; k++)
+        {
+            double c=rnd_gaus()*(3-k)*3;
+            for (size_t j=0; j<dim; j++)
+                MAT_ELEM(X,n,j)+=c*MAT_ELEM(basis,k,j);
+        }
+
+    // Exact eigenvectors of the scatter matrix
+    Matrix1D<double> avg(dim), expectedD;
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(X)
+        VEC_ELEM(avg,j)+=MAT_ELEM(X,i,j)/N;
+    Matrix2D<double> Xc=X, C, P;
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(Xc)
+        MAT_ELEM(Xc,i,j)-=VEC_ELEM(avg,j);
+    matrixOperation_AtA(Xc,C);
+    firstEigs(C,3,expectedD,P);
+
+    // Two threads, three passes. The subspace coordinates of the vectors
+    // are kept in the last one
+    StreamingRandomizedPCA pca;
+    pca.initialize(dim,3,10,true,2);
+    Matrix2D<double> coords(N,pca.Nsub);
+    for (int pass=0; pass<3; pass++)
+    {
+        pca.startPass();
+        for (size_t n=0; n<N; n++)
+        {
+            pca.addVector(&MAT_ELEM(X,n,0),n%2);
+            if (pass==2)
+                pca.projectOntoSubspace(&MAT_ELEM(X,n,0),&MAT_ELEM(coords,n,0));
+        }
+        pca.endPass();
+    }
+    for (size_t k=0; k<3; k++)
+    {
+        double dot=0;
+        for (size_t j=0; j<dim; j++)
+            dot+=MAT_ELEM(P,j,k)*MAT_ELEM(pca.PCAbasis,k,j);
+        EXPECT_NEAR(1,fabs(dot),1e-6) << "StreamingRandomizedPCA: wrong component " << k;
+        EXPECT_NEAR(1,VEC_ELEM(pca.eigenvalues,k)/VEC_ELEM(expectedD,k),1e-6) << "StreamingRandomizedPCA: wrong eigenvalue " << k;
+    }
+
+    // Projections from the subspace coordinates and from the vectors
+    double coeffs[3], coeffsSubspace[3];
+    for (size_t n=0; n<N; n++)
+    {
+        pca.project(&MAT_ELEM(X,n,0),coeffs);
+        pca.projectFromSubspace(&MAT_ELEM(coords,n,0),coeffsSubspace);
+        for (size_t k=0; k<3; k++)
+            EXPECT_NEAR(coeffs[k],coeffsSubspace[k],1e-8);
+    }
+}
+
+// Dense matrix seen as a symmetric operator
+class DenseSymmetricOperator: public SymmetricOperator
+{
+public:
+    const Matrix2D<double> *A;
+
+    size_t size() const
+    {
+        return MAT_YSIZE(*A);
+    }
+
+    void multiply(const double *x, double *y) const
+    {
+        for (size_t i=0; i<MAT_YSIZE(*A); ++i)
+        {
+            y[i]=0;
+            for (size_t j=0; j<MAT_XSIZE(*A); ++j)
+                y[i]+=MAT_ELEM(*A,i,j)*x[j];
+        }
+    }
+
+    double eigenvalueBound() const
+    {
+        double bound=0;
+        for (size_t i=0; i<MAT_YSIZE(*A); ++i)
+        {
+            double rowSum=0;
+            for (size_t j=0; j<MAT_XSIZE(*A); ++j)
+                rowSum+=fabs(MAT_ELEM(*A,i,j));
+            bound=XMIPP_MAX(bound,rowSum);
+        }
+        return bound;
+    }
+};
+
+// More components than features
+TEST_F( MatrixTest, learnPCABasisSmallDimension)
+{
+    PCAMahalanobisAnalyzer analyzer;
+    MultidimArray<float> v(3);
+    for (int n=0; n<20; n++)
+    {
+        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(v)
+        DIRECT_A1D_ELEM(v,i)=(float)rnd_gaus();
+        analyzer.addVector(v);
+    }
+    analyzer.learnPCABasis(10,3);
+    ASSERT_EQ(3,analyzer.PCAbasis.size());
+    for (size_t k=0; k<3; k++)
+        for (size_t l=0; l<3; l++)
+            EXPECT_NEAR((k==l) ? 1 : 0,analyzer.PCAbasis[k].dotProduct(analyzer.PCAbasis[l]),1e-8);
+}
+
+TEST_F( MatrixTest, lanczosEigs)
+{
+    // Symmetric matrix with well separated eigenvalues
+    size_t N=100, M=4;
+    Matrix2D<double> A(N,N);
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(A)
+        MAT_ELEM(A,i,j)=(i==j) ? i+1 : 0.3/(1+fabs((double)i-j));
+    DenseSymmetricOperator op;
+    op.A=&A;
+
+    Matrix1D<double> expectedD, D;
+    Matrix2D<double> expectedP, P;
+    for (int smallest=0; smallest<2; smallest++)
+    {
+        if (smallest)
+            lastEigs(A,M,expectedD,expectedP);
+        else
+            firstEigs(A,M,expectedD,expectedP);
+        lanczosEigs(op,M,smallest,D,P);
+        ASSERT_EQ(M,VEC_XSIZE(D));
+        for (size_t k=0; k<M; k++)
+        {
+            EXPECT_NEAR(VEC_ELEM(expectedD,k),VEC_ELEM(D,k),1e-8) << "lanczosEigs: wrong eigenvalue " << k;
+            // Eigenvectors are defined up to their sign
+            double dot=0;
+            for (size_t i=0; i<N; i++)
+                dot+=MAT_ELEM(expectedP,i,k)*MAT_ELEM(P,i,k);
+            EXPECT_NEAR(1,fabs(dot),1e-8) << "lanczosEigs: wrong eigenvector " << k;
+        }
+
+        // Only the eigenvalues
+        Matrix2D<double> noP;
+        lanczosEigs(op,M,smallest,D,noP,false);
+        EXPECT_EQ(0,MAT_XSIZE(noP)) << "lanczosEigs: eigenvectors computed without Pneeded";
+        for (size_t k=0; k<M; k++)
+            EXPECT_NEAR(VEC_ELEM(expectedD,k),VEC_ELEM(D,k),1e-8) << "lanczosEigs: wrong eigenvalue " << k;
+    }
+}
+
+TEST_F( MatrixTest, sparseMatrix2D)
+{
+    // Symmetric matrix with some empty rows, the last one among them
+    int N=30;
+    Matrix2D<double> A(N,N);
+    std::vector<SparseElement> elements;
+    SparseElement e;
+    for (int i=0; i<N-1; i++)
+        for (int j=i; j<N-1; j++)
+            if (i%5!=3 && j%5!=3 && (i==j || (i*7+j*3)%4==0))
+            {
+                MAT_ELEM(A,i,j)=MAT_ELEM(A,j,i)=1+(i*13+j*5)%11;
+                e.i=i;
+                e.j=j;
+                e.value=MAT_ELEM(A,i,j);
+                elements.push_back(e);
+                if (i!=j)
+                {
+                    e.i=j;
+                    e.j=i;
+                    elements.push_back(e);
+                }
+            }
+    SparseMatrix2D S(elements,N);
+    for (int i=0; i<N; i++)
+        for (int j=0; j<N; j++)
+            EXPECT_DOUBLE_EQ(MAT_ELEM(A,i,j),S.getElemIJ(i,j)) << "SparseMatrix2D: wrong element " << i << "," << j;
+
+    // Products by vectors and dense matrices
+    Matrix2D<double> X, Y, expectedY;
+    X.initGaussian(N,3,0,1);
+    expectedY=A*X;
+    S.multMM(X,Y);
+    EXPECT_TRUE(expectedY.equal(Y,1e-10)) << "SparseMatrix2D::multMM failed";
+    Matrix1D<double> x, y(N);
+    X.getCol(0,x);
+    S.multMv(MATRIX1D_ARRAY(x),MATRIX1D_ARRAY(y));
+    for (int i=0; i<N; i++)
+        EXPECT_NEAR(MAT_ELEM(expectedY,i,0),VEC_ELEM(y,i),1e-10) << "SparseMatrix2D::multMv failed";
+
+    // Eigenvalues as the dense ones
+    Matrix1D<double> expectedD, D;
+    Matrix2D<double> expectedP, P;
+    firstEigs(A,3,expectedD,expectedP);
+    firstEigs(S,3,D,P);
+    for (size_t k=0; k<3; k++)
+        EXPECT_NEAR(VEC_ELEM(expectedD,k),VEC_ELEM(D,k),1e-8) << "firstEigs of SparseMatrix2D: wrong eigenvalue " << k;
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -1852,6 +1852,33 @@ TEST_F( MetadataTest, copyImages)
     XMIPP_CATCH
 }
 
+// Conversion of a stack to half precision floats, the output stack is created empty first
+TEST_F( MetadataTest, copyImagesFloat16)
+{
+    XMIPP_TRY
+    FileName fn = "metadata/smallStack.stk";
+    FileName out;
+    out.initUniqueName("/tmp/smallStack_XXXXXX");
+    out = out + ".xcs";
+    const char *argv[] = {"xmipp_image_convert", "-i", fn.c_str(), "-o", out.c_str(),
+                          "--depth", "float16", "-v", "0"};
+    ProgConvImg conv;
+    conv.read(9, argv);
+    conv.tryRun();
+
+    Image<float> imgStk, imgHalf;
+    imgStk.read(fn);
+    imgHalf.read(out);
+    ASSERT_TRUE(imgStk().sameShape(imgHalf()));
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(imgStk())
+    {
+        float value = DIRECT_MULTIDIM_ELEM(imgStk(), n);
+        EXPECT_NEAR(value, DIRECT_MULTIDIM_ELEM(imgHalf(), n), fabs(value) * 1e-3 + 1e-4);
+    }
+    out.deleteFile();
+    XMIPP_CATCH
+}
+
 TEST_F( MetadataTest, updateRow)
 {
     ASSERT_EQ(mDsource,mDsource);
@@ -1,4 +1,5 @@
 #include <reconstruction/movie_filter_dose.h>
+#include <data/xmipp_fftw.h>
 #include <iostream>
 #include <gtest/gtest.h>
 // MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
@@ -86,6 +87,52 @@ TEST_F( MovieFilterDoseTest, optimalDoseGivenCriticalDose)
 
 }
 
+// The weights must be those the filter computed frequency by frequency,
+// also when the critical dose table is reused or recomputed
+TEST_F( MovieFilterDoseTest, computeDoseWeights)
+{
+	ProgMovieFilterDose pmfdProg(300);
+	int sizes[][2]={ {48,64}, {49,63}, {49,63}, {49,63} };
+	double samplings[]={ 1.3, 1.3, 0.9, 0.9 };
+	double doseStart[]={ 2, 2, 2, 10 };
+	MultidimArray<double> weights;
+	for (int s=0; s<4; s++)
+	{
+		int Ydim=sizes[s][0], Xdim=sizes[s][1];
+		pmfdProg.pixel_size=samplings[s];
+		pmfdProg.computeDoseWeights(Ydim,Xdim,doseStart[s],doseStart[s]+2,weights);
+		ASSERT_EQ(YSIZE(weights),(size_t)Ydim);
+		ASSERT_EQ(XSIZE(weights),(size_t)(Xdim/2+1));
+		bool nonZero=false;
+		FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(weights)
+		{
+			double x, y, criticalDose;
+			FFT_IDX2DIGFREQ(i,Ydim,y);
+			FFT_IDX2DIGFREQ(j,Xdim,x);
+			if (i==0 && j==0)
+				criticalDose=pmfdProg.critical_dose_at_dc;
+			else
+				criticalDose=pmfdProg.criticalDose(sqrt(x*x+y*y)/pmfdProg.pixel_size);
+			double optimalDose=pmfdProg.optimalDoseGivenCriticalDose(criticalDose);
+			double weight=0;
+			if (fabs(doseStart[s]+2-optimalDose)<fabs(doseStart[s]-optimalDose))
+				weight=pmfdProg.doseFilter(doseStart[s]+2,criticalDose);
+			EXPECT_NEAR(DIRECT_A2D_ELEM(weights,i,j),weight,1e-12);
+			nonZero=nonZero || weight>0;
+		}
+		EXPECT_TRUE(nonZero);
+
+		// Applied to a transform
+		MultidimArray< std::complex<double> > FFT1(Ydim,Xdim/2+1), FFT2;
+		FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(FFT1)
+		DIRECT_A2D_ELEM(FFT1,i,j)=std::complex<double>(i+1,j-2);
+		FFT2=FFT1;
+		pmfdProg.applyDoseFilterToImage(Ydim,Xdim,FFT1,doseStart[s],doseStart[s]+2);
+		FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(FFT1)
+		EXPECT_NEAR(std::abs(DIRECT_A2D_ELEM(FFT1,i,j)-DIRECT_A2D_ELEM(FFT2,i,j)*DIRECT_A2D_ELEM(weights,i,j)),0,1e-12);
+	}
+}
+
 /*
 TEST_F( FftwTest, directFourierTransformComplex)
 {
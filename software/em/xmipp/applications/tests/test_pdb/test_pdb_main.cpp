@@ -0,0 +1,203 @@
+#include <reconstruction/volume_from_pdb.h>
+#include <data/xmipp_funcs.h>
+#include <iostream>
+#include <fstream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class PdbTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        // A few atoms of different elements and a water molecule
+        const char *names[] = { " N  ", " CA ", " C  ", " O  ", " CB ", " SG ", " H  ", " N  ", " CA ", " C  " };
+        for (int n=0; n<10; ++n)
+        {
+            name.push_back(names[n]);
+            x.push_back(3.1*cos(0.9*n)+0.37*n);
+            y.push_back(2.7*sin(0.9*n)-0.21*n);
+            z.push_back(1.3*n-5.2);
+            occupancy.push_back(0.5+0.05*n);
+            bfactor.push_back(10+n);
+        }
+        name.push_back(" O  ");
+        x.push_back(-4.3);
+        y.push_back(3.9);
+        z.push_back(2.2);
+        occupancy.push_back(1);
+        bfactor.push_back(30);
+
+        // Values as they are read from the file (3 decimals, float precision)
+        for (size_t n=0; n<name.size(); ++n)
+        {
+            x[n]=textToFloat(formatString("%.3f",x[n]));
+            y[n]=textToFloat(formatString("%.3f",y[n]));
+            z[n]=textToFloat(formatString("%.3f",z[n]));
+            occupancy[n]=textToFloat(formatString("%.2f",occupancy[n]));
+        }
+
+        fnPDB.initUniqueName("/tmp/test_pdb_XXXXXX");
+        fnPDB=fnPDB+".pdb";
+        std::ofstream fh(fnPDB.c_str());
+        fh << "REMARK test model\n";
+        for (size_t n=0; n<name.size(); ++n)
+        {
+            bool water=(n==name.size()-1);
+            fh << formatString("%-6s%5d %4s %3s A%4d    %8.3f%8.3f%8.3f%6.2f%6.2f\n",
+                               water ? "HETATM" : "ATOM", (int)n+1, name[n].c_str(),
+                               water ? "HOH" : "CYS", water ? 2 : 1,
+                               x[n], y[n], z[n], occupancy[n], bfactor[n]);
+        }
+        fh << "END\n";
+        fh.close();
+    }
+
+    virtual void TearDown()
+    {
+        fnPDB.deleteFile();
+    }
+
+    // Prepare the converter as ProgPdbConverter::run does
+    void setupConverter(ProgPdbConverter &converter)
+    {
+        converter.verbose=0;
+        converter.fn_pdb=fnPDB;
+        converter.doCenter=true;
+        converter.output_dim=32;
+        converter.produceSideInfo();
+        converter.computeProteinGeometry();
+    }
+
+    // Position of atom n in voxels
+    Matrix1D<double> atomPosition(const ProgPdbConverter &converter, size_t n, double Ts)
+    {
+        Matrix1D<double> r(3);
+        VECTOR_R3(r, x[n], y[n], z[n]);
+        r-=converter.centerOfMass;
+        r/=Ts;
+        return r;
+    }
+
+    FileName fnPDB;
+    std::vector<std::string> name;
+    std::vector<double> x, y, z, occupancy, bfactor;
+};
+
+// The splatted Gaussians must be those added atom by atom
+TEST_F( PdbTest, fixedGaussianSplatting)
+{
+    XMIPP_TRY
+    ProgPdbConverter converter;
+    converter.useFixedGaussian=true;
+    converter.sigmaGaussian=1.5;
+    converter.Ts=1.5;
+    setupConverter(converter);
+    converter.highTs=converter.Ts;
+    converter.createProteinAtHighSamplingRate();
+    const MultidimArray<double> &V=converter.Vhigh();
+
+    MultidimArray<double> Vref;
+    Vref.initZeros(V);
+    Vref.setXmippOrigin();
+    double sigma2=converter.sigmaGaussian*converter.sigmaGaussian;
+    double normalization=1.0/pow(2*PI*sigma2,1.5);
+    double radius=4.5*converter.sigmaGaussian;
+    for (size_t n=0; n<name.size(); ++n)
+    {
+        Matrix1D<double> r=atomPosition(converter,n,converter.Ts), rdiff(3);
+        for (int k=FLOOR(ZZ(r)-radius); k<=CEIL(ZZ(r)+radius); k++)
+            for (int i=FLOOR(YY(r)-radius); i<=CEIL(YY(r)+radius); i++)
+                for (int j=FLOOR(XX(r)-radius); j<=CEIL(XX(r)+radius); j++)
+                    if (!Vref.outside(k,i,j))
+                    {
+                        VECTOR_R3(rdiff, XX(r) - j, YY(r) - i, ZZ(r) - k);
+                        rdiff*=converter.Ts;
+                        double d=rdiff.module();
+                        A3D_ELEM(Vref,k,i,j)+=occupancy[n]*exp(-d*d/(2*sigma2))*normalization;
+                    }
+    }
+    double maxVal=Vref.computeMax();
+    EXPECT_GT(maxVal,0.);
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(Vref)
+    EXPECT_NEAR(A3D_ELEM(V,k,i,j),A3D_ELEM(Vref,k,i,j),1e-12*maxVal);
+    XMIPP_CATCH
+}
+
+TEST_F( PdbTest, blobSplatting)
+{
+    XMIPP_TRY
+    ProgPdbConverter converter;
+    converter.useBlobs=true;
+    converter.Ts=1;
+    setupConverter(converter);
+    converter.highTs=0.5;
+    converter.createProteinAtHighSamplingRate();
+    const MultidimArray<double> &V=converter.Vhigh();
+
+    MultidimArray<double> Vref;
+    Vref.initZeros(V);
+    Vref.setXmippOrigin();
+    struct blobtype blob=converter.blob;
+    for (size_t n=0; n<name.size(); ++n)
+    {
+        double weight, radius;
+        converter.atomBlobDescription(name[n].substr(1,2),weight,radius);
+        blob.radius=radius;
+        Matrix1D<double> r=atomPosition(converter,n,converter.highTs), rdiff(3);
+        for (int k=FLOOR(ZZ(r)-radius); k<=CEIL(ZZ(r)+radius); k++)
+            for (int i=FLOOR(YY(r)-radius); i<=CEIL(YY(r)+radius); i++)
+                for (int j=FLOOR(XX(r)-radius); j<=CEIL(XX(r)+radius); j++)
+                    if (!Vref.outside(k,i,j))
+                    {
+                        VECTOR_R3(rdiff, XX(r) - j, YY(r) - i, ZZ(r) - k);
+                        rdiff*=converter.highTs;
+                        A3D_ELEM(Vref,k,i,j)+=weight*blob_val(rdiff.module(),blob);
+                    }
+    }
+    double maxVal=Vref.computeMax();
+    EXPECT_GT(maxVal,0.);
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(Vref)
+    EXPECT_NEAR(A3D_ELEM(V,k,i,j),A3D_ELEM(Vref,k,i,j),1e-12*maxVal);
+    XMIPP_CATCH
+}
+
+// The tabulated profiles must be close to the interpolated ones
+TEST_F( PdbTest, scatteringProfileSplatting)
+{
+    XMIPP_TRY
+    ProgPdbConverter converter;
+    converter.Ts=1;
+    setupConverter(converter);
+    converter.createProteinUsingScatteringProfiles();
+    const MultidimArray<double> &V=converter.Vlow();
+
+    // The water molecule is not included
+    MultidimArray<double> Vref;
+    Vref.initZeros(V);
+    Vref.setXmippOrigin();
+    for (size_t n=0; n+1<name.size(); ++n)
+    {
+        char atomType=name[n][1];
+        double radius=converter.atomProfiles.atomRadius(atomType);
+        Matrix1D<double> r=atomPosition(converter,n,converter.Ts);
+        for (int k=FLOOR(ZZ(r)-radius); k<=CEIL(ZZ(r)+radius); k++)
+            for (int i=FLOOR(YY(r)-radius); i<=CEIL(YY(r)+radius); i++)
+                for (int j=FLOOR(XX(r)-radius); j<=CEIL(XX(r)+radius); j++)
+                {
+                    double d=sqrt((XX(r)-j)*(XX(r)-j)+(YY(r)-i)*(YY(r)-i)+(ZZ(r)-k)*(ZZ(r)-k));
+                    if (!Vref.outside(k,i,j) && d<radius)
+                        A3D_ELEM(Vref,k,i,j)+=converter.atomProfiles.volumeAtDistance(atomType,d);
+                }
+    }
+    double maxVal=Vref.computeMax();
+    EXPECT_GT(maxVal,0.);
+    FOR_ALL_ELEMENTS_IN_ARRAY3D(Vref)
+    EXPECT_NEAR(A3D_ELEM(V,k,i,j),A3D_ELEM(Vref,k,i,j),1e-3*maxVal);
+    XMIPP_CATCH
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,132 @@
+#include <reconstruction/reconstruct_fourier.h>
+#include <data/xmipp_image.h>
+#include <data/metadata.h>
+#include <iostream>
+#include <gtest/gtest.h>
+// MORE INFO HERE: http://code.google.com/p/googletest/wiki/AdvancedGuide
+class ReconstructFourierTest : public ::testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        fnRoot.initUniqueName("/tmp/test_reconstruct_fourier_XXXXXX");
+    }
+
+    virtual void TearDown()
+    {
+        for (size_t n=0; n<files.size(); ++n)
+            files[n].deleteFile();
+        fnRoot.deleteFile();
+    }
+
+    // Random projections of size Xdim at random directions
+    FileName createProjections(int Xdim, size_t N)
+    {
+        FileName fnStack=fnRoot+"_images.stk", fnMd=fnRoot+"_images.xmd";
+        Image<double> I(Xdim,Xdim,1,N);
+        I().initRandom(0,1,RND_GAUSSIAN);
+        I.write(fnStack);
+        MetaData MD;
+        for (size_t n=0; n<N; ++n)
+        {
+            size_t id=MD.addObject();
+            FileName fnImg;
+            fnImg.compose(n+1,fnStack);
+            MD.setValue(MDL_IMAGE,fnImg,id);
+            MD.setValue(MDL_ANGLE_ROT,rnd_unif(0,360),id);
+            MD.setValue(MDL_ANGLE_TILT,rnd_unif(0,180),id);
+            MD.setValue(MDL_ANGLE_PSI,rnd_unif(0,360),id);
+        }
+        MD.write(fnMd);
+        files.push_back(fnStack);
+        files.push_back(fnMd);
+        return fnMd;
+    }
+
+    // Run the program with the given arguments
+    void reconstruct(const String &args, const FileName &fnOut)
+    {
+        String command="xmipp_reconstruct_fourier -v 0 -o "+fnOut+" "+args;
+        StringVector words;
+        splitString(command," ",words);
+        std::vector<const char *> argv;
+        for (size_t n=0; n<words.size(); ++n)
+            argv.push_back(words[n].c_str());
+        ProgRecFourier prog;
+        prog.read((int)argv.size(),&argv[0]);
+        prog.run();
+        files.push_back(fnOut);
+    }
+
+    // Reconstructions with rows distributed among threads and with
+    // an accumulator per thread must be the same
+    void compareThreadModes(int Xdim, const String &args)
+    {
+        FileName fnMd=createProjections(Xdim,6);
+        FileName fnRows=fnRoot+"_rows.vol", fnAcc=fnRoot+"_acc.vol";
+        reconstruct("-i "+fnMd+" --thr 1 "+args,fnRows);
+        reconstruct("-i "+fnMd+" --thr 2 --threadAccumulators "+args,fnAcc);
+        Image<double> Vrows, Vacc;
+        Vrows.read(fnRows);
+        Vacc.read(fnAcc);
+        ASSERT_TRUE(Vrows().sameShape(Vacc()));
+        double maxVal=Vrows().computeMax()-Vrows().computeMin();
+        EXPECT_GT(maxVal,0.);
+        FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(Vrows())
+        EXPECT_NEAR(DIRECT_MULTIDIM_ELEM(Vrows(),n),DIRECT_MULTIDIM_ELEM(Vacc(),n),1e-8*maxVal);
+    }
+
+    FileName fnRoot;
+    std::vector<FileName> files;
+};
+
+// The last positive row of an odd padded image is also the first negative one
+TEST_F( ReconstructFourierTest, threadAccumulatorsOddPaddedSize)
+{
+    XMIPP_TRY
+    compareThreadModes(21,"--padding 3 2 --max_resolution 0.5");
+    XMIPP_CATCH
+}
+
+// Beyond Nyquist all the rows are gridded once
+TEST_F( ReconstructFourierTest, threadAccumulatorsHighResolution)
+{
+    XMIPP_TRY
+    compareThreadModes(20,"--padding 2 2 --max_resolution 0.8");
+    XMIPP_CATCH
+}
+
+// The volume of a saved accumulator is that of the images, and accumulators
+// of runs with other parameters must not be added
+TEST_F( ReconstructFourierTest, loadAccumulator)
+{
+    XMIPP_TRY
+    FileName fnMd=createProjections(20,4), fnAcc=fnRoot+"_acc";
+    files.push_back(fnAcc+".xmd");
+    files.push_back(fnAcc+"_Fourier.mrc");
+    files.push_back(fnAcc+"_Weights.vol");
+    reconstruct("-i "+fnMd+" --sym c2 --saveAccumulator "+fnAcc+" --noFinalize",fnRoot+"_vol1.vol");
+
+    FileName fnVol=fnRoot+"_vol2.vol", fnDirect=fnRoot+"_direct.vol";
+    reconstruct("--loadAccumulators "+fnAcc+" --sym c2",fnVol);
+    reconstruct("-i "+fnMd+" --sym c2",fnDirect);
+    Image<double> V, Vdirect;
+    V.read(fnVol);
+    Vdirect.read(fnDirect);
+    ASSERT_TRUE(V().sameShape(Vdirect()));
+    double maxVal=Vdirect().computeMax()-Vdirect().computeMin();
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(V())
+    EXPECT_NEAR(DIRECT_MULTIDIM_ELEM(V(),n),DIRECT_MULTIDIM_ELEM(Vdirect(),n),1e-5*maxVal);
+
+    EXPECT_THROW(reconstruct("--loadAccumulators "+fnAcc+" --sym c3",fnVol),XmippError);
+    EXPECT_THROW(reconstruct("--loadAccumulators "+fnAcc+" --sym c2 --blob 2.5 0 15",fnVol),XmippError);
+    EXPECT_THROW(reconstruct("--loadAccumulators "+fnAcc+" --sym c2 --blob 1.9 0 10",fnVol),XmippError);
+    EXPECT_THROW(reconstruct("--loadAccumulators "+fnAcc+" --sym c2 --max_resolution 0.25",fnVol),XmippError);
+    XMIPP_CATCH
+}
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
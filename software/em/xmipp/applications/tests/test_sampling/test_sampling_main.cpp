@@ -194,6 +194,76 @@ TEST_F(SamplingTest, computeNeighborsC1)
     XMIPP_CATCH
 }
 
+// The symmetric directions must be L*R^t applied to the experimental ones
+TEST_F(SamplingTest, fillExpDataProjectionDirectionByLR)
+{
+    XMIPP_TRY
+    MetaData DFi(fn_root + "experimental_images.xmd");
+    size_t Nsym = mysampling.R_repository.size();
+    ASSERT_EQ(mysampling.exp_data_projection_direction_by_L_R.size(), DFi.size()*Nsym);
+    Matrix1D<double> direction(3), symDirection;
+    double rot, tilt, psi;
+    size_t n = 0;
+    FOR_ALL_OBJECTS_IN_METADATA(DFi)
+    {
+        DFi.getValue(MDL_ANGLE_ROT,rot,__iter.objId);
+        DFi.getValue(MDL_ANGLE_TILT,tilt,__iter.objId);
+        DFi.getValue(MDL_ANGLE_PSI,psi,__iter.objId);
+        Euler_direction(rot, tilt, psi, direction);
+        for (size_t j = 0; j < Nsym; j++, n++)
+        {
+            symDirection = mysampling.L_repository[j] *
+                           (direction.transpose() * mysampling.R_repository[j]).transpose();
+            const Matrix1D<double> &result = mysampling.exp_data_projection_direction_by_L_R[n];
+            EXPECT_NEAR(XX(result), XX(symDirection), 1e-12);
+            EXPECT_NEAR(YY(result), YY(symDirection), 1e-12);
+            EXPECT_NEAR(ZZ(result), ZZ(symDirection), 1e-12);
+        }
+    }
+    XMIPP_CATCH
+}
+
+// Every point must be farther than the maximum angle from the symmetric
+// versions of the points kept before it, and every removed point closer
+TEST_F(SamplingTest, removeRedundantPointsExhaustive)
+{
+    XMIPP_TRY
+    int  symmetry, sym_order;
+    double maxAng = 12.;
+    Sampling s1;
+    s1.setSampling(10.);
+    s1.computeSamplingPoints(false, 180., 0.);
+    s1.SL.isSymmetryGroup("d3", symmetry, sym_order);
+    s1.SL.readSymmetryFile("d3");
+    s1.fillLRRepository();
+    s1.removeRedundantPoints(symmetry, sym_order);
+    std::vector <Matrix1D<double> > candidates = s1.no_redundant_sampling_points_vector;
+    s1.removeRedundantPointsExhaustive(symmetry, sym_order, true, maxAng);
+
+    double cosMaxAng = cos(DEG2RAD(maxAng));
+    std::vector <Matrix1D<double> > kept;
+    Matrix1D<double> direction;
+    for (size_t i = 0; i < candidates.size(); i++)
+    {
+        bool uniq = true;
+        for (size_t k = 0; k < kept.size() && uniq; k++)
+            for (size_t j = 0; j < s1.R_repository.size() && uniq; j++)
+            {
+                direction = s1.L_repository[j] *
+                            (kept[k].transpose() * s1.R_repository[j]).transpose();
+                if (ABS(dotProduct(direction, candidates[i])) > cosMaxAng)
+                    uniq = false;
+            }
+        if (uniq)
+            kept.push_back(candidates[i]);
+    }
+    ASSERT_EQ(s1.no_redundant_sampling_points_vector.size(), kept.size());
+    EXPECT_LT(kept.size(), candidates.size());
+    for (size_t k = 0; k < kept.size(); k++)
+        EXPECT_EQ(s1.no_redundant_sampling_points_vector[k], kept[k]);
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
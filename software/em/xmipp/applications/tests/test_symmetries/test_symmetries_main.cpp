@@ -123,6 +123,46 @@ TEST_F(SamplingTest, computeDistanceMetadata)
     XMIPP_CATCH
 }
 
+TEST_F(SamplingTest, rotationTables)
+{
+    XMIPP_TRY
+    FileName fn_sym("i3h");
+    SL.readSymmetryFile(fn_sym);
+    const SymRotationTable &table = SL.__Rtable;
+    ASSERT_EQ(table.symsNo, SL.symsNo());
+    EXPECT_EQ(table.stride % 4, 0);
+
+    Matrix2D<double> L, R, A, RA, M(3, 3);
+    rotation3DMatrix(30., 'Z', A, false);
+    SymRotationTable RAtable;
+    table.compose(A, RAtable);
+    double x = 0.3, y = -0.2, z = 0.9;
+    std::vector<double> rx(table.stride), ry(table.stride), rz(table.stride);
+    table.apply(&x, &y, &z, 1, &rx[0], &ry[0], &rz[0]);
+    for (int isym = 0; isym < SL.symsNo(); isym++)
+    {
+        SL.getMatrices(isym, L, R, false);
+        table.getMatrix(isym, M);
+        EXPECT_TRUE(M.equal(R, 1e-12));
+        RAtable.getMatrix(isym, M);
+        RA = R * A;
+        EXPECT_TRUE(M.equal(RA, 1e-12));
+        EXPECT_NEAR(rx[isym], R(0, 0) * x + R(0, 1) * y + R(0, 2) * z, 1e-12);
+        EXPECT_NEAR(ry[isym], R(1, 0) * x + R(1, 1) * y + R(1, 2) * z, 1e-12);
+        EXPECT_NEAR(rz[isym], R(2, 0) * x + R(2, 1) * y + R(2, 2) * z, 1e-12);
+
+        // The matrix is det times the rotation of the quaternion
+        double d = table.det[isym];
+        double w = table.q[isym], qx = table.q[table.stride + isym];
+        double qy = table.q[2 * table.stride + isym], qz = table.q[3 * table.stride + isym];
+        EXPECT_NEAR(w * w + qx * qx + qy * qy + qz * qz, 1., 1e-9);
+        EXPECT_NEAR(R(0, 1), d * 2 * (qx * qy - qz * w), 1e-9);
+        EXPECT_NEAR(R(1, 2), d * 2 * (qy * qz - qx * w), 1e-9);
+        EXPECT_NEAR(R(2, 2), d * (1 - 2 * (qx * qx + qy * qy)), 1e-9);
+    }
+    XMIPP_CATCH
+}
+
 GTEST_API_ int main(int argc, char **argv)
 {
     testing::InitGoogleTest(&argc, argv);
@@ -104,6 +104,9 @@ void addLabels(PyObject * dict)
     ADD_CONST(MDL_AVG_CHANGES_CLASSES);
 
     ADD_CONST(MDL_BGMEAN);
+    ADD_CONST(MDL_BLOB_ALPHA);
+    ADD_CONST(MDL_BLOB_ORDER);
+    ADD_CONST(MDL_BLOB_RADIUS);
     ADD_CONST(MDL_BLOCK_NUMBER);
 
     ADD_CONST(MDL_CLASS_COUNT);
@@ -238,6 +241,7 @@ void addLabels(PyObject * dict)
     ADD_CONST(MDL_MAXCC);
     ADD_CONST(MDL_MAXCC_PERCENTILE);
     ADD_CONST(MDL_MAX);
+    ADD_CONST(MDL_MAX_RESOLUTION);
     ADD_CONST(MDL_MICROGRAPH);
     ADD_CONST(MDL_MICROGRAPH_ID);
     ADD_CONST(MDL_MICROGRAPH_MOVIE);
@@ -367,6 +371,7 @@ void addLabels(PyObject * dict)
               
     ADD_CONST(MDL_SUM);
     ADD_CONST(MDL_SUMWEIGHT);
+    ADD_CONST(MDL_SYMMETRY);
     ADD_CONST(MDL_SYMNO);
 
     ADD_CONST(MDL_TIME);
@@ -30,11 +30,59 @@
 /*                            Image                         */
 /**************************************************************/
 
+#define IMAGE_BUFFER_NAME "xmipp.ImageBuffer"
+
+/* Release one reference to the image data shared with NumPy */
+void ImageBuffer_release(ImageBuffer * buffer)
+{
+    if (--buffer->refs == 0)
+    {
+        delete buffer->image;
+        delete buffer;
+    }
+}
+
+/* Called when the NumPy array holding the capsule is destroyed */
+void ImageBuffer_destroyCapsule(PyObject * capsule)
+{
+    ImageBuffer_release((ImageBuffer*) PyCapsule_GetPointer(capsule, IMAGE_BUFFER_NAME));
+}
+
+void Image_detachViews(ImageObject * self, bool keepData)
+{
+    ImageBuffer * buffer = self->buffer;
+    if (buffer == NULL)
+        return;
+    self->buffer = NULL;
+    if (buffer->refs == 1)
+        delete buffer; // All views were released, the image owns its data again
+    else
+    {
+        // Views keep the current data, the image continues with a new one
+        self->image = keepData ? new ImageGeneric(*buffer->image) : new ImageGeneric();
+        --buffer->refs;
+    }
+}
+
+ImageObject *
+Image_create(ImageGeneric * image)
+{
+    ImageObject * self = PyObject_New(ImageObject, &ImageType);
+    if (self != NULL)
+    {
+        self->image = image;
+        self->buffer = NULL;
+    }
+    return self;
+}
+
 /* Destructor */
 void Image_dealloc(ImageObject* self)
 {
-
-    delete self->image;
+    if (self->buffer != NULL)
+        ImageBuffer_release(self->buffer);
+    else
+        delete self->image;
     self->ob_type->tp_free((PyObject*) self);
 }//function Image_dealloc
 
@@ -111,7 +159,7 @@ PyMethodDef Image_methods[] =
         { "write", (PyCFunction) Image_write, METH_VARARGS,
           "Write image to disk" },
         { "getData", (PyCFunction) Image_getData, METH_VARARGS,
-          "Return NumPy array from image data" },
+          "Return NumPy array sharing the image data, or a copy if first argument is True" },
         { "projectVolumeDouble", (PyCFunction) Image_projectVolumeDouble, METH_VARARGS,
           "project a volume using Euler angles" },
 
@@ -355,13 +403,19 @@ Image_write(PyObject *obj, PyObject *args, PyObject *kwargs)
                 // Now read using both of index and filename
                 bool isStack = (index > 0);
                 WriteMode writeMode = isStack ? WRITE_REPLACE : WRITE_OVERWRITE;
-                self->image->write(filename, index, isStack, writeMode);
-
+                {
+                    ReleaseGIL nogil;
+                    self->image->write(filename, index, isStack, writeMode);
+                }
                 Py_RETURN_NONE;
               }
               if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                  self->image->write(PyString_AsString(input));
+                  FileName fn(PyString_AsString(input));
+                  {
+                      ReleaseGIL nogil;
+                      self->image->write(fn);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -402,12 +456,21 @@ Image_read(PyObject *obj, PyObject *args, PyObject *kwargs)
                 size_t index = PyInt_AsSsize_t(PyTuple_GetItem(input, 0));
                 const char * filename = PyString_AsString(PyTuple_GetItem(input, 1));
                 // Now read using both of index and filename
-                self->image->read(filename,(DataMode)datamode, index);
+                Image_detachViews(self, false);
+                {
+                    ReleaseGIL nogil;
+                    self->image->read(filename,(DataMode)datamode, index);
+                }
                 Py_RETURN_NONE;
               }
               else if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                  self->image->read(PyString_AsString(pyStr),(DataMode)datamode);
+                  FileName fn(PyString_AsString(pyStr));
+                  Image_detachViews(self, false);
+                  {
+                      ReleaseGIL nogil;
+                      self->image->read(fn,(DataMode)datamode);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -455,7 +518,12 @@ Image_readPreview(PyObject *obj, PyObject *args, PyObject *kwargs)
               PyObject *pyStr;
               if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                  readImagePreview(self->image, PyString_AsString(pyStr), x, slice);
+                  FileName fn(PyString_AsString(pyStr));
+                  Image_detachViews(self, false);
+                  {
+                      ReleaseGIL nogil;
+                      readImagePreview(self->image, fn, x, slice);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -493,7 +561,12 @@ Image_readPreviewSmooth(PyObject *obj, PyObject *args, PyObject *kwargs)
               PyObject *pyStr;
               if ((pyStr = PyObject_Str(input)) != NULL)
               {
-                self->image->readPreviewSmooth(PyString_AsString(pyStr), x);
+                  FileName fn(PyString_AsString(pyStr));
+                  Image_detachViews(self, false);
+                  {
+                      ReleaseGIL nogil;
+                      self->image->readPreviewSmooth(fn, x);
+                  }
                   Py_RETURN_NONE;
               }
               else
@@ -521,12 +594,15 @@ Image_convertPSD(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
-            ImageGeneric *image = self->image;
-            image->convert2Datatype(DT_Double);
-            MultidimArray<double> *in;
-            MULTIDIM_ARRAY_GENERIC(*image).getMultidimArrayPointer(in);
-            xmipp2PSD(*in, *in, true);
-
+            Image_detachViews(self);
+            {
+                ReleaseGIL nogil;
+                ImageGeneric *image = self->image;
+                image->convert2Datatype(DT_Double);
+                MultidimArray<double> *in;
+                MULTIDIM_ARRAY_GENERIC(*image).getMultidimArrayPointer(in);
+                xmipp2PSD(*in, *in, true);
+            }
             Py_RETURN_NONE;
         }
         catch (XmippError &xe)
@@ -620,8 +696,9 @@ PyObject *
 Image_getData(PyObject *obj, PyObject *args, PyObject *kwargs)
 {
     ImageObject *self = (ImageObject*) obj;
+    PyObject *pyCopy = Py_False;
 
-    if (self != NULL)
+    if (self != NULL && PyArg_ParseTuple(args, "|O", &pyCopy))
     {
         try
         {
@@ -638,11 +715,42 @@ Image_getData(PyObject *obj, PyObject *args, PyObject *kwargs)
             //Get the pointer to data
             void *mymem = image().getArrayPointer();
             NPY_TYPES type = datatype2NpyType(dt);
-            //dims pointer is shifted if ndim or zdim are 1
-            PyArrayObject * arr = (PyArrayObject*) PyArray_SimpleNew(nd, dims+4-nd, type);
-            void * data = PyArray_DATA(arr);
-            memcpy(data, mymem, adim.nzyxdim * gettypesize(dt));
+            PyArrayObject * arr;
+
+            if (PyObject_IsTrue(pyCopy))
+            {
+                //dims pointer is shifted if ndim or zdim are 1
+                arr = (PyArrayObject*) PyArray_SimpleNew(nd, dims+4-nd, type);
+                if (arr != NULL)
+                    memcpy(PyArray_DATA(arr), mymem, adim.nzyxdim * gettypesize(dt));
+                return (PyObject*)arr;
+            }
 
+            // Return a view of the image memory. The array holds a reference
+            // to the data, so it remains valid after the image is destroyed,
+            // read again or resized (the image then gets its own new data)
+            arr = (PyArrayObject*) PyArray_SimpleNewFromData(nd, dims+4-nd, type, mymem);
+            if (arr == NULL)
+                return NULL;
+            if (self->buffer == NULL)
+            {
+                self->buffer = new ImageBuffer;
+                self->buffer->image = self->image;
+                self->buffer->refs = 1;
+            }
+            PyObject * capsule = PyCapsule_New(self->buffer, IMAGE_BUFFER_NAME, ImageBuffer_destroyCapsule);
+            if (capsule == NULL)
+            {
+                Py_DECREF(arr);
+                return NULL;
+            }
+            ++self->buffer->refs;
+            // The reference to capsule is stolen, even on failure
+            if (PyArray_SetBaseObject(arr, capsule) < 0)
+            {
+                Py_DECREF(arr);
+                return NULL;
+            }
             return (PyObject*)arr;
         }
         catch (XmippError &xe)
@@ -666,23 +774,24 @@ Image_projectVolumeDouble(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
-            // We use the following macro to release the Python Interpreter Lock (GIL)
-            // while running this C extension code and allows threads to run concurrently.
-            // See: https://docs.python.org/2.7/c-api/init.html for details.
-            Py_BEGIN_ALLOW_THREADS
             Projection P;
-            MultidimArray<double> * pVolume;
-            self->image->data->getMultidimArrayPointer(pVolume);
-            ArrayDim aDim;
-            pVolume->getDimensions(aDim);
-            pVolume->setXmippOrigin();
-            projectVolume(*pVolume, P, aDim.xdim, aDim.ydim,rot, tilt, psi);
-            result = PyObject_New(ImageObject, &ImageType);
-            Image <double> I;
-            result->image = new ImageGeneric();
-            result->image->setDatatype(DT_Double);
-            result->image->data->setImage(MULTIDIM_ARRAY(P));
-            Py_END_ALLOW_THREADS
+            {
+                // Release the Python Interpreter Lock (GIL) while projecting
+                // and allow other threads to run concurrently.
+                ReleaseGIL nogil;
+                MultidimArray<double> * pVolume;
+                self->image->data->getMultidimArrayPointer(pVolume);
+                ArrayDim aDim;
+                pVolume->getDimensions(aDim);
+                pVolume->setXmippOrigin();
+                projectVolume(*pVolume, P, aDim.xdim, aDim.ydim,rot, tilt, psi);
+            }
+            result = Image_create(new ImageGeneric());
+            if (result != NULL)
+            {
+                result->image->setDatatype(DT_Double);
+                result->image->data->setImage(MULTIDIM_ARRAY(P));
+            }
             return (PyObject *)result;
         }
         catch (XmippError &xe)
@@ -701,33 +810,43 @@ PyObject *
 Image_setData(PyObject *obj, PyObject *args, PyObject *kwargs)
 {
     ImageObject *self = (ImageObject*) obj;
-    PyArrayObject * arr = NULL;
+    PyObject * input = NULL;
 
-    if (self != NULL && PyArg_ParseTuple(args, "O", &arr))
+    if (self != NULL && PyArg_ParseTuple(args, "O", &input))
     {
+        // Non contiguous arrays are copied first
+        PyArrayObject * arr = (PyArrayObject*) PyArray_FROM_OF(input, NPY_ARRAY_C_CONTIGUOUS | NPY_ARRAY_ALIGNED);
+        if (arr == NULL)
+            return NULL;
         try
         {
-            ImageGeneric & image = Image_Value(self);
             DataType dt = npyType2Datatype(PyArray_TYPE(arr));
             int nd = PyArray_NDIM(arr);
-            //Setup of image
-            image.setDatatype(dt);
             ArrayDim adim;
             adim.ndim = (nd == 4 ) ? PyArray_DIM(arr, 0) : 1;
             adim.zdim = (nd > 2 ) ? PyArray_DIM(arr, nd - 3) : 1;
             adim.ydim = PyArray_DIM(arr, nd - 2);
             adim.xdim = PyArray_DIM(arr, nd - 1);
-
-            MULTIDIM_ARRAY_GENERIC(image).resize(adim, false);
-            void *mymem = image().getArrayPointer();
+            adim.nzyxdim = adim.ndim * adim.zdim * adim.ydim * adim.xdim;
             void * data = PyArray_DATA(arr);
-            memcpy(mymem, data, adim.nzyxdim * gettypesize(dt));
+
+            Image_detachViews(self, false);
+            {
+                ReleaseGIL nogil;
+                //Setup of image
+                ImageGeneric & image = Image_Value(self);
+                image.setDatatype(dt);
+                MULTIDIM_ARRAY_GENERIC(image).resize(adim, false);
+                memcpy(image().getArrayPointer(), data, adim.nzyxdim * gettypesize(dt));
+            }
+            Py_DECREF(arr);
             Py_RETURN_NONE;
         }
         catch (XmippError &xe)
         {
             PyErr_SetString(PyXmippError, xe.msg.c_str());
         }
+        Py_DECREF(arr);
     }
     return NULL;
 }//function Image_setData
@@ -865,6 +984,7 @@ Image_resize(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_detachViews(self, false);
             self->image->resize(xDim, yDim, zDim, nDim, false); // TODO: Take care of copy mode if needed
             Py_RETURN_NONE;
         }
@@ -887,8 +1007,12 @@ Image_scale(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
-            MULTIDIM_ARRAY_GENERIC(Image_Value(self)).setXmippOrigin();
-            selfScaleToSize(BSPLINE2, MULTIDIM_ARRAY_GENERIC(Image_Value(self)), xDim, yDim, zDim);
+            Image_detachViews(self);
+            {
+                ReleaseGIL nogil;
+                MULTIDIM_ARRAY_GENERIC(Image_Value(self)).setXmippOrigin();
+                selfScaleToSize(BSPLINE2, MULTIDIM_ARRAY_GENERIC(Image_Value(self)), xDim, yDim, zDim);
+            }
             Py_RETURN_NONE;
         }
         catch (XmippError &xe)
@@ -910,6 +1034,7 @@ Image_reslice(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_detachViews(self);
             self->image->reslice((AxisView) axis);
             Py_RETURN_NONE;
         }
@@ -977,6 +1102,7 @@ Image_setDataType(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_detachViews(self, false);
             self->image->setDatatype((DataType)datatype);
             Py_RETURN_NONE;
         }
@@ -1000,6 +1126,7 @@ Image_convert2DataType(PyObject *obj, PyObject *args, PyObject *kwargs)
     {
         try
         {
+            Image_detachViews(self);
             self->image->convert2Datatype((DataType)datatype, (CastWriteMode)castMode);
             Py_RETURN_NONE;
         }
@@ -1224,7 +1351,7 @@ Image_adjustAndSubtract(PyObject *obj, PyObject *args, PyObject *kwargs)
 {
     ImageObject *self = (ImageObject*) obj;
     PyObject *pimg2 = NULL;
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_create();
     if (self != NULL)
     {
         try
@@ -1250,7 +1377,7 @@ Image_adjustAndSubtract(PyObject *obj, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_add(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_create();
     if (result != NULL)
     {
         try
@@ -1275,7 +1402,7 @@ Image_iadd(PyObject *obj1, PyObject *obj2)
     try
     {
         Image_Value(obj1).add(Image_Value(obj2));
-        if ((result = PyObject_New(ImageObject, &ImageType)))
+        if ((result = Image_create()))
             result->image = new ImageGeneric(Image_Value(obj1));
         //return obj1;
     }
@@ -1318,7 +1445,7 @@ Image_inplaceAdd(PyObject *self, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_subtract(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_create();
     if (result != NULL)
     {
         try
@@ -1343,7 +1470,7 @@ Image_isubtract(PyObject *obj1, PyObject *obj2)
     try
     {
         Image_Value(obj1).subtract(Image_Value(obj2));
-        if ((result = PyObject_New(ImageObject, &ImageType)))
+        if ((result = Image_create()))
             result->image = new ImageGeneric(Image_Value(obj1));
     }
     catch (XmippError &xe)
@@ -1384,7 +1511,7 @@ Image_inplaceSubtract(PyObject *self, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_multiply(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_create();
     if (result != NULL)
     {
         try
@@ -1409,7 +1536,7 @@ Image_imultiply(PyObject *obj1, PyObject *obj2)
     try
     {
         ImageObject * result = NULL;
-        if ((result = PyObject_New(ImageObject, &ImageType)))
+        if ((result = Image_create()))
             result->image = new ImageGeneric(Image_Value(obj1));
         double value = PyFloat_AsDouble(obj2);
         Image_Value(result).multiply(value);
@@ -1458,7 +1585,7 @@ Image_inplaceMultiply(PyObject *self, PyObject *args, PyObject *kwargs)
 PyObject *
 Image_divide(PyObject *obj1, PyObject *obj2)
 {
-    ImageObject * result = PyObject_New(ImageObject, &ImageType);
+    ImageObject * result = Image_create();
     if (result != NULL)
     {
         try
@@ -1487,7 +1614,7 @@ Image_idivide(PyObject *obj1, PyObject *obj2)
     try
     {
       ImageObject * result = NULL;
-      if ((result = PyObject_New(ImageObject, &ImageType)))
+      if ((result = Image_create()))
           result->image = new ImageGeneric(Image_Value(obj1));
       double value = PyFloat_AsDouble(obj2);
       Image_Value(result).divide(value);
@@ -1613,6 +1740,7 @@ Image_applyCTF(PyObject *obj, PyObject *args, PyObject *kwargs)
 		if (PyString_Check(input) || MetaData_Check(input))
 		{
 		    ImageObject *self = (ImageObject*) obj;
+		    Image_detachViews(self);
 	            ImageGeneric *image = self->image;
 	            image->convert2Datatype(DT_Double);
 	            MultidimArray<double> * pImage=NULL;
@@ -1631,8 +1759,11 @@ Image_applyCTF(PyObject *obj, PyObject *args, PyObject *kwargs)
                        FileName fnCTF = PyString_AsString(pyStr);
 		       ctf.read(fnCTF);
                        }
-		    ctf.produceSideInfo();
-		    ctf.applyCTF(*pImage,Ts,absPhase);
+		    {
+		        ReleaseGIL nogil;
+		        ctf.produceSideInfo();
+		        ctf.applyCTF(*pImage,Ts,absPhase);
+		    }
 		    Py_RETURN_NONE;
 		}
         }
@@ -1677,7 +1808,11 @@ Image_readApplyGeo(PyObject *obj, PyObject *args, PyObject *kwargs)
                 params.datamode = (DataMode)datamode;
                 params.select_img = select_img;
                 params.wrap = boolWrap;
-                self->image->readApplyGeo(MetaData_Value(md), objectId, params);
+                Image_detachViews(self, false);
+                {
+                    ReleaseGIL nogil;
+                    self->image->readApplyGeo(MetaData_Value(md), objectId, params);
+                }
                 Py_RETURN_NONE;
             }
             catch (XmippError &xe)
@@ -1718,7 +1853,11 @@ Image_applyGeo(PyObject *obj, PyObject *args, PyObject *kwargs)
                 ApplyGeoParams params;
                 params.only_apply_shifts = boolOnly_apply_shifts;
                 params.wrap = boolWrap;
-                self->image->applyGeo(MetaData_Value(md), objectId, params);
+                Image_detachViews(self);
+                {
+                    ReleaseGIL nogil;
+                    self->image->applyGeo(MetaData_Value(md), objectId, params);
+                }
                 Py_RETURN_NONE;
             }
             catch (XmippError &xe)
@@ -37,11 +37,23 @@
 #define Image_Check(v) (((v)->ob_type == &ImageType))
 #define Image_Value(v) ((*((ImageObject*)(v))->image))
 
+/* Image data shared with NumPy views.
+ * The ImageGeneric is destroyed when the last reference
+ * (the Image object or any of its views) is released.
+ */
+typedef struct
+{
+    ImageGeneric * image;
+    size_t refs;
+}
+ImageBuffer;
+
 /*Image Object*/
 typedef struct
 {
     PyObject_HEAD
     ImageGeneric * image;
+    ImageBuffer * buffer; // Only set while data is exported to NumPy
 }
 ImageObject;
 
@@ -50,6 +62,17 @@ ImageObject;
 /* Destructor */
 void Image_dealloc(ImageObject* self);
 
+/* Allocate an Image object wrapping the given ImageGeneric */
+ImageObject *
+Image_create(ImageGeneric * image = NULL);
+
+/* Give the image its own data if NumPy views of it are alive.
+ * Should be called before any operation that could reallocate,
+ * resize or change the type of the image data. If keepData is false
+ * the image will be empty (useful before reading).
+ */
+void Image_detachViews(ImageObject * self, bool keepData = true);
+
 /* Constructor */
 PyObject *
 Image_new(PyTypeObject *type, PyObject *args, PyObject *kwargs);
@@ -219,6 +219,103 @@ xmipp_getImageSize(PyObject *obj, PyObject *args, PyObject *kwargs)
     return NULL;
 }
 
+/** Read n consecutive images of a stack, starting at first,
+ * into contiguous memory. Only one image is in memory at a time.
+ */
+template <typename T>
+void readStackImages(const FileName &fn, size_t first, size_t n, size_t imageSize, T * data)
+{
+    Image<T> img;
+    for (size_t i = 0; i < n; ++i, data += imageSize)
+    {
+        img.read(fn, DATA, first + i);
+        if (MULTIDIM_SIZE(img()) != imageSize)
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, formatString("readStack: image %lu of %s has not the expected size",
+                         first + i, fn.c_str()));
+        memcpy(data, MULTIDIM_ARRAY(img()), imageSize * sizeof(T));
+    }
+}
+
+/* readStack */
+PyObject *
+xmipp_readStack(PyObject *obj, PyObject *args, PyObject *kwargs)
+{
+    PyObject *pyValue, *pyArray = Py_None;
+    size_t first = FIRST_IMAGE;
+
+    if (PyArg_ParseTuple(args, "O|Ok", &pyValue, &pyArray, &first))
+    {
+        PyArrayObject * arr = NULL;
+        try
+        {
+            PyObject * pyStr = PyObject_Str(pyValue);
+            if (pyStr == NULL)
+                return NULL;
+            FileName fn = PyString_AsString(pyStr);
+            Py_DECREF(pyStr);
+            size_t xdim, ydim, zdim, ndim;
+            {
+                ReleaseGIL nogil;
+                getImageSize(fn, xdim, ydim, zdim, ndim);
+            }
+            if (first < FIRST_IMAGE || first > ndim)
+            {
+                PyErr_SetString(PyExc_IndexError, "readStack: first image out of the stack");
+                return NULL;
+            }
+            // Arrays are N x Y x X for 2D images and N x Z x Y x X for volumes
+            int nd = (zdim > 1) ? 4 : 3;
+            npy_intp dims[4];
+            dims[0] = ndim - first + 1;
+            dims[1] = zdim;
+            dims[nd - 2] = ydim;
+            dims[nd - 1] = xdim;
+
+            if (pyArray == Py_None)
+            {
+                if ((arr = (PyArrayObject*) PyArray_SimpleNew(nd, dims, NPY_FLOAT)) == NULL)
+                    return NULL;
+            }
+            else
+            {
+                // Fill the given array, it may hold less images than the stack
+                arr = (PyArrayObject*) pyArray;
+                bool valid = PyArray_Check(pyArray) && PyArray_ISCARRAY(arr) &&
+                             (PyArray_TYPE(arr) == NPY_FLOAT || PyArray_TYPE(arr) == NPY_DOUBLE) &&
+                             PyArray_NDIM(arr) == nd && PyArray_DIM(arr, 0) <= dims[0];
+                for (int i = 1; valid && i < nd; ++i)
+                    valid = PyArray_DIM(arr, i) == dims[i];
+                if (!valid)
+                {
+                    PyErr_SetString(PyExc_ValueError,
+                                    "readStack: Expected a writable contiguous float32 or float64 array "
+                                    "with the images dimensions");
+                    return NULL;
+                }
+                Py_INCREF(arr);
+            }
+
+            size_t n = PyArray_DIM(arr, 0), imageSize = xdim * ydim * zdim;
+            void * data = PyArray_DATA(arr);
+            bool isFloat = PyArray_TYPE(arr) == NPY_FLOAT;
+            {
+                ReleaseGIL nogil;
+                if (isFloat)
+                    readStackImages(fn, first, n, imageSize, (float*) data);
+                else
+                    readStackImages(fn, first, n, imageSize, (double*) data);
+            }
+            return (PyObject*) arr;
+        }
+        catch (XmippError &xe)
+        {
+            Py_XDECREF(arr);
+            PyErr_SetString(PyXmippError, xe.msg.c_str());
+        }
+    }
+    return NULL;
+}
+
 PyObject * xmipp_MetaDataInfo(PyObject *obj, PyObject *args, PyObject *kwargs)
 {
     PyObject *pyValue; //Only used to skip label and value
@@ -680,8 +777,12 @@ xmipp_fastEstimateEnhancedPSD(PyObject *obj, PyObject *args, PyObject *kwargs)
             if (validateInputImageString(pyImage, pyStrFn, fn))
             {
                 MultidimArray<double> data;
-                fastEstimateEnhancedPSD(fn, downsampling, data, Nthreads);
-                selfScaleToSize(LINEAR, data, dim, dim);
+                {
+                    ReleaseGIL nogil;
+                    fastEstimateEnhancedPSD(fn, downsampling, data, Nthreads);
+                    selfScaleToSize(LINEAR, data, dim, dim);
+                }
+                Image_detachViews((ImageObject*) pyImage, false);
                 Image_Value(pyImage).setDatatype(DT_Double);
                 Image_Value(pyImage).data->setImage(data);
                 Py_RETURN_NONE;
@@ -699,8 +800,10 @@ xmipp_fastEstimateEnhancedPSD(PyObject *obj, PyObject *args, PyObject *kwargs)
 try {\
 if (validateInputImageString(pyImage, pyStrFn, fn)) {\
 Image<double> img;\
-img.read(fn);\
 MultidimArray<double> &data = MULTIDIM_ARRAY(img);\
+{\
+ReleaseGIL nogil;\
+img.read(fn);\
 ArrayDim idim;\
 data.getDimensions(idim);
 
@@ -710,6 +813,8 @@ if (x > y) h = y * (dim/x);\
 else if (y > x)\
   w = x * (dim/y);\
 selfScaleToSize(LINEAR, data, w, h);\
+}\
+Image_detachViews((ImageObject*) pyImage, false);\
 Image_Value(pyImage).setDatatype(DT_Double);\
 data.resetOrigin();\
 MULTIDIM_ARRAY_GENERIC(Image_Value(pyImage)).setImage(data);\
@@ -1054,6 +1159,8 @@ xmipp_methods[] =
           METH_VARARGS, "create empty stack (speed up things)" },
         { "getImageSize", (PyCFunction) xmipp_getImageSize,
           METH_VARARGS, "Get image dimensions" },
+        { "readStack", (PyCFunction) xmipp_readStack, METH_VARARGS,
+          "Read images of a stack into a NumPy array (N x Y x X), optionally given and starting at first image" },
         { "MetaDataInfo", (PyCFunction) xmipp_MetaDataInfo, METH_VARARGS,
           "Get image dimensions of first metadata entry and the number of entries" },
         { "existsBlockInMetaDataFile", (PyCFunction) xmipp_existsBlockInMetaDataFile, METH_VARARGS,
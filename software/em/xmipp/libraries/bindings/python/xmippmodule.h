@@ -50,6 +50,28 @@
 
 extern PyObject * PyXmippError;
 
+/** Release the Python interpreter lock (GIL) while in scope.
+ * Use it around file I/O and heavy computations, so other Python
+ * threads can run concurrently. No Python API calls are allowed
+ * in the scope. The lock is acquired again on destruction, also
+ * when an exception is thrown, so errors can be reported as usual.
+ * See: https://docs.python.org/2.7/c-api/init.html for details.
+ */
+class ReleaseGIL
+{
+public:
+    ReleaseGIL()
+    {
+        state = PyEval_SaveThread();
+    }
+    ~ReleaseGIL()
+    {
+        PyEval_RestoreThread(state);
+    }
+private:
+    PyThreadState * state;
+};
+
 #define SymList_Check(v) (((v)->ob_type == &SymListType))
 #define SymList_Value(v)  ((*((SymListObject*)(v))->symlist))
 
@@ -87,6 +109,10 @@ xmipp_createEmptyFile(PyObject *obj, PyObject *args, PyObject *kwargs);
 PyObject *
 xmipp_getImageSize(PyObject *obj, PyObject *args, PyObject *kwargs);
 
+/* Read images of a stack into a NumPy array */
+PyObject *
+xmipp_readStack(PyObject *obj, PyObject *args, PyObject *kwargs);
+
 /* ImgSize (from metadata filename)*/
 PyObject *
 xmipp_ImgSize(PyObject *obj, PyObject *args, PyObject *kwargs);
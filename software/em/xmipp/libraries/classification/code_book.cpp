@@ -29,6 +29,7 @@
 
 
 #include "code_book.h"
+#include "feature_matrix.h"
 #include <data/xmipp_funcs.h>
 
 /**
@@ -229,6 +230,31 @@ unsigned CodeBook::winner(const ClassicTrainingVectors& _ts, unsigned _in) const
 }
 
 
+/* Closest code vector to each input, with the same criterion as testIndex */
+class WinnerBody: public DistanceRowsBody
+{
+public:
+    std::vector<unsigned> winners;
+    std::vector<double> distances;
+
+    void processRow(size_t j, double *d, int thread_id)
+    {
+        unsigned bestIndex = 0;
+        double bestDist = sqrt(d[0]);
+        for (size_t i = 1; i < C->rows; i++)
+        {
+            double dist = sqrt(d[i]);
+            if (dist < bestDist)
+            {
+                bestDist = dist;
+                bestIndex = i;
+            }
+        }
+        winners[j] = bestIndex;
+        distances[j] = bestDist;
+    }
+};
+
 /**
  * Fills the classifVectors with the list of the best input vectors associated to it.
  * Parameter: _ts  Sample list to classify
@@ -239,14 +265,22 @@ void CodeBook::classify(const ClassicTrainingVectors* _ts)
     classifVectors.resize(size());
     aveDistances.clear(); // clear previous classification.
     aveDistances.resize(size());
+
+    FeatureMatrix X, V;
+    X.fromVectors(_ts->theItems);
+    V.fromVectors(theItems);
+    WinnerBody body;
+    body.winners.resize(_ts->size());
+    body.distances.resize(_ts->size());
+    body.run(X, V);
     for (unsigned j = 0 ; j < _ts->size() ; j++)
-        classifVectors[testIndex(_ts->theItems[j])].push_back(j);
+        classifVectors[body.winners[j]].push_back(j);
 
     for (unsigned i = 0 ; i < size() ; i++)
     {
         double aveDist = 0;
         for (unsigned j = 0 ; j < classifVectors[i].size() ; j++)
-            aveDist += euclideanDistance(theItems[i], _ts->theItems[classifVectors[i][j]]);
+            aveDist += body.distances[classifVectors[i][j]];
         if (classifVectors[i].size() != 0)
             aveDist /= (double) classifVectors[i].size();
         aveDistances[i] = (double) aveDist;
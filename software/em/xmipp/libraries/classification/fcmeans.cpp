@@ -28,6 +28,7 @@
 //-----------------------------------------------------------------------------
 
 #include "fcmeans.h"
+#include "feature_matrix.h"
 
 /**  Ctor from stream
  * Parameter: _is Must have the parameters in the same order than the previous ctor.
@@ -66,22 +67,28 @@ void FuzzyCMeans::train(FuzzyCodeBook& _xmippDS, TS& _examples) const
     // Create auxiliar stuff
 
     unsigned numClusters = _xmippDS.size();
-    unsigned numVectors = _examples.size();
-    unsigned i, j, k;
+    unsigned i, j;
     double stopError = 0, auxError = 0;
-    double auxDist, auxProd, tmp, auxExp, auxSum;
     unsigned t = 0;  // Iteration index
-    FeatureVector zero(_xmippDS.theItems[0].size()) ;
-    fill(zero.begin(), zero.end(), 0.0);
+    unsigned dim = _xmippDS.theItems[0].size();
+
+    // Packed training vectors and code vectors
+    FeatureMatrix X, V;
+    X.fromVectors(_examples.theItems);
+    std::vector< std::vector<double> > S;
+    std::vector<double> dens;
 
 
     // Initialize auxiliary Codebook
 
     auxCB = _xmippDS;
 
-    // Set auxExp
+    // Memberships are computed from squared distances, so the exponent
+    // 2/(m-1) of the euclidean distances becomes 1/(m-1)
 
-    auxExp = 2 / (m - 1);
+    FuzzyMembershipBody membBody;
+    membBody.memb = &(_xmippDS.memb);
+    membBody.exponent = 1 / (m - 1);
 
     // This is the main code of the algorithm. Iterates "epochs" times
 
@@ -93,51 +100,19 @@ void FuzzyCMeans::train(FuzzyCodeBook& _xmippDS, TS& _examples) const
 
         // Update Membership matrix
 
-        for (k = 0; k < numVectors; k++)
-        {
-
-            auxProd = 1;
-            for (j = 0; j < numClusters; j++)
-                auxProd *= euclideanDistance(_xmippDS.theItems[j], _examples.theItems[k]);
-
-            if (auxProd == 0.)
-            { // Apply k-means criterion (Data-CB) must be > 0
-                for (j = 0; j < numClusters; j ++)
-                    if (euclideanDistance(_xmippDS.theItems[j], _examples.theItems[k]) == 0.)
-                        _xmippDS.memb[k][j] = 1.0;
-                    else
-                        _xmippDS.memb[k][j] =  0.0;
-            }
-            else
-            {
-                for (i = 0; i < numClusters; i ++)
-                {
-                    auxDist = 0;
-                    for (j = 0; j < numClusters; j ++)
-                    {
-                        tmp = euclideanDistance(_xmippDS.theItems[i], _examples.theItems[k]) /
-                              euclideanDistance(_xmippDS.theItems[j], _examples.theItems[k]);
-                        auxDist += pow(tmp, auxExp);
-                    } // for j
-                    _xmippDS.memb[k][i] = (floatFeature) 1.0 / auxDist;
-                } // for i
-            } // if auxProd
-        } // for k
+        V.fromVectors(_xmippDS.theItems);
+        membBody.run(X, V);
 
 
         // Update code vectors (Cluster Centers)
 
+        weightedSums(X, _xmippDS.memb, m, S, dens);
         for (i = 0; i < numClusters; i++)
         {
-            _xmippDS.theItems[i] = zero;
-            auxSum = 0;
-            for (k = 0; k < numVectors; k++)
-            {
-                _xmippDS.theItems[i] += (floatFeature) pow((double)(_xmippDS.memb[k][i]), m) * _examples.theItems[k];
-                auxSum += pow((double)(_xmippDS.memb[k][i]), m);
-            } // for i
-            _xmippDS.theItems[i] /= (floatFeature) auxSum;
-        } // for k
+            floatFeature *ptrItem = &(_xmippDS.theItems[i][0]);
+            for (j = 0; j < dim; j++)
+                ptrItem[j] = (floatFeature)(S[i][j] / dens[i]);
+        } // for i
 
         // Compute stopping criterion
         stopError = 0;
@@ -0,0 +1,267 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+//-----------------------------------------------------------------------------
+// FeatureMatrix.cc
+// Contiguous storage of feature vectors and distance kernels
+//-----------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "feature_matrix.h"
+#include <data/xmipp_error.h>
+
+// Rows of X processed by each call to squaredDistances in DistanceRowsBody
+#define DISTANCE_ROWS_BLOCK 64
+
+FeatureMatrix::FeatureMatrix()
+{
+    rows = cols = stride = 0;
+    data = NULL;
+}
+
+FeatureMatrix::~FeatureMatrix()
+{
+    clear();
+}
+
+void FeatureMatrix::clear()
+{
+    free(data);
+    data = NULL;
+    rows = cols = stride = 0;
+}
+
+void FeatureMatrix::resize(size_t _rows, size_t _cols)
+{
+    const size_t align = FEATURE_MATRIX_ALIGN / sizeof(floatFeature);
+    size_t _stride = ((_cols + align - 1) / align) * align;
+    if (_rows * _stride != rows * stride)
+    {
+        clear();
+        void *ptr = NULL;
+        if (_rows * _stride > 0 &&
+            posix_memalign(&ptr, FEATURE_MATRIX_ALIGN, _rows * _stride * sizeof(floatFeature)) != 0)
+            REPORT_ERROR(ERR_MEM_NOTENOUGH, "FeatureMatrix::resize: No space left");
+        data = (floatFeature *) ptr;
+    }
+    rows = _rows;
+    cols = _cols;
+    stride = _stride;
+    if (data != NULL)
+        memset(data, 0, rows * stride * sizeof(floatFeature));
+}
+
+void FeatureMatrix::fromVectors(const std::vector<FeatureVector> &_v)
+{
+    resize(_v.size(), _v.empty() ? 0 : _v[0].size());
+    for (size_t i = 0; i < rows; i++)
+    {
+        if (_v[i].size() != cols)
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, "FeatureMatrix::fromVectors: vectors of different size");
+        if (cols > 0)
+            memcpy(row(i), &(_v[i][0]), cols * sizeof(floatFeature));
+    }
+}
+
+void squaredDistances(const FeatureMatrix &X, size_t first, size_t last,
+                      const FeatureMatrix &C, double *D)
+{
+    const size_t dim = X.cols, nc = C.rows, xs = X.stride;
+    size_t i = first;
+    // Blocks of 4 vectors, each code vector is compared to all of them
+    for (; i + 3 <= last; i += 4)
+    {
+        const floatFeature *x0 = X.row(i), *x1 = x0 + xs, *x2 = x1 + xs, *x3 = x2 + xs;
+        double *d0 = D + (i - first) * nc, *d1 = d0 + nc, *d2 = d1 + nc, *d3 = d2 + nc;
+        for (size_t c = 0; c < nc; c++)
+        {
+            const floatFeature *y = C.row(c);
+            double r0 = 0, r1 = 0, r2 = 0, r3 = 0;
+            for (size_t j = 0; j < dim; j++)
+            {
+                double yj = (double) y[j];
+                double t0 = (double) x0[j] - yj;
+                double t1 = (double) x1[j] - yj;
+                double t2 = (double) x2[j] - yj;
+                double t3 = (double) x3[j] - yj;
+                r0 += t0 * t0;
+                r1 += t1 * t1;
+                r2 += t2 * t2;
+                r3 += t3 * t3;
+            }
+            d0[c] = r0;
+            d1[c] = r1;
+            d2[c] = r2;
+            d3[c] = r3;
+        }
+    }
+    for (; i <= last; i++)
+    {
+        const floatFeature *x = X.row(i);
+        double *d = D + (i - first) * nc;
+        for (size_t c = 0; c < nc; c++)
+        {
+            const floatFeature *y = C.row(c);
+            double r = 0;
+            for (size_t j = 0; j < dim; j++)
+            {
+                double t = (double) x[j] - (double) y[j];
+                r += t * t;
+            }
+            d[c] = r;
+        }
+    }
+}
+
+/* Weighted sums of a range of rows into per thread accumulators */
+class WeightedSumsBody: public ParallelForBody
+{
+public:
+    const FeatureMatrix *X;
+    const std::vector< std::vector<floatFeature> > *U;
+    double m;
+    size_t nc;
+    std::vector< std::vector<double> > S, dens;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        const size_t dim = X->cols;
+        std::vector<double> &St = S[thread_id], &denst = dens[thread_id];
+        if (St.empty())
+        {
+            St.resize(nc * dim, 0.);
+            denst.resize(nc, 0.);
+        }
+        double *ptrS = &St[0];
+        for (size_t v = first; v <= last; v++)
+        {
+            const floatFeature *x = X->row(v);
+            const floatFeature *u = &((*U)[v][0]);
+            for (size_t c = 0; c < nc; c++)
+            {
+                double w = (m == 1) ? (double) u[c] : pow((double) u[c], m);
+                if (w == 0)
+                    continue;
+                denst[c] += w;
+                double *s = ptrS + c * dim;
+                for (size_t j = 0; j < dim; j++)
+                    s[j] += w * (double) x[j];
+            }
+        }
+    }
+};
+
+void weightedSums(const FeatureMatrix &X, const std::vector< std::vector<floatFeature> > &U,
+                  double m, std::vector< std::vector<double> > &S, std::vector<double> &dens)
+{
+    WeightedSumsBody body;
+    body.X = &X;
+    body.U = &U;
+    body.m = m;
+    body.nc = U.empty() ? 0 : U[0].size();
+    int nThreads = ThreadPool::getInstance().getNumberOfThreads() + 1;
+    body.S.resize(nThreads);
+    body.dens.resize(nThreads);
+    if (X.rows > 0)
+        ThreadPool::getInstance().parallelFor(0, X.rows - 1, body, 256);
+
+    S.resize(body.nc);
+    dens.assign(body.nc, 0.);
+    for (size_t c = 0; c < body.nc; c++)
+        S[c].assign(X.cols, 0.);
+    for (int t = 0; t < nThreads; t++)
+    {
+        if (body.S[t].empty())
+            continue;
+        const double *ptrS = &(body.S[t][0]);
+        for (size_t c = 0; c < body.nc; c++, ptrS += X.cols)
+        {
+            dens[c] += body.dens[t][c];
+            double *s = &(S[c][0]);
+            for (size_t j = 0; j < X.cols; j++)
+                s[j] += ptrS[j];
+        }
+    }
+}
+
+double DistanceRowsBody::run(const FeatureMatrix &_X, const FeatureMatrix &_C)
+{
+    X = &_X;
+    C = &_C;
+    int nThreads = ThreadPool::getInstance().getNumberOfThreads() + 1;
+    partialSums.assign(nThreads, 0.);
+    scratch.resize(nThreads);
+    for (int t = 0; t < nThreads; t++)
+        scratch[t].resize(C->rows);
+    if (X->rows > 0)
+        ThreadPool::getInstance().parallelFor(0, X->rows - 1, *this, DISTANCE_ROWS_BLOCK);
+    double sum = 0;
+    for (int t = 0; t < nThreads; t++)
+        sum += partialSums[t];
+    return sum;
+}
+
+void DistanceRowsBody::operator()(size_t first, size_t last, int thread_id)
+{
+    std::vector<double> D(DISTANCE_ROWS_BLOCK * C->rows);
+    for (size_t i0 = first; i0 <= last; i0 += DISTANCE_ROWS_BLOCK)
+    {
+        size_t i1 = std::min(last, i0 + DISTANCE_ROWS_BLOCK - 1);
+        squaredDistances(*X, i0, i1, *C, &D[0]);
+        for (size_t i = i0; i <= i1; i++)
+            processRow(i, &D[(i - i0) * C->rows], thread_id);
+    }
+}
+
+void FuzzyMembershipBody::processRow(size_t v, double *d, int thread_id)
+{
+    floatFeature *ptrMemb = &((*memb)[v][0]);
+    const size_t nc = C->rows;
+    bool coincident = false;
+    for (size_t j = 0; j < nc; j++)
+        if (d[j] == 0.)
+        {
+            coincident = true;
+            break;
+        }
+    if (coincident)
+    { // Apply k-means criterion (Data-CB) must be > 0
+        for (size_t j = 0; j < nc; j++)
+            ptrMemb[j] = (d[j] == 0.) ? 1.0 : 0.0;
+        return;
+    }
+    double auxSum = 0;
+    for (size_t j = 0; j < nc; j++)
+    {
+        d[j] = (exponent == 1.) ? d[j] : pow(d[j], exponent);
+        auxSum += 1. / d[j];
+    }
+    for (size_t i = 0; i < nc; i++)
+        ptrMemb[i] = (floatFeature)(1.0 / (d[i] * auxSum));
+}
@@ -0,0 +1,179 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+//-----------------------------------------------------------------------------
+// FeatureMatrix.h
+// Contiguous storage of feature vectors and distance kernels
+//-----------------------------------------------------------------------------
+
+#ifndef XMIPPFEATUREMATRIX_H
+#define XMIPPFEATUREMATRIX_H
+
+#include <vector>
+
+#include "data_types.h"
+#include <data/xmipp_threads.h>
+
+/**@defgroup FeatureMatrix Contiguous feature matrix
+   @ingroup ClassificationLibrary */
+//@{
+
+/// Alignment in bytes of the rows of a FeatureMatrix
+#define FEATURE_MATRIX_ALIGN 32
+
+/**
+ * Set of feature vectors stored as a contiguous row-major float matrix.
+ * Rows are padded with zeros to a multiple of FEATURE_MATRIX_ALIGN bytes
+ * and start at aligned addresses. The training algorithms pack the training
+ * vectors and the code vectors in this format before computing distances,
+ * so that the kernels below run over contiguous memory.
+ */
+class FeatureMatrix
+{
+public:
+    /// Number of vectors
+    size_t rows;
+    /// Number of features of each vector
+    size_t cols;
+    /// Number of elements between the start of consecutive rows
+    size_t stride;
+    /// Aligned data
+    floatFeature * data;
+
+    /// Empty constructor
+    FeatureMatrix();
+
+    /// Destructor
+    ~FeatureMatrix();
+
+    /// Resize, previous content is lost and the matrix is set to 0
+    void resize(size_t _rows, size_t _cols);
+
+    /// Free the memory
+    void clear();
+
+    /// Copy a set of vectors of the same size
+    void fromVectors(const std::vector<FeatureVector> &_v);
+
+    /// Pointer to the beginning of a row
+    inline const floatFeature * row(size_t i) const
+    {
+        return data + i * stride;
+    }
+
+    /// Pointer to the beginning of a row
+    inline floatFeature * row(size_t i)
+    {
+        return data + i * stride;
+    }
+
+private:
+    FeatureMatrix(const FeatureMatrix &);
+    FeatureMatrix & operator=(const FeatureMatrix &);
+};
+
+/**
+ * Squared euclidean distances between the rows first..last of X and all
+ * the rows of C. D is a (last-first+1) x C.rows row-major matrix.
+ * Blocks of rows of X are compared with each row of C, so that every code
+ * vector is loaded once per block. Differences are accumulated in double
+ * precision in the same order as euclideanDistance, so the results are
+ * the square of its results. This fixed order is not reordered by the
+ * compiler without -ffast-math, so each sum is not vectorized.
+ */
+void squaredDistances(const FeatureMatrix &X, size_t first, size_t last,
+                      const FeatureMatrix &C, double *D);
+
+/**
+ * Weighted sums of the rows of X (the W^t X product used to update the
+ * code vectors). For every code vector c
+ * S[c][j] = sum_v w(v,c) X(v,j) and dens[c] = sum_v w(v,c),
+ * where w(v,c) = U[v][c]^m. The rows of X are split among the threads
+ * of the pool, each one accumulates into its own copy of S and dens.
+ * S and dens are resized to U[0].size() x X.cols and U[0].size().
+ */
+void weightedSums(const FeatureMatrix &X, const std::vector< std::vector<floatFeature> > &U,
+                  double m, std::vector< std::vector<double> > &S, std::vector<double> &dens);
+
+/**
+ * Parallel loop over the rows of a matrix and their distances to a set
+ * of code vectors. Subclasses implement processRow, that receives the
+ * squared distances from the row to all the code vectors. Rows are
+ * processed in blocks by the threads of the pool, so processRow must
+ * only write data of its row. Each thread has a partial sum and a
+ * scratch vector of C.rows elements, run() returns the total sum.
+ * @code
+ * class NearestBody: public DistanceRowsBody
+ * {
+ *     void processRow(size_t i, double *d, int thread_id)
+ *     {
+ *         ...
+ *         partialSums[thread_id] += d[best];
+ *     }
+ * };
+ * NearestBody body;
+ * double total = body.run(X, C);
+ * @endcode
+ */
+class DistanceRowsBody: public ParallelForBody
+{
+public:
+    /// Per thread partial sums
+    std::vector<double> partialSums;
+    /// Per thread scratch (C.rows elements each)
+    std::vector< std::vector<double> > scratch;
+
+    /// Process all rows of X. Returns the sum of partialSums
+    double run(const FeatureMatrix &X, const FeatureMatrix &C);
+
+    /** Process row i of X, d are its squared distances to the rows of C.
+     * d can be modified.
+     */
+    virtual void processRow(size_t i, double *d, int thread_id) = 0;
+
+    void operator()(size_t first, size_t last, int thread_id);
+
+protected:
+    const FeatureMatrix *X, *C;
+};
+
+/**
+ * Fuzzy c-means memberships from the squared distances d to the code
+ * vectors: memb[v][i] = 1 / sum_j (d_i/d_j)^exponent, evaluated as
+ * 1 / (d_i^exponent sum_j d_j^-exponent). If the vector coincides with
+ * some code vectors, they get membership 1 and the rest 0 (k-means
+ * criterion).
+ */
+class FuzzyMembershipBody: public DistanceRowsBody
+{
+public:
+    std::vector< std::vector<floatFeature> > *memb;
+    double exponent;
+
+    void processRow(size_t v, double *d, int thread_id);
+};
+//@}
+
+#endif//XMIPPFEATUREMATRIX_H
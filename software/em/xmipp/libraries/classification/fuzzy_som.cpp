@@ -108,6 +108,7 @@ void FuzzySOM::train(FuzzyMap& _som, const TS& _examples)
         tmpMap[i].resize(dim, 0.);
 
     tmpD.resize(numNeurons);
+    X.fromVectors(_examples.theItems);
     double stopError;
 
     int verbosity = listener->getVerbosity();
@@ -186,7 +187,8 @@ void FuzzySOM::train(FuzzyMap& _som, const TS& _examples)
     tmpDens.clear();
     tmpMap.clear();
     tmpD.clear();
-
+    X.clear();
+    V.clear();
 }
 
 
@@ -228,46 +230,50 @@ double FuzzySOM::test(const FuzzyMap& _som, const TS& _examples) const
 
 
 //-----------------------------------------------------------------------------
-/**
- * Update Fuzzy Memberships
- */
-double FuzzySOM::updateU(FuzzyMap& _som, const TS& _examples, const double& _m)
+/* Fuzzy memberships of each vector and their variation */
+class FuzzySOMMembershipBody: public DistanceRowsBody
 {
+public:
+    FuzzyMap *som;
+    double auxExp;
 
-    // Create auxiliar stuff
-
-    unsigned i, j, k;
-    double var = 0;
-    double auxDist, auxProd, auxExp;
-
-    auxExp = 1. / (_m - 1.);
-    // Update Membership matrix
-
-    for (k = 0; k < numVectors; k++)
+    void processRow(size_t k, double *d, int thread_id)
     {
-        auxProd = 0;
-        for (i = 0; i < numNeurons; i ++)
+        const size_t numNeurons = C->rows;
+        double auxProd = 0;
+        for (size_t i = 0; i < numNeurons; i ++)
         {
-            auxDist = 0;
-            for (j = 0; j < dim; j++)
-                auxDist += (double)((double)(_examples.theItems[k][j]) - (double)(_som.theItems[i][j])) * ((double)(_examples.theItems[k][j]) - (double)(_som.theItems[i][j]));
-            auxDist = pow(auxDist, auxExp);
+            double auxDist = pow(d[i], auxExp);
             if (!finite(auxDist))
                 auxDist = MAXFLOAT;
             if (auxDist < MAXZERO)
                 auxDist = MAXZERO;
             auxProd += (double) 1. / auxDist;
-            tmpD[i] = auxDist;
+            d[i] = auxDist;
         }
-        for (j = 0; j < numNeurons; j ++)
+        floatFeature *ptrMemb = &(som->memb[k][0]);
+        double var = 0;
+        for (size_t j = 0; j < numNeurons; j ++)
         {
-            double tmp =  1. / (auxProd * tmpD[j]);
-            var += fabs((double)(_som.memb[k][j]) - tmp);
-            _som.memb[k][j] = (floatFeature) tmp;
+            double tmp =  1. / (auxProd * d[j]);
+            var += fabs((double)(ptrMemb[j]) - tmp);
+            ptrMemb[j] = (floatFeature) tmp;
         }
+        partialSums[thread_id] += var;
+    }
+};
 
-
-    } // for k
+/**
+ * Update Fuzzy Memberships
+ */
+double FuzzySOM::updateU(FuzzyMap& _som, const TS& _examples, const double& _m)
+{
+    // Update Membership matrix
+    FuzzySOMMembershipBody body;
+    body.som = &_som;
+    body.auxExp = 1. / (_m - 1.);
+    V.fromVectors(_som.theItems);
+    double var = body.run(X, V);
 
     var /= (double) numNeurons * numVectors;
 
@@ -282,25 +288,13 @@ double FuzzySOM::updateU(FuzzyMap& _som, const TS& _examples, const double& _m)
  */
 void FuzzySOM::updateV(FuzzyMap& _som, const TS& _examples, const double& _m)
 {
-    unsigned j, cc, vv;
+    unsigned j, cc;
     unsigned t2 = 0;  // Iteration index
 
     // Calculate Temporal scratch values
+    weightedSums(X, _som.memb, _m, tmpMap, tmpDens);
     for (cc = 0; cc < numNeurons; cc++)
-    {
-        for (j = 0; j < dim; j++)
-            tmpMap[cc][j] = 0.;
-        tmpDens[cc] = reg;
-        for (vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = (double) pow((double)(_som.memb[vv][cc]), (double)_m);
-            tmpDens[cc] += tmpU;
-            for (j = 0; j < dim; j++)
-            {
-                tmpMap[cc][j] += (double)((double) tmpU * (double)(_examples.theItems[vv][j]));
-            }
-        }
-    }
+        tmpDens[cc] += reg;
 
 
     // Update Code vectors using a sort of Gauss-Seidel iterative algorithm.
@@ -336,23 +330,43 @@ void FuzzySOM::updateV(FuzzyMap& _som, const TS& _examples, const double& _m)
  * Determines the functional value
  * Returns the fidelity to the data and penalty parts of the functional
  */
-double FuzzySOM::functional(const TS& _examples, const FuzzyMap& _som, double _m, double _reg, double& _fidelity, double& _penalty)
+/* Weighted distances of each vector to the code vectors */
+class FuzzySOMFidelityBody: public DistanceRowsBody
 {
-    unsigned j, vv, cc;
-    double t, t1, t2 = 0;
-    _fidelity = 0;
-    for (vv = 0; vv < numVectors; vv++)
+public:
+    const FuzzyMap *som;
+    double m;
+    std::vector<double> partialWeights;
+
+    void processRow(size_t vv, double *d, int thread_id)
     {
-        for (cc = 0; cc < numNeurons; cc++)
+        const floatFeature *ptrMemb = &(som->memb[vv][0]);
+        double fidelity = 0, weight = 0;
+        for (size_t cc = 0; cc < C->rows; cc++)
         {
-            t = 0;
-            for (size_t j = 0; j < dim; j++)
-                t += ((double)(_examples.theItems[vv][j]) - (double)(_som.theItems[cc][j])) * ((double)(_examples.theItems[vv][j]) - (double)(_som.theItems[cc][j]));
-            t1 = (double) pow((double)_som.memb[vv][cc], (double) _m);
-            t2 += t1;
-            _fidelity += t1 * t;
+            double t1 = (double) pow((double)ptrMemb[cc], m);
+            weight += t1;
+            fidelity += t1 * d[cc];
         }
+        partialSums[thread_id] += fidelity;
+        partialWeights[thread_id] += weight;
     }
+};
+
+double FuzzySOM::functional(const TS& _examples, const FuzzyMap& _som, double _m, double _reg, double& _fidelity, double& _penalty)
+{
+    unsigned j, cc;
+    FuzzySOMFidelityBody body;
+    body.som = &_som;
+    body.m = _m;
+    body.partialWeights.assign(ThreadPool::getInstance().getNumberOfThreads() + 1, 0.);
+    FeatureMatrix packedExamples, packedCodes;
+    packedExamples.fromVectors(_examples.theItems);
+    packedCodes.fromVectors(_som.theItems);
+    _fidelity = body.run(packedExamples, packedCodes);
+    double t2 = 0;
+    for (size_t t = 0; t < body.partialWeights.size(); t++)
+        t2 += body.partialWeights[t];
     _fidelity /= t2;
     _penalty = 0;
 
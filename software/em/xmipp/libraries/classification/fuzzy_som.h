@@ -33,6 +33,7 @@
 
 #include "base_algorithm.h"
 #include "map.h"
+#include "feature_matrix.h"
 
 /**@defgroup SmoothFuzzyCmeans Smoothly Distributed Fuzzy c-means Self-Organizing Map algorithm
    @ingroup ClassificationLibrary */
@@ -149,6 +150,7 @@ private:
     unsigned dim;
     std::vector<double> tmpV, tmpD, tmpDens;
     std::vector < std::vector<double> > tmpMap;
+    FeatureMatrix X, V;  // Packed training vectors and code vectors
 
     void showX(const TS& _ts);
 
@@ -60,6 +60,8 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
         tmpMap[i].resize(dim, 0.);
     tmpD.resize(numNeurons);
     tmpD1.resize(numNeurons);
+    packedExamples = NULL;
+    packExamples(&_examples);
     double stopError;
 
     int verbosity = listener->getVerbosity();
@@ -234,41 +236,28 @@ void GaussianKerDenSOM::train(FuzzyMap& _som, TS& _examples, FileName& _fn,
     tmpMap.clear();
     tmpD.clear();
     tmpD1.clear();
-
+    X.clear();
+    V.clear();
+    packedExamples = NULL;
 }
 
 //-----------------------------------------------------------------------------
-/**
- * Update the U (Membership)
- */
-double GaussianKerDenSOM::updateU(FuzzyMap* _som, const TS* _examples,
-		                          const double& _sigma, double& _alpha)
+/* Gaussian kernel memberships of each vector */
+class GaussianMembershipBody: public DistanceRowsBody
 {
-    // Create auxiliar stuff
-    double auxDist;
-    double rr2, max1, d1, tmp, r1;
-
-    double irr1 =1.0/( 2.0 * _sigma);
-    _alpha = 0;
+public:
+    FuzzyMap *som;
+    double irr1, idim;
 
-    // Update Membership matrix
-    double *ptrTmpD=&tmpD[0];
-    double *ptrTmpD1=&tmpD1[0];
-    double idim=1.0/dim;
-    for (size_t k = 0; k < numVectors; k++)
+    void processRow(size_t k, double *ptrTmpD, int thread_id)
     {
+        double rr2, max1, d1, tmp, r1;
+        const size_t numNeurons = C->rows;
+        double *ptrTmpD1 = &(scratch[thread_id][0]);
         max1 = -MAXFLOAT;
-        const floatFeature *ptrExample=&(_examples->theItems[k][0]);
         for (size_t i = 0; i < numNeurons; i ++)
         {
-            auxDist = 0;
-            const floatFeature *ptrCodeVector=&(_som->theItems[i][0]);
-            for (size_t j = 0; j < dim; j++)
-            {
-                double tmp=((double)ptrExample[j] - (double)ptrCodeVector[j]);
-                auxDist += tmp * tmp;
-            }
-            auxDist*=idim;
+            double auxDist = ptrTmpD[i] * idim;
             ptrTmpD[i] = auxDist;
             rr2 = -auxDist * irr1;
             ptrTmpD1[i] = rr2;
@@ -288,14 +277,31 @@ double GaussianKerDenSOM::updateU(FuzzyMap* _som, const TS* _examples,
         }
         double ir1=1.0/r1;
 
-        floatFeature *ptrSomMembK=&(_som->memb[k][0]);
+        floatFeature *ptrSomMembK=&(som->memb[k][0]);
+        double alpha = 0;
         for (size_t j = 0; j < numNeurons; j ++)
         {
             tmp = ptrTmpD1[j] * ir1;
             ptrSomMembK[j] = (floatFeature) tmp;
-            _alpha += tmp * ptrTmpD[j];
+            alpha += tmp * ptrTmpD[j];
         }
-    } // for k
+        partialSums[thread_id] += alpha;
+    }
+};
+
+/**
+ * Update the U (Membership)
+ */
+double GaussianKerDenSOM::updateU(FuzzyMap* _som, const TS* _examples,
+		                          const double& _sigma, double& _alpha)
+{
+    // Update Membership matrix
+    GaussianMembershipBody body;
+    body.som = _som;
+    body.irr1 = 1.0/( 2.0 * _sigma);
+    body.idim = 1.0/dim;
+    V.fromVectors(_som->theItems);
+    _alpha = body.run(packExamples(_examples), V);
     return 0.0;
 }
 
@@ -383,23 +389,44 @@ double GaussianKerDenSOM::dataDens(const TS* _examples, const FeatureVector* _ex
  * Determines the functional value
  * Returns the likelihood and penalty parts of the functional
  */
-double GaussianKerDenSOM::functional(const TS* _examples, const FuzzyMap* _som,
-		                             double _sigma, double _reg, double& _likelihood,
-		                             double& _penalty)
+/* Log likelihood of each vector, as in codeDens */
+class LogCodeDensBody: public DistanceRowsBody
 {
-    unsigned j, vv, cc;
-    double t;
-    _likelihood = 0;
-    for (vv = 0; vv < numVectors; vv++)
+public:
+    double K, factor;
+
+    void processRow(size_t vv, double *d, int thread_id)
     {
-        t = codeDens(_som, &(_examples->theItems[vv]), _sigma);
+        double s = 0;
+        for (size_t cc = 0; cc < C->rows; cc++)
+        {
+            double t = d[cc] * K;
+            if (t < MAXZ)
+                t = 0;
+            else
+                t = exp(t);
+            s += t;
+        }
+        double t = factor * s / C->rows;
         if (t == 0)
         {
             t = 1e-300;
         }
-        _likelihood += log(t);
+        partialSums[thread_id] += log(t);
     }
-    _likelihood = -_likelihood;
+};
+
+double GaussianKerDenSOM::functional(const TS* _examples, const FuzzyMap* _som,
+		                             double _sigma, double _reg, double& _likelihood,
+		                             double& _penalty)
+{
+    unsigned j, cc;
+    double t;
+    LogCodeDensBody body;
+    body.K = -1.0/(2*_sigma);
+    body.factor = std::pow(2*PI*_sigma, -0.5*dim);
+    V.fromVectors(_som->theItems);
+    _likelihood = -body.run(packExamples(_examples), V);
     _penalty = 0;
 
     if (_reg != 0)
@@ -109,6 +109,21 @@ double KerDenSOM::test(const FuzzyMap& _som, const TS& _examples) const
 //-----------------------------------------------------------------------------
 
 
+/**
+ * Packs the training vectors in X
+ */
+const FeatureMatrix & KerDenSOM::packExamples(const TS* _examples)
+{
+    if (_examples != packedExamples)
+    {
+        X.fromVectors(_examples->theItems);
+        packedExamples = _examples;
+    }
+    return X;
+}
+
+//-----------------------------------------------------------------------------
+
 /**
  * Update Code Vectors
  */
@@ -117,24 +132,10 @@ void KerDenSOM::updateV(FuzzyMap* _som, const TS* _examples, const double& _reg)
     unsigned t2 = 0;  // Iteration index
 
     // Calculate Temporal scratch values
-    for (size_t cc = 0; cc < numNeurons; cc++)
-    {
-    	double *ptrTmpMap_cc=&(tmpMap[cc][0]);
-    	memset(ptrTmpMap_cc,0,dim*sizeof(double));
-    	double &tmpDens_cc=tmpDens[cc];
-        if (_reg != 0)
-        	tmpDens_cc = _reg * _som->getLayout().numNeig(_som, (SomPos) _som->indexToPos(cc));
-        else
-        	tmpDens_cc = 0.;
-        for (size_t vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = (double) _som->memb[vv][cc];
-            tmpDens_cc += tmpU;
-            const floatFeature * ptrExample=&(_examples->theItems[vv][0]);
-            for (size_t j = 0; j < dim; j++)
-            	ptrTmpMap_cc[j] +=  tmpU * ptrExample[j];
-        }
-    }
+    weightedSums(packExamples(_examples), _som->memb, 1., tmpMap, tmpDens);
+    if (_reg != 0)
+        for (size_t cc = 0; cc < numNeurons; cc++)
+            tmpDens[cc] += _reg * _som->getLayout().numNeig(_som, (SomPos) _som->indexToPos(cc));
 
     // Update Code vectors using a sort of Gauss-Seidel iterative algorithm.
     // Usually 100 iterations are enough.
@@ -202,29 +203,30 @@ double KerDenSOM::mainIterations(FuzzyMap* _som, const TS* _examples, double& _s
 
 //-----------------------------------------------------------------------------
 
-// Estimate Sigma Part I
-double KerDenSOM::updateSigmaI(FuzzyMap* _som, const TS* _examples)
+/* Membership weighted distances to the code vectors */
+class SigmaIBody: public DistanceRowsBody
 {
-    double t = 0;
+public:
+    const FuzzyMap *som;
 
-    // Computing Sigma (Part I)
-    for (size_t vv = 0; vv < numVectors; vv++)
+    void processRow(size_t vv, double *d, int thread_id)
     {
-    	const FeatureVector &example=_examples->theItems[vv];
-    	const floatFeature *ptrExample0=&example[0];
-        for (size_t cc = 0; cc < numNeurons; cc++)
-        {
-            double r = 0.0;
-        	const floatFeature *ptrExample=ptrExample0;
-        	const floatFeature *ptrCodeVector=&(_som->theItems[cc][0]);
-            for (size_t j = 0; j < dim; j++)
-            {
-            	double diff=(double)(*ptrExample++) - (double)(*ptrCodeVector++);
-                r += diff*diff;
-            }
-            t += r * (double)(_som->memb[vv][cc]);
-        }
+        const floatFeature *ptrMemb = &(som->memb[vv][0]);
+        double t = 0;
+        for (size_t cc = 0; cc < C->rows; cc++)
+            t += d[cc] * (double)(ptrMemb[cc]);
+        partialSums[thread_id] += t;
     }
+};
+
+// Estimate Sigma Part I
+double KerDenSOM::updateSigmaI(FuzzyMap* _som, const TS* _examples)
+{
+    // Computing Sigma (Part I)
+    SigmaIBody body;
+    body.som = _som;
+    V.fromVectors(_som->theItems);
+    double t = body.run(packExamples(_examples), V);
     return (double)(t / (double)(numVectors*dim));
 }
 
@@ -240,27 +242,7 @@ double KerDenSOM::updateSigmaI(FuzzyMap* _som, const TS* _examples)
  */
 void KerDenSOM::updateV1(FuzzyMap* _som, const TS* _examples)
 {
-    for (size_t cc = 0; cc < numNeurons; cc++)
-    {
-    	std::vector<double> &tmpMap_cc=tmpMap[cc];
-    	double *ptrTmpMap_cc0=&tmpMap_cc[0];
-    	memset(ptrTmpMap_cc0,0,dim*sizeof(double));
-        double &tmpDens_cc=tmpDens[cc];
-        tmpDens_cc = 0.0;
-        for (size_t vv = 0; vv < numVectors; vv++)
-        {
-            double tmpU = _som->memb[vv][cc];
-            tmpDens_cc += tmpU;
-            const floatFeature *ptrExample=&(_examples->theItems[vv][0]);
-            double *ptrTmpMap_cc=ptrTmpMap_cc0;
-            for (size_t j = 0; j < dim; j++)
-            {
-            	*ptrTmpMap_cc += tmpU * (*ptrExample);
-            	++ptrExample;
-            	++ptrTmpMap_cc;
-            }
-        }
-    }
+    weightedSums(packExamples(_examples), _som->memb, 1., tmpMap, tmpDens);
 
     for (size_t cc = 0; cc < numNeurons; cc++)
     {
@@ -281,40 +263,12 @@ void KerDenSOM::updateV1(FuzzyMap* _som, const TS* _examples)
  */
 void KerDenSOM::updateU1(FuzzyMap* _som, const TS* _examples)
 {
-
-    double auxProd, auxDist, tmp;
-    size_t k, j, i;
-
     // Update Membership matrix
-    for (k = 0; k < numVectors; k++)
-    {
-        auxProd = 1;
-        for (j = 0; j < numNeurons; j++)
-            auxProd *= euclideanDistance(_som->theItems[j], _examples->theItems[k]);
-
-        if (auxProd == 0.)
-        { // Apply k-means criterion (Data-CB) must be > 0
-            for (j = 0; j < numNeurons; j ++)
-                if (euclideanDistance(_som->theItems[j], _examples->theItems[k]) == 0.)
-                    _som->memb[k][j] = 1.0;
-                else
-                    _som->memb[k][j] =  0.0;
-        }
-        else
-        {
-            for (i = 0; i < numNeurons; i ++)
-            {
-                auxDist = 0;
-                for (j = 0; j < numNeurons; j ++)
-                {
-                    tmp = euclideanDistance(_som->theItems[i], _examples->theItems[k]) /
-                    		euclideanDistance(_som->theItems[j], _examples->theItems[k]);
-                    auxDist += pow(tmp, 2);
-                } // for j
-                _som->memb[k][i] = (floatFeature) 1.0 / auxDist;
-            } // for i
-        } // if auxProd
-    } // for k
+    FuzzyMembershipBody body;
+    body.memb = &(_som->memb);
+    body.exponent = 1.;
+    V.fromVectors(_som->theItems);
+    body.run(packExamples(_examples), V);
 }
 
 //-----------------------------------------------------------------------------
@@ -379,6 +333,7 @@ double KerDenSOM::randApproxGVC(const TS* _examples, const FuzzyMap* _som, doubl
             tmpTS.theItems[vv][j] += rnd_gaus() * _dataSD;
     }
     updateV(&tmpSOM, &tmpTS, _reg);
+    packedExamples = NULL; // X holds tmpTS
     den = 0.0;
 
     init_random_generator();
@@ -34,6 +34,7 @@
 
 #include "base_algorithm.h"
 #include "map.h"
+#include "feature_matrix.h"
 
 /**@defgroup Kendersom Kendersom: Smoothly Distributed Kernel Probability Density Estimator Self Organizing Map
    @ingroup ClassificationLibrary */
@@ -56,7 +57,7 @@ public:
     KerDenSOM(double _reg0, double _reg1, unsigned long _annSteps,
                    double _epsilon, unsigned long _nSteps)
             : ClassificationAlgorithm<FuzzyMap>(), annSteps(_annSteps), reg0(_reg0), reg1(_reg1),
-            epsilon(_epsilon), somNSteps(_nSteps)
+            epsilon(_epsilon), somNSteps(_nSteps), packedExamples(NULL)
     {};
 
     /**
@@ -132,6 +133,12 @@ protected:
     size_t dim;
     std::vector < std::vector<double> > tmpMap;
     std::vector<double> tmpD, tmpD1, tmpDens, tmpV;
+    FeatureMatrix X;          // Training vectors packed for the distance kernels
+    const TS * packedExamples; // Training set currently packed in X
+    FeatureMatrix V;          // Code vectors packed for the distance kernels
+
+    // Pack the training vectors in X (if they are not already there)
+    const FeatureMatrix & packExamples(const TS* _examples);
 
 
     /** Declaration of virtual method */
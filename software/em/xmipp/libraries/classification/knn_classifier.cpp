@@ -23,12 +23,22 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <algorithm>
 #include "knn_classifier.h"
+#include <data/xmipp_threads.h>
+
+// Samples in the leaves of the search tree
+#define KNN_LEAF_SIZE 16
+// With more features the tree does not prune and all samples are compared
+#define KNN_TREE_MAX_DIM 16
+// Features accumulated between checks of the partial distance
+#define KNN_DISTANCE_BLOCK 8
 
 KNN::KNN(int k)
 {
     setK(k);
     neighborsIndex.resize(1,1,1,K);
+    distance=EUCLIDEAN;
 }
 
 void KNN::train(MultidimArray<double> &dataset,MultidimArray<double> &dataLabel,
@@ -37,44 +47,165 @@ void KNN::train(MultidimArray<double> &dataset,MultidimArray<double> &dataLabel,
     __dataset=dataset;
     __dataLabel=dataLabel;
     __labelSet=labelset;
+    buildIndex();
 }
 
-void KNN::KNearestNeighbors(MultidimArray<double> &sample)
+/* Compare two samples of the dataset by one feature */
+struct KNNCompareFeature
 {
-    double maximum,distance;
-    int maximumIndex;
-    maxDist.resize(1,1,1,K);
-    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(maxDist)
+    const MultidimArray<double> *dataset;
+    int feature;
+    bool operator()(int i1, int i2) const
     {
-        DIRECT_A1D_ELEM(maxDist,i)=euclideanDistance(sample,i,-1.0);
-        DIRECT_A1D_ELEM(neighborsIndex,i)=i;
+        return DIRECT_A2D_ELEM(*dataset,i1,feature)<DIRECT_A2D_ELEM(*dataset,i2,feature);
     }
-    maximumIndex=findMaxIndex(maxDist);
-    maximum=DIRECT_A1D_ELEM(maxDist,maximumIndex);
-    for (size_t i=K;i<YSIZE(__dataset);i++)
+};
+
+void KNN::buildIndex()
+{
+    size_t N=YSIZE(__dataset), dim=XSIZE(__dataset);
+    order.resize(N);
+    for (size_t i=0;i<N;i++)
+        order[i]=i;
+    nodes.clear();
+    if (N>0)
+        buildNode(0,N,dim<=KNN_TREE_MAX_DIM);
+
+    // Samples of the same leaf are contiguous
+    treeData.resize(N*dim);
+    for (size_t i=0;i<N;i++)
+        memcpy(&treeData[i*dim],&DIRECT_A2D_ELEM(__dataset,order[i],0),dim*sizeof(double));
+}
+
+size_t KNN::buildNode(size_t first, size_t last, bool split)
+{
+    size_t n=nodes.size();
+    nodes.push_back(Node());
+    nodes[n].first=first;
+    nodes[n].last=last;
+    nodes[n].splitFeature=-1;
+    if (!split || last-first<=KNN_LEAF_SIZE)
+        return n;
+
+    // Split by the feature with the largest spread
+    int bestFeature=0;
+    double bestSpread=-1;
+    for (size_t j=0;j<XSIZE(__dataset);j++)
     {
-        distance=euclideanDistance(sample,i,maximum);
-        if (distance==-1)
-            continue;
-        if (distance<maximum)
+        double minVal=1e38, maxVal=-1e38;
+        for (size_t i=first;i<last;i++)
         {
-            DIRECT_A1D_ELEM(maxDist,maximumIndex)=distance;
-            DIRECT_A1D_ELEM(neighborsIndex,maximumIndex)=i;
-            maximumIndex=findMaxIndex(maxDist);
-            maximum=DIRECT_A1D_ELEM(maxDist,maximumIndex);
+            double v=DIRECT_A2D_ELEM(__dataset,order[i],j);
+            minVal=std::min(minVal,v);
+            maxVal=std::max(maxVal,v);
+        }
+        if (maxVal-minVal>bestSpread)
+        {
+            bestSpread=maxVal-minVal;
+            bestFeature=j;
         }
     }
+    if (bestSpread<=0)
+        return n; // All samples are equal
+
+    size_t middle=(first+last)/2;
+    KNNCompareFeature compare;
+    compare.dataset=&__dataset;
+    compare.feature=bestFeature;
+    std::nth_element(order.begin()+first,order.begin()+middle,order.begin()+last,compare);
+    nodes[n].splitFeature=bestFeature;
+    nodes[n].splitValue=DIRECT_A2D_ELEM(__dataset,order[middle],bestFeature);
+    size_t left=buildNode(first,middle,split);
+    size_t right=buildNode(middle,last,split);
+    nodes[n].left=left;
+    nodes[n].right=right;
+    return n;
 }
 
-int KNN::predict(MultidimArray<double> &sample,double &score)
+int KNN::numberOfNeighbors() const
+{
+    return std::min(K,(int)YSIZE(__dataset));
+}
+
+void KNN::searchNode(size_t node, const double *x, int *idx, double *dist, int Kn) const
+{
+    const Node &nd=nodes[node];
+    if (nd.splitFeature<0)
+    {
+        const size_t dim=XSIZE(__dataset);
+        for (size_t i=nd.first;i<nd.last;i++)
+        {
+            // Distance to the sample, abandoned when it is farther than the
+            // K-th neighbor
+            const double *y=&treeData[i*dim];
+            double maximum=dist[Kn-1];
+            double d=0;
+            for (size_t j0=0;j0<dim && d<=maximum;j0+=KNN_DISTANCE_BLOCK)
+            {
+                size_t j1=std::min(dim,j0+KNN_DISTANCE_BLOCK);
+                if (distance==EUCLIDEAN)
+                    for (size_t j=j0;j<j1;j++)
+                    {
+                        double tmp=x[j]-y[j];
+                        d+=tmp*tmp;
+                    }
+                else
+                    for (size_t j=j0;j<j1;j++)
+                        d+=fabs(x[j]-y[j]);
+            }
+            int index=order[i];
+            if (d>maximum || (d==maximum && idx[Kn-1]>=0 && index>idx[Kn-1]))
+                continue;
+
+            // Insert sorted by distance, and by index among equal distances
+            int k=Kn-1;
+            while (k>0 && (dist[k-1]>d || (dist[k-1]==d && idx[k-1]>index)))
+            {
+                dist[k]=dist[k-1];
+                idx[k]=idx[k-1];
+                k--;
+            }
+            dist[k]=d;
+            idx[k]=index;
+        }
+        return;
+    }
+    double diff=x[nd.splitFeature]-nd.splitValue;
+    size_t nearChild=(diff<0) ? nd.left : nd.right;
+    size_t farChild=(diff<0) ? nd.right : nd.left;
+    searchNode(nearChild,x,idx,dist,Kn);
+    // The other side can only contain closer samples if the split is not
+    // farther than the K-th neighbor
+    double bound=(distance==EUCLIDEAN) ? diff*diff : fabs(diff);
+    if (bound<=dist[Kn-1])
+        searchNode(farChild,x,idx,dist,Kn);
+}
+
+void KNN::search(const double *x, int *idx, double *dist) const
+{
+    int Kn=numberOfNeighbors();
+    if (Kn==0)
+        REPORT_ERROR(ERR_VALUE_INCORRECT,"KNN: the classifier has not been trained");
+    for (int k=0;k<Kn;k++)
+    {
+        idx[k]=-1;
+        dist[k]=1e38;
+    }
+    searchNode(0,x,idx,dist,Kn);
+    if (distance==EUCLIDEAN)
+        for (int k=0;k<Kn;k++)
+            dist[k]=sqrt(dist[k]);
+}
+
+int KNN::vote(const int *idx, double &score) const
 {
     MultidimArray<double> voteArray;
     int index;
     voteArray.initZeros(XSIZE(__labelSet));
-    KNearestNeighbors(sample);
-    FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(neighborsIndex)
+    int Kn=numberOfNeighbors();
+    for (int i=0;i<Kn;i++)
     {
-        index=DIRECT_A1D_ELEM(neighborsIndex,i);
+        index=idx[i];
         for (size_t j=0;j<XSIZE(__labelSet);++j)
             if (DIRECT_A1D_ELEM(__labelSet,j)==DIRECT_A1D_ELEM(__dataLabel,index))
                 DIRECT_A1D_ELEM(voteArray,j)+=1;
@@ -83,11 +214,93 @@ int KNN::predict(MultidimArray<double> &sample,double &score)
     score=DIRECT_A1D_ELEM(voteArray,index)/double(K);
     if (DIRECT_A1D_ELEM(voteArray,index)>(K*0.5))
         return (int)DIRECT_A1D_ELEM(__labelSet,index);
-    index=findMinIndex(maxDist);
-    return (int)DIRECT_A1D_ELEM(__dataLabel,DIRECT_A1D_ELEM(neighborsIndex,index));
+    // Neighbors are sorted, the first one is the closest
+    return (int)DIRECT_A1D_ELEM(__dataLabel,idx[0]);
+}
+
+void KNN::KNearestNeighbors(MultidimArray<double> &sample)
+{
+    int Kn=numberOfNeighbors();
+    neighborsIndex.resizeNoCopy(Kn);
+    maxDist.resizeNoCopy(Kn);
+    search(MULTIDIM_ARRAY(sample),MULTIDIM_ARRAY(neighborsIndex),MULTIDIM_ARRAY(maxDist));
+}
+
+int KNN::predict(MultidimArray<double> &sample,double &score)
+{
+    KNearestNeighbors(sample);
+    return vote(MULTIDIM_ARRAY(neighborsIndex),score);
+}
+
+/* Neighbors and classes of a range of samples */
+class KNNBatchBody: public ParallelForBody
+{
+public:
+    const KNN *knn;
+    const MultidimArray<double> *samples;
+    MultidimArray<int> *idx;
+    MultidimArray<double> *dist, *labels, *scores;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        int Kn=knn->numberOfNeighbors();
+        std::vector<int> sampleIdx(Kn);
+        std::vector<double> sampleDist(Kn);
+        double score;
+        for (size_t i=first;i<=last;i++)
+        {
+            knn->search(&DIRECT_A2D_ELEM(*samples,i,0),&sampleIdx[0],&sampleDist[0]);
+            if (idx!=NULL)
+                for (int k=0;k<Kn;k++)
+                {
+                    DIRECT_A2D_ELEM(*idx,i,k)=sampleIdx[k];
+                    DIRECT_A2D_ELEM(*dist,i,k)=sampleDist[k];
+                }
+            if (labels!=NULL)
+            {
+                DIRECT_A1D_ELEM(*labels,i)=knn->vote(&sampleIdx[0],score);
+                DIRECT_A1D_ELEM(*scores,i)=score;
+            }
+        }
+    }
+};
+
+void KNN::predict(const MultidimArray<double> &samples, MultidimArray<double> &labels,
+                  MultidimArray<double> &scores)
+{
+    labels.initZeros(YSIZE(samples));
+    scores.initZeros(YSIZE(samples));
+    if (YSIZE(samples)==0)
+        return;
+    KNNBatchBody body;
+    body.knn=this;
+    body.samples=&samples;
+    body.idx=NULL;
+    body.dist=NULL;
+    body.labels=&labels;
+    body.scores=&scores;
+    ThreadPool::getInstance().parallelFor(0,YSIZE(samples)-1,body,16);
+}
+
+void KNN::KNearestNeighbors(const MultidimArray<double> &samples, MultidimArray<int> &idx,
+                            MultidimArray<double> &dist)
+{
+    int Kn=numberOfNeighbors();
+    idx.initZeros(YSIZE(samples),Kn);
+    dist.initZeros(YSIZE(samples),Kn);
+    if (YSIZE(samples)==0)
+        return;
+    KNNBatchBody body;
+    body.knn=this;
+    body.samples=&samples;
+    body.idx=&idx;
+    body.dist=&dist;
+    body.labels=NULL;
+    body.scores=NULL;
+    ThreadPool::getInstance().parallelFor(0,YSIZE(samples)-1,body,16);
 }
 
-int KNN::findMaxIndex(MultidimArray<double> &inputArray)
+int KNN::findMaxIndex(const MultidimArray<double> &inputArray) const
 {
     double maximum;
     int maximumIndex;
@@ -102,7 +315,7 @@ int KNN::findMaxIndex(MultidimArray<double> &inputArray)
     return maximumIndex;
 }
 
-int KNN::findMinIndex(MultidimArray<double> &inputArray)
+int KNN::findMinIndex(const MultidimArray<double> &inputArray) const
 {
     double minimum;
     int minimumIndex;
@@ -185,6 +398,7 @@ void KNN::loadModel(const FileName &fn)
         }
     }
     fh.close();
+    buildIndex();
 }
 
 void KNN::setK(int k)
@@ -192,4 +406,9 @@ void KNN::setK(int k)
     K=k;
 }
 
+void KNN::setDistance(distType type)
+{
+    distance=type;
+}
+
 
@@ -27,6 +27,7 @@
 #define KNN_CLASSIFIER_HH
 
 /* Includes-----------------------------------------------------------------*/
+#include <vector>
 #include <data/multidim_array.h>
 
 /**@defgroup KNN Classifier
@@ -34,8 +35,11 @@
 //@{
 /**
  * This class implements KNN (K Nearest Neighbors). It does the classification
- * by a voting of nearest neighbors of the point. It uses the exhaustive search
- * in order to find the nearest neighbors.
+ * by a voting of nearest neighbors of the point. The training samples are
+ * organized in a kd-tree when there are few features; otherwise all of them
+ * are compared with the sample, abandoning a sample as soon as its partial
+ * distance is larger than that of the current K-th neighbor. Sets of samples
+ * can be classified at once by the threads of the pool.
  */
 
 class KNN
@@ -63,9 +67,25 @@ public:
      */
     int predict(MultidimArray<double> &sample,double &score);
 
+    /** Predict the class of each row of samples.
+     * labels and scores are resized to the number of samples, and receive
+     * the same values as predict for each sample. Samples are split among
+     * the threads of the pool.
+     */
+    void predict(const MultidimArray<double> &samples, MultidimArray<double> &labels,
+                 MultidimArray<double> &scores);
+
     /// Compute the K nearest neighbors to the sample
     void KNearestNeighbors(MultidimArray<double> &sample);
 
+    /** Compute the K nearest neighbors to each row of samples.
+     * The element i,j of idx (dist) is the index (distance) of the j-th
+     * nearest neighbor of the i-th sample. Neighbors are sorted by
+     * increasing distance (ties by index).
+     */
+    void KNearestNeighbors(const MultidimArray<double> &samples, MultidimArray<int> &idx,
+                           MultidimArray<double> &dist);
+
     /// Save the model for the classifier
     void saveModel(const FileName &fn);
 
@@ -75,6 +95,9 @@ public:
     /// Method for setting the K
     void setK(int k);
 
+    /// Method for setting the type of distance (EUCLIDEAN by default)
+    void setDistance(distType type);
+
 private:
     /// Compute the euclidean distance
     double euclideanDistance(MultidimArray<double> &sample,int index,double maximumDist);
@@ -83,10 +106,32 @@ private:
     double cityBlockDistance(MultidimArray<double> &sample,int index,double maximumDist);
 
     /// This function find the index of maximum value in an 1D-array
-    int findMaxIndex(MultidimArray<double> &inputArray);
+    int findMaxIndex(const MultidimArray<double> &inputArray) const;
 
     /// This function find the index of minimum value in an 1D-array
-    int findMinIndex(MultidimArray<double> &inputArray);
+    int findMinIndex(const MultidimArray<double> &inputArray) const;
+
+    /// Number of neighbors actually searched (K or the size of the dataset)
+    int numberOfNeighbors() const;
+
+    /// Build the search tree of the current dataset
+    void buildIndex();
+
+    /// Build the node for the samples first..last-1 of order
+    size_t buildNode(size_t first, size_t last, bool split);
+
+    /** Nearest neighbors of x sorted by increasing distance. idx and dist
+     * must have numberOfNeighbors() elements. Thread-safe.
+     */
+    void search(const double *x, int *idx, double *dist) const;
+
+    /// Search in a node of the tree with squared (euclidean) or plain distances
+    void searchNode(size_t node, const double *x, int *idx, double *dist, int Kn) const;
+
+    /// Voting among the neighbors found by search. Thread-safe.
+    int vote(const int *idx, double &score) const;
+
+    friend class KNNBatchBody;
 
 private:
     /// The number of nearest neighbors
@@ -106,6 +151,30 @@ private:
 
     /// Neighbors distance in dataset
     MultidimArray<double> maxDist;
+
+    /// Type of distance
+    distType distance;
+
+    /// Node of the search tree
+    struct Node
+    {
+        /// Range of the samples in order (first..last-1)
+        size_t first, last;
+        /// Split feature (-1 for leaves) and split value
+        int splitFeature;
+        double splitValue;
+        /// Children
+        size_t left, right;
+    };
+
+    /// Search tree (the root is the first node)
+    std::vector<Node> nodes;
+
+    /// Index in the dataset of the samples in the order of the tree
+    std::vector<int> order;
+
+    /// Copy of the dataset in the order of the tree
+    std::vector<double> treeData;
 };
 //@}
 #endif
@@ -2461,6 +2461,17 @@ double svm_get_svr_probability(const svm_model *model)
 }
 
 double svm_predict_values(const svm_model *model, const svm_node *x, double* dec_values)
+{
+	int l = model->l;
+	double *kvalue = Malloc(double,l);
+	for(int i=0;i<l;i++)
+		kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
+	double pred_result = svm_predict_values_from_kernel(model, kvalue, dec_values);
+	free(kvalue);
+	return pred_result;
+}
+
+double svm_predict_values_from_kernel(const svm_model *model, const double *kvalue, double* dec_values)
 {
 	int i;
 	if(model->param.svm_type == ONE_CLASS ||
@@ -2470,7 +2481,7 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 		double *sv_coef = model->sv_coef[0];
 		double sum = 0;
 		for(i=0;i<model->l;i++)
-			sum += sv_coef[i] * Kernel::k_function(x,model->SV[i],model->param);
+			sum += sv_coef[i] * kvalue[i];
 		sum -= model->rho[0];
 		*dec_values = sum;
 
@@ -2482,11 +2493,6 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 	else
 	{
 		int nr_class = model->nr_class;
-		int l = model->l;
-		
-		double *kvalue = Malloc(double,l);
-		for(i=0;i<l;i++)
-			kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
 
 		int *start = Malloc(int,nr_class);
 		start[0] = 0;
@@ -2529,7 +2535,6 @@ double svm_predict_values(const svm_model *model, const svm_node *x, double* dec
 			if(vote[i] > vote[vote_max_idx])
 				vote_max_idx = i;
 
-		free(kvalue);
 		free(start);
 		free(vote);
 		return model->label[vote_max_idx];
@@ -2554,13 +2559,26 @@ double svm_predict(const svm_model *model, const svm_node *x)
 double svm_predict_probability(
 	const svm_model *model, const svm_node *x, double *prob_estimates)
 {
+	int l = model->l;
+	double *kvalue = Malloc(double,l);
+	for(int i=0;i<l;i++)
+		kvalue[i] = Kernel::k_function(x,model->SV[i],model->param);
+	double pred_result = svm_predict_probability_from_kernel(model, kvalue, prob_estimates);
+	free(kvalue);
+	return pred_result;
+}
+
+double svm_predict_probability_from_kernel(
+	const svm_model *model, const double *kvalue, double *prob_estimates)
+{
+	int nr_class = model->nr_class;
+	double *dec_values;
 	if ((model->param.svm_type == C_SVC || model->param.svm_type == NU_SVC) &&
 	    model->probA!=NULL && model->probB!=NULL)
 	{
 		int i;
-		int nr_class = model->nr_class;
-		double *dec_values = Malloc(double, nr_class*(nr_class-1)/2);
-		svm_predict_values(model, x, dec_values);
+		dec_values = Malloc(double, nr_class*(nr_class-1)/2);
+		svm_predict_values_from_kernel(model, kvalue, dec_values);
 
 		double min_prob=1e-7;
 		double **pairwise_prob=Malloc(double *,nr_class);
@@ -2586,8 +2604,18 @@ double svm_predict_probability(
 		free(pairwise_prob);	     
 		return model->label[prob_max_idx];
 	}
-	else 
-		return svm_predict(model, x);
+	else
+	{
+		if(model->param.svm_type == ONE_CLASS ||
+		   model->param.svm_type == EPSILON_SVR ||
+		   model->param.svm_type == NU_SVR)
+			dec_values = Malloc(double, 1);
+		else 
+			dec_values = Malloc(double, nr_class*(nr_class-1)/2);
+		double pred_result = svm_predict_values_from_kernel(model, kvalue, dec_values);
+		free(dec_values);
+		return pred_result;
+	}
 }
 
 static const char *svm_type_table[] =
@@ -89,6 +89,11 @@ double svm_predict_values(const struct svm_model *model, const struct svm_node *
 double svm_predict(const struct svm_model *model, const struct svm_node *x);
 double svm_predict_probability(const struct svm_model *model, const struct svm_node *x, double* prob_estimates);
 
+/* Same as svm_predict_values and svm_predict_probability, but from the
+   kernel values of x with all the support vectors (kvalue[l]) */
+double svm_predict_values_from_kernel(const struct svm_model *model, const double *kvalue, double* dec_values);
+double svm_predict_probability_from_kernel(const struct svm_model *model, const double *kvalue, double* prob_estimates);
+
 void svm_free_model_content(struct svm_model *model_ptr);
 void svm_free_and_destroy_model(struct svm_model **model_ptr_ptr);
 void svm_destroy_param(struct svm_parameter *param);
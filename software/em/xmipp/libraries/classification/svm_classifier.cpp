@@ -22,7 +22,12 @@
  *  All comments concerning this program package may be sent to the    
  *  e-mail address 'xmipp@cnb.csic.es'                                  
  ***************************************************************************/
+#include <algorithm>
 #include "svm_classifier.h"
+#include <data/xmipp_threads.h>
+
+// Feature vectors compared at the same time with each support vector
+#define SVM_BATCH_BLOCK 4
 
 bool findElementIn1DArray(MultidimArray<double> &inputArray,double element)
 {
@@ -50,13 +55,20 @@ void SVMClassifier::setParameters(double c,double gamma)
     param.weight_label = NULL;
     param.weight = NULL;
     model=NULL;
+    denseModel=NULL;
+    denseDim=0;
     prob.y=NULL;
     prob.x=NULL;
 }
 SVMClassifier::~SVMClassifier()
 {
-    svm_free_and_destroy_model(&model);
+    clearModel();
     svm_destroy_param(&param);
+}
+void SVMClassifier::clearModel()
+{
+    // The support vectors of a trained model point to the training set
+    svm_free_and_destroy_model(&model);
     if (prob.y!=NULL)
         delete [] prob.y;
     if (prob.x!=NULL)
@@ -65,10 +77,16 @@ SVMClassifier::~SVMClassifier()
             delete [] prob.x[i];
         delete [] prob.x;
     }
+    prob.y=NULL;
+    prob.x=NULL;
+    // A new model may be allocated at the address of the old one
+    denseModel=NULL;
+    denseDim=0;
+    std::vector<double>().swap(denseSV);
 }
 void SVMClassifier::SVMTrain(MultidimArray<double> &trainSet,MultidimArray<double> &label)
 {
-
+    clearModel();
     prob.l = YSIZE(trainSet);
     prob.y = new double[prob.l];
     prob.x = new svm_node *[prob.l+1];
@@ -101,20 +119,25 @@ void SVMClassifier::SVMTrain(MultidimArray<double> &trainSet,MultidimArray<doubl
     model=svm_train(&prob,&param);
 }
 double SVMClassifier::predict(MultidimArray<double> &featVec,double &score)
+{
+    return predict(MULTIDIM_ARRAY(featVec),XSIZE(featVec),score);
+}
+
+double SVMClassifier::predict(const double *featVec, size_t n, double &score) const
 {
     svm_node *x_space;
     int cnt=0;
     int nr_class=svm_get_nr_class(model);
     double *prob_estimates=new double[nr_class];
-    x_space=new svm_node[XSIZE(featVec)+1];
+    x_space=new svm_node[n+1];
 
-    for (size_t i=0;i<XSIZE(featVec);i++)
+    for (size_t i=0;i<n;i++)
     {
-        if (DIRECT_A1D_ELEM(featVec,i)==0)
+        if (featVec[i]==0)
             continue;
         else
         {
-            x_space[cnt].value=DIRECT_A1D_ELEM(featVec,i);
+            x_space[cnt].value=featVec[i];
             x_space[cnt].index=i+1;
             cnt++;
         }
@@ -130,6 +153,129 @@ double SVMClassifier::predict(MultidimArray<double> &featVec,double &score)
     delete [] x_space;
     return label;
 }
+
+void SVMClassifier::buildDenseSupportVectors(size_t dim)
+{
+    // Features beyond the input vectors are zero in both sides
+    for (int s=0;s<model->l;s++)
+        for (const svm_node *node=model->SV[s];node->index!=-1;node++)
+            dim=std::max(dim,(size_t)node->index);
+    if (denseModel==model && denseDim==dim)
+        return;
+    denseDim=dim;
+    denseModel=model;
+    denseSV.assign(model->l*dim,0.);
+    for (int s=0;s<model->l;s++)
+    {
+        double *ptrSV=&denseSV[s*dim];
+        for (const svm_node *node=model->SV[s];node->index!=-1;node++)
+            ptrSV[node->index-1]=node->value;
+    }
+}
+
+/* Batch prediction of a range of rows */
+class SVMBatchBody: public ParallelForBody
+{
+public:
+    const SVMClassifier *classifier;
+    const MultidimArray<double> *featVecs;
+    const std::vector<size_t> *rows;
+    MultidimArray<double> *labels, *scores;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        const svm_model *model=classifier->model;
+        const size_t n=XSIZE(*featVecs);
+        double label, score;
+        if (model->param.kernel_type!=RBF)
+        {
+            for (size_t k=first;k<=last;k++)
+            {
+                size_t r=(*rows)[k];
+                label=classifier->predict(&DIRECT_A2D_ELEM(*featVecs,r,0),n,score);
+                DIRECT_A1D_ELEM(*labels,r)=label;
+                DIRECT_A1D_ELEM(*scores,r)=score;
+            }
+            return;
+        }
+
+        const size_t l=model->l, dim=classifier->denseDim;
+        const double gamma=model->param.gamma;
+        int nr_class=model->nr_class;
+        std::vector<double> x(SVM_BATCH_BLOCK*dim), kvalue(SVM_BATCH_BLOCK*l), prob(nr_class);
+        double *x0=&x[0], *x1=x0+dim, *x2=x1+dim, *x3=x2+dim;
+        for (size_t k0=first;k0<=last;k0+=SVM_BATCH_BLOCK)
+        {
+            size_t nb=std::min((size_t)SVM_BATCH_BLOCK,last-k0+1);
+            std::fill(x.begin(),x.end(),0.);
+            for (size_t b=0;b<nb;b++)
+                memcpy(&x[b*dim],&DIRECT_A2D_ELEM(*featVecs,(*rows)[k0+b],0),n*sizeof(double));
+
+            // Squared distances of the block to all support vectors
+            double *k0v=&kvalue[0], *k1v=k0v+l, *k2v=k1v+l, *k3v=k2v+l;
+            for (size_t s=0;s<l;s++)
+            {
+                const double *y=&(classifier->denseSV[s*dim]);
+                double r0=0, r1=0, r2=0, r3=0;
+                for (size_t j=0;j<dim;j++)
+                {
+                    double yj=y[j];
+                    double t0=x0[j]-yj;
+                    double t1=x1[j]-yj;
+                    double t2=x2[j]-yj;
+                    double t3=x3[j]-yj;
+                    r0+=t0*t0;
+                    r1+=t1*t1;
+                    r2+=t2*t2;
+                    r3+=t3*t3;
+                }
+                k0v[s]=exp(-gamma*r0);
+                k1v[s]=exp(-gamma*r1);
+                k2v[s]=exp(-gamma*r2);
+                k3v[s]=exp(-gamma*r3);
+            }
+
+            for (size_t b=0;b<nb;b++)
+            {
+                std::fill(prob.begin(),prob.end(),0.);
+                label=svm_predict_probability_from_kernel(model,&kvalue[b*l],&prob[0]);
+                // Extracting the probability of the selected class
+                score=*std::max_element(prob.begin(),prob.end());
+                size_t r=(*rows)[k0+b];
+                DIRECT_A1D_ELEM(*labels,r)=label;
+                DIRECT_A1D_ELEM(*scores,r)=score;
+            }
+        }
+    }
+};
+
+void SVMClassifier::predict(const MultidimArray<double> &featVecs, MultidimArray<double> &labels,
+                            MultidimArray<double> &scores, const std::vector<size_t> *rows)
+{
+    labels.initZeros(YSIZE(featVecs));
+    scores.initZeros(YSIZE(featVecs));
+    std::vector<size_t> allRows;
+    if (rows==NULL)
+    {
+        allRows.resize(YSIZE(featVecs));
+        for (size_t i=0;i<allRows.size();i++)
+            allRows[i]=i;
+        rows=&allRows;
+    }
+    if (rows->empty())
+        return;
+    if (model->param.kernel_type==RBF)
+        buildDenseSupportVectors(XSIZE(featVecs));
+
+    SVMBatchBody body;
+    body.classifier=this;
+    body.featVecs=&featVecs;
+    body.rows=rows;
+    body.labels=&labels;
+    body.scores=&scores;
+    ThreadPool::getInstance().parallelFor(0,rows->size()-1,body,16*SVM_BATCH_BLOCK);
+}
+
 void SVMClassifier::SaveModel(const FileName &fnModel)
 {
     if (model->l!=0)
@@ -137,6 +283,7 @@ void SVMClassifier::SaveModel(const FileName &fnModel)
 }
 void SVMClassifier::LoadModel(const FileName &fnModel)
 {
+    clearModel();
     model=svm_load_model(fnModel.c_str());
 }
 int SVMClassifier::getNumClasses()
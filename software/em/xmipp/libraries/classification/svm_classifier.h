@@ -28,6 +28,7 @@
 #define XMIPP__SVM_CLASSIFIER_HH__
 
 /* Includes ---------------------------------------------------------------- */
+#include <vector>
 #include <data/xmipp_program.h>
 #include "svm.h"
 
@@ -45,16 +46,48 @@ public:
     svm_parameter param;
     svm_problem prob;
     svm_model *model;
+    /// Dense copy of the support vectors (one row per vector) for batch prediction
+    std::vector<double> denseSV;
+    /// Number of features of each row of denseSV
+    size_t denseDim;
+    /// Model from which denseSV was built
+    const svm_model *denseModel;
 public:
 
     //SVMClassifier(double c,double gamma);
     ~SVMClassifier();
     void SVMTrain(MultidimArray<double> &trainSet,MultidimArray<double> &lable);
     double  predict(MultidimArray<double> &featVec,double &score);
+
+    /** Prediction of a sparse feature vector of n elements.
+     *  Zeros are skipped as in the training set. Thread-safe.
+     */
+    double predict(const double *featVec, size_t n, double &score) const;
+
+    /** Batch prediction.
+     *  Each row of featVecs is a feature vector. labels and scores are
+     *  resized to the number of rows and filled with the same values
+     *  returned by predict for each row. For RBF kernels, the kernel
+     *  values against all the support vectors are computed for blocks
+     *  of rows from a dense copy of the support vectors. Rows are split
+     *  among the threads of the pool.
+     *
+     *  If rows is not NULL, only the listed rows are evaluated (e.g., the
+     *  candidates accepted by a previous classifier); the others get
+     *  label 0 and score 0.
+     */
+    void predict(const MultidimArray<double> &featVecs, MultidimArray<double> &labels,
+                 MultidimArray<double> &scores, const std::vector<size_t> *rows=NULL);
+
+    /// Build denseSV with at least dim features per row
+    void buildDenseSupportVectors(size_t dim);
     void SaveModel(const FileName &fnModel);
     void LoadModel(const FileName &fnModel);
     void setParameters(double c,double gamma);
     int getNumClasses();
+private:
+    /// Free the model, its training set and the dense support vectors
+    void clearModel();
 };
 //@}
 #endif
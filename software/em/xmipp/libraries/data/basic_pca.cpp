@@ -25,6 +25,7 @@
 
 #include "basic_pca.h"
 #include "matrix2d.h"
+#include "xmipp_threads.h"
 
 /* Subtract average ------------------------------------------------------- */
 void PCAMahalanobisAnalyzer::subtractAvg()
@@ -168,136 +169,54 @@ void PCAMahalanobisAnalyzer::reconsFromPCA(const Matrix2D<double> &CtY, std::vec
     }
 }
 
-void PCAMahalanobisAnalyzer::learnPCABasis(size_t NPCA, size_t Niter)
+/* Learn basis ------------------------------------------------------------ */
+// Subspace iteration with oversampling converges in a few passes
+#define LEARN_PCA_MAX_PASSES 5
+
+/* Add the stored vectors to a streaming PCA */
+class AddVectorsBody: public ParallelForBody
 {
-    // Take the first vectors for the PCA basis
-    MultidimArray<double> vPCA;
-    NPCA=XMIPP_MIN(NPCA,v.size());
-    std::vector<size_t> used;
-    PCAbasis.clear();
-    for (size_t n=0; n<NPCA; n++)
+public:
+    const std::vector< MultidimArray<float> > *v;
+    StreamingRandomizedPCA *pca;
+
+    void operator()(size_t first, size_t last, int thread_id)
     {
-    	size_t nRandom;
-    	do {
-    		nRandom=(size_t)round((v.size()-1)*rnd_unif(0,1));
-    	} while (std::find(used.begin(),used.end(),nRandom)!=used.end());
-        typeCast(v[nRandom],vPCA);
-        PCAbasis.push_back(vPCA);
-        used.push_back(nRandom);
+        for (size_t n=first; n<=last; n++)
+            pca->addVector(MULTIDIM_ARRAY((*v)[n]),thread_id);
     }
+};
 
+void PCAMahalanobisAnalyzer::learnPCABasis(size_t NPCA, size_t Niter)
+{
     size_t N=v.size();
-    for (size_t n=0; n<Niter; n++)
-    {
-        // E-step ..........................................................
-        // Compute C^t*C
-        Matrix2D<double> CtC(NPCA,NPCA);
-        for (size_t ii=0; ii<NPCA; ii++)
-        {
-            const MultidimArray<double> &Iii=PCAbasis[ii];
-            for (size_t jj=ii; jj<NPCA; jj++)
-            {
-                const MultidimArray<double> &Ijj=PCAbasis[jj];
-                CtC(ii,jj)=0;
-                FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(Ijj)
-                MAT_ELEM(CtC,ii,jj)+=
-                    DIRECT_A1D_ELEM(Iii,i)*DIRECT_A1D_ELEM(Ijj,i);
-
-                if (ii!=jj)
-                    CtC(jj,ii)=CtC(ii,jj);
-
-            }
-        }
-
-        Matrix2D<double> CtY, X;
-        projectOnPCABasis(CtY);
-        X=CtC.inv()*CtY;
-
-        // M-step ..........................................................
-        Matrix2D<double> XtXXtinv=X.transpose()*(X*X.transpose()).inv();
-        for (size_t ii=0;ii<NPCA;ii++)
-        {
-            MultidimArray<double> &Ipca=PCAbasis[ii];
-            const size_t unroll=4;
-            size_t nmax=unroll*(MULTIDIM_SIZE(Ipca)/unroll);
-            Ipca.initZeros();
-            for (size_t jj=0; jj<N; jj++)
-            {
-                const MultidimArray<float> &I=v[jj];
-                const float *ptrI=MULTIDIM_ARRAY(I);
-                double *ptrPCA=MULTIDIM_ARRAY(Ipca);
-                double val=MAT_ELEM(XtXXtinv,jj,ii);
-                size_t n;
-                for (n=0; n<nmax; n+=unroll, ptrPCA+=unroll, ptrI+=unroll)
-                {
-                    *ptrPCA += *ptrI * val;
-                    *(ptrPCA+1) += *(ptrI+1) * val;
-                    *(ptrPCA+2) += *(ptrI+2) * val;
-                    *(ptrPCA+3) += *(ptrI+3) * val;
-                }
-                for (n=nmax, ptrI=MULTIDIM_ARRAY(I)+nmax, ptrPCA=MULTIDIM_ARRAY(Ipca)+nmax;
-                     n<MULTIDIM_SIZE(I); ++n, ++ptrI, ++ptrPCA)
-                    *ptrPCA += *ptrI * val;
-            }
-        }
-    }
+    NPCA=XMIPP_MIN(NPCA,N);
+    PCAbasis.clear();
+    if (NPCA==0)
+        return;
 
-    //Obtain the Orthonormal vectors for the C (According to paper)
-    gramSchmidt();
-
-    //Generate a Matrix for true PCA and compute the average C'*data
-    Matrix2D<double> data;
-    double *refData;
-    MultidimArray<double> average;
-    data.initZeros(NPCA,v.size());
-    average.initZeros(NPCA);
-    refData = &MAT_ELEM(data,0,0);
-    for (size_t ii=0;ii<NPCA;ii++)
-    {
-        MultidimArray<double> &C=PCAbasis[ii];
-        for (size_t jj=0;jj<v.size();jj++)
-        {
-            MultidimArray<float> &D=v[jj];
-            FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(C)
-            (*refData) += DIRECT_A1D_ELEM(C,i)*DIRECT_A1D_ELEM(D,i);
-            DIRECT_A1D_ELEM(average,ii)+=(*refData)++;
-        }
-    }
-    average/=v.size();
-    FOR_ALL_ELEMENTS_IN_MATRIX2D(data)
-    MAT_ELEM(data,i,j)-=DIRECT_A1D_ELEM(average,i);
-
-    Matrix2D<double> covarMatrix;
-    Matrix2D<double> u;
-    Matrix2D<double> v;
-    covarMatrix=data*data.transpose();
-    svdcmp(covarMatrix,u,w,v);
-
-    /// Do the PCAbasis*v
-    size_t xsize=XSIZE(PCAbasis[0]);
-    MultidimArray<double> temp;
-    for (size_t i=0;i<xsize;i++)
+    ThreadPool &pool=ThreadPool::getInstance();
+    StreamingRandomizedPCA pca;
+    pca.initialize(MULTIDIM_SIZE(v[0]),NPCA,10,true,pool.getNumberOfThreads()+1);
+    AddVectorsBody body;
+    body.v=&v;
+    body.pca=&pca;
+    size_t Npasses=XMIPP_MAX(2,XMIPP_MIN(Niter,LEARN_PCA_MAX_PASSES));
+    for (size_t pass=0; pass<Npasses; pass++)
     {
-        temp.initZeros(1,NPCA);
-        for (size_t j=0;j<NPCA;j++)
-            for (size_t k=0;k<NPCA;k++)
-            {
-                const MultidimArray<double> &Iii=PCAbasis[k];
-                DIRECT_A1D_ELEM(temp,j)+=DIRECT_A1D_ELEM(Iii,i)* MAT_ELEM(v,k,j);
-            }
-        for (size_t k=0;k<NPCA;k++)
-        {
-            const MultidimArray<double> &Iii=PCAbasis[k];
-            DIRECT_A1D_ELEM(Iii,i)=DIRECT_A1D_ELEM(temp,k);
-        }
+        pca.startPass();
+        pool.parallelFor(0,N-1,body,16);
+        pca.endPass();
     }
 
-    // Normalize output vectors
-    for (size_t ii=0;ii<NPCA;ii++)
+    // Copy the basis, it has no more vectors than the dimension
+    MultidimArray<double> vPCA(MULTIDIM_SIZE(v[0]));
+    for (size_t ii=0; ii<pca.NPCA; ii++)
     {
-        double norm=sqrt(PCAbasis[ii].sum2());
-        PCAbasis[ii]/=norm;
+        memcpy(MULTIDIM_ARRAY(vPCA),&MAT_ELEM(pca.PCAbasis,ii,0),MULTIDIM_SIZE(vPCA)*sizeof(double));
+        PCAbasis.push_back(vPCA);
     }
+    w=pca.eigenvalues;
 }
 
 /** computes the orthonormal basis for a subspace
@@ -536,3 +455,277 @@ void PCAonline::addVector(MultidimArray<double> &y)
 		N++;
 	}
 }
+
+/* Streaming randomized PCA ----------------------------------------------- */
+// Maximum number of vectors processed together by each thread, and
+// maximum size of the block in bytes (for very long vectors, e.g. volumes)
+#define STREAMING_PCA_BLOCK 8
+#define STREAMING_PCA_BLOCK_BYTES 16777216
+
+// Orthonormalize the rows of M by Gram-Schmidt. Each row is projected
+// twice on the previous ones for numerical stability. Rows that are
+// linearly dependent on the previous ones are replaced by random vectors.
+static void orthonormalizeRows(Matrix2D<double> &M)
+{
+    size_t Nrows=MAT_YSIZE(M), dim=MAT_XSIZE(M);
+    for (size_t j1=0; j1<Nrows; j1++)
+    {
+        double *q1=&MAT_ELEM(M,j1,0);
+        for (int attempt=0; ; attempt++)
+        {
+            double norm0=0;
+            for (size_t i=0; i<dim; i++)
+                norm0+=q1[i]*q1[i];
+            for (int it=0; it<2; it++)
+                for (size_t j2=0; j2<j1; j2++)
+                {
+                    const double *q2=&MAT_ELEM(M,j2,0);
+                    double s12=0;
+                    for (size_t i=0; i<dim; i++)
+                        s12+=q1[i]*q2[i];
+                    for (size_t i=0; i<dim; i++)
+                        q1[i]-=s12*q2[i];
+                }
+            double norm=0;
+            for (size_t i=0; i<dim; i++)
+                norm+=q1[i]*q1[i];
+            if (norm>1e-20*norm0 && norm>0)
+            {
+                double inorm=1.0/sqrt(norm);
+                for (size_t i=0; i<dim; i++)
+                    q1[i]*=inorm;
+                break;
+            }
+            if (attempt==10)
+                REPORT_ERROR(ERR_NUMERICAL,"Cannot find an orthonormal basis of the subspace");
+            for (size_t i=0; i<dim; i++)
+                q1[i]=rnd_gaus();
+        }
+    }
+}
+
+StreamingRandomizedPCA::StreamingRandomizedPCA()
+{
+    dim=NPCA=Nsub=N=0;
+    blockSize=1;
+    center=true;
+}
+
+void StreamingRandomizedPCA::initialize(size_t _dim, size_t _NPCA, size_t oversampling,
+                                        bool _center, int Nthreads)
+{
+    dim=_dim;
+    NPCA=XMIPP_MIN(_NPCA,dim);
+    Nsub=XMIPP_MIN(NPCA+oversampling,dim);
+    center=_center;
+    N=0;
+    blockSize=XMIPP_MAX(1,XMIPP_MIN(STREAMING_PCA_BLOCK,STREAMING_PCA_BLOCK_BYTES/(dim*sizeof(double))));
+
+    Q.resizeNoCopy(Nsub,dim);
+    FOR_ALL_ELEMENTS_IN_MATRIX2D(Q)
+    MAT_ELEM(Q,i,j)=rnd_gaus();
+    orthonormalizeRows(Q);
+
+    threadAccumulator.clear();
+    threadAccumulator.resize(Nthreads);
+    threadBlock.clear();
+    threadBlock.resize(Nthreads);
+    threadBlockSize.assign(Nthreads,0);
+    accumulator.clear();
+}
+
+void StreamingRandomizedPCA::startPass()
+{
+    // Thread accumulators are allocated by the first vector of each thread
+    for (size_t t=0; t<threadAccumulator.size(); t++)
+    {
+        std::vector<double> &acc=threadAccumulator[t];
+        if (!acc.empty())
+            memset(&acc[0],0,acc.size()*sizeof(double));
+        threadBlockSize[t]=0;
+    }
+}
+
+void StreamingRandomizedPCA::processBlock(int thread_id)
+{
+    size_t nb=threadBlockSize[thread_id];
+    if (nb==0)
+        return;
+    std::vector<double> &acc=threadAccumulator[thread_id];
+    if (acc.empty())
+        acc.resize(Nsub*dim+dim+1,0.);
+    const double *B=&(threadBlock[thread_id][0]);
+
+    // Sum of the vectors
+    double *sum=&acc[Nsub*dim];
+    for (size_t r=0; r<nb; r++)
+    {
+        const double *b=B+r*dim;
+        for (size_t i=0; i<dim; i++)
+            sum[i]+=b[i];
+    }
+    acc[Nsub*dim+dim]+=nb;
+
+    // Y_j+=sum_r (b_r^t q_j) b_r
+    double p[STREAMING_PCA_BLOCK];
+    for (size_t j=0; j<Nsub; j++)
+    {
+        const double *q=&MAT_ELEM(Q,j,0);
+        for (size_t r=0; r<nb; r++)
+        {
+            const double *b=B+r*dim;
+            double dot=0;
+            for (size_t i=0; i<dim; i++)
+                dot+=b[i]*q[i];
+            p[r]=dot;
+        }
+        double *y=&acc[j*dim];
+        for (size_t r=0; r<nb; r++)
+        {
+            const double *b=B+r*dim;
+            double pr=p[r];
+            for (size_t i=0; i<dim; i++)
+                y[i]+=pr*b[i];
+        }
+    }
+    threadBlockSize[thread_id]=0;
+}
+
+void StreamingRandomizedPCA::addVector(const double *v, int thread_id)
+{
+    std::vector<double> &block=threadBlock[thread_id];
+    if (block.empty())
+        block.resize(blockSize*dim);
+    size_t &nb=threadBlockSize[thread_id];
+    memcpy(&block[nb*dim],v,dim*sizeof(double));
+    if (++nb==blockSize)
+        processBlock(thread_id);
+}
+
+void StreamingRandomizedPCA::addVector(const float *v, int thread_id)
+{
+    std::vector<double> &block=threadBlock[thread_id];
+    if (block.empty())
+        block.resize(blockSize*dim);
+    size_t &nb=threadBlockSize[thread_id];
+    double *ptr=&block[nb*dim];
+    for (size_t i=0; i<dim; i++)
+        ptr[i]=v[i];
+    if (++nb==blockSize)
+        processBlock(thread_id);
+}
+
+void StreamingRandomizedPCA::gatherThreads()
+{
+    // The first accumulator is moved, not copied, to save memory
+    accumulator.clear();
+    for (size_t t=0; t<threadAccumulator.size(); t++)
+    {
+        processBlock(t);
+        std::vector<double> &acc=threadAccumulator[t];
+        if (acc.empty())
+            continue;
+        if (accumulator.empty())
+            accumulator.swap(acc);
+        else
+            for (size_t i=0; i<acc.size(); i++)
+                accumulator[i]+=acc[i];
+    }
+    if (accumulator.empty())
+        accumulator.assign(Nsub*dim+dim+1,0.);
+}
+
+void StreamingRandomizedPCA::updateSubspace()
+{
+    N=(size_t)accumulator[Nsub*dim+dim];
+    if (N==0)
+        REPORT_ERROR(ERR_NUMERICAL,"StreamingRandomizedPCA: no vectors have been added");
+    Matrix2D<double> Y;
+    Y.resizeNoCopy(Nsub,dim);
+    memcpy(MATRIX2D_ARRAY(Y),&accumulator[0],Nsub*dim*sizeof(double));
+    avg.resizeNoCopy(dim);
+    const double *sum=&accumulator[Nsub*dim];
+    double iN=1.0/N;
+    for (size_t i=0; i<dim; i++)
+        VEC_ELEM(avg,i)=sum[i]*iN;
+    std::vector<double>().swap(accumulator);
+
+    // Centered vectors: sum_n (b_n-avg)(b_n-avg)^t q = Y - N avg (avg^t q)
+    if (center)
+        for (size_t j=0; j<Nsub; j++)
+        {
+            const double *q=&MAT_ELEM(Q,j,0);
+            double *y=&MAT_ELEM(Y,j,0);
+            double dot=0;
+            for (size_t i=0; i<dim; i++)
+                dot+=VEC_ELEM(avg,i)*q[i];
+            dot*=N;
+            for (size_t i=0; i<dim; i++)
+                y[i]-=dot*VEC_ELEM(avg,i);
+        }
+
+    // Rayleigh-Ritz in the subspace of Q
+    Matrix2D<double> G, P;
+    matrixOperation_ABt(Q,Y,G);
+    for (size_t i=0; i<Nsub; i++)
+        for (size_t j=i+1; j<Nsub; j++)
+            MAT_ELEM(G,i,j)=MAT_ELEM(G,j,i)=0.5*(MAT_ELEM(G,i,j)+MAT_ELEM(G,j,i));
+    firstEigs(G,NPCA,eigenvalues,P);
+    matrixOperation_AtB(P,Q,PCAbasis);
+    subspacePCA=P.transpose();
+    subspaceAvg.initZeros(Nsub);
+    if (center)
+        for (size_t j=0; j<Nsub; j++)
+        {
+            const double *q=&MAT_ELEM(Q,j,0);
+            double dot=0;
+            for (size_t i=0; i<dim; i++)
+                dot+=VEC_ELEM(avg,i)*q[i];
+            VEC_ELEM(subspaceAvg,j)=dot;
+        }
+
+    // Next subspace
+    Q=Y;
+    orthonormalizeRows(Q);
+}
+
+void StreamingRandomizedPCA::project(const double *v, double *coeffs) const
+{
+    for (size_t k=0; k<NPCA; k++)
+    {
+        const double *c=&MAT_ELEM(PCAbasis,k,0);
+        double dot=0;
+        if (center)
+            for (size_t i=0; i<dim; i++)
+                dot+=(v[i]-VEC_ELEM(avg,i))*c[i];
+        else
+            for (size_t i=0; i<dim; i++)
+                dot+=v[i]*c[i];
+        coeffs[k]=dot;
+    }
+}
+
+void StreamingRandomizedPCA::projectOntoSubspace(const double *v, double *coords) const
+{
+    for (size_t j=0; j<Nsub; j++)
+    {
+        const double *q=&MAT_ELEM(Q,j,0);
+        double dot=0;
+        for (size_t i=0; i<dim; i++)
+            dot+=v[i]*q[i];
+        coords[j]=dot;
+    }
+}
+
+void StreamingRandomizedPCA::projectFromSubspace(const double *coords, double *coeffs) const
+{
+    // The principal components are combinations of the rows of Q of the last pass
+    for (size_t k=0; k<NPCA; k++)
+    {
+        const double *p=&MAT_ELEM(subspacePCA,k,0);
+        double dot=0;
+        for (size_t j=0; j<Nsub; j++)
+            dot+=(coords[j]-VEC_ELEM(subspaceAvg,j))*p[j];
+        coeffs[k]=dot;
+    }
+}
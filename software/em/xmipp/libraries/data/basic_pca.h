@@ -29,6 +29,7 @@
 
 #include <vector>
 #include "multidim_array.h"
+#include "matrix2d.h"
 
 
 /**@defgroup BasicPCA Basic PCA class
@@ -37,8 +38,7 @@
 /** Basic PCA class.
  *  The difference with PCAAnalyzer is that this one uses a different
  *  base class for the input vectors and the algorithm used to compute
- *  the PCA decomposition (see Roweis, "EM algorithms for PCA and SPCA",
- *  Neural Information Processing Systems 10 (NIPS'97) pp.626-632)
+ *  the PCA decomposition (see StreamingRandomizedPCA)
  *
  *  Example of use:
  *  @code
@@ -120,7 +120,10 @@ public:
     /// Standardarize variables
     void standardarizeVariables();
 
-    /// Learn basis
+    /** Learn basis.
+     * The basis is computed with StreamingRandomizedPCA over the stored
+     * vectors, using between 2 and 5 passes (at most Niter if Niter>=2).
+     */
     void learnPCABasis(size_t NPCA, size_t Niter);
 
     /// Project on basis
@@ -180,5 +183,129 @@ public:
 		return zn;
 	}
 };
+
+/** Streaming randomized PCA.
+ * Principal components of a set of vectors that is visited several times
+ * but never kept in memory, by subspace iteration with oversampling
+ * (Halko, Martinsson, Tropp. Finding structure with randomness. SIAM
+ * Review 53:217-288 (2011)). Each pass over the vectors accumulates
+ * Y=A A^t Q, where A has the vectors as columns and Q is the current
+ * orthonormal basis of the subspace. At the end of the pass the principal
+ * components are estimated from Q^t A A^t Q (Rayleigh-Ritz) and Q is
+ * replaced by an orthonormal basis of Y. Memory is O(dim*Nsub) per thread,
+ * independently of the number of vectors. The first pass starts from a
+ * random subspace, so at least two passes are needed.
+ *
+ * Vectors may be added from several threads at the same time if each one
+ * uses a different thread_id. Blocks of vectors are processed together to
+ * reuse the subspace basis while it is in cache.
+ *
+ * With MPI, each node adds its own vectors, calls gatherThreads and sums
+ * accumulator with MPI_Allreduce before calling updateSubspace. All nodes
+ * must start with the same Q (e.g., broadcast it after initialize).
+ *
+ * @code
+ * StreamingRandomizedPCA pca;
+ * pca.initialize(dim, NPCA);
+ * for (int pass=0; pass<Npasses; pass++)
+ * {
+ *    pca.startPass();
+ *    FOR_ALL_VECTORS ...
+ *       pca.addVector(v);
+ *    pca.endPass();
+ * }
+ * // Principal components are the rows of pca.PCAbasis
+ * @endcode
+ */
+class StreamingRandomizedPCA
+{
+public:
+    /// Vector size
+    size_t dim;
+    /// Number of principal components
+    size_t NPCA;
+    /// Size of the iterated subspace (NPCA plus oversampling)
+    size_t Nsub;
+    /// Subtract the average of the vectors
+    bool center;
+    /// Orthonormal basis of the subspace (Nsub x dim, by rows)
+    Matrix2D<double> Q;
+    /// Principal components (NPCA x dim, by rows), by decreasing eigenvalue
+    Matrix2D<double> PCAbasis;
+    /// Eigenvalues (sum of the squared projections) of the principal components
+    Matrix1D<double> eigenvalues;
+    /// Average of the vectors of the last pass
+    Matrix1D<double> avg;
+    /// Number of vectors of the last pass
+    size_t N;
+    /// Number of vectors processed together by each thread
+    size_t blockSize;
+    /** Sums of the current pass: A A^t Q (Nsub x dim), sum of the
+     * vectors (dim) and number of vectors (1). Filled by gatherThreads
+     * and released by updateSubspace. */
+    std::vector<double> accumulator;
+public:
+    /// Empty constructor
+    StreamingRandomizedPCA();
+
+    /** Set sizes and initialize Q with random vectors.
+     * Nthreads is the number of different thread_id that will add vectors.
+     */
+    void initialize(size_t _dim, size_t _NPCA, size_t oversampling=10,
+                    bool _center=true, int Nthreads=1);
+
+    /// Reset the accumulators for a new pass
+    void startPass();
+
+    /// Add a vector of dim elements
+    void addVector(const double *v, int thread_id=0);
+
+    /// Add a vector of dim elements
+    void addVector(const float *v, int thread_id=0);
+
+    /// Sum the accumulators of all threads into accumulator
+    void gatherThreads();
+
+    /** Estimate the principal components and the new subspace from accumulator.
+     * The output of the last pass is in PCAbasis and eigenvalues.
+     */
+    void updateSubspace();
+
+    /// Finish a pass (gatherThreads and updateSubspace)
+    void endPass()
+    {
+        gatherThreads();
+        updateSubspace();
+    }
+
+    /// Project a (non centered) vector onto the NPCA principal components
+    void project(const double *v, double *coeffs) const;
+
+    /** Coordinates (Nsub) of a vector in the subspace of the current pass.
+     * Keeping them during the last pass, the projections onto the principal
+     * components are obtained with projectFromSubspace after endPass,
+     * without another pass over the vectors.
+     */
+    void projectOntoSubspace(const double *v, double *coords) const;
+
+    /** Projection onto the NPCA principal components of a vector from its
+     * coordinates in the subspace of the last pass (see projectOntoSubspace).
+     */
+    void projectFromSubspace(const double *coords, double *coeffs) const;
+
+private:
+    // Principal components in the subspace of the last pass (NPCA x Nsub)
+    Matrix2D<double> subspacePCA;
+    // Average of the last pass in the subspace of the last pass (Nsub)
+    Matrix1D<double> subspaceAvg;
+    // Accumulators of each thread, with the same layout as accumulator
+    std::vector< std::vector<double> > threadAccumulator;
+    // Vectors not yet processed of each thread
+    std::vector< std::vector<double> > threadBlock;
+    std::vector<size_t> threadBlockSize;
+
+    // Process the vectors in the block of a thread
+    void processBlock(int thread_id);
+};
 //@}
 #endif
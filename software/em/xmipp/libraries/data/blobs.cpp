@@ -31,6 +31,7 @@
 
 #include "xmipp_funcs.h"
 #include "geometry.h"
+#include "xmipp_threads.h"
 
 pthread_mutex_t blobs_conv_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -902,6 +903,24 @@ void voxel_volume_shape(const GridVolume &vol_blobs,
 }
 #undef DEBUG
 
+/* Run blobs2voxels_SimpleGrid in the thread pool ------------------------- */
+// The workers distribute the slices among themselves, so each task keeps
+// working until all slices are done. Running them in the shared pool avoids
+// creating threads for every call.
+void blobs2voxels_runThreads(ThreadBlobsToVoxels * threads_d, int threads)
+{
+    ThreadPool &pool = ThreadPool::getInstance();
+    std::vector<FunctionTask> tasks(threads);
+    TaskFuture done;
+    for (int c = 0; c < threads; c++)
+    {
+        tasks[c].function = blobs2voxels_SimpleGrid;
+        tasks[c].data = (void *)(threads_d + c);
+        pool.submit(&tasks[c], &done);
+    }
+    done.wait();
+}
+
 /* Blobs -> Voxels for a Grid ---------------------------------------------- */
 //#define DEBUG
 void blobs2voxels(const GridVolume &vol_blobs,
@@ -925,7 +944,6 @@ void blobs2voxels(const GridVolume &vol_blobs,
         (*vol_voxels).setXmippOrigin();
     }
 
-    pthread_t * th_ids = new pthread_t [threads];
     ThreadBlobsToVoxels * threads_d = new ThreadBlobsToVoxels [threads];
 
     // Convert each subvolume ...............................................
@@ -953,14 +971,10 @@ void blobs2voxels(const GridVolume &vol_blobs,
             threads_d[c].threads_num = threads;
             threads_d[c].min_separation = min_distance;
 
-            pthread_create( (th_ids+c), NULL, blobs2voxels_SimpleGrid, (void *)(threads_d+c) );
         }
 
-        // Wait for threads to finish
-        for( int c = 0 ; c < threads ; c++ )
-        {
-            pthread_join(*(th_ids+c),NULL);
-        }
+        // Run the conversion in the shared thread pool and wait for it
+        blobs2voxels_runThreads(threads_d, threads);
 
 #ifdef DEBUG
         std::cout << "Blob grid no " << i << " stats: ";
@@ -1001,7 +1015,6 @@ void blobs2voxels(const GridVolume &vol_blobs,
             A3D_ELEM(*vol_voxels, k, i, j) = min_val;
     }
 
-    delete[] th_ids;
     delete[] threads_d;
 }
 #undef DEBUG
@@ -1106,7 +1119,6 @@ void ART_voxels2blobs_single_step(
     }
     (*corr_vol).initZeros(*theo_vol);
 
-    pthread_t * th_ids = (pthread_t *)malloc( threads * sizeof( pthread_t));
     ThreadBlobsToVoxels * threads_d = (ThreadBlobsToVoxels *) malloc ( threads * sizeof( ThreadBlobsToVoxels ) );
 
     // Translate actual blob volume to voxels ...............................
@@ -1134,14 +1146,10 @@ void ART_voxels2blobs_single_step(
             threads_d[c].threads_num = threads;
             threads_d[c].min_separation = min_distance;
 
-            pthread_create( (th_ids+c), NULL, blobs2voxels_SimpleGrid, (void *)(threads_d+c) );
         }
 
-        // Wait for threads to finish
-        for( int c = 0 ; c < threads ; c++ )
-        {
-            pthread_join(*(th_ids+c),NULL);
-        }
+        // Run the conversion in the shared thread pool and wait for it
+        blobs2voxels_runThreads(threads_d, threads);
 
         free( slices_status );
         //        blobs2voxels_SimpleGrid(vol_in(i)(), vol_in.grid(i), blob, theo_vol, D,
@@ -1265,14 +1273,10 @@ void ART_voxels2blobs_single_step(
             threads_d[c].threads_num = threads;
             threads_d[c].min_separation = 1;
 
-            pthread_create( (th_ids+c), NULL, blobs2voxels_SimpleGrid, (void *)(threads_d+c) );
         }
 
-        // Wait for threads to finish
-        for( int c = 0 ; c < threads ; c++ )
-        {
-            pthread_join(*(th_ids+c),NULL);
-        }
+        // Run the conversion in the shared thread pool and wait for it
+        blobs2voxels_runThreads(threads_d, threads);
 
         free( slices_status );
         //        blobs2voxels_SimpleGrid((*vol_out)(i)(), (*vol_out).grid(i), blob,
@@ -64,6 +64,10 @@ typedef struct{
 	int min_separation;
 } ThreadBlobsToVoxels ;
 
+/** Execute blobs2voxels_SimpleGrid with the given arguments in the
+ * shared ThreadPool and wait for all of them to finish. */
+void blobs2voxels_runThreads(ThreadBlobsToVoxels * threads_d, int threads);
+
 /* ========================================================================= */
 /* BLOBS                                                                     */
 /* ========================================================================= */
@@ -25,6 +25,7 @@
 
 #include "filters.h"
 #include <list>
+#include <algorithm>
 #include "morphology.h"
 #include "wavelet.h"
 
@@ -62,6 +63,115 @@ void substractBackgroundPlane(MultidimArray<double> &I)
     A2D_ELEM(I, i, j) -= x(0) * i + x(1) * j + x(2);
 }
 
+/* Rows of the shrinked image of the rolling ball ------------------------- */
+class RollingBallShrinkRows: public ParallelForBody
+{
+public:
+    const MultidimArray<double> *I;
+    MultidimArray<double> *shrinkI;
+    int shrinkFactor;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        const MultidimArray<double> &mI = *I;
+        int Ydim = (int)YSIZE(mI);
+        int Xdim = (int)XSIZE(mI);
+        for (int ySmall = (int)first; ySmall <= (int)last; ySmall++)
+            for (int xSmall = 0; xSmall < (int)XSIZE(*shrinkI); xSmall++)
+            {
+                double minVal = 1e38;
+                for (int j = 0, y = shrinkFactor * ySmall;
+                     j < shrinkFactor && y < Ydim; j++, y++)
+                    for (int k = 0, x = shrinkFactor * xSmall;
+                         k < shrinkFactor && x < Xdim; k++, x++)
+                    {
+                        double thispixel = DIRECT_A2D_ELEM(mI,y,x);
+                        if (thispixel < minVal)
+                            minVal = thispixel;
+                    }
+                DIRECT_A2D_ELEM(*shrinkI,ySmall,xSmall) = minVal;
+            }
+    }
+};
+
+/* Rows of the rolling ball ----------------------------------------------- */
+// zBall(yb+radius,xb+radius) is the height at which the ball centered at
+// (yb,xb) touches the shrinked image. If computeHeights is false, the rows
+// of Irolled are computed from zBall instead.
+class RollingBallRows: public ParallelForBody
+{
+public:
+    const MultidimArray<double> *shrinkI;
+    const MultidimArray<double> *ball;
+    MultidimArray<double> *zBall;
+    MultidimArray<double> *Irolled;
+    int radius;
+    bool computeHeights;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        const MultidimArray<double> &mI = *shrinkI;
+        const MultidimArray<double> &mBall = *ball;
+        int Ydim = (int)YSIZE(mI);
+        int Xdim = (int)XSIZE(mI);
+        for (int row = (int)first; row <= (int)last; row++)
+        {
+            if (computeHeights)
+            {
+                int yb = row - radius;
+                int y0 = XMIPP_MAX(yb - radius, 0);
+                int y0b = y0 - yb + radius;
+                int yF = XMIPP_MIN(yb + radius, Ydim - 1);
+                double *ptrZ = &DIRECT_A2D_ELEM(*zBall,row,0);
+                for (int xb = -radius; xb < Xdim + radius; xb++)
+                {
+                    int x0 = XMIPP_MAX(xb - radius, 0);
+                    int x0b = x0 - xb + radius;
+                    int xF = XMIPP_MIN(xb + radius, Xdim - 1);
+                    double z = 1e38;
+                    for (int yp = y0, ybp = y0b; yp <= yF; yp++, ybp++)
+                    {
+                        const double *ptrI = &DIRECT_A2D_ELEM(mI,yp,x0);
+                        const double *ptrBall = &DIRECT_A2D_ELEM(mBall,ybp,x0b);
+                        for (int n = 0; n <= xF - x0; n++)
+                        {
+                            double zReduced = ptrI[n] - ptrBall[n];
+                            z = (zReduced < z) ? zReduced : z;
+                        }
+                    }
+                    ptrZ[xb + radius] = z;
+                }
+            }
+            else
+            {
+                // Ball centers touching this row
+                int yp = row;
+                double *ptrOut = &DIRECT_A2D_ELEM(*Irolled,yp,0);
+                for (int xp = 0; xp < Xdim; xp++)
+                    ptrOut[xp] = -500;
+                for (int yb = yp - radius; yb <= yp + radius; yb++)
+                {
+                    const double *ptrZ = &DIRECT_A2D_ELEM(*zBall,yb + radius,0);
+                    const double *ptrBall = &DIRECT_A2D_ELEM(mBall,yp - yb + radius,0);
+                    for (int xp = 0; xp < Xdim; xp++)
+                    {
+                        // Ball centers xb in [xp-radius,xp+radius], stored
+                        // in zBall at xb+radius
+                        double zMax = ptrOut[xp];
+                        const double *ptrZx = ptrZ + xp;
+                        for (int xbp = 2 * radius; xbp >= 0; xbp--)
+                        {
+                            double zMin = ptrZx[2 * radius - xbp] + ptrBall[xbp];
+                            zMax = (zMin > zMax) ? zMin : zMax;
+                        }
+                        ptrOut[xp] = zMax;
+                    }
+                }
+            }
+        }
+    }
+};
+
 /* Subtract background ---------------------------------------------------- */
 void substractBackgroundRollingBall(MultidimArray<double> &I, int radius)
 {
@@ -113,69 +223,33 @@ void substractBackgroundRollingBall(MultidimArray<double> &I, int radius)
     int sYdim = (YSIZE(I) + shrinkFactor - 1) / shrinkFactor;
     MultidimArray<double> shrinkI(sYdim, sXdim);
     shrinkI.setXmippOrigin();
-    for (int ySmall = 0; ySmall < sYdim; ySmall++)
-    {
-        for (int xSmall = 0; xSmall < sXdim; xSmall++)
-        {
-            double minVal = 1e38;
-            for (int j = 0, y = shrinkFactor * ySmall;
-                 j < shrinkFactor && y < (int)YSIZE(I); j++, y++)
-                for (int k = 0, x = shrinkFactor * xSmall;
-                     k < shrinkFactor && x < (int)XSIZE(I); k++, x++)
-                {
-                    double thispixel = DIRECT_A2D_ELEM(I,y,x);
-                    if (thispixel < minVal)
-                        minVal = thispixel;
-                }
-            DIRECT_A2D_ELEM(shrinkI,ySmall,xSmall) = minVal;
-        }
-    }
-
-    // Now roll the ball
+    ThreadPool &pool = ThreadPool::getInstance();
+    RollingBallShrinkRows shrinkRows;
+    shrinkRows.I = &I;
+    shrinkRows.shrinkI = &shrinkI;
+    shrinkRows.shrinkFactor = shrinkFactor;
+    pool.parallelFor(0, sYdim - 1, shrinkRows);
+
+    // Now roll the ball. The lowest position of the ball at each
+    // location is computed first, and then every pixel of the background
+    // takes the highest ball surface covering it. Both passes are
+    // independent per row.
     radius = ballWidth / 2;
+    MultidimArray<double> zBall(YSIZE(shrinkI) + 2 * radius,
+                                XSIZE(shrinkI) + 2 * radius);
+    RollingBallRows rollRows;
+    rollRows.shrinkI = &shrinkI;
+    rollRows.ball = &ball;
+    rollRows.zBall = &zBall;
+    rollRows.radius = radius;
+    rollRows.computeHeights = true;
+    pool.parallelFor(0, YSIZE(zBall) - 1, rollRows);
+
     MultidimArray<double> Irolled;
     Irolled.resizeNoCopy(shrinkI);
-    Irolled.initConstant(-500);
-    for (int yb = -radius; yb < (int)YSIZE(shrinkI) + radius; yb++)
-    {
-        // Limits of the ball
-        int y0 = yb - radius;
-        if (y0 < 0)
-            y0 = 0;
-        int y0b = y0 - yb + radius; //y coordinate in the ball corresponding to y0
-        int yF = yb + radius;
-        if (yF >= (int)YSIZE(shrinkI))
-            yF = (int)YSIZE(shrinkI) - 1;
-
-        for (int xb = -radius; xb < (int)XSIZE(shrinkI) + radius; xb++)
-        {
-            // Limits of the ball
-            int x0 = xb - radius;
-            if (x0 < 0)
-                x0 = 0;
-            int x0b = x0 - xb + radius;
-            int xF = xb + radius;
-            if (xF >= (int)XSIZE(shrinkI))
-                xF = (int)XSIZE(shrinkI) - 1;
-
-            double z = 1e38;
-            for (int yp = y0, ybp = y0b; yp <= yF; yp++, ybp++)
-                for (int xp = x0, xbp = x0b; xp <= xF; xp++, xbp++)
-                {
-                    double zReduced = DIRECT_A2D_ELEM(shrinkI,yp,xp)
-                                      - DIRECT_A2D_ELEM(ball,ybp,xbp);
-                    if (z > zReduced)
-                        z = zReduced;
-                }
-            for (int yp = y0, ybp = y0b; yp <= yF; yp++, ybp++)
-                for (int xp = x0, xbp = x0b; xp <= xF; xp++, xbp++)
-                {
-                    double zMin = z + DIRECT_A2D_ELEM(ball,ybp,xbp);
-                    if (DIRECT_A2D_ELEM(Irolled,yp,xp) < zMin)
-                        DIRECT_A2D_ELEM(Irolled,yp,xp) = zMin;
-                }
-        }
-    }
+    rollRows.Irolled = &Irolled;
+    rollRows.computeHeights = false;
+    pool.parallelFor(0, YSIZE(Irolled) - 1, rollRows);
 
     // Now rescale the background
     MultidimArray<double> bgEnlarged;
@@ -631,44 +705,203 @@ void distanceTransform(const MultidimArray<int> &in, MultidimArray<int> &out,
 }
 
 /* Label image ------------------------------------------------------------ */
-int labelImage2D(const MultidimArray<double> &I, MultidimArray<double> &label,
-                 int neighbourhood)
+// Connected components are computed with a union-find forest stored in
+// parent: roots have negative values, -1 for a component without label yet
+// and -(l+1) once it is given the label l. Trees are always linked to the
+// root with the smallest index so that the result is deterministic.
+// The image is split into bands of rows (slices for volumes) that are
+// labeled in parallel, then the trees of neighbouring bands are merged.
+static inline int findComponentRoot(const std::vector<int> &parent, int p)
 {
-    I.checkDimension(2);
+    while (parent[p] >= 0)
+        p = parent[p];
+    return p;
+}
 
-    label = I;
-    int colour = 32000;
-    FOR_ALL_ELEMENTS_IN_ARRAY2D(label)
+static inline int findComponentRoot(std::vector<int> &parent, int p)
+{
+    int root = p;
+    while (parent[root] >= 0)
+        root = parent[root];
+    while (parent[p] >= 0)
     {
-        if (label(i, j) != 1)
-            continue;
-        regionGrowing2D(label, label, i, j, 0, colour, false, neighbourhood);
-        colour++;
+        int next = parent[p];
+        parent[p] = root;
+        p = next;
     }
-    FOR_ALL_ELEMENTS_IN_ARRAY2D(label)
-    if (label(i, j) != 0)
-        label(i, j) = label(i, j) - 31999;
-    return colour - 32000;
+    return root;
 }
 
-/* Label volume ------------------------------------------------------------ */
-int labelImage3D(const MultidimArray<double> &V, MultidimArray<double> &label)
+static inline void joinComponents(std::vector<int> &parent, int p, int q)
 {
-    V.checkDimension(3);
+    p = findComponentRoot(parent, p);
+    q = findComponentRoot(parent, q);
+    if (p < q)
+        parent[q] = p;
+    else if (q < p)
+        parent[p] = q;
+}
 
-    label = V;
-    int colour = 32000;
-    FOR_ALL_ELEMENTS_IN_ARRAY3D(label)
+class ConnectedComponentsBands: public ParallelForBody
+{
+public:
+    const MultidimArray<double> *I;
+    MultidimArray<double> *label;
+    std::vector<int> *parent;
+    // Offsets (k,i,j) of the neighbours already visited in raster order
+    std::vector<int> dk, di, dj;
+    // First outer index (slice or row) of every band, plus the end
+    std::vector<int> bandStart;
+    bool volume;
+    bool labelPass;
+
+    // Join p=(k,i,j) with its previous neighbours whose outer index is
+    // at least minOuter
+    void joinNeighbours(int k, int i, int j, int minOuter)
     {
-        if (label(k, i, j) != 1)
-            continue;
-        regionGrowing3D(label, label, k, i, j, 0, colour, false);
-        colour++;
+        const MultidimArray<double> &mI = *I;
+        int p = (int)((k * YSIZE(mI) + i) * XSIZE(mI) + j);
+        for (size_t n = 0; n < dk.size(); n++)
+        {
+            int kk = k + dk[n], ii = i + di[n], jj = j + dj[n];
+            if (kk < 0 || ii < 0 || jj < 0 || ii >= (int)YSIZE(mI) ||
+                jj >= (int)XSIZE(mI) ||
+                (volume ? kk : ii) < minOuter)
+                continue;
+            if (DIRECT_A3D_ELEM(mI, kk, ii, jj) > 0)
+                joinComponents(*parent, p,
+                               (int)((kk * YSIZE(mI) + ii) * XSIZE(mI) + jj));
+        }
+    }
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        const MultidimArray<double> &mI = *I;
+        const std::vector<int> &cparent = *parent;
+        for (size_t band = first; band <= last; band++)
+        {
+            int outer0 = bandStart[band], outerF = bandStart[band + 1];
+            int k0 = volume ? outer0 : 0, kF = volume ? outerF : 1;
+            int i0 = volume ? 0 : outer0, iF = volume ? (int)YSIZE(mI) : outerF;
+            for (int k = k0; k < kF; k++)
+                for (int i = i0; i < iF; i++)
+                    for (int j = 0; j < (int)XSIZE(mI); j++)
+                    {
+                        int p = (int)((k * YSIZE(mI) + i) * XSIZE(mI) + j);
+                        double value = DIRECT_A3D_ELEM(mI, k, i, j);
+                        if (!labelPass)
+                        {
+                            if (value > 0)
+                                joinNeighbours(k, i, j, outer0);
+                        }
+                        else
+                        {
+                            // Components without any pixel equal to 1 are
+                            // not labeled, as in the region growing version
+                            int l = 0;
+                            if (value > 0)
+                                l = -cparent[findComponentRoot(cparent, p)] - 1;
+                            if (l > 0)
+                                DIRECT_A3D_ELEM(*label, k, i, j) = l;
+                            else if (value != 0)
+                                DIRECT_A3D_ELEM(*label, k, i, j) = value - 31999;
+                            else
+                                DIRECT_A3D_ELEM(*label, k, i, j) = 0;
+                        }
+                    }
+        }
     }
-    FOR_ALL_ELEMENTS_IN_ARRAY3D(label)
-    if (A3D_ELEM(label,k, i, j) != 0)
-        A3D_ELEM(label,k, i, j) = A3D_ELEM(label,k, i, j) - 31999;
-    return colour - 32000;
+};
+
+static int labelConnectedComponents(const MultidimArray<double> &I,
+                                    MultidimArray<double> &label, int neighbourhood, bool volume)
+{
+    size_t Ndim = MULTIDIM_SIZE(I);
+    if (Ndim >= (size_t)INT_MAX)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "labelImage: array too large");
+
+    ConnectedComponentsBands bands;
+    bands.I = &I;
+    bands.volume = volume;
+    int offsets2D[4][3] = {{0, 0, -1}, {0, -1, 0}, {0, -1, -1}, {0, -1, 1}};
+    if (volume)
+    {
+        for (int k = -1; k <= 0; k++)
+            for (int i = -1; i <= 1; i++)
+                for (int j = -1; j <= 1; j++)
+                    if (k < 0 || i < 0 || (i == 0 && j < 0))
+                    {
+                        bands.dk.push_back(k);
+                        bands.di.push_back(i);
+                        bands.dj.push_back(j);
+                    }
+    }
+    else
+        for (int n = 0; n < (neighbourhood == 8 ? 4 : 2); n++)
+        {
+            bands.dk.push_back(offsets2D[n][0]);
+            bands.di.push_back(offsets2D[n][1]);
+            bands.dj.push_back(offsets2D[n][2]);
+        }
+
+    ThreadPool &pool = ThreadPool::getInstance();
+    int outerSize = volume ? (int)ZSIZE(I) : (int)YSIZE(I);
+    int Nbands = XMIPP_MIN(outerSize, 4 * (pool.getNumberOfThreads() + 1));
+    for (int n = 0; n < Nbands; n++)
+        bands.bandStart.push_back((int)(((size_t)n * outerSize) / Nbands));
+    bands.bandStart.push_back(outerSize);
+
+    // Local trees within each band
+    std::vector<int> parent(Ndim, -1);
+    bands.parent = &parent;
+    bands.labelPass = false;
+    pool.parallelFor(0, Nbands - 1, bands, 1);
+
+    // Merge the first row (slice) of each band with the previous band
+    for (int n = 1; n < Nbands; n++)
+    {
+        int outer = bands.bandStart[n];
+        int k0 = volume ? outer : 0, kF = volume ? outer + 1 : 1;
+        int i0 = volume ? 0 : outer, iF = volume ? (int)YSIZE(I) : outer + 1;
+        for (int k = k0; k < kF; k++)
+            for (int i = i0; i < iF; i++)
+                for (int j = 0; j < (int)XSIZE(I); j++)
+                    if (DIRECT_A3D_ELEM(I, k, i, j) > 0)
+                        bands.joinNeighbours(k, i, j, outer - 1);
+    }
+
+    // Components are numbered by the order of their first pixel equal to 1
+    int Nlabels = 0;
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(I)
+    if (DIRECT_MULTIDIM_ELEM(I, n) == 1)
+    {
+        int root = findComponentRoot(parent, (int)n);
+        if (parent[root] == -1)
+            parent[root] = -(++Nlabels) - 1;
+    }
+
+    // Write the labels. The input is no longer needed after this pass,
+    // so that I and label may be the same array
+    if (&label != &I)
+        label.resizeNoCopy(I);
+    bands.label = &label;
+    bands.labelPass = true;
+    pool.parallelFor(0, Nbands - 1, bands, 1);
+    return Nlabels;
+}
+
+int labelImage2D(const MultidimArray<double> &I, MultidimArray<double> &label,
+                 int neighbourhood)
+{
+    I.checkDimension(2);
+    return labelConnectedComponents(I, label, neighbourhood, false);
+}
+
+/* Label volume ------------------------------------------------------------ */
+int labelImage3D(const MultidimArray<double> &V, MultidimArray<double> &label)
+{
+    V.checkDimension(3);
+    return labelConnectedComponents(V, label, 26, true);
 }
 
 /* Remove small components ------------------------------------------------- */
@@ -1455,14 +1688,11 @@ void bestNonwrappingShift(const MultidimArray<double> &I1,
     bestNonwrappingShift(I1,aux.FFT1,I2,shiftX,shiftY,aux);
 }
 
-void bestNonwrappingShift(const MultidimArray<double> &I1, const MultidimArray< std::complex<double> >&FFTI1,
-                          const MultidimArray<double> &I2, double &shiftX, double &shiftY,
-                          CorrelationAux &aux)
+/* Choose among the wrapped and non-wrapped versions of the shift found
+   by bestShift the one with the highest correlation */
+static void nonwrappingShift(const MultidimArray<double> &I1, const MultidimArray<double> &I2,
+                             double &shiftX, double &shiftY)
 {
-    I1.checkDimension(2);
-    I2.checkDimension(2);
-
-    bestShift(I1, FFTI1, I2, shiftX, shiftY, aux);
     double bestCorr, corr;
     MultidimArray<double> Iaux;
 
@@ -1539,6 +1769,30 @@ void bestNonwrappingShift(const MultidimArray<double> &I1, const MultidimArray<
 }
 #undef DEBUG
 
+void bestNonwrappingShift(const MultidimArray<double> &I1, const MultidimArray< std::complex<double> >&FFTI1,
+                          const MultidimArray<double> &I2, double &shiftX, double &shiftY,
+                          CorrelationAux &aux)
+{
+    I1.checkDimension(2);
+    I2.checkDimension(2);
+
+    bestShift(I1, FFTI1, I2, shiftX, shiftY, aux);
+    nonwrappingShift(I1, I2, shiftX, shiftY);
+}
+
+void bestNonwrappingShift(const MultidimArray<double> &I1, const MultidimArray< std::complex<double> >&FFTI1,
+                          const MultidimArray<double> &I2, const MultidimArray< std::complex<double> >&FFTI2,
+                          double &shiftX, double &shiftY, CorrelationAux &aux)
+{
+    I1.checkDimension(2);
+    I2.checkDimension(2);
+
+    MultidimArray<double> Mcorr;
+    Mcorr.resizeNoCopy(I2);
+    bestShift(FFTI1, FFTI2, Mcorr, shiftX, shiftY, aux);
+    nonwrappingShift(I1, I2, shiftX, shiftY);
+}
+
 /* Best shift -------------------------------------------------------------- */
 double bestShiftRealSpace(const MultidimArray<double> &I1, MultidimArray<double> &I2,
                double &shiftX, double &shiftY,
@@ -1588,7 +1842,7 @@ AlignmentAux::~AlignmentAux()
 void computeAlignmentTransforms(const MultidimArray<double>& I, AlignmentTransforms &ITransforms,
 		AlignmentAux &aux, CorrelationAux &aux2)
 {
-	aux2.transformer1.FourierTransform((MultidimArray<double> &)I, ITransforms.FFTI, false);
+	aux2.transformer1.FourierTransform((MultidimArray<double> &)I, ITransforms.FFTI, true);
     normalizedPolarFourierTransform(I, ITransforms.polarFourierI, false, XSIZE(I) / 5, XSIZE(I) / 2, aux.plans, 1);
 }
 
@@ -1598,9 +1852,13 @@ void computeAlignmentTransforms(const MultidimArray<double>& I, AlignmentTransfo
 #define INITIAL_SHIFT_THRESHOLD 	SHIFT_THRESHOLD + 1.0		// Shift threshold in pixels.
 #define INITIAL_ROTATE_THRESHOLD 	ROTATE_THRESHOLD + 1.0		// Rotate threshold in degrees.
 
-double alignImages(const MultidimArray<double>& Iref, const AlignmentTransforms& IrefTransforms, MultidimArray<double>& I,
-                   Matrix2D<double>&M, bool wrap, AlignmentAux &aux, CorrelationAux &aux2,
-                   RotationalCorrelationAux &aux3)
+/* Align I to Iref. If ITransforms is not NULL, it has the FFT of I and its
+   conjugated polar Fourier transform, and they are used by the first shift
+   and rotation searches. */
+static double alignImages(const MultidimArray<double>& Iref, const AlignmentTransforms& IrefTransforms,
+                          MultidimArray<double>& I, const AlignmentTransforms *ITransforms,
+                          Matrix2D<double>&M, bool wrap, AlignmentAux &aux, CorrelationAux &aux2,
+                          RotationalCorrelationAux &aux3)
 {
     I.checkDimension(2);
 
@@ -1622,7 +1880,11 @@ double alignImages(const MultidimArray<double>& Iref, const AlignmentTransforms&
 		if (((shiftXSR > SHIFT_THRESHOLD) || (shiftXSR < (-SHIFT_THRESHOLD))) ||
 			((shiftYSR > SHIFT_THRESHOLD) || (shiftYSR < (-SHIFT_THRESHOLD))))
 		{
-			bestNonwrappingShift(Iref, IrefTransforms.FFTI, aux.IauxSR, shiftXSR, shiftYSR, aux2);
+			if (i == 0 && ITransforms != NULL)
+				bestNonwrappingShift(Iref, IrefTransforms.FFTI, aux.IauxSR, ITransforms->FFTI,
+									 shiftXSR, shiftYSR, aux2);
+			else
+				bestNonwrappingShift(Iref, IrefTransforms.FFTI, aux.IauxSR, shiftXSR, shiftYSR, aux2);
 			MAT_ELEM(aux.ASR,0,2) += shiftXSR;
 			MAT_ELEM(aux.ASR,1,2) += shiftYSR;
 			applyGeometry(LINEAR, aux.IauxSR, I, aux.ASR, IS_NOT_INV, wrap);
@@ -1642,9 +1904,14 @@ double alignImages(const MultidimArray<double>& Iref, const AlignmentTransforms&
         // Rotate then shift
 		if (bestRotRS > ROTATE_THRESHOLD)
 		{
-			normalizedPolarFourierTransform(aux.IauxRS, aux.polarFourierI, true,
-											XSIZE(Iref) / 5, XSIZE(Iref) / 2, aux.plans, 1);
-			bestRotRS = best_rotation(IrefTransforms.polarFourierI, aux.polarFourierI, aux3);
+			if (i == 0 && ITransforms != NULL)
+				bestRotRS = best_rotation(IrefTransforms.polarFourierI, ITransforms->polarFourierI, aux3);
+			else
+			{
+				normalizedPolarFourierTransform(aux.IauxRS, aux.polarFourierI, true,
+												XSIZE(Iref) / 5, XSIZE(Iref) / 2, aux.plans, 1);
+				bestRotRS = best_rotation(IrefTransforms.polarFourierI, aux.polarFourierI, aux3);
+			}
 			rotation2DMatrix(bestRotRS, aux.R);
 			aux.ARS = aux.R * aux.ARS;
 			applyGeometry(LINEAR, aux.IauxRS, I, aux.ARS, IS_NOT_INV, wrap);
@@ -1678,6 +1945,13 @@ double alignImages(const MultidimArray<double>& Iref, const AlignmentTransforms&
     return corr;
 }
 
+double alignImages(const MultidimArray<double>& Iref, const AlignmentTransforms& IrefTransforms, MultidimArray<double>& I,
+                   Matrix2D<double>&M, bool wrap, AlignmentAux &aux, CorrelationAux &aux2,
+                   RotationalCorrelationAux &aux3)
+{
+    return alignImages(Iref, IrefTransforms, I, NULL, M, wrap, aux, aux2, aux3);
+}
+
 double alignImages(const MultidimArray<double>& Iref, MultidimArray<double>& I,
                    Matrix2D<double>&M, bool wrap, AlignmentAux &aux, CorrelationAux &aux2,
                    RotationalCorrelationAux &aux3)
@@ -1746,6 +2020,254 @@ double alignImagesConsideringMirrors(const MultidimArray<double>& Iref,
     return alignImagesConsideringMirrors(Iref, IrefTransforms, I, M, aux, aux2, aux3, wrap, mask);
 }
 
+/* Multireference alignment ------------------------------------------------ */
+MultireferenceAligner::MultireferenceAligner()
+{
+    wrap = WRAP;
+    considerMirrors = true;
+    Ncandidates = 0;
+    mask = NULL;
+}
+
+MultireferenceAligner::~MultireferenceAligner()
+{
+    clearReferences();
+    for (size_t t = 0; t < threadAux.size(); ++t)
+        delete threadAux[t];
+}
+
+void MultireferenceAligner::addReference(const MultidimArray<double> &Iref)
+{
+    Iref.checkDimension(2);
+    if (!references.empty() && !Iref.sameShape(*references[0]))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "MultireferenceAligner: all references must have the same size");
+    MultidimArray<double> *ref = new MultidimArray<double>;
+    ref->alias(Iref);
+    references.push_back(ref);
+}
+
+void MultireferenceAligner::clearReferences()
+{
+    for (size_t refno = 0; refno < references.size(); ++refno)
+        delete references[refno];
+    references.clear();
+    referenceTransforms.clear();
+}
+
+void MultireferenceAligner::allocateThreadAux()
+{
+    size_t nThreads = ThreadPool::getInstance().getNumberOfThreads() + 1;
+    while (threadAux.size() < nThreads)
+        threadAux.push_back(new ThreadAux);
+}
+
+/* Transforms of a range of references */
+class MultireferenceTransformsBody: public ParallelForBody
+{
+public:
+    MultireferenceAligner *aligner;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        MultireferenceAligner::ThreadAux &taux = *(aligner->threadAux[thread_id]);
+        for (size_t refno = first; refno <= last; ++refno)
+            computeAlignmentTransforms(*(aligner->references[refno]),
+                                       aligner->referenceTransforms[refno], taux.aux, taux.aux2);
+    }
+};
+
+void MultireferenceAligner::computeReferenceTransforms()
+{
+    size_t first = referenceTransforms.size();
+    if (first >= references.size())
+        return;
+    allocateThreadAux();
+    referenceTransforms.resize(references.size());
+    MultireferenceTransformsBody body;
+    body.aligner = this;
+    ThreadPool::getInstance().parallelFor(first, references.size() - 1, body);
+}
+
+/* Rotational correlation of the experimental image, and its mirror, with a
+   range of references */
+class MultireferenceScreeningBody: public ParallelForBody
+{
+public:
+    MultireferenceAligner *aligner;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        MultireferenceAligner::ThreadAux &taux = *(aligner->threadAux[thread_id]);
+        const AlignmentTransforms &transforms = aligner->referenceTransforms[first];
+        taux.aux.rotationalCorr.resize(2 * transforms.polarFourierI.getSampleNoOuterRing() - 1);
+        taux.aux3.local_transformer.setReal(taux.aux.rotationalCorr);
+        for (size_t refno = first; refno <= last; ++refno)
+        {
+            const Polar< std::complex<double> > &polarRef =
+                aligner->referenceTransforms[refno].polarFourierI;
+            best_rotation(polarRef, aligner->IexpTransforms.polarFourierI, taux.aux3,
+                          aligner->scores[2 * refno]);
+            if (aligner->considerMirrors)
+                best_rotation(polarRef, aligner->IexpMirrorTransforms.polarFourierI, taux.aux3,
+                              aligner->scores[2 * refno + 1]);
+        }
+    }
+};
+
+/* Full alignment of the candidate pairs of a range of references */
+class MultireferenceAlignmentBody: public ParallelForBody
+{
+public:
+    MultireferenceAligner *aligner;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        MultireferenceAligner::ThreadAux &taux = *(aligner->threadAux[thread_id]);
+        for (size_t refno = first; refno <= last; ++refno)
+        {
+            bool direct = aligner->candidate[2 * refno];
+            bool mirror = aligner->candidate[2 * refno + 1];
+            if (!direct && !mirror)
+                continue;
+            const MultidimArray<double> &Iref = *(aligner->references[refno]);
+            const AlignmentTransforms &IrefTransforms = aligner->referenceTransforms[refno];
+            double corr = -1e38, corrMirror = -1e38;
+            if (direct)
+            {
+                taux.I = aligner->Iexp;
+                corr = alignImages(Iref, IrefTransforms, taux.I, &(aligner->IexpTransforms),
+                                   taux.M, aligner->wrap, taux.aux, taux.aux2, taux.aux3);
+                if (aligner->mask != NULL)
+                    corr = correlationIndex(Iref, taux.I, aligner->mask);
+            }
+            if (mirror)
+            {
+                taux.Imirror = aligner->IexpMirror;
+                corrMirror = alignImages(Iref, IrefTransforms, taux.Imirror,
+                                         &(aligner->IexpMirrorTransforms), taux.Mmirror,
+                                         aligner->wrap, taux.aux, taux.aux2, taux.aux3);
+                if (aligner->mask != NULL)
+                    corrMirror = correlationIndex(Iref, taux.Imirror, aligner->mask);
+            }
+
+            MultireferenceAlignment &alignment = aligner->refAlignments[refno];
+            alignment.refno = refno;
+            if (corrMirror > corr)
+            {
+                alignment.corr = corrMirror;
+                alignment.score = aligner->scores[2 * refno + 1];
+                alignment.mirror = true;
+                alignment.M = taux.Mmirror;
+                MAT_ELEM(alignment.M,0,0) *= -1;
+                MAT_ELEM(alignment.M,1,0) *= -1;
+                aligner->processAlignment(alignment, taux.Imirror, thread_id);
+            }
+            else
+            {
+                alignment.corr = corr;
+                alignment.score = aligner->scores[2 * refno];
+                alignment.mirror = false;
+                alignment.M = taux.M;
+                aligner->processAlignment(alignment, taux.I, thread_id);
+            }
+        }
+    }
+};
+
+/* Sort alignments by decreasing correlation */
+static bool betterAlignment(const MultireferenceAlignment &a1, const MultireferenceAlignment &a2)
+{
+    return a1.corr > a2.corr;
+}
+
+/* Sort pairs by decreasing score */
+class MultireferenceScoreComparator
+{
+public:
+    const std::vector<double> *scores;
+
+    bool operator()(size_t p1, size_t p2) const
+    {
+        return (*scores)[p1] > (*scores)[p2];
+    }
+};
+
+void MultireferenceAligner::align(const MultidimArray<double> &I,
+                                  std::vector<MultireferenceAlignment> &alignments, size_t K)
+{
+    alignments.clear();
+    size_t Nrefs = references.size();
+    if (Nrefs == 0)
+        return;
+    I.checkDimension(2);
+    if (!I.sameShape(*references[0]))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "MultireferenceAligner: the image and the references have different sizes");
+    computeReferenceTransforms();
+    allocateThreadAux();
+    ThreadPool &pool = ThreadPool::getInstance();
+
+    // Transforms of the experimental image and its mirror
+    ThreadAux &taux = *(threadAux[0]);
+    Iexp = I;
+    Iexp.setXmippOrigin();
+    taux.aux2.transformer1.FourierTransform(Iexp, IexpTransforms.FFTI, true);
+    normalizedPolarFourierTransform(Iexp, IexpTransforms.polarFourierI, true,
+                                    XSIZE(Iexp) / 5, XSIZE(Iexp) / 2, taux.aux.plans, 1);
+    if (considerMirrors)
+    {
+        IexpMirror = Iexp;
+        IexpMirror.selfReverseX();
+        IexpMirror.setXmippOrigin();
+        taux.aux2.transformer1.FourierTransform(IexpMirror, IexpMirrorTransforms.FFTI, true);
+        normalizedPolarFourierTransform(IexpMirror, IexpMirrorTransforms.polarFourierI, true,
+                                        XSIZE(IexpMirror) / 5, XSIZE(IexpMirror) / 2, taux.aux.plans, 1);
+    }
+
+    // Rotational screening
+    scores.assign(2 * Nrefs, -1e38);
+    candidate.assign(2 * Nrefs, false);
+    MultireferenceScreeningBody screening;
+    screening.aligner = this;
+    pool.parallelFor(0, Nrefs - 1, screening);
+
+    size_t Npairs = considerMirrors ? 2 * Nrefs : Nrefs;
+    if (Ncandidates == 0 || Ncandidates >= Npairs)
+        for (size_t refno = 0; refno < Nrefs; ++refno)
+        {
+            candidate[2 * refno] = true;
+            candidate[2 * refno + 1] = considerMirrors;
+        }
+    else
+    {
+        std::vector<size_t> pairs;
+        pairs.reserve(Npairs);
+        for (size_t refno = 0; refno < Nrefs; ++refno)
+        {
+            pairs.push_back(2 * refno);
+            if (considerMirrors)
+                pairs.push_back(2 * refno + 1);
+        }
+        MultireferenceScoreComparator comparator;
+        comparator.scores = &scores;
+        std::nth_element(pairs.begin(), pairs.begin() + Ncandidates, pairs.end(), comparator);
+        for (size_t n = 0; n < Ncandidates; ++n)
+            candidate[pairs[n]] = true;
+    }
+
+    // Full alignment of the candidates
+    refAlignments.resize(Nrefs);
+    MultireferenceAlignmentBody body;
+    body.aligner = this;
+    pool.parallelFor(0, Nrefs - 1, body, 1);
+
+    for (size_t refno = 0; refno < Nrefs; ++refno)
+        if (candidate[2 * refno] || candidate[2 * refno + 1])
+            alignments.push_back(refAlignments[refno]);
+    std::stable_sort(alignments.begin(), alignments.end(), betterAlignment);
+    if (K > 0 && alignments.size() > K)
+        alignments.resize(K);
+}
+
 void alignSetOfImages(MetaData &MD, MultidimArray<double>& Iavg, int Niter,
                       bool considerMirror)
 {
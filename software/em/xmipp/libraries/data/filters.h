@@ -35,6 +35,7 @@
 #include "xmipp_program.h"
 #include "mask.h"
 #include "polar.h"
+#include "xmipp_threads.h"
 
 /// @defgroup Filters Filters
 /// @ingroup DataLibrary
@@ -537,6 +538,13 @@ void bestNonwrappingShift(const MultidimArray<double> &I1, const MultidimArray<
                           const MultidimArray<double> &I2, double &shiftX, double &shiftY,
                           CorrelationAux &aux);
 
+/** Translational search (non-wrapping).
+ * Assumes that FFTI1 and FFTI2 are already computed.
+ */
+void bestNonwrappingShift(const MultidimArray<double> &I1, const MultidimArray< std::complex<double> > &FFTI1,
+                          const MultidimArray<double> &I2, const MultidimArray< std::complex<double> > &FFTI2,
+                          double &shiftX, double &shiftY, CorrelationAux &aux);
+
 /** Translational search (non-wrapping).
  * @ingroup Filters
  *
@@ -661,6 +669,154 @@ double alignImagesConsideringMirrors(const MultidimArray< double >& Iref,
                                      bool wrap=WRAP,
                                      const MultidimArray< int >* mask = NULL);
 
+/** Alignment of an image with one of the references of a MultireferenceAligner */
+class MultireferenceAlignment
+{
+public:
+    /// Reference number
+    size_t refno;
+    /// Correlation between the aligned image and the reference
+    double corr;
+    /// Rotational correlation used to screen the reference
+    double score;
+    /// The alignment was found for the mirror of the image
+    bool mirror;
+    /// Transformation of the image into the reference (including the mirror)
+    Matrix2D<double> M;
+};
+
+/** Alignment of an image with a set of references.
+ * @ingroup Filters
+ *
+ * The FFT and polar Fourier transforms of the references are computed once.
+ * For every experimental image, its transforms and those of its mirror are
+ * computed once and shared by the first shift and rotation searches of all
+ * the pairwise alignments. Before the full alignment, every (reference,
+ * mirror) pair is screened with the rotational correlation of their polar
+ * Fourier transforms, which costs a 1D inverse FFT per pair. If Ncandidates
+ * is not 0, only the Ncandidates pairs with the highest rotational
+ * correlation are fully aligned. This correlation is not shift invariant,
+ * so the direct and mirror pairs of a reference may be ranked in the wrong
+ * order if the image is shifted. Screening and alignments are distributed
+ * among the threads of ThreadPool::getInstance().
+ *
+ * With Ncandidates=0, the correlations and transformations are those of
+ * alignImagesConsideringMirrors (or alignImages if mirrors are not
+ * considered) with each one of the references.
+ *
+ * The references are aliased, they must not be freed nor modified while
+ * they are in the aligner.
+ * @code
+ * MultireferenceAligner aligner;
+ * for (size_t k=0; k<K; ++k)
+ *     aligner.addReference(Iref[k]);
+ * std::vector<MultireferenceAlignment> best;
+ * aligner.align(I, best, 3); // Three best references
+ * @endcode
+ */
+class MultireferenceAligner
+{
+public:
+    /// Wrap the images when they are transformed
+    bool wrap;
+    /// Consider also the mirror of the experimental image
+    bool considerMirrors;
+    /// Number of (reference, mirror) pairs fully aligned, 0 for all
+    size_t Ncandidates;
+    /** Mask for the final correlation.
+     * If it is NULL, the correlation is computed on the whole image. */
+    const MultidimArray<int> *mask;
+public:
+    /// Empty constructor
+    MultireferenceAligner();
+
+    /// Destructor
+    virtual ~MultireferenceAligner();
+
+    /** Add a reference.
+     * The reference is aliased. Its transforms are computed by the next
+     * call to align.
+     */
+    void addReference(const MultidimArray<double> &Iref);
+
+    /// Remove all references
+    void clearReferences();
+
+    /// Number of references
+    inline size_t size() const
+    {
+        return references.size();
+    }
+
+    /// Reference refno
+    inline const MultidimArray<double>& reference(size_t refno) const
+    {
+        return *references[refno];
+    }
+
+    /// Compute the transforms of the references that do not have them
+    void computeReferenceTransforms();
+
+    /** Align an image with all the references.
+     * The K best alignments are returned sorted by decreasing correlation
+     * (K=0 returns all the alignments that have been computed). I is not
+     * modified.
+     */
+    void align(const MultidimArray<double> &I,
+               std::vector<MultireferenceAlignment> &alignments, size_t K=1);
+
+    /** Process the alignment with one reference.
+     * It is called by the threads once for every aligned reference, with the
+     * image transformed by the best alignment (the mirror one if it
+     * is better). Calls for different references may run concurrently.
+     */
+    virtual void processAlignment(const MultireferenceAlignment &alignment,
+                                  const MultidimArray<double> &Ialigned, int thread_id)
+    {}
+
+protected:
+    // Auxiliary variables of each thread
+    class ThreadAux
+    {
+    public:
+        AlignmentAux aux;
+        CorrelationAux aux2;
+        RotationalCorrelationAux aux3;
+        MultidimArray<double> I, Imirror;
+        Matrix2D<double> M, Mmirror;
+    };
+
+    // References (aliases) and their transforms
+    std::vector< MultidimArray<double>* > references;
+    std::vector<AlignmentTransforms> referenceTransforms;
+
+    // Experimental image, its mirror and their transforms
+    MultidimArray<double> Iexp, IexpMirror;
+    AlignmentTransforms IexpTransforms, IexpMirrorTransforms;
+
+    // Rotational correlation of each (reference, mirror) pair
+    std::vector<double> scores;
+
+    // Alignment of each reference
+    std::vector<MultireferenceAlignment> refAlignments;
+
+    // Pairs that must be fully aligned
+    std::vector<bool> candidate;
+
+    // Auxiliary variables of each thread
+    std::vector<ThreadAux *> threadAux;
+
+    // Allocate the auxiliary variables of all the threads of the pool
+    void allocateThreadAux();
+
+    friend class MultireferenceTransformsBody;
+    friend class MultireferenceScreeningBody;
+    friend class MultireferenceAlignmentBody;
+private:
+    MultireferenceAligner(const MultireferenceAligner &);
+    MultireferenceAligner & operator=(const MultireferenceAligner &);
+};
+
 /** Align a set of images.
  * Align a set of images and produce a class average as well as the set of
  * alignment parameters. The output is in Iavg. The metadata is modified by adding
@@ -1182,29 +1338,20 @@ void median(MultidimArray< T >& x, MultidimArray< T >& y, T& m)
                     m = DIRECT_MULTIDIM_ELEM(y,4);
 }
 
-/** Median_filter with a 3x3 selfWindow
- * @ingroup Filters
- */
+// Median filter of the rows [firstRow, lastRow] of m (with origin at 0)
 template <typename T>
-void medianFilter3x3(MultidimArray< T >&m, MultidimArray< T >& out)
+void medianFilter3x3Rows(const MultidimArray< T >&m, MultidimArray< T >& out,
+                         int firstRow, int lastRow)
 {
-    int backup_startingx = STARTINGX(m);
-    int backup_startingy = STARTINGY(m);
-
-    STARTINGX(m) = STARTINGY(m) = 0;
     MultidimArray< T > v1(3), v2(3), v3(3), v4(3);
     MultidimArray< T > v(6);
 
-    // Set the output matrix size
-    out.initZeros(m);
-
     // Set the initial and final matrix indices to explore
-    int initialY = 1, initialX = 1;
-    int finalY = YSIZE(m) - 2;
+    int initialX = 1;
     int finalX = XSIZE(m) - 2;
 
     // For every row
-    for (int i = initialY; i <= finalY; i++)
+    for (int i = firstRow; i <= lastRow; i++)
     {
         // For every pair of pixels (mean is computed obtaining
         // two means at the same time using an efficient method)
@@ -1257,6 +1404,48 @@ void medianFilter3x3(MultidimArray< T >&m, MultidimArray< T >& out)
             }
         }
     }
+}
+
+// Rows of the median filter processed by the thread pool
+template <typename T>
+class MedianFilter3x3Body: public ParallelForBody
+{
+public:
+    const MultidimArray< T > *m;
+    MultidimArray< T > *out;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        medianFilter3x3Rows(*m, *out, (int)first, (int)last);
+    }
+};
+
+/** Median_filter with a 3x3 selfWindow
+ * @ingroup Filters
+ *
+ * Rows are distributed among the threads of ThreadPool::getInstance().
+ */
+template <typename T>
+void medianFilter3x3(MultidimArray< T >&m, MultidimArray< T >& out)
+{
+    int backup_startingx = STARTINGX(m);
+    int backup_startingy = STARTINGY(m);
+
+    STARTINGX(m) = STARTINGY(m) = 0;
+
+    // Set the output matrix size
+    out.initZeros(m);
+
+    // Each row only reads its two neighbour rows in m, so that blocks of
+    // rows are independent
+    if (YSIZE(m) >= 3)
+    {
+        MedianFilter3x3Body<T> body;
+        body.m = &m;
+        body.out = &out;
+        size_t rowsPerChunk = XMIPP_MAX((size_t)1, 16384 / XMIPP_MAX(XSIZE(m), (size_t)1));
+        ThreadPool::getInstance().parallelFor(1, YSIZE(m) - 2, body, rowsPerChunk);
+    }
 
     STARTINGX(m) = STARTINGX(out) = backup_startingx;
     STARTINGY(m) = STARTINGY(out) = backup_startingy;
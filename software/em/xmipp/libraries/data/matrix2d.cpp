@@ -29,6 +29,10 @@
 #include <alglib/src/linalg.h>
 
 #include "matrix2d.h"
+#include "xmipp_threads.h"
+#ifdef XMIPP_CBLAS
+#include <cblas.h>
+#endif
 
 /* Cholesky decomposition -------------------------------------------------- */
 void cholesky(const Matrix2D<double> &M, Matrix2D<double> &L)
@@ -412,9 +416,211 @@ void generalizedEigs(const Matrix2D<double> &A, const Matrix2D<double> &B, Matri
 		MAT_ELEM(P,i,j)=z(i,j);
 }
 
+// Matrices for which firstEigs and lastEigs use lanczosEigs
+#define LANCZOS_MIN_SIZE 2000
+#define LANCZOS_MAX_FRACTION 20
+
+// Dense symmetric matrix as operator, rows are multiplied in parallel
+class DenseSymmetricOperator: public SymmetricOperator, public ParallelForBody
+{
+public:
+    const Matrix2D<double> *A;
+    mutable const double *x;
+    mutable double *y;
+
+    size_t size() const
+    {
+        return MAT_YSIZE(*A);
+    }
+
+    void multiply(const double *x, double *y) const
+    {
+        this->x = x;
+        this->y = y;
+        ThreadPool::getInstance().parallelFor(0, MAT_YSIZE(*A) - 1,
+                                              *const_cast<DenseSymmetricOperator *>(this));
+    }
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        size_t N = MAT_XSIZE(*A);
+        for (size_t i = first; i <= last; ++i)
+        {
+            const double *ptrA = &MAT_ELEM(*A, i, 0);
+            double aux = 0.;
+            for (size_t j = 0; j < N; ++j)
+                aux += ptrA[j] * x[j];
+            y[i] = aux;
+        }
+    }
+
+    double eigenvalueBound() const
+    {
+        double bound = 0;
+        for (size_t i = 0; i < MAT_YSIZE(*A); ++i)
+        {
+            double rowSum = 0;
+            for (size_t j = 0; j < MAT_XSIZE(*A); ++j)
+                rowSum += fabs(MAT_ELEM(*A, i, j));
+            bound = std::max(bound, rowSum);
+        }
+        return bound;
+    }
+};
+
+// Multiply by A, or by bI-A if shifted
+static void lanczosMultiply(const SymmetricOperator &A, bool shifted, double bound,
+                            const double *x, double *y)
+{
+    A.multiply(x, y);
+    if (shifted)
+        for (size_t n = 0; n < A.size(); ++n)
+            y[n] = bound * x[n] - y[n];
+}
+
+// Orthogonalize r against the first rows of V (twice, for stability).
+// Returns the norm of the result.
+static double lanczosOrthogonalize(const Matrix2D<double> &V, size_t rows, double *r)
+{
+    size_t N = MAT_XSIZE(V);
+    for (int pass = 0; pass < 2; ++pass)
+        for (size_t i = 0; i < rows; ++i)
+        {
+            const double *ptrV = &MAT_ELEM(V, i, 0);
+            double dot = 0;
+            for (size_t n = 0; n < N; ++n)
+                dot += ptrV[n] * r[n];
+            for (size_t n = 0; n < N; ++n)
+                r[n] -= dot * ptrV[n];
+        }
+    double norm2 = 0;
+    for (size_t n = 0; n < N; ++n)
+        norm2 += r[n] * r[n];
+    return sqrt(norm2);
+}
+
+// Deterministic pseudorandom vector, so that results are reproducible
+// and the global random generator is not disturbed
+static void lanczosRandomVector(double *r, size_t N, unsigned int &seed)
+{
+    for (size_t n = 0; n < N; ++n)
+    {
+        seed = seed * 1103515245u + 12345u;
+        r[n] = ((seed >> 8) & 0xFFFF) / 65536.0 - 0.5;
+    }
+}
+
+void lanczosEigs(const SymmetricOperator &A, size_t M, bool smallest,
+                 Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded,
+                 double tolerance, int maxRestarts)
+{
+    size_t N = A.size();
+    if (M > N)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "lanczosEigs: more eigenvectors than the size of the matrix");
+    double bound = smallest ? A.eigenvalueBound() : 0;
+
+    // Size of the Krylov basis and number of vectors kept at each restart
+    size_t m = std::min(N, 2 * M + 20);
+    size_t kept = std::min(M + (m - M) / 2, m - 1);
+
+    Matrix2D<double> V(m, N), H(m, m);
+    std::vector<double> r(N), w(N);
+    unsigned int seed = 12345;
+    lanczosRandomVector(&r[0], N, seed);
+    alglib::real_2d_array h, z;
+    alglib::real_1d_array theta;
+    size_t k = 0;
+    for (int restart = 0; restart <= maxRestarts; ++restart)
+    {
+        // Extend the basis up to m vectors
+        double beta = 0;
+        for (size_t j = k; j < m; ++j)
+        {
+            double norm = lanczosOrthogonalize(V, j, &r[0]);
+            while (norm < 1e-12)
+            {
+                // Invariant subspace found, continue with a new direction
+                lanczosRandomVector(&r[0], N, seed);
+                norm = lanczosOrthogonalize(V, j, &r[0]);
+            }
+            double *ptrVj = &MAT_ELEM(V, j, 0);
+            double iNorm = 1.0 / norm;
+            for (size_t n = 0; n < N; ++n)
+                ptrVj[n] = r[n] * iNorm;
+
+            // Projection of A onto the basis
+            lanczosMultiply(A, smallest, bound, ptrVj, &w[0]);
+            for (size_t i = 0; i <= j; ++i)
+            {
+                const double *ptrVi = &MAT_ELEM(V, i, 0);
+                double dot = 0;
+                for (size_t n = 0; n < N; ++n)
+                    dot += ptrVi[n] * w[n];
+                MAT_ELEM(H, i, j) = MAT_ELEM(H, j, i) = dot;
+            }
+            r = w;
+            if (j + 1 == N)
+                break;
+        }
+        if (m < N)
+            beta = lanczosOrthogonalize(V, m, &r[0]);
+
+        // Ritz values and vectors
+        h.setcontent(m, m, MATRIX2D_ARRAY(H));
+        if (!smatrixevd(h, m, 1, true, theta, z))
+            REPORT_ERROR(ERR_NUMERICAL, "lanczosEigs: could not diagonalize the projected matrix");
+        double thetaMax = std::max(fabs(theta(0)), fabs(theta(m - 1)));
+        bool converged = true;
+        for (size_t i = 0; i < M && converged; ++i)
+            if (beta * fabs(z(m - 1, m - 1 - i)) > tolerance * std::max(1.0, thetaMax))
+                converged = false;
+        if (converged || restart == maxRestarts)
+        {
+            if (!converged)
+                std::cerr << "Warning: lanczosEigs did not converge" << std::endl;
+            break;
+        }
+
+        // Restart with the best Ritz vectors, they are orthonormal and
+        // A is diagonal on them
+        Matrix2D<double> S(m, kept), Vkept;
+        for (size_t i = 0; i < m; ++i)
+            for (size_t l = 0; l < kept; ++l)
+                MAT_ELEM(S, i, l) = z(i, m - 1 - l);
+        matrixOperation_AtB(S, V, Vkept);
+        memcpy(MATRIX2D_ARRAY(V), MATRIX2D_ARRAY(Vkept), kept * N * sizeof(double));
+        H.initZeros();
+        for (size_t l = 0; l < kept; ++l)
+            MAT_ELEM(H, l, l) = theta(m - 1 - l);
+        k = kept;
+    }
+
+    // Eigenvalues and eigenvectors of the M most extreme ones
+    D.resizeNoCopy(M);
+    for (size_t l = 0; l < M; ++l)
+    {
+        double lambda = theta(m - 1 - l);
+        VEC_ELEM(D, l) = smallest ? bound - lambda : lambda;
+    }
+    if (!Pneeded)
+        return;
+    Matrix2D<double> S(m, M);
+    for (size_t l = 0; l < M; ++l)
+        for (size_t i = 0; i < m; ++i)
+            MAT_ELEM(S, i, l) = z(i, m - 1 - l);
+    matrixOperation_AtB(V, S, P);
+}
+
 void firstEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded)
 {
 	int N=(int)MAT_YSIZE(A);
+	if (N>=LANCZOS_MIN_SIZE && M*LANCZOS_MAX_FRACTION<=(size_t)N)
+	{
+		DenseSymmetricOperator op;
+		op.A=&A;
+		lanczosEigs(op, M, false, D, P, Pneeded);
+		return;
+	}
 	alglib::real_2d_array a, z;
 	a.setcontent(N,N,MATRIX2D_ARRAY(A));
 	alglib::real_1d_array d;
@@ -436,6 +642,13 @@ void firstEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2
 void lastEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P)
 {
 	int N=(int)MAT_YSIZE(A);
+	if (N>=LANCZOS_MIN_SIZE && M*LANCZOS_MAX_FRACTION<=(size_t)N)
+	{
+		DenseSymmetricOperator op;
+		op.A=&A;
+		lanczosEigs(op, M, true, D, P);
+		return;
+	}
 	alglib::real_2d_array a, z;
 	a.setcontent(N,N,MATRIX2D_ARRAY(A));
 	alglib::real_1d_array d;
@@ -524,17 +737,179 @@ void connectedComponentsOfUndirectedGraph(const Matrix2D<double> &G, Matrix1D<in
 	} while (workDone);
 }
 
+/* Matrix multiplication -------------------------------------------------- */
+// Block of C (rows x columns) computed by a task, and block of k
+#define GEMM_BLOCK_M 64
+#define GEMM_BLOCK_N 256
+#define GEMM_BLOCK_K 256
+// Products with fewer multiplications are computed directly, products
+// with more multiplications than GEMM_PARALLEL_PRODUCT are computed in parallel
+#define GEMM_SMALL_PRODUCT 32768
+#define GEMM_PARALLEL_PRODUCT 1048576
+
+// C+=Ap*Bp, where Ap is mb x kb and Bp is kb x nb, both packed by rows.
+// Four rows of C are updated with each row of Bp.
+static void multiplyPackedBlock(const double *Ap, const double *Bp, double *C,
+                                size_t ldc, size_t mb, size_t nb, size_t kb)
+{
+    size_t i = 0;
+    for (; i + 4 <= mb; i += 4)
+    {
+        double *C0 = C + i * ldc, *C1 = C0 + ldc, *C2 = C1 + ldc, *C3 = C2 + ldc;
+        const double *A0 = Ap + i * kb, *A1 = A0 + kb, *A2 = A1 + kb, *A3 = A2 + kb;
+        for (size_t k = 0; k < kb; ++k)
+        {
+            double a0 = A0[k], a1 = A1[k], a2 = A2[k], a3 = A3[k];
+            const double *ptrB = Bp + k * nb;
+            for (size_t j = 0; j < nb; ++j)
+            {
+                double b = ptrB[j];
+                C0[j] += a0 * b;
+                C1[j] += a1 * b;
+                C2[j] += a2 * b;
+                C3[j] += a3 * b;
+            }
+        }
+    }
+    for (; i < mb; ++i)
+    {
+        double *C0 = C + i * ldc;
+        const double *A0 = Ap + i * kb;
+        for (size_t k = 0; k < kb; ++k)
+        {
+            double a0 = A0[k];
+            const double *ptrB = Bp + k * nb;
+            for (size_t j = 0; j < nb; ++j)
+                C0[j] += a0 * ptrB[j];
+        }
+    }
+}
+
+// Blocks of C distributed among threads
+class MatrixMultiplyBlocks: public ParallelForBody
+{
+public:
+    const double *A, *B;
+    double *C;
+    bool transposeA, transposeB;
+    size_t M, N, K, blocksN;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        std::vector<double> Ap(GEMM_BLOCK_M * GEMM_BLOCK_K);
+        std::vector<double> Bp(GEMM_BLOCK_K * GEMM_BLOCK_N);
+        for (size_t block = first; block <= last; ++block)
+        {
+            size_t i0 = (block / blocksN) * GEMM_BLOCK_M;
+            size_t j0 = (block % blocksN) * GEMM_BLOCK_N;
+            size_t mb = XMIPP_MIN(GEMM_BLOCK_M, M - i0);
+            size_t nb = XMIPP_MIN(GEMM_BLOCK_N, N - j0);
+            double *Cblock = C + i0 * N + j0;
+            for (size_t i = 0; i < mb; ++i)
+                memset(Cblock + i * N, 0, nb * sizeof(double));
+            for (size_t k0 = 0; k0 < K; k0 += GEMM_BLOCK_K)
+            {
+                size_t kb = XMIPP_MIN(GEMM_BLOCK_K, K - k0);
+
+                // Copy op(A)(i0:i0+mb-1,k0:k0+kb-1)
+                double *ptrAp = &Ap[0];
+                if (transposeA)
+                    for (size_t k = 0; k < kb; ++k)
+                    {
+                        const double *ptrA = A + (k0 + k) * M + i0;
+                        for (size_t i = 0; i < mb; ++i)
+                            ptrAp[i * kb + k] = ptrA[i];
+                    }
+                else
+                    for (size_t i = 0; i < mb; ++i)
+                        memcpy(ptrAp + i * kb, A + (i0 + i) * K + k0, kb * sizeof(double));
+
+                // Copy op(B)(k0:k0+kb-1,j0:j0+nb-1)
+                double *ptrBp = &Bp[0];
+                if (transposeB)
+                    for (size_t j = 0; j < nb; ++j)
+                    {
+                        const double *ptrB = B + (j0 + j) * K + k0;
+                        for (size_t k = 0; k < kb; ++k)
+                            ptrBp[k * nb + j] = ptrB[k];
+                    }
+                else
+                    for (size_t k = 0; k < kb; ++k)
+                        memcpy(ptrBp + k * nb, B + (k0 + k) * N + j0, nb * sizeof(double));
+
+                multiplyPackedBlock(ptrAp, ptrBp, Cblock, N, mb, nb, kb);
+            }
+        }
+    }
+};
+
+void matrixMultiply(const double *A, bool transposeA,
+                    const double *B, bool transposeB,
+                    double *C, size_t M, size_t N, size_t K)
+{
+    if (M == 0 || N == 0)
+        return;
+    size_t strideA = transposeA ? M : K;
+    size_t strideB = transposeB ? K : N;
+    double products = (double)M * N * K;
+    if (products < GEMM_SMALL_PRODUCT)
+    {
+        for (size_t i = 0; i < M; ++i)
+            for (size_t j = 0; j < N; ++j)
+            {
+                double aux = 0.;
+                for (size_t k = 0; k < K; ++k)
+                {
+                    double a = transposeA ? A[k * strideA + i] : A[i * strideA + k];
+                    double b = transposeB ? B[j * strideB + k] : B[k * strideB + j];
+                    aux += a * b;
+                }
+                C[i * N + j] = aux;
+            }
+        return;
+    }
+
+#ifdef XMIPP_CBLAS
+    cblas_dgemm(CblasRowMajor, transposeA ? CblasTrans : CblasNoTrans,
+                transposeB ? CblasTrans : CblasNoTrans, (int)M, (int)N, (int)K,
+                1.0, A, (int)strideA, B, (int)strideB, 0.0, C, (int)N);
+#else
+    MatrixMultiplyBlocks blocks;
+    blocks.A = A;
+    blocks.B = B;
+    blocks.C = C;
+    blocks.transposeA = transposeA;
+    blocks.transposeB = transposeB;
+    blocks.M = M;
+    blocks.N = N;
+    blocks.K = K;
+    blocks.blocksN = (N + GEMM_BLOCK_N - 1) / GEMM_BLOCK_N;
+    size_t Nblocks = ((M + GEMM_BLOCK_M - 1) / GEMM_BLOCK_M) * blocks.blocksN;
+    if (products < GEMM_PARALLEL_PRODUCT || Nblocks == 1)
+        blocks(0, Nblocks - 1, 0);
+    else
+        ThreadPool::getInstance().parallelFor(0, Nblocks - 1, blocks, 1);
+#endif
+}
+
+template<>
+Matrix2D<double> Matrix2D<double>::operator*(const Matrix2D<double>& op1) const
+{
+    Matrix2D<double> result;
+    if (mdimx != op1.mdimy)
+        REPORT_ERROR(ERR_MATRIX_SIZE, "Not compatible sizes in matrix multiplication");
+
+    result.initZeros(mdimy, op1.mdimx);
+    matrixMultiply(mdata, false, op1.mdata, false, result.mdata,
+                   mdimy, op1.mdimx, mdimx);
+    return result;
+}
+
 void matrixOperation_AB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_YSIZE(A), MAT_XSIZE(B));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-		for (size_t j = 0; j < MAT_XSIZE(B); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-				aux += MAT_ELEM(A, i, k) * MAT_ELEM(B, k, j);
-			MAT_ELEM(C, i, j)=aux;
-		}
+	C.resizeNoCopy(MAT_YSIZE(A), MAT_XSIZE(B));
+	matrixMultiply(MATRIX2D_ARRAY(A), false, MATRIX2D_ARRAY(B), false,
+	               MATRIX2D_ARRAY(C), MAT_YSIZE(A), MAT_XSIZE(B), MAT_XSIZE(A));
 }
 
 void matrixOperation_Ax(const Matrix2D <double> &A, const Matrix1D<double> &x, Matrix1D<double> &y)
@@ -552,53 +927,29 @@ void matrixOperation_Ax(const Matrix2D <double> &A, const Matrix1D<double> &x, M
 void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B)
 {
     B.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(A));
-    for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-        for (size_t j = i; j < MAT_XSIZE(A); ++j)
-        {
-            double aux=0.;
-            for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-                aux += MAT_ELEM(A, k, i) * MAT_ELEM(A, k, j);
-            MAT_ELEM(B, j, i) = MAT_ELEM(B, i, j) = aux;
-        }
+    matrixMultiply(MATRIX2D_ARRAY(A), true, MATRIX2D_ARRAY(A), false,
+                   MATRIX2D_ARRAY(B), MAT_XSIZE(A), MAT_XSIZE(A), MAT_YSIZE(A));
 }
 
 void matrixOperation_AAt(const Matrix2D <double> &A, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_YSIZE(A), MAT_YSIZE(A));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-		for (size_t j = i; j < MAT_YSIZE(A); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-				aux += MAT_ELEM(A, i, k) * MAT_ELEM(A, j, k);
-			MAT_ELEM(C, j, i)=MAT_ELEM(C, i, j)=aux;
-		}
+	C.resizeNoCopy(MAT_YSIZE(A), MAT_YSIZE(A));
+	matrixMultiply(MATRIX2D_ARRAY(A), false, MATRIX2D_ARRAY(A), true,
+	               MATRIX2D_ARRAY(C), MAT_YSIZE(A), MAT_YSIZE(A), MAT_XSIZE(A));
 }
 
 void matrixOperation_ABt(const Matrix2D <double> &A, const Matrix2D <double> &B, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_YSIZE(A), MAT_YSIZE(B));
-	for (size_t i = 0; i < MAT_YSIZE(A); ++i)
-		for (size_t j = 0; j < MAT_YSIZE(B); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_XSIZE(A); ++k)
-				aux += MAT_ELEM(A, i, k) * MAT_ELEM(B, j, k);
-			MAT_ELEM(C, i, j)=aux;
-		}
+	C.resizeNoCopy(MAT_YSIZE(A), MAT_YSIZE(B));
+	matrixMultiply(MATRIX2D_ARRAY(A), false, MATRIX2D_ARRAY(B), true,
+	               MATRIX2D_ARRAY(C), MAT_YSIZE(A), MAT_YSIZE(B), MAT_XSIZE(A));
 }
 
 void matrixOperation_AtB(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
     C.resizeNoCopy(MAT_XSIZE(A), MAT_XSIZE(B));
-    for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-        for (size_t j = 0; j < MAT_XSIZE(B); ++j)
-        {
-            double aux=0.;
-            for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-                aux += MAT_ELEM(A, k, i) * MAT_ELEM(B, k, j);
-			MAT_ELEM(C, i, j)=aux;
-        }
+    matrixMultiply(MATRIX2D_ARRAY(A), true, MATRIX2D_ARRAY(B), false,
+                   MATRIX2D_ARRAY(C), MAT_XSIZE(A), MAT_XSIZE(B), MAT_YSIZE(A));
 }
 
 void matrixOperation_Atx(const Matrix2D <double> &A, const Matrix1D<double> &x, Matrix1D<double> &y)
@@ -615,29 +966,18 @@ void matrixOperation_Atx(const Matrix2D <double> &A, const Matrix1D<double> &x,
 
 void matrixOperation_AtBt(const Matrix2D <double> &A, const Matrix2D<double> &B, Matrix2D<double> &C)
 {
-	C.initZeros(MAT_XSIZE(A), MAT_YSIZE(B));
-	for (size_t i = 0; i < MAT_XSIZE(A); ++i)
-		for (size_t j = 0; j < MAT_YSIZE(B); ++j)
-		{
-			double aux=0.;
-			for (size_t k = 0; k < MAT_YSIZE(A); ++k)
-				aux += MAT_ELEM(A, k, i) * MAT_ELEM(B, j, k);
-			MAT_ELEM(C, i, j)=aux;
-		}
+	C.resizeNoCopy(MAT_XSIZE(A), MAT_YSIZE(B));
+	matrixMultiply(MATRIX2D_ARRAY(A), true, MATRIX2D_ARRAY(B), true,
+	               MATRIX2D_ARRAY(C), MAT_XSIZE(A), MAT_YSIZE(B), MAT_YSIZE(A));
 }
 
 void matrixOperation_XtAX_symmetric(const Matrix2D<double> &X, const Matrix2D<double> &A, Matrix2D<double> &B)
 {
 	Matrix2D<double> AX=A*X;
-    B.resizeNoCopy(MAT_XSIZE(X), MAT_XSIZE(X));
-    for (size_t i = 0; i < MAT_XSIZE(X); ++i)
-        for (size_t j = i; j < MAT_XSIZE(X); ++j)
-        {
-            double aux=0.;
-            for (size_t k = 0; k < MAT_YSIZE(X); ++k)
-                aux += MAT_ELEM(X, k, i) * MAT_ELEM(AX, k, j);
-            MAT_ELEM(B, j, i) = MAT_ELEM(B, i, j) = aux;
-        }
+	matrixOperation_AtB(X, AX, B);
+	for (size_t i = 0; i < MAT_XSIZE(X); ++i)
+		for (size_t j = i + 1; j < MAT_XSIZE(X); ++j)
+			MAT_ELEM(B, j, i) = MAT_ELEM(B, i, j);
 }
 
 void matrixOperation_IplusA(Matrix2D<double> &A)
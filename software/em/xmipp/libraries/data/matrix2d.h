@@ -1768,6 +1768,12 @@ public:
 typedef Matrix2D<double> DMatrix;
 typedef Matrix2D<int> IMatrix;
 
+/** Matrix by Matrix multiplication for doubles.
+ * It uses the blocked, multithreaded product of matrixMultiply.
+ */
+template<>
+Matrix2D<double> Matrix2D<double>::operator*(const Matrix2D<double>& op1) const;
+
 template<typename T>
 bool operator==(const Matrix2D<T>& op1, const Matrix2D<T>& op2)
 {
@@ -1856,16 +1862,59 @@ void generalizedEigs(const Matrix2D<double> &A, const Matrix2D<double> &B, Matri
 
 /** First eigenvectors of a real, symmetric matrix.
  * Solves the problem Av=dv.
- * Only the eigenvectors of the largest M eigenvalues are returned as columns of P
+ * Only the eigenvectors of the largest M eigenvalues are returned as columns of P.
+ * When only a few eigenvectors of a large matrix are needed, they are
+ * computed with lanczosEigs instead of a dense decomposition.
  */
 void firstEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded=true);
 
 /** Last eigenvectors of a real, symmetric matrix.
  * Solves the problem Av=dv.
- * Only the eigenvectors of the smallest M eigenvalues are returned as columns of P
+ * Only the eigenvectors of the smallest M eigenvalues are returned as columns of P.
+ * As in firstEigs, lanczosEigs is used for large matrices.
  */
 void lastEigs(const Matrix2D<double> &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P);
 
+/** Symmetric linear operator.
+ * Interface to the matrices used by lanczosEigs, which only need to
+ * be multiplied by vectors (e.g. sparse matrices).
+ */
+class SymmetricOperator
+{
+public:
+    virtual ~SymmetricOperator()
+    {}
+
+    /// The operator is NxN
+    virtual size_t size() const=0;
+
+    /// y=A*x, x and y have size() elements
+    virtual void multiply(const double *x, double *y) const=0;
+
+    /** Upper bound of the absolute value of the eigenvalues.
+     * For instance, the maximum absolute row sum. Only needed to compute the
+     * smallest eigenvalues.
+     */
+    virtual double eigenvalueBound() const=0;
+};
+
+/** Some eigenvectors of a symmetric operator.
+ * The eigenvectors of the M largest (or smallest) eigenvalues are computed
+ * with a thick restarted Lanczos iteration with full reorthogonalization.
+ * Only products of A by vectors are needed, so that the cost is about
+ * O(N*(2M+20)^2) per restart plus the matrix products. The smallest
+ * eigenvalues are computed as the largest ones of bI-A, where b is
+ * A.eigenvalueBound().
+ *
+ * D is sorted from the most extreme eigenvalue (descending order for the
+ * largest, ascending for the smallest), and P has the corresponding
+ * eigenvectors as columns (only if Pneeded). Iterations stop when all
+ * residuals are below tolerance*max(1,|lambda_max|).
+ */
+void lanczosEigs(const SymmetricOperator &A, size_t M, bool smallest,
+                 Matrix1D<double> &D, Matrix2D<double> &P, bool Pneeded=true,
+                 double tolerance=1e-10, int maxRestarts=500);
+
 /** Compute eigenvectors between two indexes of a real, symmetric matrix.
  * Solves the problem Av=dv.
  * Only the eigenvectors of the smallest eigenvalues between indexes I1 and I2 are returned as columns of P. Indexes start at 0.
@@ -1964,6 +2013,24 @@ void normalizeColumnsBetween0and1(Matrix2D<double> &A);
  */
 void subtractColumnMeans(Matrix2D<double> &A);
 
+/** Matrix product C=op(A)*op(B).
+ * A, B and C are stored by rows, op(A) is A or A^t depending on
+ * transposeA (the same for B), op(A) is MxK and op(B) is KxN. C must
+ * have room for MxN elements and it is overwritten.
+ *
+ * Large products are computed by blocks that fit in cache (packing
+ * the operands so that the inner loop runs over contiguous memory and
+ * can be vectorized by the compiler), and the blocks of C are
+ * distributed among the threads of ThreadPool::getInstance(). The
+ * terms of each element are summed in increasing k, so that the
+ * result is the same as that of the straightforward triple loop.
+ * If Xmipp is compiled with CBLAS=True, large products are computed
+ * by cblas_dgemm instead.
+ */
+void matrixMultiply(const double *A, bool transposeA,
+                    const double *B, bool transposeB,
+                    double *C, size_t M, size_t N, size_t K);
+
 /** Matrix operation: B=A^t*A. */
 void matrixOperation_AtA(const Matrix2D <double> &A, Matrix2D<double> &B);
 
@@ -296,6 +296,13 @@ void getImageInfo(const MetaData &md, ImageInfo &imgInfo, MDLabel image_label)
         REPORT_ERROR(ERR_MD_NOOBJ, "Can not read image size from empty metadata");
 }
 
+void getImageHeaders(const MetaData &md, std::vector<ImageHeaderInfo> &headers, MDLabel image_label)
+{
+    std::vector<FileName> filenames;
+    md.getColumnValues(image_label, filenames);
+    readImageHeaders(filenames, headers);
+}
+
 void getImageSizeFromFilename(const FileName &filename, size_t &Xdim, size_t &Ydim, size_t &Zdim, size_t &Ndim, MDLabel image_label)
 {
     if (filename.hasImageExtension())
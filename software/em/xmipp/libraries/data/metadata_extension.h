@@ -10,6 +10,7 @@
 
 #include "xmipp_filename.h"
 #include "xmipp_image.h"
+#include "xmipp_image_extension.h"
 #include "metadata.h"
 #include <stdlib.h>
 #include <fstream>
@@ -55,6 +56,12 @@ void getImageInfo(const MetaData &md, size_t &Xdim, size_t &Ydim, size_t &Zdim,
 
 void getImageInfo(const MetaData &md, ImageInfo &imgInfo, MDLabel image_label=MDL_IMAGE);
 
+/** Header information (size, data type and sampling) of the images of a metadata.
+ *  The headers are read in batch with readImageHeaders, headers[i] is the
+ *  header of the i-th object of the metadata.
+ */
+void getImageHeaders(const MetaData &md, std::vector<ImageHeaderInfo> &headers, MDLabel image_label=MDL_IMAGE);
+
 /** Get image size and data type of a Metadata file */
 void getImageSizeFromFilename(const FileName &filename, size_t &Xdim, size_t &Ydim, size_t &Zdim, size_t &Ndim, MDLabel image_label=MDL_IMAGE);
 
@@ -73,6 +73,9 @@ enum MDLabel
     MDL_AVG_CHANGES_CLASSES, /// Average change in class assignment(double dimensionaless)
     MDL_AVGPMAX, ///< Average (per class) of the maximum value of normalized probability function) (double)
     MDL_BGMEAN, ///< Mean background value for an image
+    MDL_BLOB_ALPHA, ///< Alpha parameter of an interpolation blob (double)
+    MDL_BLOB_ORDER, ///< Order of the Bessel function of an interpolation blob (int)
+    MDL_BLOB_RADIUS, ///< Radius of an interpolation blob in pixels (double)
     MDL_BLOCK_NUMBER, ///< Current block number (for incremental EM)
 
     MDL_CL2D_CHANGES, ///< Number of changes between iterations
@@ -245,6 +248,7 @@ enum MDLabel
     MDL_MAXCC, ///< Maximum cross-correlation for the image (double)
     MDL_MAXCC_PERCENTILE, ///< Percentile of the maximum cross-correlation for the image (double)
     MDL_MAX, ///< Maximum value (double)
+    MDL_MAX_RESOLUTION, ///< Maximum digital frequency of a reconstruction (double, Nyquist=0.5)
     MDL_MICROGRAPH, ///< Name of a micrograph (std::string)
     MDL_MICROGRAPH_ID, ///< Micrograph unique id for reference (MDL_ITEM_ID should be used for Micrographs list)
     MDL_MICROGRAPH_MOVIE, ///< Name of a movie (std::string)
@@ -392,6 +396,7 @@ enum MDLabel
     MDL_STAR_COMMENT, ///< A comment for this object /*** NOTE THIS IS A SPECIAL CASE AND SO IS TREATED ***/
     MDL_SUM, ///< Sum of elements of a given type (double) [this is a genereic type do not use to transfer information to another program]
     MDL_SUMWEIGHT, ///< Sum of all weights in ML model
+    MDL_SYMMETRY, ///< Symmetry group or file (std::string)
     MDL_SYMNO, ///< Symmetry number for a projection (used in ART)
     MDL_TOMOGRAM_VOLUME, ///< Name for the reconstructed tomogram volume (std::string)
     MDL_TOMOGRAMMD, ///< Name for a Metadata file (std::string)
@@ -1385,6 +1390,9 @@ private:
         MDL::addLabel(MDL_AVGPMAX, LABEL_DOUBLE, "avgPMax");
 
         MDL::addLabel(MDL_BGMEAN, LABEL_DOUBLE, "bgMean");
+        MDL::addLabel(MDL_BLOB_ALPHA, LABEL_DOUBLE, "blobAlpha");
+        MDL::addLabel(MDL_BLOB_ORDER, LABEL_INT, "blobOrder");
+        MDL::addLabel(MDL_BLOB_RADIUS, LABEL_DOUBLE, "blobRadius");
         MDL::addLabel(MDL_BLOCK_NUMBER, LABEL_INT, "blockNumber");
 
         MDL::addLabel(MDL_CL2D_CHANGES, LABEL_INT, "cl2dChanges");
@@ -1644,6 +1652,7 @@ private:
         MDL::addLabel(MDL_MAXCC, LABEL_DOUBLE, "maxCC");
         MDL::addLabel(MDL_MAXCC_PERCENTILE, LABEL_DOUBLE, "maxCCPerc");
         MDL::addLabel(MDL_MAX, LABEL_DOUBLE, "max");
+        MDL::addLabel(MDL_MAX_RESOLUTION, LABEL_DOUBLE, "maxResolution");
         MDL::addLabel(MDL_MICROGRAPH_ID, LABEL_SIZET, "micrographId");
         MDL::addLabel(MDL_MICROGRAPH, LABEL_STRING, "micrograph", TAGLABEL_MICROGRAPH);
         MDL::addLabel(MDL_MICROGRAPH_MOVIE_ID, LABEL_SIZET, "micrographMovieId");
@@ -1817,6 +1826,7 @@ private:
         MDL::addLabel(MDL_STAR_COMMENT, LABEL_STRING, "starComment");
         MDL::addLabel(MDL_SUM, LABEL_DOUBLE, "sum");
         MDL::addLabel(MDL_SUMWEIGHT, LABEL_DOUBLE, "sumWeight");
+        MDL::addLabel(MDL_SYMMETRY, LABEL_STRING, "symmetry");
         MDL::addLabel(MDL_SYMNO, LABEL_INT, "symNo");
 
         MDL::addLabel(MDL_TOMOGRAM_VOLUME, LABEL_STRING, "tomogramVolume", TAGLABEL_IMAGE);
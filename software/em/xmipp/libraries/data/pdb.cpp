@@ -23,6 +23,8 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <algorithm>
+#include <string.h>
 #include "pdb.h"
 #include "fstream"
 #include "args.h"
@@ -100,81 +102,9 @@ void computePDBgeometry(const std::string &fnPDB,
                         Matrix1D<double> &limit0, Matrix1D<double> &limitF,
                         const std::string &intensityColumn)
 {
-    // Initialization
-    centerOfMass.initZeros(3);
-    limit0.initZeros(3);
-    limitF.initZeros(3);
-    limit0.initConstant(1e30);
-    limitF.initConstant(-1e30);
-    double total_mass = 0;
-
-    // Open the file
-    std::ifstream fh_pdb;
-    fh_pdb.open(fnPDB.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fnPDB);
-
-    // Process all lines of the file
-    int col=1;
-    if (intensityColumn=="Bfactor")
-        col=2;
-    while (!fh_pdb.eof())
-    {
-        // Read a ATOM line
-        std::string line;
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        std::string kind = line.substr(0,4);
-        if (kind != "ATOM" && kind!="HETA")
-            continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        std::string atom_type = line.substr(13,2);
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
-
-        // Update center of mass and limits
-        if (x < XX(limit0))
-            XX(limit0) = x;
-        else if (x > XX(limitF))
-            XX(limitF) = x;
-        if (y < YY(limit0))
-            YY(limit0) = y;
-        else if (y > YY(limitF))
-            YY(limitF) = y;
-        if (z < ZZ(limit0))
-            ZZ(limit0) = z;
-        else if (z > ZZ(limitF))
-            ZZ(limitF) = z;
-        double weight;
-        if (atom_type=="EN")
-        {
-            if      (col==1)
-                weight=textToFloat(line.substr(54,6));
-            else if (col==2)
-                weight=textToFloat(line.substr(60,6));
-        }
-        else
-        {
-            if (kind=="HETA")
-                continue;
-            weight=(double) atomCharge(atom_type);
-        }
-        total_mass += weight;
-        XX(centerOfMass) += weight * x;
-        YY(centerOfMass) += weight * y;
-        ZZ(centerOfMass) += weight * z;
-    }
-
-    // Finish calculations
-    centerOfMass /= total_mass;
-
-    // Close file
-    fh_pdb.close();
+    AtomicModel model;
+    model.read(fnPDB);
+    model.computeGeometry(centerOfMass, limit0, limitF, intensityColumn);
 }
 
 /* Apply geometry ---------------------------------------------------------- */
@@ -352,6 +282,170 @@ void PDBRichPhantom::read(const FileName &fnPDB)
     fh_in.close();
 }
 
+/* Element index ----------------------------------------------------------- */
+int atomElementIndex(char letter0, char letter1)
+{
+    switch (letter0)
+    {
+    case 'H':
+        return 0;
+    case 'C':
+        return 1;
+    case 'N':
+        return 2;
+    case 'O':
+        return 3;
+    case 'P':
+        return 4;
+    case 'S':
+        return 5;
+    case 'F':
+        return 6;
+    case 'E':
+        return (letter1 == 'N') ? ATOM_PSEUDO : -1;
+    default:
+        return -1;
+    }
+}
+
+/* Atomic model ----------------------------------------------------------- */
+void AtomicModel::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    occupancy.clear();
+    bfactor.clear();
+    atomName.clear();
+    element.clear();
+    hetero.clear();
+    remarks.clear();
+}
+
+// Float in the columns [start,start+width) of a line, 0 if it is empty
+static double pdbField(const char *line, size_t length, size_t start, size_t width)
+{
+    if (start >= length)
+        return 0;
+    char buffer[16];
+    width = XMIPP_MIN(width, length - start);
+    memcpy(buffer, line + start, width);
+    buffer[width] = 0;
+    // Same precision as textToFloat
+    return (double) strtof(buffer, NULL);
+}
+
+void AtomicModel::read(const FileName &fnPDB)
+{
+    clear();
+
+    // The whole file is read at once
+    FILE *fh = fopen(fnPDB.c_str(), "rb");
+    if (fh == NULL)
+        REPORT_ERROR(ERR_IO_NOTEXIST, fnPDB);
+    std::vector<char> text;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fh)) > 0)
+        text.insert(text.end(), buffer, buffer + n);
+    fclose(fh);
+    if (text.empty())
+        return;
+
+    size_t nlines = std::count(text.begin(), text.end(), '\n') + 1;
+    x.reserve(nlines);
+    y.reserve(nlines);
+    z.reserve(nlines);
+    occupancy.reserve(nlines);
+    bfactor.reserve(nlines);
+    atomName.reserve(2 * nlines);
+    element.reserve(nlines);
+    hetero.reserve(nlines);
+
+    const char *ptr = &text[0], *end = ptr + text.size();
+    while (ptr < end)
+    {
+        const char *eol = (const char *) memchr(ptr, '\n', end - ptr);
+        if (eol == NULL)
+            eol = end;
+        const char *line = ptr;
+        size_t length = eol - ptr;
+        ptr = eol + 1;
+
+        if (length >= 6 && strncmp(line, "REMARK", 6) == 0)
+        {
+            remarks.push_back(String(line, length));
+            continue;
+        }
+        if (length < 15)
+            continue;
+        bool isAtom = strncmp(line, "ATOM", 4) == 0;
+        if (!isAtom && strncmp(line, "HETA", 4) != 0)
+            continue;
+
+        // Typical line:
+        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
+        atomName.push_back(line[13]);
+        atomName.push_back(line[14]);
+        element.push_back((signed char) atomElementIndex(line[13], line[14]));
+        hetero.push_back(isAtom ? 0 : 1);
+        x.push_back(pdbField(line, length, 30, 8));
+        y.push_back(pdbField(line, length, 38, 8));
+        z.push_back(pdbField(line, length, 46, 8));
+        occupancy.push_back(pdbField(line, length, 54, 6));
+        bfactor.push_back(pdbField(line, length, 60, 6));
+    }
+}
+
+void AtomicModel::computeGeometry(Matrix1D<double> &centerOfMass,
+                                  Matrix1D<double> &limit0, Matrix1D<double> &limitF,
+                                  const std::string &intensityColumn) const
+{
+    // Initialization
+    centerOfMass.initZeros(3);
+    limit0.initZeros(3);
+    limitF.initZeros(3);
+    limit0.initConstant(1e30);
+    limitF.initConstant(-1e30);
+    double total_mass = 0;
+    bool useBfactor = intensityColumn == "Bfactor";
+
+    size_t nAtoms = getNumberOfAtoms();
+    for (size_t n = 0; n < nAtoms; n++)
+    {
+        // Update center of mass and limits
+        double xn = x[n], yn = y[n], zn = z[n];
+        if (xn < XX(limit0))
+            XX(limit0) = xn;
+        else if (xn > XX(limitF))
+            XX(limitF) = xn;
+        if (yn < YY(limit0))
+            YY(limit0) = yn;
+        else if (yn > YY(limitF))
+            YY(limitF) = yn;
+        if (zn < ZZ(limit0))
+            ZZ(limit0) = zn;
+        else if (zn > ZZ(limitF))
+            ZZ(limitF) = zn;
+        double weight;
+        if (element[n] == ATOM_PSEUDO)
+            weight = useBfactor ? bfactor[n] : occupancy[n];
+        else
+        {
+            if (hetero[n])
+                continue;
+            weight = (double) atomCharge(getAtomName(n));
+        }
+        total_mass += weight;
+        XX(centerOfMass) += weight * xn;
+        YY(centerOfMass) += weight * yn;
+        ZZ(centerOfMass) += weight * zn;
+    }
+
+    // Finish calculations
+    centerOfMass /= total_mass;
+}
+
 /* Write phantom to PDB --------------------------------------------------- */
 void PDBRichPhantom::write(const FileName &fnPDB)
 {
@@ -821,10 +915,15 @@ void atomProjectionRadialProfile(int M,
 /** Atom interpolations ---------------------------------------------------- */
 void AtomInterpolator::setup(int m, double hights, bool computeProjection)
 {
+    // The profiles depend on the sampling
+    if (volumeProfileCoefficients.size()==7 && m==M && hights==highTs &&
+        (!computeProjection || projectionProfileCoefficients.size()==7))
+    	return;
+    volumeProfileCoefficients.clear();
+    projectionProfileCoefficients.clear();
+    radii.clear();
     M=m;
     highTs=hights;
-    if (volumeProfileCoefficients.size()==7)
-    	return;
     addAtom("H",computeProjection);
     addAtom("C",computeProjection);
     addAtom("N",computeProjection);
@@ -194,6 +194,60 @@ public:
 
 };
 
+/** Element index of the pseudoatoms of xmipp_convert_vol2pseudo (atom name EN) */
+#define ATOM_PSEUDO 7
+
+/** Element index of an atom name (two letters).
+    The elements of the short list are indexed in the order H, C, N, O, P,
+    S, Fe (as AtomInterpolator::getAtomIndex), pseudoatoms are ATOM_PSEUDO
+    and -1 is returned for the rest. */
+int atomElementIndex(char letter0, char letter1);
+
+/** Atomic model.
+    The atoms of a PDB file stored as a structure of arrays. The file is
+    parsed once and the programs that sample the model (e.g., several
+    times for different samplings) access directly the coordinates. */
+class AtomicModel
+{
+public:
+    /// Coordinates (Angstroms)
+    std::vector<double> x, y, z;
+    /// Occupancy and B factor
+    std::vector<double> occupancy, bfactor;
+    /// Two letters of the atom name (columns 14 and 15) of each atom
+    std::vector<char> atomName;
+    /// Element index (see atomElementIndex)
+    std::vector<signed char> element;
+    /// 1 for HETATM atoms
+    std::vector<char> hetero;
+    /// REMARK lines
+    std::vector<String> remarks;
+
+    /// Number of atoms
+    size_t getNumberOfAtoms() const
+    {
+        return x.size();
+    }
+
+    /// Name of atom i (two letters)
+    String getAtomName(size_t i) const
+    {
+        return String(&atomName[2 * i], 2);
+    }
+
+    /// Remove all atoms
+    void clear();
+
+    /// Read the ATOM and HETATM records of a PDB file
+    void read(const FileName &fnPDB);
+
+    /** Center of mass and limits.
+        Same as computePDBgeometry. */
+    void computeGeometry(Matrix1D<double> &centerOfMass,
+                         Matrix1D<double> &limit0, Matrix1D<double> &limitF,
+                         const std::string &intensityColumn) const;
+};
+
 /** Description of the electron scattering factors.
     The returned descriptor is descriptor(0)=Z (number of electrons of the
     atom), descriptor(1-5)=a1-5, descriptor(6-10)=b1-5.
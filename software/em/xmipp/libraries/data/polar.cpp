@@ -141,6 +141,13 @@ void normalizedPolarFourierTransform(const MultidimArray<double> &in,
 // Best rotation -----------------------------------------------------------
 double best_rotation(const Polar<std::complex<double> > &I1,
 		const Polar<std::complex<double> > &I2, RotationalCorrelationAux &aux) {
+	double bestCorr;
+	return best_rotation(I1, I2, aux, bestCorr);
+}
+
+double best_rotation(const Polar<std::complex<double> > &I1,
+		const Polar<std::complex<double> > &I2, RotationalCorrelationAux &aux,
+		double &bestCorr) {
 	MultidimArray<double> angles;
 	rotationalCorrelation(I1, I2, angles, aux);
 
@@ -157,6 +164,7 @@ double best_rotation(const Polar<std::complex<double> > &I1,
 		}
 
 	// Return the corresponding angle
+	bestCorr = maxval;
 	return DIRECT_A1D_ELEM(angles,imax);
 }
 
@@ -813,6 +813,13 @@ void normalizedPolarFourierTransform(const MultidimArray<double> &in,
 double best_rotation(const Polar< std::complex<double> > &I1,
                      const Polar< std::complex<double> > &I2, RotationalCorrelationAux &aux);
 
+/** Best rotation between two normalized polar Fourier transforms.
+ * The value of the rotational correlation at the best rotation is
+ * returned in bestCorr. */
+double best_rotation(const Polar< std::complex<double> > &I1,
+                     const Polar< std::complex<double> > &I2, RotationalCorrelationAux &aux,
+                     double &bestCorr);
+
 /** Align I2 rotationally to I1 */
 void alignRotationally(MultidimArray<double> &I1, MultidimArray<double> &I2,
 					   RotationalCorrelationAux &aux,
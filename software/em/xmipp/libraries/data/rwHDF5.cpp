@@ -26,6 +26,10 @@
 #include "xmipp_image_base.h"
 #include "xmipp_hdf5.h"
 
+// Largest chunk of an image written by writeHDF5 (HDF5 chunks must be smaller than 4GB)
+#define H5_MAX_CHUNK_SIZE 2147483648UL
+// Compression level of the deflate filter (fast, the shuffle filter does most of the work)
+#define H5_DEFLATE_LEVEL 1
 
 
 DataType ImageBase::datatypeH5(hid_t h5datatype)
@@ -121,10 +125,15 @@ hid_t ImageBase::H5Datatype(DataType datatype)
 int ImageBase::readHDF5(size_t select_img)
 {
     bool isStack = false;
+    bool readContiguous = false;
+    int errCode = 0;
+    DataType datatype;
 
-    H5infoProvider provider = getProvider(fhdf5); // Provider name
+    {
+    // All the HDF5 calls while holding the HDF5 mutex
+    H5Lock lock;
 
-    int errCode = 0;
+    H5infoProvider provider = getProvider(fhdf5); // Provider name
 
     hid_t dataset;    /* Dataset and datatype identifiers */
     hid_t filespace;
@@ -179,7 +188,8 @@ int ImageBase::readHDF5(size_t select_img)
     rank  = H5Sget_simple_extent_dims(filespace, dims, NULL);
 
     // Offset only set when it is possible to access to data directly
-    offset = (H5D_CONTIGUOUS == H5Pget_layout(cparms))? H5Dget_offset(dataset) : 0;
+    bool contiguous = (H5D_CONTIGUOUS == H5Pget_layout(cparms));
+    offset = contiguous ? H5Dget_offset(dataset) : 0;
 
 
     //    status = H5Dread(dataset, tid, H5S_ALL, H5S_ALL, H5P_DEFAULT, bm_out);
@@ -203,19 +213,24 @@ int ImageBase::readHDF5(size_t select_img)
         break;
     }
 
-    DataType datatype = datatypeH5(h5datatype);
+    datatype = datatypeH5(h5datatype);
     MDMainHeader.setValue(MDL_DATATYPE,(int) datatype);
+    H5Tclose(h5datatype);
 
     // Setting isStack depending on provider
     switch (provider.first)
     {
     case MISTRAL: // rank 3 arrays are stacks
+    case XMIPP:
         isStack = true;
         break;
         //    case EMAN: // Images in stack are stored in separated groups
     default:
     	break;
     }
+    // Datasets written by Xmipp (e.g., with a block name) are always stacks
+    if (H5Aexists(dataset, XMIPP_H5_STACK_ATTRIBUTE) > 0)
+        isStack = true;
 
 
     ArrayDim aDim;
@@ -235,97 +250,283 @@ int ImageBase::readHDF5(size_t select_img)
     setDimensions(aDim);
 
     //Read header only
-    if(dataMode == HEADER || (dataMode == _HEADER_ALL && aDim.ndim > 1))
-        return errCode;
-
-
-    // EMAN stores each image in a separate dataset
-    if ( provider.first == EMAN )
-        select_img = 1;
+    if(!(dataMode == HEADER || (dataMode == _HEADER_ALL && aDim.ndim > 1)))
+    {
+        // EMAN stores each image in a separate dataset
+        if ( provider.first == EMAN )
+            select_img = 1;
+
+        size_t   imgStart = IMG_INDEX(select_img);
+        size_t   imgEnd = (select_img != ALL_IMAGES) ? imgStart + 1 : aDim.ndim;
+
+        MD.clear();
+        MD.resize(imgEnd - imgStart,MDL::emptyHeader);
+
+        // Contiguous datasets are read directly from the file (if opened),
+        // the rest with a hyperslab of the selected images, so that only
+        // their chunks are read and decompressed
+        if (dataMode >= DATA && contiguous && fimg != NULL)
+            readContiguous = true;
+        else if (dataMode >= DATA)
+        {
+            // Allocate memory for image data (Assume xdim, ydim, zdim and ndim are already set
+            //if memory already allocated use it (no resize allowed)
+            mdaBase->coreAllocateReuse();
 
-    size_t   imgStart = IMG_INDEX(select_img);
-    size_t   imgEnd = (select_img != ALL_IMAGES) ? imgStart + 1 : aDim.ndim;
+            hsize_t start[4]; // Hyperslab offset in the file
+            hsize_t count[4]; // Size of the hyperslab in the file
+            for (int i = 0; i < rank; ++i)
+            {
+                start[i] = 0;
+                count[i] = dims[i];
+            }
+            // The first dimension of stacks and 4D datasets runs along the images
+            if (rank == 4 || (rank == 3 && isStack))
+            {
+                start[0] = (provider.first == EMAN) ? 0 : imgStart;
+                count[0] = (rank == 4 && !isStack) ? 1 : imgEnd - imgStart;
+            }
 
+            // Define the memory space to read a hyperslab.
+            hid_t memspace = H5Screate_simple(rank, count, NULL);
 
+            if ( H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL,
+                                     count, NULL) < 0 )
+                REPORT_ERROR(ERR_IO_NOREAD, formatString("readHDF5: Error selecting hyperslab %lu from filename %s",
+                             imgStart, filename.c_str()));
 
-    MD.clear();
-    MD.resize(imgEnd - imgStart,MDL::emptyHeader);
+            if ( H5Dread(dataset, H5Datatype(myT()), memspace, filespace,
+                         H5P_DEFAULT, mdaBase->getArrayPointer()) < 0 )
+                REPORT_ERROR(ERR_IO_NOREAD,formatString("readHDF5: Error reading hyperslab %lu from filename %s",
+                                                        imgStart, filename.c_str()));
+            H5Sclose(memspace);
+        }
+    }
 
-    if (dataMode < DATA)   // Don't read  data if not necessary but read the header
-        return errCode;
+    H5Pclose(cparms);
+    H5Sclose(filespace);
+    H5Dclose(dataset);
+    }
 
-    if ( H5Pget_layout(cparms) == H5D_CONTIGUOUS ) //We can read it directly
+    // Without holding the HDF5 mutex
+    if (readContiguous)
         readData(fimg, select_img, datatype, 0);
-    else // We read it by hyperslabs
-    {
-        // Allocate memory for image data (Assume xdim, ydim, zdim and ndim are already set
-        //if memory already allocated use it (no resize allowed)
-        mdaBase->coreAllocateReuse();
-
-        hid_t       memspace;
-
-        hsize_t offset[4]; // Hyperslab offset in the file
-        hsize_t  count[4]; // Size of the hyperslab in the file
 
-        // Define the offset and count of the hyperslab to be read.
+    return errCode;
+}
 
-        switch (rank)
+/** HDF5 Writer
+ *
+ * Images are written to a chunked dataset (the block name of the file name
+ * or XMIPP_H5_DATASET) of rank 3 (N x Ydim x Xdim) or 4 for volumes, with
+ * one image per chunk and an unlimited number of images, so that images can
+ * be appended and replaced and each image is read without reading the rest.
+ * The dataset has the attribute XMIPP_H5_STACK_ATTRIBUTE, so that it is read
+ * as a stack also when the file has no Xmipp provider.
+ * bitDepth is a comma separated list with the datatype (as in writeMRC) and
+ * "deflate" to compress the chunks with the shuffle and deflate filters
+ * (e.g., particles.h5%float,deflate).
+ */
+int ImageBase::writeHDF5(size_t select_img, bool isStack, int mode, String bitDepth, CastWriteMode castMode)
+{
+    if (isComplexT())
+        REPORT_ERROR(ERR_TYPE_INCORRECT, "rwHDF5: Complex images are not supported.");
+
+    // Cast T to datatype
+    DataType wDType = DT_Unknown, myTypeID = myT();
+    bool deflate = false;
+    StringVector options;
+    splitString(bitDepth, ",", options);
+    for (size_t i = 0; i < options.size(); ++i)
+    {
+        if (options[i] == "deflate")
+            deflate = true;
+        else if (options[i] != "default")
         {
-        case 4:
-            count[0] = 1;
-        case 3:
-            //            if (stack)
-            count[rank-3] = aDim.zdim;
-            offset[rank-2]  = 0;
-        case 2:
-            count[rank-2]  = aDim.ydim;
-            offset[rank-2]  = 0;
+            wDType = datatypeRAW(options[i]);
+            if (wDType == DT_Unknown || wDType >= DT_CShort)
+                REPORT_ERROR(ERR_TYPE_INCORRECT, formatString("rwHDF5: incorrect option %s.", options[i].c_str()));
+        }
+    }
+    if (wDType == DT_Unknown)
+    {
+        castMode = CW_CAST;
+        switch (myTypeID)
+        {
+        case DT_UChar:
+        case DT_SChar:
+        case DT_UShort:
+        case DT_Short:
+            wDType = myTypeID;
             break;
+        case DT_Bool:
+            wDType = DT_UChar;
+            break;
+        default:
+            wDType = DT_Float;
         }
-        count[rank-1]  = aDim.xdim;
-        offset[rank-1]  = 0;
+    }
 
-        aDim.xdim = dims[rank-1];
-        aDim.ydim = (rank>1)?dims[rank-2]:1;
-        aDim.zdim = (rank == 4)?dims[1]:1;
-        // size_t nDimFile = (rank>2)?dims[0]:1 ;
+    if (mmapOnWrite)
+    {
+        /* Chunked datasets cannot be mapped. When ImageGeneric asks for the datatype
+         * to use, go on and create the dataset, otherwise keep using the image in
+         * memory as in the other formats whose datatype cannot be mapped.
+         */
+        mmapOnWrite = false;
+        if (dataMode >= DATA)
+        {
+            dataMode = DATA;
+            MDMainHeader.setValue(MDL_DATATYPE, (int) myTypeID);
+            mdaBase->coreAllocateReuse();
+            return 0;
+        }
+    }
 
-        // Define the memory space to read a hyperslab.
-        memspace = H5Screate_simple(rank,count,NULL);
+    size_t Xdim, Ydim, Zdim, Ndim;
+    getDimensions(Xdim, Ydim, Zdim, Ndim);
+    size_t datasize_n = Xdim * Ydim * Zdim;
 
-        size_t data = (size_t) this->mdaBase->getArrayPointer();
-        size_t pad = aDim.zyxdim*gettypesize(myT());
+    // All the HDF5 calls while holding the HDF5 mutex
+    H5Lock lock;
 
+    String dsname = filename.getBlockName();
+    if (dsname.empty())
+    {
+        H5infoProvider provider = (_exists) ? getProvider(fhdf5) : std::make_pair(NONE, String(""));
+        if (provider.first == EMAN)
+            REPORT_ERROR(ERR_NOT_IMPLEMENTED, "writeHDF5: EMAN files cannot be written.");
+        dsname = (provider.first == NONE) ? String(XMIPP_H5_DATASET) : provider.second;
+    }
 
-        for (size_t idx = imgStart, imN = 0; idx < imgEnd; ++idx, ++imN)
-        {
+    int rank = (Zdim > 1) ? 4 : 3;
+    hsize_t dims[4], maxdims[4];
+    size_t imgStart = (mode == WRITE_APPEND) ? replaceNsize : IMG_INDEX(select_img);
 
-            // Set the offset of the hyperslab to be read
-            offset[0] = idx;
+    hid_t dataset = -1;
+    if (_exists && mode != WRITE_OVERWRITE)
+    {
+        H5E_BEGIN_TRY
+        {
+            dataset = H5Dopen2(fhdf5, dsname.c_str(), H5P_DEFAULT);
+        }
+        H5E_END_TRY;
+    }
 
-            if ( H5Sselect_hyperslab(filespace, H5S_SELECT_SET, offset, NULL,
-                                     count, NULL) < 0 )
-                REPORT_ERROR(ERR_IO_NOREAD, formatString("readHDF5: Error selecting hyperslab %d from filename %s",
-                             imgStart, filename.c_str()));
+    if (dataset >= 0)
+    {
+        // Images are written in the datatype of the dataset
+        hid_t h5datatype = H5Dget_type(dataset);
+        wDType = datatypeH5(h5datatype);
+        H5Tclose(h5datatype);
+
+        hid_t filespace = H5Dget_space(dataset);
+        int fileRank = H5Sget_simple_extent_dims(filespace, dims, maxdims);
+        H5Sclose(filespace);
+        if (fileRank != rank)
+            REPORT_ERROR(ERR_MULTIDIM_SIZE, formatString("writeHDF5: Dataset %s of %s has %d dimensions instead of %d.",
+                         dsname.c_str(), dataFName.c_str(), fileRank, rank));
+        if (imgStart + Ndim > dims[0])
+        {
+            dims[0] = imgStart + Ndim;
+            if ((maxdims[0] != H5S_UNLIMITED && dims[0] > maxdims[0]) || H5Dset_extent(dataset, dims) < 0)
+                REPORT_ERROR(ERR_IO_NOWRITE, formatString("writeHDF5: Dataset %s of %s cannot be extended to %lu images.",
+                             dsname.c_str(), dataFName.c_str(), (size_t) dims[0]));
+        }
+    }
+    else
+    {
+        hsize_t chunk[4];
+        dims[0] = chunk[0] = imgStart + Ndim;
+        maxdims[0] = H5S_UNLIMITED;
+        chunk[0] = 1;
+        if (rank == 4)
+        {
+            dims[1] = maxdims[1] = chunk[1] = Zdim;
+            // Large volumes are chunked by slices
+            if (datasize_n * gettypesize(wDType) > H5_MAX_CHUNK_SIZE)
+                chunk[1] = 1;
+        }
+        dims[rank - 2] = maxdims[rank - 2] = chunk[rank - 2] = Ydim;
+        dims[rank - 1] = maxdims[rank - 1] = chunk[rank - 1] = Xdim;
 
-            //            movePointerTo(ALL_SLICES,imN);
-            // Read
-            if ( H5Dread(dataset, H5Datatype(myT()), memspace, filespace,
-                         H5P_DEFAULT, (void*)(data + pad*imN)) < 0 )
-                REPORT_ERROR(ERR_IO_NOREAD,formatString("readHDF5: Error reading hyperslab %d from filename %s",
-                                                        imgStart, filename.c_str()));
+        hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        H5Pset_chunk(dcpl, rank, chunk);
+        if (deflate)
+        {
+            H5Pset_shuffle(dcpl);
+            H5Pset_deflate(dcpl, H5_DEFLATE_LEVEL);
         }
-        H5Sclose(memspace);
+        hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+        H5Pset_create_intermediate_group(lcpl, 1);
+        hid_t filespace = H5Screate_simple(rank, dims, maxdims);
+        dataset = H5Dcreate2(fhdf5, dsname.c_str(), H5Datatype(wDType), filespace, lcpl, dcpl, H5P_DEFAULT);
+        H5Sclose(filespace);
+        H5Pclose(lcpl);
+        H5Pclose(dcpl);
+        if (dataset < 0)
+            REPORT_ERROR(ERR_IO_NOWRITE, formatString("writeHDF5: Cannot create dataset %s in %s.",
+                         dsname.c_str(), dataFName.c_str()));
+
+        // Mark the dataset as a stack, so that it is read back as written
+        int stackFlag = 1;
+        hid_t attrspace = H5Screate(H5S_SCALAR);
+        hid_t attr = H5Acreate2(dataset, XMIPP_H5_STACK_ATTRIBUTE, H5T_NATIVE_INT, attrspace,
+                                H5P_DEFAULT, H5P_DEFAULT);
+        H5Awrite(attr, H5T_NATIVE_INT, &stackFlag);
+        H5Aclose(attr);
+        H5Sclose(attrspace);
     }
+    MDMainHeader.setValue(MDL_DATATYPE, (int) wDType);
 
-    H5Pclose(cparms);
-    H5Sclose(filespace);
-    H5Dclose(dataset);
+    if (wDType == myTypeID && castMode == CW_CONVERT)
+        castMode = CW_CAST;
 
-    return errCode;
-}
+    if (dataMode >= DATA) // Images are not written if only the header is being modified
+    {
+        hsize_t start[4], count[4];
+        for (int i = 1; i < rank; ++i)
+        {
+            start[i] = 0;
+            count[i] = dims[i];
+        }
+        start[0] = imgStart;
+        hid_t filespace = H5Dget_space(dataset);
+        herr_t err = 0;
+        if (castMode == CW_CAST)
+        {
+            // All the images at once, converted by the library
+            count[0] = Ndim;
+            hid_t memspace = H5Screate_simple(rank, count, NULL);
+            H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+            err = H5Dwrite(dataset, H5Datatype(myTypeID), memspace, filespace, H5P_DEFAULT,
+                           mdaBase->getArrayPointer());
+            H5Sclose(memspace);
+        }
+        else
+        {
+            // Each image with its own range
+            count[0] = 1;
+            hid_t memspace = H5Screate_simple(rank, count, NULL);
+            char *page = (char *) askMemory(datasize_n * gettypesize(wDType));
+            for (size_t n = 0; n < Ndim && err >= 0; ++n)
+            {
+                double min0, max0;
+                mdaBase->computeDoubleMinMaxRange(min0, max0, n * datasize_n, datasize_n);
+                getCastConvertPageFromT(n * datasize_n, page, wDType, datasize_n, min0, max0, castMode);
+                start[0] = imgStart + n;
+                H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+                err = H5Dwrite(dataset, H5Datatype(wDType), memspace, filespace, H5P_DEFAULT, page);
+            }
+            freeMemory(page, datasize_n * gettypesize(wDType));
+            H5Sclose(memspace);
+        }
+        H5Sclose(filespace);
+        if (err < 0)
+            REPORT_ERROR(ERR_IO_NOWRITE, formatString("writeHDF5: Cannot write dataset %s of %s.",
+                         dsname.c_str(), dataFName.c_str()));
+    }
+    H5Dclose(dataset);
 
-int ImageBase::writeHDF5(size_t select_img, bool isStack, int mode, String bitDepth, CastWriteMode castMode)
-{
-    REPORT_ERROR(ERR_NOT_IMPLEMENTED, "writeHDF5: Not implemented yet.");
+    return 0;
 }
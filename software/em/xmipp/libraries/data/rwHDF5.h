@@ -44,10 +44,14 @@ hid_t H5Datatype(DataType datatype);
 
 
 /** Read Images from HDF5 container files.
+  * Only the chunks of the selected images are read (a hyperslab), so
+  * N@file.h5 does not read nor decompress the rest of the stack.
   */
 int readHDF5(size_t select_img);
 
 /** Write Images to HDF5 container files.
+  * Stacks are chunked by images and can be appended and replaced.
+  * bitDepth accepts the datatype and "deflate" (e.g., %uint16,deflate).
   */
 int writeHDF5(size_t select_img, bool isStack=false, int mode=WRITE_OVERWRITE, String bitDepth="", CastWriteMode castMode = CW_CAST);
 
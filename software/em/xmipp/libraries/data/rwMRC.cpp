@@ -132,8 +132,11 @@ int ImageBase::readMRC(size_t select_img, bool isStack)
 
     int errCode = 0;
 
-    if ( fread( header, MRCSIZE, 1, fimg ) < 1 )
+    if ( readFileBytes( header, MRCSIZE, 0 ) < MRCSIZE )
+    {
+        delete header;
         return(-2);
+    }
 
     // Determine byte order and swap bytes if from little-endian machine
     if ( (swap = (( abs( header->mode ) > SWAPTRIG ) || ( abs(header->nz) > SWAPTRIG ))) )
@@ -224,8 +227,7 @@ int ImageBase::readMRC(size_t select_img, bool isStack)
     if ( header->mode > 2 && header->mode < 5 )
     {
         transform = CentHerm;
-        fseek(fimg, 0, SEEK_END);
-        if ( ftell(fimg) > offset + 0.8*datasize_n*gettypesize(datatype) )
+        if ( readFileSize() > offset + 0.8*datasize_n*gettypesize(datatype) )
             _xDim = (2 * (_xDim - 1));
         if ( header->mx%2 == 1 )
             _xDim += 1;     // Quick fix for odd x-size maps
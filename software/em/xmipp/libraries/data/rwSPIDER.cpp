@@ -145,7 +145,7 @@ int  ImageBase::readSPIDER(size_t select_img)
 #undef DEBUG
 
     SPIDERhead* header = new SPIDERhead;
-    if ( fread( header, SPIDERSIZE, 1, fimg ) != 1 )
+    if ( readFileBytes( header, SPIDERSIZE, 0 ) != SPIDERSIZE )
         REPORT_ERROR(ERR_IO_NOREAD, formatString("rwSPIDER: cannot read Spider main header from file %s"
                      ". Error message: %s", filename.c_str() ,strerror(errno)));
 
@@ -225,22 +225,18 @@ int  ImageBase::readSPIDER(size_t select_img)
     //std::cerr << formatString("DEBUG_JM: header_size: %10lu, datasize_n: %10lu, image_size: %10lu, imgStart: %10lu, img_seek: %10lu",
     //    header_size, datasize_n, image_size, imgStart, img_seek) <<std::endl;
 
-    for (size_t n = 0, i = imgStart; i < imgEnd; ++i, ++n, img_seek += image_size )
+    // The header of each image is only needed for its geometry
+    if (dataMode == _HEADER_ALL || dataMode == _DATA_ALL)
     {
-        if (fseek( fimg, img_seek, SEEK_SET ) != 0)//fseek return 0 on success
-            REPORT_ERROR(ERR_IO, formatString("rwSPIDER: error seeking %lu for read image %lu", img_seek, i));
-
-        // std::cerr << formatString("DEBUG_JM: rwSPIDER: seeking %lu for read image %lu", img_seek, i) <<std::endl;
-
-        if(isStack)
-        {
-            if ( fread( header, SPIDERSIZE, 1, fimg ) != 1 )
-                REPORT_ERROR(ERR_IO_NOREAD, formatString("rwSPIDER: cannot read Spider image %lu header", i));
-            if ( swap )
-                swapPage((char *) header, SPIDERSIZE - 180, DT_Float);
-        }
-        if (dataMode == _HEADER_ALL || dataMode == _DATA_ALL)
+        for (size_t n = 0, i = imgStart; i < imgEnd; ++i, ++n, img_seek += image_size )
         {
+            if(isStack)
+            {
+                if ( readFileBytes( header, SPIDERSIZE, img_seek ) != SPIDERSIZE )
+                    REPORT_ERROR(ERR_IO_NOREAD, formatString("rwSPIDER: cannot read Spider image %lu header", i));
+                if ( swap )
+                    swapPage((char *) header, SPIDERSIZE - 180, DT_Float);
+            }
             daux = (double)header->xoff;
             MD[n].setValue(MDL_SHIFT_X, daux);
             daux = (double)header->yoff;
@@ -0,0 +1,724 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <zlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "xmipp_image_base.h"
+#include "xmipp_image_registry.h"
+#include "xmipp_threads.h"
+
+/*
+ File layout (all the numbers in the byte order of the writer):
+   XCShead           main header (256 bytes)
+   XCSindexEntry[C]  position and size of the chunk of each image, with room
+                     for C>=N images (zero entries beyond N)
+   chunks            compressed images, in any order
+ New chunks are appended at the end of the file. When the stack grows beyond
+ the room of its index, the index is moved to the end of the file with twice
+ the room. A chunk of the same size as the image is stored without
+ compression and a chunk of size 0 is an image of zeros (images not written
+ yet). Files of previous versions with indexCapacity=0 have no extra room.
+*/
+
+#define XCS_MAGIC "XMIPPXCS"
+#define XCS_VERSION 1
+#define XCS_ENCODING_RAW 0
+#define XCS_ENCODING_FLOAT16 1
+// Deflate level, the fastest one is enough for shuffled samples
+#define XCS_COMPRESSION_LEVEL Z_BEST_SPEED
+// Images compressed in parallel by each thread before writing them
+#define XCS_IMAGES_PER_THREAD 4
+// Decoding errors
+#define XCS_ERR_READ -100
+#define XCS_ERR_SIZE -101
+
+/** XCS main header
+  * @ingroup XCS
+*/
+struct XCShead
+{
+    char magic[8];           // XMIPPXCS
+    int version;             // Format version
+    int datatype;            // DataType of the decoded samples
+    int encoding;            // XCS_ENCODING_RAW or XCS_ENCODING_FLOAT16
+    int shuffle;             // Bytes of the samples are shuffled before compression
+    int xdim;                // Image size
+    int ydim;
+    int zdim;
+    int unused0;
+    unsigned long long ndim; // Number of images
+    unsigned long long indexOffset; // Position of the index
+    float sampling[3];       // Sampling rate in X, Y and Z
+    int unused1;
+    unsigned long long indexCapacity; // Entries of the space of the index
+    char unused[176];        // Up to 256 bytes
+};
+
+/** XCS index entry
+  * @ingroup XCS
+*/
+struct XCSindexEntry
+{
+    unsigned long long offset; // Position of the chunk
+    unsigned long long size;   // Bytes of the chunk
+};
+
+static void swapXCShead(XCShead &header)
+{
+    swapbytes((char *) &header.version, sizeof(int));
+    swapbytes((char *) &header.datatype, sizeof(int));
+    swapbytes((char *) &header.encoding, sizeof(int));
+    swapbytes((char *) &header.shuffle, sizeof(int));
+    swapbytes((char *) &header.xdim, sizeof(int));
+    swapbytes((char *) &header.ydim, sizeof(int));
+    swapbytes((char *) &header.zdim, sizeof(int));
+    swapbytes((char *) &header.ndim, sizeof(unsigned long long));
+    swapbytes((char *) &header.indexOffset, sizeof(unsigned long long));
+    swapbytes((char *) &header.indexCapacity, sizeof(unsigned long long));
+    for (int i = 0; i < 3; ++i)
+        swapbytes((char *) &header.sampling[i], sizeof(float));
+}
+
+/* Half precision float of a float, rounding to the nearest even. Values out
+ * of the range of half floats saturate to the largest finite value.
+ */
+static unsigned short float2half(float value)
+{
+    unsigned int x;
+    memcpy(&x, &value, sizeof(float));
+    unsigned int sign = (x >> 16) & 0x8000;
+    unsigned int mantissa = x & 0x007fffff;
+    int exponent = (int) ((x >> 23) & 0xff);
+    if (exponent == 255) // Inf or NaN
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    exponent += 15 - 127;
+    if (exponent >= 31)
+        return sign | 0x7bff;
+    unsigned int half, rest, halfway;
+    if (exponent <= 0)
+    {
+        // Subnormal half
+        if (exponent < -10)
+            return sign;
+        mantissa |= 0x00800000;
+        int shift = 14 - exponent;
+        half = mantissa >> shift;
+        rest = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    else
+    {
+        half = ((unsigned int) exponent << 10) | (mantissa >> 13);
+        rest = mantissa & 0x1fff;
+        halfway = 0x1000;
+    }
+    // A carry into the exponent is the right result
+    if (rest > halfway || (rest == halfway && (half & 1)))
+        ++half;
+    if (half >= 0x7c00)
+        half = 0x7bff;
+    return sign | half;
+}
+
+/* Float of a half precision float */
+static float half2float(unsigned short half)
+{
+    unsigned int sign = ((unsigned int) half & 0x8000) << 16;
+    unsigned int exponent = (half >> 10) & 0x1f;
+    unsigned int mantissa = half & 0x3ff;
+    unsigned int x;
+    if (exponent == 0x1f)
+        x = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0)
+        x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        x = sign;
+    else
+    {
+        // Subnormal half, normal float
+        exponent = 127 - 14;
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            --exponent;
+        }
+        x = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+    float value;
+    memcpy(&value, &x, sizeof(float));
+    return value;
+}
+
+/* Byte b of every sample goes to the b-th block of n bytes, so that the
+ * exponents and high order bytes, which change slowly, are together.
+ */
+static void shuffleBytes(const char *in, char *out, size_t n, size_t typeSize)
+{
+    for (size_t b = 0; b < typeSize; ++b)
+    {
+        char *outB = out + b * n;
+        const char *inB = in + b;
+        for (size_t i = 0; i < n; ++i, inB += typeSize)
+            outB[i] = *inB;
+    }
+}
+
+/* Inverse of shuffleBytes */
+static void unshuffleBytes(const char *in, char *out, size_t n, size_t typeSize)
+{
+    for (size_t b = 0; b < typeSize; ++b)
+    {
+        const char *inB = in + b * n;
+        char *outB = out + b;
+        for (size_t i = 0; i < n; ++i, outB += typeSize)
+            *outB = inB[i];
+    }
+}
+
+/* Positioned read of the file of an image, from the registry of open stacks
+ * or from the descriptor of fimg. Thread-safe.
+ */
+static size_t readXCSBytes(const StackFileHandle *handle, FILE *fimg, void *buffer, size_t size, size_t pos)
+{
+    if (handle != NULL)
+        return handle->read(buffer, size, pos);
+    int fd = fileno(fimg);
+    char *ptr = (char *) buffer;
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = pread(fd, ptr + done, size - done, pos + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+/* Positioned write to the file of fimg. Returns the bytes written. */
+static size_t writeXCSBytes(FILE *fimg, const void *buffer, size_t size, size_t pos)
+{
+    int fd = fileno(fimg);
+    const char *ptr = (const char *) buffer;
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t n = pwrite(fd, ptr + done, size - done, pos + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+class ImageBase::XCSEncodeBody: public ParallelForBody
+{
+public:
+    ImageBase *image;
+    DataType datatype;
+    bool half;
+    CastWriteMode castMode;
+    size_t datasize_n;
+    /// First image of the block being compressed
+    size_t blockFirst;
+    /// Chunks and zlib status of the images of the block
+    std::vector< std::vector<char> > chunks;
+    std::vector<int> status;
+    /// Per thread samples in the type of the file and shuffled samples
+    std::vector< std::vector<char> > pages, shuffled;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        size_t typeSize = half ? 2 : gettypesize(datatype);
+        size_t rawBytes = datasize_n * typeSize;
+        std::vector<char> &pageV = pages[thread_id];
+        if (pageV.empty())
+        {
+            pageV.resize(datasize_n * gettypesize(datatype));
+            if (typeSize > 1)
+                shuffled[thread_id].resize(rawBytes);
+        }
+        char *page = &pageV[0];
+        for (size_t n = first; n <= last; ++n)
+        {
+            size_t offset = n * datasize_n;
+            if (castMode == CW_CAST)
+                image->getPageFromT(offset, page, datatype, datasize_n);
+            else
+            {
+                double min0, max0;
+                image->mdaBase->computeDoubleMinMaxRange(min0, max0, offset, datasize_n);
+                image->getCastConvertPageFromT(offset, page, datatype, datasize_n, min0, max0, castMode);
+            }
+            if (half)
+            {
+                // In place, each half is written before the floats not read yet
+                const float *ptrF = (const float *) page;
+                unsigned short *ptrH = (unsigned short *) page;
+                for (size_t i = 0; i < datasize_n; ++i)
+                    ptrH[i] = float2half(ptrF[i]);
+            }
+            const char *src = page;
+            if (typeSize > 1)
+            {
+                shuffleBytes(page, &shuffled[thread_id][0], datasize_n, typeSize);
+                src = &shuffled[thread_id][0];
+            }
+
+            std::vector<char> &chunk = chunks[n - blockFirst];
+            uLongf chunkSize = compressBound(rawBytes);
+            chunk.resize(chunkSize);
+            status[n - blockFirst] = compress2((Bytef *) &chunk[0], &chunkSize,
+                                               (const Bytef *) src, rawBytes, XCS_COMPRESSION_LEVEL);
+            // Incompressible images are stored as they are
+            if (chunkSize >= rawBytes)
+                chunk.assign(src, src + rawBytes);
+            else
+                chunk.resize(chunkSize);
+        }
+    }
+};
+
+class ImageBase::XCSDecodeBody: public ParallelForBody
+{
+public:
+    ImageBase *image;
+    const StackFileHandle *handle;
+    FILE *fimg;
+    DataType datatype;
+    bool half;
+    bool shuffle;
+    int swap;
+    size_t datasize_n;
+    /// Chunks of the images to decode
+    const std::vector<XCSindexEntry> *index;
+    /// Status of each image (0, zlib error or XCS_ERR_*)
+    std::vector<int> status;
+    /// Per thread chunk, decompressed bytes and samples
+    std::vector< std::vector<char> > chunks, inflated, pages;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        size_t typeSize = half ? 2 : gettypesize(datatype);
+        size_t rawBytes = datasize_n * typeSize;
+        std::vector<char> &pageV = pages[thread_id];
+        if (pageV.empty())
+        {
+            pageV.resize(datasize_n * gettypesize(datatype));
+            if (shuffle && typeSize > 1)
+                inflated[thread_id].resize(rawBytes);
+        }
+        char *page = &pageV[0];
+        bool unshuffle = shuffle && typeSize > 1;
+        for (size_t n = first; n <= last; ++n)
+        {
+            const XCSindexEntry &entry = (*index)[n];
+            if (entry.size == 0)
+            {
+                memset(page, 0, pageV.size());
+                image->setPage2T(n * datasize_n, page, datatype, datasize_n);
+                continue;
+            }
+            std::vector<char> &chunk = chunks[thread_id];
+            chunk.resize(entry.size);
+            if (readXCSBytes(handle, fimg, &chunk[0], entry.size, entry.offset) != entry.size)
+            {
+                status[n] = XCS_ERR_READ;
+                continue;
+            }
+            char *dest = unshuffle ? &inflated[thread_id][0] : page;
+            if (entry.size == rawBytes)
+            {
+                if (unshuffle)
+                    unshuffleBytes(&chunk[0], page, datasize_n, typeSize);
+                else
+                    memcpy(page, &chunk[0], rawBytes);
+            }
+            else
+            {
+                uLongf destSize = rawBytes;
+                int err = uncompress((Bytef *) dest, &destSize, (const Bytef *) &chunk[0], entry.size);
+                if (err != Z_OK || destSize != rawBytes)
+                {
+                    status[n] = (err != Z_OK) ? err : XCS_ERR_SIZE;
+                    continue;
+                }
+                if (unshuffle)
+                    unshuffleBytes(dest, page, datasize_n, typeSize);
+            }
+            if (swap)
+                image->swapPage(page, rawBytes, half ? DT_UShort : datatype, swap);
+            if (half)
+            {
+                // In place from the end, each float overwrites halves already read
+                const unsigned short *ptrH = (const unsigned short *) page;
+                float *ptrF = (float *) page;
+                for (size_t i = datasize_n; i-- > 0; )
+                    ptrF[i] = half2float(ptrH[i]);
+            }
+            image->setPage2T(n * datasize_n, page, datatype, datasize_n);
+        }
+    }
+};
+
+/************************************************************************
+@Function: readXCS
+@Description:
+ Reading a compressed Xmipp stack.
+@Algorithm:
+ The main header and the index entries of the selected images are read,
+ then their chunks are read and decompressed (in parallel if there are
+ several images).
+@Arguments:
+ size_t select_img  image selection in multi-image file (ALL_IMAGES = all images).
+@Returns:
+ int     error code (<0 means failure).
+**************************************************************************/
+/** XCS Reader
+  * @ingroup XCS
+*/
+int ImageBase::readXCS(size_t select_img)
+{
+    XCShead header;
+    if (readFileBytes(&header, sizeof(XCShead), 0) != sizeof(XCShead) ||
+        memcmp(header.magic, XCS_MAGIC, 8) != 0)
+        REPORT_ERROR(ERR_IO_NOTFILE, formatString("rwXCS: %s is not a compressed Xmipp stack", filename.c_str()));
+
+    // The version is a small number, it is large if written with the other byte order
+    swap = (abs(header.version) > SWAPTRIG) ? 1 : 0;
+    if (swap)
+        swapXCShead(header);
+    if (header.version > XCS_VERSION)
+        REPORT_ERROR(ERR_IO_NOTFILE, formatString("rwXCS: unknown version %d of file %s",
+                     header.version, filename.c_str()));
+
+    DataType datatype = (DataType) header.datatype;
+    bool half = header.encoding == XCS_ENCODING_FLOAT16;
+    MDMainHeader.setValue(MDL_SAMPLINGRATE_X, (double) header.sampling[0]);
+    MDMainHeader.setValue(MDL_SAMPLINGRATE_Y, (double) header.sampling[1]);
+    MDMainHeader.setValue(MDL_SAMPLINGRATE_Z, (double) header.sampling[2]);
+    MDMainHeader.setValue(MDL_DATATYPE, (int) datatype);
+
+    size_t _nDim = (size_t) header.ndim;
+    if (header.xdim < 1 || header.ydim < 1 || header.zdim < 1 || _nDim < 1)
+        REPORT_ERROR(ERR_IO_NOTFILE, formatString("Invalid compressed Xmipp stack:  %s", filename.c_str()));
+    if (select_img > _nDim)
+        REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("readXCS (%s): Image number %lu exceeds stack size %lu",
+                     filename.c_str(), select_img, _nDim));
+
+    replaceNsize = _nDim;
+    size_t _nDimSet = (select_img == ALL_IMAGES) ? _nDim : 1;
+    setDimensions(header.xdim, header.ydim, header.zdim, _nDimSet);
+    offset = 0;
+
+    if (dataMode == HEADER || (dataMode == _HEADER_ALL && _nDimSet > 1)) // Stop reading if not necessary
+        return 0;
+
+    size_t imgStart = IMG_INDEX(select_img);
+    size_t imgEnd = (select_img != ALL_IMAGES) ? imgStart + 1 : _nDim;
+
+    MD.clear();
+    MD.resize(imgEnd - imgStart, MDL::emptyHeader);
+
+    if (dataMode < DATA)   // Don't read  data if not necessary but read the header
+        return 0;
+
+    if (mmapOnRead)
+    {
+        reportWarning("Image::readXCS: Compressed images cannot be mapped. Loading into memory.");
+        mmapOnRead = false;
+    }
+    mdaBase->coreAllocateReuse();
+
+    // Only the entries of the images being read
+    size_t nImages = imgEnd - imgStart;
+    std::vector<XCSindexEntry> index(nImages);
+    size_t indexSize = nImages * sizeof(XCSindexEntry);
+    if (readFileBytes(&index[0], indexSize, header.indexOffset + imgStart * sizeof(XCSindexEntry)) != indexSize)
+        REPORT_ERROR(ERR_IO_NOREAD, formatString("rwXCS: cannot read the index of %s", filename.c_str()));
+    if (swap)
+        for (size_t n = 0; n < nImages; ++n)
+        {
+            swapbytes((char *) &index[n].offset, sizeof(unsigned long long));
+            swapbytes((char *) &index[n].size, sizeof(unsigned long long));
+        }
+
+    XCSDecodeBody body;
+    body.image = this;
+    body.handle = stackHandle;
+    body.fimg = fimg;
+    body.datatype = datatype;
+    body.half = half;
+    body.shuffle = header.shuffle != 0;
+    body.swap = swap;
+    body.datasize_n = (size_t) header.xdim * header.ydim * header.zdim;
+    body.index = &index;
+    body.status.resize(nImages, 0);
+    ThreadPool &pool = ThreadPool::getInstance();
+    size_t nSlots = (nImages > 1) ? pool.getNumberOfThreads() + 1 : 1;
+    body.chunks.resize(nSlots);
+    body.inflated.resize(nSlots);
+    body.pages.resize(nSlots);
+    if (nImages > 1)
+        pool.parallelFor(0, nImages - 1, body, 1);
+    else
+        body(0, 0, 0);
+
+    for (size_t n = 0; n < nImages; ++n)
+        if (body.status[n] == XCS_ERR_READ)
+            REPORT_ERROR(ERR_IO_NOREAD, formatString("rwXCS: cannot read image %lu of %s",
+                         imgStart + n + 1, filename.c_str()));
+        else if (body.status[n] != 0)
+            REPORT_ERROR(ERR_IO_NOREAD, formatString("rwXCS: image %lu of %s is corrupted (error %d)",
+                         imgStart + n + 1, filename.c_str(), body.status[n]));
+    return 0;
+}
+
+/************************************************************************
+@Function: writeXCS
+@Description:
+ Writing a compressed Xmipp stack.
+@Algorithm:
+ The images are compressed in parallel by blocks and their chunks are
+ appended at the end of the file. Then only the index entries of the written
+ images and the main header are written, unless the index has no room for
+ the new images and the whole index is moved to the end of the file.
+@Arguments:
+@Returns:
+ int     error code (<0 means failure).
+**************************************************************************/
+/** XCS Writer
+  * @ingroup XCS
+*/
+int ImageBase::writeXCS(size_t select_img, bool isStack, int mode, const String &bitDepth, CastWriteMode castMode)
+{
+    if (isComplexT())
+        REPORT_ERROR(ERR_TYPE_INCORRECT, "rwXCS: Complex images are not supported by the compressed stack format.");
+
+    // Cast T to datatype
+    DataType wDType, myTypeID = myT();
+    bool half = false;
+    if (bitDepth == "")
+    {
+        castMode = CW_CAST;
+        switch (myTypeID)
+        {
+        case DT_UChar:
+        case DT_SChar:
+        case DT_UShort:
+        case DT_Short:
+            wDType = myTypeID;
+            break;
+        case DT_Bool:
+            wDType = DT_UChar;
+            break;
+        default:
+            wDType = DT_Float;
+        }
+    }
+    else if (bitDepth == "float16")
+    {
+        wDType = DT_Float;
+        half = true;
+    }
+    else
+    {
+        wDType = (bitDepth == "default") ? DT_Float : datatypeRAW(bitDepth);
+        switch (wDType)
+        {
+        case DT_UChar:
+        case DT_SChar:
+        case DT_UShort:
+        case DT_Short:
+        case DT_Float:
+            break;
+        case DT_Double:
+        case DT_Int:
+        case DT_UInt:
+            wDType = DT_Float;
+            break;
+        default:
+            REPORT_ERROR(ERR_TYPE_INCORRECT, "ERROR: incorrect compressed stack bits depth value.");
+        }
+    }
+
+    if (mmapOnWrite)
+    {
+        /* Compressed images cannot be mapped. When ImageGeneric asks for the datatype
+         * to use, go on and write the header, otherwise keep using the image in memory
+         * as in the other formats whose datatype cannot be mapped.
+         */
+        mmapOnWrite = false;
+        if (dataMode >= DATA)
+        {
+            dataMode = DATA;
+            MDMainHeader.setValue(MDL_DATATYPE, (int) myTypeID);
+            mdaBase->coreAllocateReuse();
+            return 0;
+        }
+    }
+    MDMainHeader.setValue(MDL_DATATYPE, (int) wDType);
+
+    size_t Xdim, Ydim, Zdim, Ndim;
+    getDimensions(Xdim, Ydim, Zdim, Ndim);
+    size_t datasize_n = Xdim * Ydim * Zdim;
+
+    //locking the file
+    FileLock flock;
+    flock.lock(fimg);
+
+    XCShead header;
+    size_t oldNsize = 0, capacity = 0, fileEnd;
+    bool newFile = replaceNsize == 0 || mode == WRITE_OVERWRITE;
+    if (!newFile)
+    {
+        // The images are written in the type of the file
+        if (readXCSBytes(NULL, fimg, &header, sizeof(XCShead), 0) != sizeof(XCShead) ||
+            memcmp(header.magic, XCS_MAGIC, 8) != 0)
+            REPORT_ERROR(ERR_IO_NOTFILE, formatString("rwXCS: %s is not a compressed Xmipp stack", filename.c_str()));
+        if (abs(header.version) > SWAPTRIG)
+            REPORT_ERROR(ERR_IO_NOWRITE, formatString("rwXCS: %s was written with the other byte order and cannot be modified",
+                         filename.c_str()));
+        wDType = (DataType) header.datatype;
+        half = header.encoding == XCS_ENCODING_FLOAT16;
+        oldNsize = header.ndim;
+        capacity = std::max(oldNsize, (size_t) header.indexCapacity);
+        struct stat info;
+        if (fstat(fileno(fimg), &info) != 0)
+            REPORT_ERROR(ERR_IO_NOREAD, formatString("rwXCS: cannot get the size of %s", filename.c_str()));
+        fileEnd = info.st_size;
+    }
+    else
+    {
+        memset(&header, 0, sizeof(XCShead));
+        memcpy(header.magic, XCS_MAGIC, 8);
+        header.version = XCS_VERSION;
+        header.datatype = wDType;
+        header.encoding = half ? XCS_ENCODING_FLOAT16 : XCS_ENCODING_RAW;
+        header.shuffle = 1;
+        header.xdim = Xdim;
+        header.ydim = Ydim;
+        header.zdim = Zdim;
+        double aux;
+        MDMainHeader.getValueOrDefault(MDL_SAMPLINGRATE_X, aux, 1.);
+        header.sampling[0] = (float) aux;
+        MDMainHeader.getValueOrDefault(MDL_SAMPLINGRATE_Y, aux, 1.);
+        header.sampling[1] = (float) aux;
+        MDMainHeader.getValueOrDefault(MDL_SAMPLINGRATE_Z, aux, 1.);
+        header.sampling[2] = (float) aux;
+        fileEnd = sizeof(XCShead);
+    }
+    if (wDType == myTypeID && castMode == CW_CONVERT)
+        castMode = CW_CAST;
+
+    size_t imgStart = (mode == WRITE_APPEND) ? oldNsize : IMG_INDEX(select_img);
+    size_t newNsize = std::max(oldNsize, imgStart + Ndim);
+
+    /* The index keeps its place while it has room for the images. Otherwise
+     * it is moved after the end of the file (or placed after the header in
+     * a new file) and all its entries are written. index holds the entries
+     * to write, from image indexFirst.
+     */
+    bool moveIndex = newNsize > capacity;
+    size_t indexFirst = imgStart;
+    XCSindexEntry emptyEntry;
+    emptyEntry.offset = emptyEntry.size = 0;
+    std::vector<XCSindexEntry> index;
+    if (moveIndex)
+    {
+        capacity = newFile ? newNsize : std::max(newNsize, 2 * capacity);
+        index.resize(capacity, emptyEntry);
+        if (oldNsize > 0)
+        {
+            size_t indexSize = oldNsize * sizeof(XCSindexEntry);
+            if (readXCSBytes(NULL, fimg, &index[0], indexSize, header.indexOffset) != indexSize)
+                REPORT_ERROR(ERR_IO_NOREAD, formatString("rwXCS: cannot read the index of %s", filename.c_str()));
+        }
+        indexFirst = 0;
+        header.indexOffset = fileEnd;
+        header.indexCapacity = capacity;
+        fileEnd += capacity * sizeof(XCSindexEntry);
+    }
+    else if (dataMode >= DATA)
+        index.resize(Ndim, emptyEntry);
+
+    // New chunks are appended at the end of the file
+    size_t pos = fileEnd;
+    if (dataMode >= DATA) // Images are not written if only the header is being modified
+    {
+        ThreadPool &pool = ThreadPool::getInstance();
+        size_t nThreads = pool.getNumberOfThreads() + 1;
+        size_t blockSize = XCS_IMAGES_PER_THREAD * nThreads;
+        XCSEncodeBody body;
+        body.image = this;
+        body.datatype = wDType;
+        body.half = half;
+        body.castMode = castMode;
+        body.datasize_n = datasize_n;
+        body.chunks.resize(std::min(blockSize, Ndim));
+        body.status.resize(body.chunks.size());
+        body.pages.resize(nThreads);
+        body.shuffled.resize(nThreads);
+        for (size_t first = 0; first < Ndim; first += blockSize)
+        {
+            size_t last = std::min(first + blockSize, Ndim) - 1;
+            body.blockFirst = first;
+            if (last > first)
+                pool.parallelFor(first, last, body, 1);
+            else
+                body(first, last, 0);
+            for (size_t n = first; n <= last; ++n)
+            {
+                if (body.status[n - first] != Z_OK)
+                    REPORT_ERROR(ERR_MEM_NOTENOUGH, formatString("rwXCS: cannot compress image %lu (error %d)",
+                                 imgStart + n + 1, body.status[n - first]));
+                const std::vector<char> &chunk = body.chunks[n - first];
+                if (writeXCSBytes(fimg, &chunk[0], chunk.size(), pos) != chunk.size())
+                    REPORT_ERROR(ERR_IO_NOWRITE, formatString("rwXCS: cannot write %s", filename.c_str()));
+                XCSindexEntry &entry = index[imgStart + n - indexFirst];
+                entry.offset = pos;
+                entry.size = chunk.size();
+                pos += chunk.size();
+            }
+        }
+    }
+
+    header.ndim = newNsize;
+    size_t indexSize = index.size() * sizeof(XCSindexEntry);
+    if ((indexSize > 0 && writeXCSBytes(fimg, &index[0], indexSize,
+                                        header.indexOffset + indexFirst * sizeof(XCSindexEntry)) != indexSize) ||
+        writeXCSBytes(fimg, &header, sizeof(XCShead), 0) != sizeof(XCShead))
+        REPORT_ERROR(ERR_IO_NOWRITE, formatString("rwXCS: cannot write %s", filename.c_str()));
+
+    flock.unlock();
+
+    return 0;
+}
@@ -0,0 +1,64 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#ifndef RWXCS_H_
+#define RWXCS_H_
+
+///@defgroup XCS Xmipp compressed stack file format
+///@ingroup ImageFormats
+//@{
+
+/** Read Images from compressed stacks (.xcs).
+ *
+ *  Each image of the stack is an independently compressed chunk (deflate
+ *  of its byte shuffled samples), and an index keeps the position and size
+ *  of every chunk. Reading N@file.xcs only
+ *  reads the main header, the index entry of the image and its chunk.
+ *  When several images are read their chunks are decompressed in parallel
+ *  by the thread pool.
+ */
+int readXCS(size_t select_img);
+
+/** Write Images to compressed stacks (.xcs).
+ *
+ *  Samples are stored as float, (u)int16 or (u)int8 (see writeMRC for the
+ *  choice of the type from bitDepth). With bitDepth "float16" the floats
+ *  are quantized to half precision (out of range values saturate to
+ *  +-65504). Replaced images are appended at the end of the file and the
+ *  space of their previous chunks is not reused. The index has room for the
+ *  images of the stack when it is created, so that writing an image only
+ *  writes its index entry; it is moved to the end of the file with twice the
+ *  room when the stack grows beyond it.
+ */
+int writeXCS(size_t select_img, bool isStack=false, int mode=WRITE_OVERWRITE, const String &bitDepth="", CastWriteMode castMode = CW_CAST);
+
+/// Parallel compression of the images to write
+class XCSEncodeBody;
+
+/// Parallel decompression of the images read
+class XCSDecodeBody;
+
+//@}
+#endif /* RWXCS_H_ */
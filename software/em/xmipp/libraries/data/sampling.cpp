@@ -1256,7 +1256,7 @@ void Sampling::removeRedundantPointsExhaustive(const int symmetry,
     double cos_max_ang = cos(DEG2RAD(max_ang));
     double my_dotProduct;
     //int j_end=0;
-    Matrix1D<double>  direction(3), direction1(3);
+    Matrix1D<double>  direction1(3);
 
     // First call to conventional removeRedundantPoints
     removeRedundantPoints(symmetry, sym_order);
@@ -1270,21 +1270,28 @@ void Sampling::removeRedundantPointsExhaustive(const int symmetry,
     // Precalculate symmetry matrices
     fillLRRepository();
 
+    // Symmetric versions of the points kept so far, the versions of the
+    // point k start at k*stride
+    size_t stride = LR_table.stride;
+    size_t symsNo = LR_table.symsNo;
+    std::vector<double> rx, ry, rz;
+
     // Then check all points versus each other
     for (size_t i = 0; i < old_angles.size(); i++)
     {
         //direction1=(old_vector[i]).transpose();
         direction1=old_vector[i];
         bool uniq = true;
-        for (size_t j = 0; j < R_repository.size(); j++)
+        for (size_t k = 0; k < no_redundant_sampling_points_vector.size(); k++)
         {
-            for (size_t k = 0; k < no_redundant_sampling_points_vector.size(); k++)
+            const double *ptrx = &rx[k * stride];
+            const double *ptry = &ry[k * stride];
+            const double *ptrz = &rz[k * stride];
+            for (size_t j = 0; j < symsNo; j++)
             {
-                direction =  L_repository[j] *
-                             (no_redundant_sampling_points_vector[k].transpose() *
-                              R_repository[j]).transpose();
                 //Calculate distance
-                my_dotProduct = dotProduct(direction,direction1);
+                my_dotProduct = ptrx[j] * XX(direction1) + ptry[j] * YY(direction1) +
+                                ptrz[j] * ZZ(direction1);
                 if (only_half_sphere)
                     my_dotProduct = ABS(my_dotProduct);
 
@@ -1293,12 +1300,18 @@ void Sampling::removeRedundantPointsExhaustive(const int symmetry,
                     uniq = false;
                     break;
                 }
-            }// for k
+            }// for j
             if (!uniq)
                 break;
-        } // for j
+        } // for k
         if (uniq)
         {
+            size_t k = no_redundant_sampling_points_vector.size();
+            rx.resize((k + 1) * stride);
+            ry.resize((k + 1) * stride);
+            rz.resize((k + 1) * stride);
+            LR_table.apply(&XX(direction1), &YY(direction1), &ZZ(direction1), 1,
+                           &rx[k * stride], &ry[k * stride], &rz[k * stride]);
             no_redundant_sampling_points_vector.push_back(old_vector[i]);
             no_redundant_sampling_points_angles.push_back(old_angles[i]);
         }
@@ -2213,6 +2226,17 @@ void Sampling::fillLRRepository(void)
         R_repository.push_back(R);
         L_repository.push_back(L);
     }
+
+    // Table of the products L*R^t, the rotations applied to the directions
+    Matrix2D<double> LR(4 * SL.symsNo(), 4), LRt;
+    for (int isym = 0; isym < SL.symsNo(); isym++)
+    {
+        LRt = L_repository[isym + 1] * R_repository[isym + 1].transpose();
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                dMij(LR, 4 * isym + i, j) = dMij(LRt, i, j);
+    }
+    LR_table.initialize(LR, true);
 //#define DEBUG3
 #ifdef  DEBUG3
     std::cout << "==============================\n" ;
@@ -2275,12 +2299,27 @@ void Sampling::fillExpDataProjectionDirectionByLR(MetaData &DFi)
     exp_data_projection_direction_by_L_R_psi.clear();
 #endif
 
-    for (size_t i = 0; i < exp_data_projection_direction.size(); i++)
+    // Symmetric versions of all the directions at once
+    size_t Ndirections = exp_data_projection_direction.size();
+    size_t stride = LR_table.stride;
+    std::vector<double> x(Ndirections), y(Ndirections), z(Ndirections);
+    std::vector<double> rx(Ndirections * stride), ry(Ndirections * stride),
+    rz(Ndirections * stride);
+    for (size_t i = 0; i < Ndirections; i++)
+    {
+        x[i] = XX(exp_data_projection_direction[i]);
+        y[i] = YY(exp_data_projection_direction[i]);
+        z[i] = ZZ(exp_data_projection_direction[i]);
+    }
+    if (Ndirections > 0)
+        LR_table.apply(&x[0], &y[0], &z[0], Ndirections, &rx[0], &ry[0], &rz[0]);
+
+    exp_data_projection_direction_by_L_R.reserve(Ndirections * LR_table.symsNo);
+    for (size_t i = 0; i < Ndirections; i++)
         for (size_t j = 0; j < R_repository.size(); j++)
         {
-            direction =  L_repository[j] *
-                         (exp_data_projection_direction[i].transpose() *
-                          R_repository[j]).transpose();
+            size_t n = i * stride + j;
+            VECTOR_R3(direction, rx[n], ry[n], rz[n]);
             exp_data_projection_direction_by_L_R.push_back(direction);
 #ifdef MYPSI
 
@@ -106,6 +106,8 @@ public:
     /** vector with symmetry matrices */
     std::vector <Matrix2D<double> > R_repository;
     std::vector <Matrix2D<double> > L_repository;
+    /** products L*R^t of the symmetry matrices, the identity first */
+    SymRotationTable LR_table;
     /** vector with product of experimental images and L and R */
     std::vector <Matrix1D<double> > exp_data_projection_direction_by_L_R;
     /** vector with product of experimental images and L and R */
@@ -25,6 +25,7 @@
 
 
 #include "sparse_matrix2d.h"
+#include "xmipp_threads.h"
 
 
 // Sparse matrices --------------------------------------------------------
@@ -42,7 +43,7 @@ SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelem
 
 	values.resizeNoCopy(ln);
 	jIdx.resizeNoCopy(ln);
-	iIdx.resizeNoCopy(N);
+	iIdx.initZeros(N); // Rows without elements
 
 	int actualRow = -1;
 	int i         =  0; // Iterator for the vectors "values" and "jIdx"
@@ -69,6 +70,9 @@ SparseMatrix2D::SparseMatrix2D(std::vector<SparseElement> &_elements, int _Nelem
 			++i;
 		}
 	}
+	// Zero values are not stored
+	values.resize(i);
+	jIdx.resize(i);
 }
 
 /*
@@ -122,33 +126,86 @@ SparseMatrix2D &SparseMatrix2D::operator =(const SparseMatrix2D &X)
 	return *this;
 }
 
+void SparseMatrix2D::getRowRange(int i, int &begin, int &end) const
+{
+	begin = end = 0;
+	if (DIRECT_MULTIDIM_ELEM(iIdx,i) == 0)
+		return;
+	begin = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
+	// Rows without elements have a 0 in iIdx, the row ends where the
+	// next row with elements begins
+	end = XSIZE(values);
+	for (int ii = i+1; ii < N; ii++)
+		if (DIRECT_MULTIDIM_ELEM(iIdx,ii) != 0)
+		{
+			end = DIRECT_MULTIDIM_ELEM(iIdx,ii) -1;
+			break;
+		}
+}
+
+// Rows of y=A*x or Y=A*X computed by the thread pool
+class SparseMatrixProductRows: public ParallelForBody
+{
+public:
+	const SparseMatrix2D *A;
+	const double *x;
+	double *y;
+	// Number of columns of X and Y
+	size_t M;
+
+	void operator()(size_t first, size_t last, int thread_id)
+	{
+		for (size_t i = first; i <= last; i++)
+		{
+			int rowBeg, rowEnd;
+			A->getRowRange(i, rowBeg, rowEnd);
+			double *ptrY = y + i*M;
+			for (size_t m = 0; m < M; m++)
+				ptrY[m] = 0.0;
+			for (int j = rowBeg; j < rowEnd; j++)
+			{
+				// Column with a nonzero element in this row of the matrix
+				int col = DIRECT_MULTIDIM_ELEM(A->jIdx,j) -1;
+				double val = DIRECT_MULTIDIM_ELEM(A->values,j);
+				const double *ptrX = x + col*M;
+				for (size_t m = 0; m < M; m++)
+					ptrY[m] += val * ptrX[m];
+			}
+		}
+	}
+};
+
 /**
  * It computes y <- this*x
  */
-void SparseMatrix2D::multMv(double* x, double* y)
+void SparseMatrix2D::multMv(const double* x, double* y) const
 {
-	int col, rowEnd, rowBeg;
-	double val;
-	memset(y,0,N*sizeof(double));
+	if (N == 0)
+		return;
+	SparseMatrixProductRows rows;
+	rows.A = this;
+	rows.x = x;
+	rows.y = y;
+	rows.M = 1;
+	ThreadPool::getInstance().parallelFor(0, N-1, rows);
+}
 
-	size_t nnz=XSIZE(values);
-    for(int i = 0; i< N; i++)
-    {
-    	// We get the gap where are the elements of the row i in value's vector
-		rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,i) -1;
-		if( i != N-1 )
-			rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,i+1) -1;
-		else
-			rowEnd = nnz;
-
-		val = 0.0;
-		for(int j = rowBeg; j < rowEnd ; j++)
-		{
-			col = DIRECT_MULTIDIM_ELEM(jIdx,j) -1;// Column with a nonzero element in this row of the matrix
-			val += DIRECT_MULTIDIM_ELEM(values,j) * x[col];
-		}
-		y[i] = val;
-    }
+/**
+ * It computes Y <- this*X
+ */
+void SparseMatrix2D::multMM(const Matrix2D<double> &X, Matrix2D<double> &Y) const
+{
+	if ((int)MAT_YSIZE(X) != N)
+		REPORT_ERROR(ERR_MATRIX_SIZE, "SparseMatrix2D::multMM: Not compatible sizes");
+	Y.resizeNoCopy(N, MAT_XSIZE(X));
+	if (N == 0)
+		return;
+	SparseMatrixProductRows rows;
+	rows.A = this;
+	rows.x = MATRIX2D_ARRAY(X);
+	rows.y = MATRIX2D_ARRAY(Y);
+	rows.M = MAT_XSIZE(X);
+	ThreadPool::getInstance().parallelFor(0, N-1, rows);
 }
 
 /*
@@ -171,13 +228,8 @@ std::ostream & operator << (std::ostream &out, const SparseMatrix2D &X)
  */
 double SparseMatrix2D::getElemIJ(int row, int col) const
 {
-	int rowBeg = DIRECT_MULTIDIM_ELEM(iIdx,row) -1;
-	int rowEnd;
-
-	if( row != N-1 )
-		rowEnd = DIRECT_MULTIDIM_ELEM(iIdx,row+1) -1;
-	else
-		rowEnd = XSIZE(values);
+	int rowBeg, rowEnd;
+	getRowRange(row, rowBeg, rowEnd);
 
 	// If there is a non-zero element, the column is in jIdx
 	for(int i = rowBeg; i < rowEnd ; i++)
@@ -295,3 +347,49 @@ void SparseMatrix2D::loadMatrix(const FileName &fn)
 	sparseMatrix2DFromVector(elems);
 }
 
+
+// Sparse symmetric matrix as operator for lanczosEigs
+class SparseSymmetricOperator: public SymmetricOperator
+{
+public:
+	const SparseMatrix2D *A;
+
+	size_t size() const
+	{
+		return A->N;
+	}
+
+	void multiply(const double *x, double *y) const
+	{
+		A->multMv(x, y);
+	}
+
+	double eigenvalueBound() const
+	{
+		double bound = 0;
+		for (int i = 0; i < A->N; i++)
+		{
+			int rowBeg, rowEnd;
+			A->getRowRange(i, rowBeg, rowEnd);
+			double rowSum = 0;
+			for (int j = rowBeg; j < rowEnd; j++)
+				rowSum += fabs(DIRECT_MULTIDIM_ELEM(A->values,j));
+			bound = std::max(bound, rowSum);
+		}
+		return bound;
+	}
+};
+
+void firstEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P)
+{
+	SparseSymmetricOperator op;
+	op.A = &A;
+	lanczosEigs(op, M, false, D, P);
+}
+
+void lastEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P)
+{
+	SparseSymmetricOperator op;
+	op.A = &A;
+	lanczosEigs(op, M, true, D, P);
+}
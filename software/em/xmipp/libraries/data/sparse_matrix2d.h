@@ -27,6 +27,7 @@
 #define SPARSE_MATRIX2D_H_
 
 #include "multidim_array.h"
+#include "matrix2d.h"
 
 /** @ingroup Matrices
  */
@@ -100,10 +101,20 @@ public:
     /// Fill the sparse matrix A with the elements of the vector.
     void sparseMatrix2DFromVector(std::vector<SparseElement> &_elements);
 
+    /** Range of the nonzero elements of a row.
+     * The elements of row i (starting at 0) are at the positions
+     * [begin,end) of values and jIdx. begin==end for empty rows.
+     */
+    void getRowRange(int i, int &begin, int &end) const;
+
     /** Computes y=this*x
-     * y and x are vectors of size Nx1
+     * y and x are vectors of size Nx1. Rows are computed in parallel
+     * by the threads of ThreadPool::getInstance().
      */
-    void multMv(double* x, double* y);
+    void multMv(const double* x, double* y) const;
+
+    /** Computes Y=this*X where X is a dense NxM matrix */
+    void multMM(const Matrix2D<double> &X, Matrix2D<double> &Y) const;
 
     /// Computes Y=this*X
     void multMM(const SparseMatrix2D &X, SparseMatrix2D &Y);
@@ -134,6 +145,18 @@ public:
      */
     void loadMatrix(const FileName &fn);
 };
+
+/** First eigenvectors of a symmetric, sparse matrix.
+ * The eigenvectors of the largest M eigenvalues are returned as columns
+ * of P, and the eigenvalues in D in descending order. See lanczosEigs.
+ */
+void firstEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P);
+
+/** Last eigenvectors of a symmetric, sparse matrix.
+ * The eigenvectors of the smallest M eigenvalues are returned as columns
+ * of P, and the eigenvalues in D in ascending order. See lanczosEigs.
+ */
+void lastEigs(const SparseMatrix2D &A, size_t M, Matrix1D<double> &D, Matrix2D<double> &P);
 //@}
 
 #endif /* SPARSE_MATRIX2D_H_ */
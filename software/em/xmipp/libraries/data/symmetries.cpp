@@ -340,6 +340,7 @@ int SymList::readSymmetryFile(FileName fn_sym, double accuracy)
         space_group = sym_P1;
     else
         space_group = sym_undefined;
+    computeRotationTables();
     return pgGroup;
 }
 
@@ -529,6 +530,142 @@ void SymList::computeSubgroup(double accuracy)
     std::cerr << "__R" << __R <<std::endl;
 #endif
 #undef DEBUG
+    computeRotationTables();
+}
+
+// Rotation tables =========================================================
+void SymRotationTable::initialize(const Matrix2D<double> &matrices, bool identity)
+{
+    int first = identity ? 1 : 0;
+    symsNo = MAT_YSIZE(matrices) / 4 + first;
+    stride = (symsNo + 3) / 4 * 4;
+    m.assign(9 * stride, 0.);
+    q.assign(4 * stride, 0.);
+    det.assign(stride, 0.);
+    for (int isym = 0; isym < symsNo; isym++)
+    {
+        double M[3][3];
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+                M[i][j] = (isym < first) ? (double)(i == j) : dMij(matrices, 4 * (isym - first) + i, j);
+
+        // Mirrors and inversions are the opposite of a rotation
+        double d = M[0][0] * (M[1][1] * M[2][2] - M[1][2] * M[2][1]) -
+                   M[0][1] * (M[1][0] * M[2][2] - M[1][2] * M[2][0]) +
+                   M[0][2] * (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
+        det[isym] = (d < 0) ? -1. : 1.;
+        for (int i = 0; i < 3; i++)
+            for (int j = 0; j < 3; j++)
+            {
+                m[(3 * i + j) * stride + isym] = M[i][j];
+                M[i][j] *= det[isym];
+            }
+
+        // Quaternion of the rotation from the largest of its components
+        double w, x, y, z, t = M[0][0] + M[1][1] + M[2][2];
+        if (t > 0)
+        {
+            double s = 0.5 / sqrt(t + 1.);
+            w = 0.25 / s;
+            x = (M[2][1] - M[1][2]) * s;
+            y = (M[0][2] - M[2][0]) * s;
+            z = (M[1][0] - M[0][1]) * s;
+        }
+        else if (M[0][0] > M[1][1] && M[0][0] > M[2][2])
+        {
+            double s = 2. * sqrt(1. + M[0][0] - M[1][1] - M[2][2]);
+            w = (M[2][1] - M[1][2]) / s;
+            x = 0.25 * s;
+            y = (M[0][1] + M[1][0]) / s;
+            z = (M[0][2] + M[2][0]) / s;
+        }
+        else if (M[1][1] > M[2][2])
+        {
+            double s = 2. * sqrt(1. + M[1][1] - M[0][0] - M[2][2]);
+            w = (M[0][2] - M[2][0]) / s;
+            x = (M[0][1] + M[1][0]) / s;
+            y = 0.25 * s;
+            z = (M[1][2] + M[2][1]) / s;
+        }
+        else
+        {
+            double s = 2. * sqrt(1. + M[2][2] - M[0][0] - M[1][1]);
+            w = (M[1][0] - M[0][1]) / s;
+            x = (M[0][2] + M[2][0]) / s;
+            y = (M[1][2] + M[2][1]) / s;
+            z = 0.25 * s;
+        }
+        if (w < 0)
+        {
+            w = -w;
+            x = -x;
+            y = -y;
+            z = -z;
+        }
+        q[isym] = w;
+        q[stride + isym] = x;
+        q[2 * stride + isym] = y;
+        q[3 * stride + isym] = z;
+    }
+}
+
+void SymRotationTable::getMatrix(int isym, Matrix2D<double> &M) const
+{
+    if (MAT_XSIZE(M) != 3 || MAT_YSIZE(M) != 3)
+        M.resizeNoCopy(3, 3);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            dMij(M, i, j) = m[(3 * i + j) * stride + isym];
+}
+
+void SymRotationTable::apply(const double *x, const double *y, const double *z, size_t N,
+                             double *rx, double *ry, double *rz) const
+{
+    if (symsNo == 0)
+        return;
+    const double *m00 = &m[0], *m01 = m00 + stride, *m02 = m01 + stride;
+    const double *m10 = m02 + stride, *m11 = m10 + stride, *m12 = m11 + stride;
+    const double *m20 = m12 + stride, *m21 = m20 + stride, *m22 = m21 + stride;
+    for (size_t n = 0; n < N; n++)
+    {
+        double xn = x[n], yn = y[n], zn = z[n];
+        double *ptrX = rx + n * stride, *ptrY = ry + n * stride, *ptrZ = rz + n * stride;
+        // The padding of the table is also computed, so the loop has no remainder
+        for (int isym = 0; isym < stride; isym++)
+        {
+            ptrX[isym] = m00[isym] * xn + m01[isym] * yn + m02[isym] * zn;
+            ptrY[isym] = m10[isym] * xn + m11[isym] * yn + m12[isym] * zn;
+            ptrZ[isym] = m20[isym] * xn + m21[isym] * yn + m22[isym] * zn;
+        }
+    }
+}
+
+void SymRotationTable::compose(const Matrix2D<double> &A, SymRotationTable &result) const
+{
+    result.symsNo = symsNo;
+    result.stride = stride;
+    result.m.resize(9 * stride);
+    result.q.clear();
+    result.det.clear();
+    if (symsNo == 0)
+        return;
+    for (int i = 0; i < 3; i++)
+    {
+        const double *mi0 = &m[3 * i * stride], *mi1 = mi0 + stride, *mi2 = mi1 + stride;
+        for (int j = 0; j < 3; j++)
+        {
+            double a0j = dMij(A, 0, j), a1j = dMij(A, 1, j), a2j = dMij(A, 2, j);
+            double *ptr = &result.m[(3 * i + j) * stride];
+            for (int isym = 0; isym < stride; isym++)
+                ptr[isym] = mi0[isym] * a0j + mi1[isym] * a1j + mi2[isym] * a2j;
+        }
+    }
+}
+
+void SymList::computeRotationTables()
+{
+    __Ltable.initialize(__L);
+    __Rtable.initialize(__R);
 }
 /** Guess Crystallographic space group.
     Return the group number
@@ -108,6 +108,73 @@
 #define SYMINDEX(SL, sym_no, i, numIMG) \
     numIMG+SL.__L.mdimy/4*i+sym_no
 
+/** Table of the rotations of a symmetry list.
+    The 3x3 rotations are stored by elements (structure of arrays), so that
+    the same element of all the symmetries is contiguous and the loops over
+    the symmetries are vectorized by the compiler. Element (i,j) of the
+    rotation isym is m[(3*i+j)*stride+isym], and the table is padded with
+    zeros up to stride (a multiple of 4) symmetries.
+
+    Mirrors and inversions are not rotations. Each matrix is det times the
+    rotation of its quaternion (w,x,y,z), that is q[k*stride+isym] for
+    k=0..3 with w>=0.
+    \\ Ex:
+    @code
+       SymList SL("i3");
+       SymRotationTable AR;
+       SL.__Rtable.compose(A, AR); // R*A for all the symmetries at once
+       Matrix2D<double> RA;
+       for (int isym=0; isym<AR.symsNo; isym++) {
+           AR.getMatrix(isym, RA);
+           ...
+       }
+    @endcode */
+class SymRotationTable
+{
+public:
+    /// Number of rotations
+    int symsNo;
+    /// Distance between the elements of a rotation
+    int stride;
+    /// Elements of the rotations
+    std::vector<double> m;
+    /// Quaternions of the rotations (not set by compose)
+    std::vector<double> q;
+    /// Determinants of the matrices (+1 or -1, not set by compose)
+    std::vector<double> det;
+
+    /// Empty table
+    SymRotationTable()
+    {
+        symsNo = stride = 0;
+    }
+
+    /** Table of the 3x3 rotations of a list of 4x4 matrices, one below the
+        other as in SymList::__L. With identity the first rotation of the table
+        is the identity and the rest are those of the list. */
+    void initialize(const Matrix2D<double> &matrices, bool identity = false);
+
+    /// Element (i,j) of the rotation isym
+    inline double operator()(int isym, int i, int j) const
+    {
+        return m[(3 * i + j) * stride + isym];
+    }
+
+    /// 3x3 rotation isym
+    void getMatrix(int isym, Matrix2D<double> &M) const;
+
+    /** Apply all the rotations to N vectors.
+        The vectors are given by their coordinates, and the rotation isym of
+        the vector n is written at position n*stride+isym of rx, ry and rz,
+        which must have N*stride elements. */
+    void apply(const double *x, const double *y, const double *z, size_t N,
+               double *rx, double *ry, double *rz) const;
+
+    /** Products M*A of all the rotations M and a 3x3 matrix A (the 3x3 top left
+        corner of A if it is 4x4). */
+    void compose(const Matrix2D<double> &A, SymRotationTable &result) const;
+};
+
 /** Symmetry List class.
     Internally the symmetry list class is implemented as a single 2D matrix,
     where every 4 rows (remember that in 3D the geometrical transformation
@@ -153,6 +220,9 @@ public:
     // Number of Axis, mirrors, ...
     int              __sym_elements;
 
+    // Rotations of L and R as tables (see computeRotationTables)
+    SymRotationTable __Ltable, __Rtable;
+
 public:
     /** Create an empty list.
         The 2D matrices are 0x0.
@@ -254,6 +324,17 @@ public:
         So far, all the shifts associated to generated matrices are set to 0*/
     void computeSubgroup(double accuracy = SYM_ACCURACY);
 
+    /** Compute the tables of the rotations of L and R.
+        The tables are computed by readSymmetryFile and computeSubgroup. After
+        setting or adding matrices they must be computed again.
+        \\ Ex:
+        @code
+           // Directions of the symmetric views of N directions
+           std::vector<double> rx(N*SL.__Rtable.stride), ry(rx.size()), rz(rx.size());
+           SL.__Rtable.apply(&x[0], &y[0], &z[0], N, &rx[0], &ry[0], &rz[0]);
+        @endcode */
+    void computeRotationTables();
+
     /** Number of symmetry matrices inside the structure.
         This is the number of all the matrices inside the subgroup.
         \\ Ex:
@@ -634,34 +634,24 @@ void frc_dpr(MultidimArray< double > & m1,
     }
 }
 
-void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mdaIn, MultidimArray<double> &mdaOut, int nThreads)
+void windowFourierTransform(const MultidimArray< std::complex<double> > &MmemFourier,
+                            MultidimArray< std::complex<double> > &MpmemFourier)
 {
-	//Mmem = *this
-    //memory for fourier transform output
-    MultidimArray<std::complex<double> > MmemFourier;
-    // Perform the Fourier transform
-    FourierTransformer transformerM;
-    transformerM.setThreadsNumber(nThreads);
-    transformerM.FourierTransform(mdaIn, MmemFourier, false);
-
-    // Create space for the downsampled image and its Fourier transform
-    mdaOut.resizeNoCopy(Zdim, Ydim, Xdim);
-    MultidimArray<std::complex<double> > MpmemFourier;
-    FourierTransformer transformerMp;
-    transformerMp.setReal(mdaOut);
-    transformerMp.getFourierAlias(MpmemFourier);
-
+    // Y and Z sizes of the transforms are those of the images. Frequencies
+    // 0...N/2 are at the beginning and the (N-1)/2 negative ones at the end
     size_t xsize = std::min(XSIZE(MmemFourier),XSIZE(MpmemFourier))*sizeof(std::complex<double>);
-    size_t yhalf = std::min(std::min((YSIZE(mdaIn)+1)/2,(YSIZE(mdaOut)+1)/2),YSIZE(mdaIn)-1);
-    size_t zhalf = std::min(std::min((ZSIZE(mdaIn)+1)/2,(ZSIZE(mdaOut)+1)/2),ZSIZE(mdaIn)-1);
+    size_t yhalf = std::min(YSIZE(MmemFourier)/2,YSIZE(MpmemFourier)/2);
+    size_t zhalf = std::min(ZSIZE(MmemFourier)/2,ZSIZE(MpmemFourier)/2);
+    size_t ynegative = std::min((YSIZE(MmemFourier)-1)/2,(YSIZE(MpmemFourier)-1)/2);
+    size_t znegative = std::min((ZSIZE(MmemFourier)-1)/2,(ZSIZE(MpmemFourier)-1)/2);
 
     size_t kp0=0;
     size_t kpF=zhalf;
     size_t ip0=0;
     size_t ipF=yhalf;
-    size_t km0=ZSIZE(MmemFourier)>=ZSIZE(MpmemFourier)?(kpF+1):(ZSIZE(MpmemFourier)-(ZSIZE(MmemFourier)-(zhalf+1)));
+    size_t km0=ZSIZE(MpmemFourier)-znegative;
     size_t kmF=ZSIZE(MpmemFourier)-1;
-    size_t im0=YSIZE(MmemFourier)>=YSIZE(MpmemFourier)?(ipF+1):(YSIZE(MpmemFourier)-(YSIZE(MmemFourier)-(yhalf+1)));
+    size_t im0=YSIZE(MpmemFourier)-ynegative;
     size_t imF=YSIZE(MpmemFourier)-1;
 
     //Init with zero
@@ -688,6 +678,26 @@ void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mda
         	memcpy(&dAkij(MpmemFourier,k,i,0),&dAkij(MmemFourier,kp,ip,0),xsize);
         }
     }
+}
+
+void scaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArray<double> &mdaIn, MultidimArray<double> &mdaOut, int nThreads)
+{
+	//Mmem = *this
+    //memory for fourier transform output
+    MultidimArray<std::complex<double> > MmemFourier;
+    // Perform the Fourier transform
+    FourierTransformer transformerM;
+    transformerM.setThreadsNumber(nThreads);
+    transformerM.FourierTransform(mdaIn, MmemFourier, false);
+
+    // Create space for the downsampled image and its Fourier transform
+    mdaOut.resizeNoCopy(Zdim, Ydim, Xdim);
+    MultidimArray<std::complex<double> > MpmemFourier;
+    FourierTransformer transformerMp;
+    transformerMp.setReal(mdaOut);
+    transformerMp.getFourierAlias(MpmemFourier);
+
+    windowFourierTransform(MmemFourier, MpmemFourier);
 
     // Transform data
     transformerMp.inverseFourierTransform();
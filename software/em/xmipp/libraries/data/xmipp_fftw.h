@@ -531,6 +531,16 @@ public:
     FourierTransformer transformer1, transformer2;
 };
 
+/** Correlation in Fourier space
+ * @ingroup FourierOperations
+ *
+ * FF2 is substituted by FF1*conj(FF2)*dSize, that is the Fourier transform
+ * of the correlation computed by correlation_matrix for images of dSize
+ * pixels. Filters can be applied to it before the inverse transform.
+ */
+void correlationInFourier(const MultidimArray< std::complex< double > > & FF1,
+                          MultidimArray< std::complex< double > > & FF2, double dSize);
+
 /** Correlation of two nD images
  * @ingroup FourierOperations
  *
@@ -633,6 +643,16 @@ void selfScaleToSizeFourier(int Ydim, int Xdim, MultidimArray<double> &mda, int
 void selfScaleToSizeFourier(int Zdim, int Ydim, int Xdim, MultidimArrayGeneric &mda, int nthreads=1);
 void selfScaleToSizeFourier(int Ydim, int Xdim, MultidimArrayGeneric &mda, int nthreads=1);
 
+/** Copy the Fourier coefficients of a transform into a transform of a different size
+ * @ingroup FourierOperations
+ * Fout must already have the size of the transform of the target image.
+ * The frequencies present in both are copied and the rest are set to 0, so
+ * that the inverse transform of Fout is the image scaled by scaleToSizeFourier.
+ * This allows to scale an image whose transform is already available.
+ */
+void windowFourierTransform(const MultidimArray< std::complex<double> > &Fin,
+                            MultidimArray< std::complex<double> > &Fout);
+
 #define POWER_SPECTRUM 0
 #define AMPLITUDE_SPECTRUM 1
 
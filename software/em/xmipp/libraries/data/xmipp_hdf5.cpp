@@ -23,10 +23,14 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <sys/stat.h>
 #include "xmipp_hdf5.h"
 #include "xmipp_strings.h"
 #include "xmipp_error.h"
 
+// Open files by default
+#define H5_POOL_CAPACITY 16
+
 struct H5TreeInfo
 {
     std::string rootname;
@@ -105,6 +109,7 @@ std::map<String, H5infoProvider > createProviderMap()
     m["NXtomo"] = std::make_pair(MISTRAL, "/NXtomo/instrument/sample/data");
     m["TomoNormalized"] = std::make_pair(MISTRAL, "/TomoNormalized/TomoNormalized");
     m["MDF"]  = std::make_pair(EMAN,    "/MDF/images/%i/image");
+    m["xmipp"] = std::make_pair(XMIPP,  XMIPP_H5_DATASET);
     return m;
 }
 
@@ -205,7 +210,7 @@ H5infoProvider getProvider(hid_t fhdf5)
 
     size_t maxSize = 1024;
     char groupName[1024];
-    char memName[1024];
+    char memName[1024] = "";
 
     hid_t gid;
     ssize_t len;
@@ -234,3 +239,166 @@ H5infoProvider getProvider(hid_t fhdf5)
 //    REPORT_ERROR(ERR_IO, "rwHDF5: Unknown file provider. Default dataset unknown.");
 
 }
+
+Mutex &getH5Mutex()
+{
+    static Mutex h5Mutex;
+    return h5Mutex;
+}
+
+H5FilePool & H5FilePool::getInstance()
+{
+    static pthread_mutex_t instanceMutex = PTHREAD_MUTEX_INITIALIZER;
+    static H5FilePool * instance = NULL;
+    pthread_mutex_lock(&instanceMutex);
+    if (instance == NULL)
+        instance = new H5FilePool();
+    pthread_mutex_unlock(&instanceMutex);
+    return *instance;
+}
+
+H5FilePool::H5FilePool()
+{
+    capacity = H5_POOL_CAPACITY;
+}
+
+H5FilePool::~H5FilePool()
+{
+    clear();
+}
+
+hid_t H5FilePool::acquire(const FileName &fileName)
+{
+    H5Lock lock;
+    if (capacity == 0)
+        return -1;
+    struct stat info;
+    time_t now = time(NULL);
+    OpenFile *file = NULL;
+    std::map<String, OpenFile *>::iterator it = files.find(fileName);
+    if (it != files.end())
+    {
+        file = it->second;
+        // Check whether the file has changed
+        if (now != file->lastCheck)
+        {
+            if (stat(fileName.c_str(), &info) != 0 || (size_t) info.st_size != file->fileSize ||
+                info.st_mtime != file->mtime || info.st_ino != file->inode)
+            {
+                detach(file);
+                file = NULL;
+            }
+            else
+                file->lastCheck = now;
+        }
+    }
+    if (file == NULL)
+    {
+        if (stat(fileName.c_str(), &info) != 0 || info.st_size <= 0 || H5Fis_hdf5(fileName.c_str()) <= 0)
+            return -1;
+        hid_t fhdf5 = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+        if (fhdf5 < 0)
+            return -1;
+        file = new OpenFile;
+        file->fileName = fileName;
+        file->fhdf5 = fhdf5;
+        file->fileSize = info.st_size;
+        file->mtime = info.st_mtime;
+        file->inode = info.st_ino;
+        file->lastCheck = now;
+        file->refCount = 0;
+        file->detached = false;
+        files[fileName] = file;
+        openIds[fhdf5] = file;
+        lru.push_front(file);
+        file->lruPosition = lru.begin();
+    }
+    else if (file->lruPosition != lru.begin())
+        lru.splice(lru.begin(), lru, file->lruPosition);
+    file->refCount++;
+    evict();
+    return file->fhdf5;
+}
+
+void H5FilePool::release(hid_t fhdf5)
+{
+    H5Lock lock;
+    std::map<hid_t, OpenFile *>::iterator it = openIds.find(fhdf5);
+    if (it == openIds.end())
+        return;
+    OpenFile *file = it->second;
+    file->refCount--;
+    if (file->detached && file->refCount == 0)
+    {
+        openIds.erase(it);
+        H5Fclose(file->fhdf5);
+        delete file;
+    }
+    else
+        evict();
+}
+
+void H5FilePool::detach(OpenFile *file)
+{
+    files.erase(file->fileName);
+    lru.erase(file->lruPosition);
+    file->detached = true;
+    if (file->refCount == 0)
+    {
+        openIds.erase(file->fhdf5);
+        H5Fclose(file->fhdf5);
+        delete file;
+    }
+}
+
+void H5FilePool::evict()
+{
+    std::list<OpenFile *>::iterator it = lru.end();
+    while (files.size() > capacity && it != lru.begin())
+    {
+        --it;
+        OpenFile *file = *it;
+        if (file->refCount == 0)
+        {
+            // Erasing it invalidates the iterator
+            std::list<OpenFile *>::iterator next = it;
+            ++next;
+            detach(file);
+            it = next;
+        }
+    }
+}
+
+void H5FilePool::invalidate(const FileName &fileName)
+{
+    H5Lock lock;
+    std::map<String, OpenFile *>::iterator it = files.find(fileName);
+    if (it == files.end())
+        return;
+    // HDF5 cannot open again for writing a file that is still open
+    if (it->second->refCount > 0)
+        REPORT_ERROR(ERR_IO_LOCKED, formatString("H5FilePool::invalidate: %s is still in use by "
+                     "another thread and cannot be written", fileName.c_str()));
+    detach(it->second);
+}
+
+void H5FilePool::clear()
+{
+    H5Lock lock;
+    size_t oldCapacity = capacity;
+    capacity = 0;
+    evict();
+    capacity = oldCapacity;
+}
+
+size_t H5FilePool::getCapacity() const
+{
+    return capacity;
+}
+
+void H5FilePool::setCapacity(size_t _capacity)
+{
+    H5Lock lock;
+    capacity = _capacity;
+    evict();
+}
@@ -28,9 +28,14 @@
 
 #include <iostream>
 #include<map>
+#include <list>
+#include <time.h>
+#include <sys/types.h>
 #include "hdf5.h"
 #include "H5Cpp.h"
 #include "matrix1d.h"
+#include "xmipp_filename.h"
+#include "xmipp_threads.h"
 
 
 
@@ -44,9 +49,16 @@ enum H5FileProvider
 {
     NONE,
     MISTRAL,
-    EMAN
+    EMAN,
+    XMIPP
 } ;
 
+/// Dataset of the stacks written by Xmipp when the file name has no block name
+#define XMIPP_H5_DATASET "/xmipp/images"
+
+/// Attribute of the datasets written by Xmipp, they are read as stacks whatever the file provider
+#define XMIPP_H5_STACK_ATTRIBUTE "xmippStack"
+
 
 typedef std::pair<H5FileProvider, String> H5infoProvider;
 std::map<String, H5infoProvider > createProviderMap();
@@ -105,6 +117,107 @@ public:
 
 herr_t showObjectInfo(hid_t group, const char *name, void *op_data);
 
+/** Mutex of the calls to the HDF5 library.
+ * The library is not built thread-safe, so the image readers and writers
+ * make all their HDF5 calls while holding this mutex (see H5Lock).
+ */
+Mutex &getH5Mutex();
+
+/** Lock of the HDF5 mutex for the life of the object.
+ * @code
+ * {
+ *     H5Lock lock;
+ *     dataset = H5Dopen2(fhdf5, dsname.c_str(), H5P_DEFAULT);
+ *     ...
+ * } // Unlocked here, also if an exception is thrown
+ * @endcode
+ */
+class H5Lock
+{
+public:
+    H5Lock()
+    {
+        getH5Mutex().lock();
+    }
+    ~H5Lock()
+    {
+        getH5Mutex().unlock();
+    }
+private:
+    H5Lock(const H5Lock &);
+    H5Lock & operator=(const H5Lock &);
+};
+
+/** Pool of HDF5 files open for reading.
+ * Opening an HDF5 file reads its superblock and root group, so reading the
+ * images of a metadata one by one from an HDF5 stack spent most of the time
+ * opening and closing the file. ImageBase::read takes the files from the
+ * pool, which keeps them open while they are not modified (their size,
+ * modification time and inode are checked at most once per second) and
+ * closes the least recently used files not in use when there are more than
+ * getCapacity() open files. All the methods are thread-safe.
+ */
+class H5FilePool
+{
+public:
+    /// The pool of the process
+    static H5FilePool &getInstance();
+
+    /** HDF5 identifier of a file open for reading (without image number,
+     * block name nor format). Returns a negative value if the file does not
+     * exist or is not an HDF5 file. The file must be released.
+     */
+    hid_t acquire(const FileName &fileName);
+
+    /// Release a file returned by acquire
+    void release(hid_t fhdf5);
+
+    /** Remove a file from the pool (e.g., because it is going to be written).
+     * An error is reported if the file is still being read by another thread,
+     * since HDF5 cannot open it for writing while it is open.
+     */
+    void invalidate(const FileName &fileName);
+
+    /// Close all files not in use
+    void clear();
+
+    /// Maximum number of open files (16 by default)
+    size_t getCapacity() const;
+
+    /// Set the maximum number of open files (0 disables the pool)
+    void setCapacity(size_t capacity);
+
+private:
+    struct OpenFile
+    {
+        FileName fileName;
+        hid_t fhdf5;
+        size_t fileSize;
+        time_t mtime;
+        ino_t inode;
+        time_t lastCheck;
+        int refCount;
+        bool detached;
+        std::list<OpenFile *>::iterator lruPosition;
+    };
+
+    H5FilePool();
+    ~H5FilePool();
+    H5FilePool(const H5FilePool &);
+    H5FilePool & operator=(const H5FilePool &);
+
+    /// Remove from the pool and close it if not in use. Must hold the HDF5 mutex
+    void detach(OpenFile *file);
+
+    /// Close the least recently used files not in use. Must hold the HDF5 mutex
+    void evict();
+
+    size_t capacity;
+    std::map<String, OpenFile *> files;
+    std::map<hid_t, OpenFile *> openIds;
+    std::list<OpenFile *> lru;
+};
+
 
 /** @}
  */
@@ -1305,7 +1305,9 @@ template<typename T>
         else
           page = (char *) askMemory(pagesize * sizeof(char));
 
-        if (fseek(fimg, selectImgOffset, SEEK_SET) == -1)
+        // Stacks in the registry are read with positioned reads
+        size_t pos = selectImgOffset;
+        if (stackHandle == NULL && fseek(fimg, selectImgOffset, SEEK_SET) == -1)
           REPORT_ERROR(ERR_IO_SIZE, "readData: can not seek the file pointer");
         for (size_t myn = 0; myn < NSIZE(data); myn++)
         {
@@ -1318,7 +1320,13 @@ template<typename T>
             readsize_n = readsize / datatypesize;
 
             //Read page from disc
-            if (fread(page, readsize, 1, fimg) != 1)
+            if (stackHandle != NULL)
+            {
+              if (readFileBytes(page, readsize, pos) != readsize)
+                REPORT_ERROR(ERR_IO_NOREAD, "Cannot read the whole page");
+              pos += readsize;
+            }
+            else if (fread(page, readsize, 1, fimg) != 1)
               REPORT_ERROR(ERR_IO_NOREAD, "Cannot read the whole page");
             //swap per page
             if (swap)
@@ -1328,7 +1336,9 @@ template<typename T>
                 readsize_n);
             haveread_n += readsize_n;
           }
-          if (pad > 0)
+          if (pad > 0 && stackHandle != NULL)
+            pos += pad;
+          else if (pad > 0)
             //fread( padpage, pad, 1, fimg);
             if (fseek(fimg, pad, SEEK_CUR) == -1)
               REPORT_ERROR(ERR_IO_SIZE,
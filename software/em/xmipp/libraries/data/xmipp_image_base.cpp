@@ -26,6 +26,8 @@
 #include "xmipp_image_base.h"
 #include "xmipp_image.h"
 #include "xmipp_error.h"
+#include "xmipp_image_registry.h"
+#include "xmipp_hdf5.h"
 
 //This is needed for static memory allocation
 
@@ -36,6 +38,7 @@ void ImageBase::init()
     filename = tempFilename = dataFName = "";
     fimg = fhed = NULL;
     hFile = NULL;
+    stackHandle = NULL;
     tif = NULL;
     dataMode = DATA;
     transform = isComplexT() ? Standard : NoTransform;
@@ -64,12 +67,110 @@ int ImageBase::read(const FileName &name, DataMode datamode, size_t select_img,
     if (!mapData)
         mode = WRITE_READONLY; //TODO: Check if openfile other than readonly is necessary
 
+    // Images of MRC and Spider stacks, and the headers of any MRC and Spider
+    // file, are read from the registry of open stacks, without opening the
+    // file again
+    if (!mapData && (select_img != ALL_IMAGES || name.isInStack() || datamode == HEADER))
+    {
+        FileName fileName, ext_name;
+        if (ImageFileRegistry::registryFileName(name, fileName, ext_name))
+            stackHandle = ImageFileRegistry::getInstance().acquire(name);
+        if (stackHandle != NULL)
+        {
+            ImageFHandler stackFile;
+            stackFile.fimg = stackFile.fhed = NULL;
+            stackFile.tif = NULL;
+            stackFile.fhdf5 = 0;
+            stackFile.fileName = fileName;
+            stackFile.ext_name = ext_name;
+            stackFile.exist = true;
+            stackFile.mode = WRITE_READONLY;
+            int err;
+            try
+            {
+                err = _read(name, &stackFile, datamode, select_img, false);
+            }
+            catch (...)
+            {
+                ImageFileRegistry::getInstance().release(stackHandle);
+                stackHandle = NULL;
+                throw;
+            }
+            ImageFileRegistry::getInstance().release(stackHandle);
+            stackHandle = NULL;
+            return err;
+        }
+    }
+
+    // HDF5 files are taken from the pool of open files
+    if (!mapData)
+    {
+        FileName ext_name = name.getFileFormat();
+        if (ext_name.contains("hdf") || ext_name.contains("h5"))
+        {
+            FileName fileName = name.removeAllPrefixes().removeFileFormat();
+            size_t found = fileName.find_first_of("%");
+            if (found != String::npos)
+                fileName = fileName.substr(0, found);
+            hid_t pooled = H5FilePool::getInstance().acquire(fileName);
+            if (pooled >= 0)
+            {
+                ImageFHandler h5File;
+                h5File.fimg = h5File.fhed = NULL;
+                h5File.tif = NULL;
+                h5File.fhdf5 = pooled;
+                h5File.fileName = fileName;
+                h5File.ext_name = ext_name;
+                h5File.exist = true;
+                h5File.mode = WRITE_READONLY;
+                // Contiguous datasets are read directly from the file (as
+                // in openFile). If it cannot be opened, they are read with
+                // HDF5
+                if (datamode >= DATA)
+                    h5File.fimg = fopen(fileName.c_str(), "r");
+                int err;
+                try
+                {
+                    err = _read(name, &h5File, datamode, select_img, false);
+                }
+                catch (...)
+                {
+                    if (h5File.fimg != NULL)
+                        fclose(h5File.fimg);
+                    H5FilePool::getInstance().release(pooled);
+                    throw;
+                }
+                if (h5File.fimg != NULL)
+                    fclose(h5File.fimg);
+                H5FilePool::getInstance().release(pooled);
+                return err;
+            }
+        }
+    }
+
     hFile = openFile(name, mode);
     int err = _read(name, hFile, datamode, select_img, mapData);
     closeFile(hFile);
     return err;
 }
 
+size_t ImageBase::readFileBytes(void *buffer, size_t size, size_t pos)
+{
+    if (stackHandle != NULL)
+        return stackHandle->read(buffer, size, pos);
+    if (fseek(fimg, pos, SEEK_SET) != 0)
+        return 0;
+    return fread(buffer, 1, size, fimg);
+}
+
+size_t ImageBase::readFileSize()
+{
+    if (stackHandle != NULL)
+        return stackHandle->fileSize;
+    fseek(fimg, 0, SEEK_END);
+    return ftell(fimg);
+}
+
 
 int ImageBase::readMapped(const FileName &name, size_t select_img, int mode)
 {
@@ -231,9 +332,11 @@ void ImageBase::write(const FileName &name, size_t select_img, bool isStack,
     swapWrite = _swapWrite;
 
     /* If the filename is in stack we will suppose you want to write this,
-     * even if you have not set the flags to.
+     * even if you have not set the flags to. A block name without image
+     * number (block@file) is the whole stack, which is overwritten.
      */
-    if ( fname.isInStack() && mode == WRITE_OVERWRITE)
+    if ( fname.isInStack() && mode == WRITE_OVERWRITE &&
+         (fname.getBlockName().empty() || fname.getPrefixNumber() != ALL_IMAGES))
     {
         isStack = true;
         mode = WRITE_REPLACE;
@@ -492,6 +595,10 @@ ImageFHandler* ImageBase::openFile(const FileName &name, int mode) const
     if (name.empty())
         REPORT_ERROR(ERR_PARAM_INCORRECT, "ImageBase::openFile Cannot open an empty Filename.");
 
+    // The registry must not keep an outdated copy of a file being written
+    if (mode != WRITE_READONLY)
+        ImageFileRegistry::getInstance().invalidate(name);
+
     ImageFHandler* hFile = new ImageFHandler;
     FileName fileName, headName = "";
     FileName ext_name = name.getFileFormat();
@@ -545,11 +652,24 @@ ImageFHandler* ImageBase::openFile(const FileName &name, int mode) const
     }
     else if (ext_name.contains("hdf") || ext_name.contains("h5"))
     {
-        if ((hFile->fhdf5 = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT)) == -1 )
+        if (mode != WRITE_READONLY)
+            H5FilePool::getInstance().invalidate(fileName);
+        {
+            H5Lock lock;
+            if (mode == WRITE_READONLY)
+                hFile->fhdf5 = H5Fopen(fileName.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+            else if (hFile->exist && mode != WRITE_OVERWRITE)
+                hFile->fhdf5 = H5Fopen(fileName.c_str(), H5F_ACC_RDWR, H5P_DEFAULT);
+            else
+                hFile->fhdf5 = H5Fcreate(fileName.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+        }
+        if (hFile->fhdf5 < 0)
             REPORT_ERROR(ERR_IO_NOTOPEN,"ImageBase::openFile: There is a problem opening the HDF5 file.");
-        //        hFile->fimg = NULL;
 
-        if ( (hFile->fimg = fopen(fileName.c_str(), wmChar.c_str())) == NULL )
+        // Contiguous datasets are read directly from the file
+        if (mode != WRITE_READONLY)
+            hFile->fimg = NULL;
+        else if ( (hFile->fimg = fopen(fileName.c_str(), wmChar.c_str())) == NULL )
         {
             if (errno == EACCES)
                 REPORT_ERROR(ERR_IO_NOPERM,formatString("Image::openFile: permission denied when opening %s",fileName.c_str()));
@@ -661,8 +781,11 @@ void ImageBase::closeFile(ImageFHandler* hFile) const
     }
     else if (ext_name.contains("hdf") || ext_name.contains("h5"))
     {
-        H5Fclose(fhdf5);
-        if (fclose(fimg) != 0 )
+        {
+            H5Lock lock;
+            H5Fclose(fhdf5);
+        }
+        if (fimg != NULL && fclose(fimg) != 0 )
             REPORT_ERROR(ERR_IO_NOCLOSED,(String)"Can not close image file "+ filename);
     }
     else
@@ -767,6 +890,8 @@ int ImageBase::_read(const FileName &name, ImageFHandler* hFile, DataMode datamo
         err = readJPEG(select_img);
     else if (ext_name.contains("hdf") || ext_name.contains("h5"))//SPE
         err = readHDF5(select_img);
+    else if (ext_name.contains("xcs"))//Compressed stack
+        err = readXCS(select_img);
     else
         err = readSPIDER(select_img);
 
@@ -799,12 +924,19 @@ void ImageBase::_write(const FileName &name, ImageFHandler* hFile, size_t select
     fimg = hFile->fimg;
     fhed = hFile->fhed;
     tif  = hFile->tif;
+    fhdf5 = hFile->fhdf5;
 
     FileName ext_name = hFile->ext_name;
 
     size_t aux;
     FileName filNamePlusExt;
     name.decompose(aux, filNamePlusExt);
+    // Image in a block, as given by FileName::compose (n,block@file)
+    if (aux == ALL_IMAGES && !name.getBlockName().empty())
+    {
+        aux = name.getPrefixNumber();
+        filNamePlusExt = name.removePrefixNumber();
+    }
 
     if (select_img == ALL_IMAGES)
         select_img = aux;
@@ -913,8 +1045,10 @@ void ImageBase::_write(const FileName &name, ImageFHandler* hFile, size_t select
         writeSPE(select_img,isStack,mode);
     else if (ext_name.contains("jpg"))
         writeJPEG(select_img);
-    else if (ext_name.contains("hdf5") || ext_name.contains("h5"))
-        writeHDF5(select_img);
+    else if (ext_name.contains("hdf") || ext_name.contains("h5"))
+        writeHDF5(select_img,isStack,mode,imParam,castMode);
+    else if (ext_name.contains("xcs"))
+        writeXCS(select_img,isStack,mode,imParam,castMode);
     else
         err = writeSPIDER(select_img,isStack,mode);
 
@@ -114,6 +114,8 @@ struct ImageFHandler
     int        mode;   // Opening mode behavior
 };
 
+struct StackFileHandle;
+
 struct ImageInfo
 {
 	FileName  filename;
@@ -241,6 +243,7 @@ protected:
     TIFF*               tif;         // TIFF Image file hander
     hid_t    fhdf5;       // HDF5 File handler
     ImageFHandler*      hFile;       // Image File handler information structure
+    StackFileHandle*    stackHandle; // Open stack of the registry being read (NULL if read through fimg)
     ArrayDim         aDimFile;   // Image header file information structure (original info from file)
     DataMode            dataMode;    // Flag to force select what will be read/write from image files
     size_t              offset;      // Data offset
@@ -790,6 +793,7 @@ protected:
 #include "rwEM.h"
 #include "rwPIF.h"
 #include "rwHDF5.h"
+#include "rwXCS.h"
 
     /// ----------------------------------------------------------
 
@@ -820,6 +824,15 @@ protected:
       */
     virtual void readData(FILE* fimg, size_t select_img, DataType datatype, size_t pad) = 0;
 
+    /** Read size bytes at position pos of the file being read. Stacks of the
+     *  registry of open stacks are read with pread, other files with fseek
+     *  and fread on fimg. Returns the number of bytes read.
+     */
+    size_t readFileBytes(void *buffer, size_t size, size_t pos);
+
+    /** Size of the file being read */
+    size_t readFileSize();
+
     /** Write the raw date after a data type casting.
      */
     virtual void writeData(FILE* fimg, size_t offset, DataType wDType, size_t datasize_n,
@@ -69,6 +69,7 @@ void  ProgConvImg::defineParams()
     comments.addComment("++ spe : Princeton Instruments CCD camera");
     comments.addComment("++ spi, xmp : Spider");
     comments.addComment("++ tif : TIFF");
+    comments.addComment("++ xcs : Xmipp compressed stack");
     comments.addComment("++ raw#xDim,yDim,[zDim],offset,datatype,[r] : RAW image file without header file");
     comments.addComment("++ where datatype can be: uint8,int8,uint16,int16,uint32,int32,long,float,double,");
     comments.addComment("++                        cint16,cint32,cfloat,cdouble,bool");
@@ -92,6 +93,7 @@ void  ProgConvImg::defineParams()
     addParamsLine("         xmp : Spider (Data types: float* and cfloat).");
     addParamsLine("         tif : TIFF (Data types: uint8*, uint16, uint32 and float).");
     addParamsLine("         jpg : JPEG (Data types: uint8*).");
+    addParamsLine("         xcs : Xmipp compressed stack (Data types: (u)int8, (u)int16, float* and float16).");
     addParamsLine("         custom <ext> : Custom extension name, the real format will be Spider.");
     addParamsLine("  [--type <output_type=auto>] : Force output file type.");
     addParamsLine("          where <output_type>");
@@ -118,6 +120,7 @@ void  ProgConvImg::defineParams()
     addParamsLine("                 cfloat : Complex float");
     addParamsLine("                 cdouble: Complex double");
     addParamsLine("                 bool");
+    addParamsLine("                 float16: Half precision float (only xcs)");
     addParamsLine("  alias -d;");
     addParamsLine("  [--swap <type=arch>]        : Swap the endianness of the image file");
     addParamsLine("          where <type>");
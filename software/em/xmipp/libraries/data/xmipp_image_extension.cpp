@@ -24,22 +24,104 @@
  ***************************************************************************/
 
 #include "xmipp_image_extension.h"
+#include "xmipp_image_registry.h"
+#include "xmipp_threads.h"
 #include "xmipp_error.h"
 
 
-void getImageSize(const FileName &filename, size_t &Xdim, size_t &Ydim, size_t &Zdim, size_t &Ndim)
+void readImageHeader(const FileName &filename, ImageHeaderInfo &info)
 {
     Image<char> img;
     img.read(filename, HEADER);
-    img.getDimensions(Xdim, Ydim, Zdim, Ndim);
+    img.getDimensions(info.Xdim, info.Ydim, info.Zdim, info.Ndim);
+    info.datatype = img.datatype();
+    info.sampling = 0;
+    img.MDMainHeader.getValue(MDL_SAMPLINGRATE_X, info.sampling);
+}
+
+/* Read the headers of the files selected by the caller */
+class ImageHeadersBody: public ParallelForBody
+{
+public:
+    const std::vector<FileName> *filenames;
+    const std::vector<size_t> *selected;
+    std::vector<ImageHeaderInfo> *info;
+    std::vector<char> failed;
+    std::vector<String> errors;
+    std::vector<ErrorType> errorTypes;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        for (size_t i = first; i <= last; ++i)
+        {
+            size_t n = (*selected)[i];
+            try
+            {
+                readImageHeader((*filenames)[n], (*info)[n]);
+            }
+            catch (XmippError &xe)
+            {
+                failed[n] = 1;
+                errors[n] = xe.msg;
+                errorTypes[n] = xe.__errno;
+            }
+        }
+    }
+};
+
+void readImageHeaders(const std::vector<FileName> &filenames, std::vector<ImageHeaderInfo> &info)
+{
+    size_t nFiles = filenames.size();
+    info.resize(nFiles);
+    std::vector<size_t> parallelFiles, serialFiles;
+    FileName fileName, ext_name;
+    for (size_t n = 0; n < nFiles; ++n)
+        if (ImageFileRegistry::registryFileName(filenames[n], fileName, ext_name))
+            parallelFiles.push_back(n);
+        else
+            serialFiles.push_back(n);
+
+    ImageHeadersBody body;
+    body.filenames = &filenames;
+    body.info = &info;
+    body.failed.resize(nFiles, 0);
+    body.errors.resize(nFiles);
+    body.errorTypes.resize(nFiles, ERR_UNCLASSIFIED);
+    if (!parallelFiles.empty())
+    {
+        body.selected = &parallelFiles;
+        ThreadPool::getInstance().parallelFor(0, parallelFiles.size() - 1, body, 1);
+    }
+    if (!serialFiles.empty())
+    {
+        body.selected = &serialFiles;
+        body(0, serialFiles.size() - 1, 0);
+    }
+
+    for (size_t n = 0; n < nFiles; ++n)
+        if (body.failed[n])
+            REPORT_ERROR(body.errorTypes[n], body.errors[n]);
+}
+
+void getImageSize(const FileName &filename, size_t &Xdim, size_t &Ydim, size_t &Zdim, size_t &Ndim)
+{
+    ImageHeaderInfo info;
+    readImageHeader(filename, info);
+    Xdim = info.Xdim;
+    Ydim = info.Ydim;
+    Zdim = info.Zdim;
+    Ndim = info.Ndim;
 }
 
 void getImageInfo(const FileName &filename, size_t &Xdim, size_t &Ydim, size_t &Zdim, size_t &Ndim, DataType &datatype)
 {
-    Image<char> img;
-    img.read(filename, HEADER);
-    img.getDimensions(Xdim, Ydim, Zdim, Ndim);
-    datatype = img.datatype();
+    ImageHeaderInfo info;
+    readImageHeader(filename, info);
+    Xdim = info.Xdim;
+    Ydim = info.Ydim;
+    Zdim = info.Zdim;
+    Ndim = info.Ndim;
+    datatype = info.datatype;
 }
 
 void getImageInfo(const FileName &name, ImageInfo &imgInfo)
@@ -78,7 +160,8 @@ bool checkImageFileSize(const FileName &name, const ImageInfo &imgInfo, bool err
         dataFname = name.removeLastExtension().addExtension("img");
     else if (ext.contains("inf"))
         dataFname = name.removeLastExtension();
-    else if (ext.contains("tif") || ext.contains("jpg") || ext.contains("hdf") || ext.contains("h5"))
+    else if (ext.contains("tif") || ext.contains("jpg") || ext.contains("hdf") || ext.contains("h5") ||
+             ext.contains("xcs"))
         return true;
     else
         dataFname = name;
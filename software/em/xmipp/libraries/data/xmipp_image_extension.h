@@ -41,6 +41,36 @@ void getImageInfo(const FileName &filename, size_t &Xdim, size_t &Ydim, size_t &
                   size_t &Ndim, DataType &datatype);
 void getImageInfo(const FileName &name, ImageInfo &imgInfo);
 
+/** Header information of an image file */
+struct ImageHeaderInfo
+{
+    /// Dimensions
+    size_t Xdim, Ydim, Zdim, Ndim;
+    /// Type of the data in the file
+    DataType datatype;
+    /// Sampling rate in the header (0 if there is none)
+    double sampling;
+};
+
+/** Read the header of an image file */
+void readImageHeader(const FileName &filename, ImageHeaderInfo &info);
+
+/** Read the headers of a set of image files.
+ *  The headers of MRC and Spider files are read in parallel by the thread
+ *  pool, with positioned reads of their first bytes (see ImageFileRegistry).
+ *  Files of other formats, whose libraries are not thread-safe, are read
+ *  afterwards by the calling thread. info is resized to the number of files.
+ *  If any file cannot be read, the error of the first one is reported after
+ *  all of them have been processed.
+ *  @code
+ *  std::vector<FileName> fnMicrographs;
+ *  std::vector<ImageHeaderInfo> headers;
+ *  ...
+ *  readImageHeaders(fnMicrographs, headers);
+ *  @endcode
+ */
+void readImageHeaders(const std::vector<FileName> &filenames, std::vector<ImageHeaderInfo> &info);
+
 /** Get datatype information from image file*/
 void getImageDatatype(const FileName &name, DataType &datatype);
 DataType getImageDatatype(const FileName &name);
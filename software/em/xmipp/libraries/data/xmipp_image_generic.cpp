@@ -600,7 +600,8 @@ void createEmptyFile(const FileName &filename, int xdim, int ydim, int Zdim,
     else
     {
         strType = filename.substr(found+1).c_str();
-        image.setDatatype(str2Datatype(strType));
+        // Half floats are written from floats, the bit depth is kept in the filename for the writer
+        image.setDatatype((strType == "float16") ? DT_Float : str2Datatype(strType));
     }
 
     image.mapFile2Write(xdim, ydim, Zdim, filename, false, select_img, isStack, mode, _swapWrite);
@@ -0,0 +1,268 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "xmipp_image_registry.h"
+
+// Open files by default
+#define STACK_REGISTRY_CAPACITY 64
+
+size_t StackFileHandle::read(void *buffer, size_t size, size_t pos) const
+{
+    char *ptr = (char *) buffer;
+    size_t done = 0;
+    // Beginning of the file from memory
+    if (pos < headerSize)
+    {
+        done = std::min(size, headerSize - pos);
+        memcpy(ptr, header + pos, done);
+    }
+    while (done < size)
+    {
+        ssize_t n = pread(fd, ptr + done, size - done, pos + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+ImageFileRegistry & ImageFileRegistry::getInstance()
+{
+    static pthread_mutex_t instanceMutex = PTHREAD_MUTEX_INITIALIZER;
+    static ImageFileRegistry * instance = NULL;
+    pthread_mutex_lock(&instanceMutex);
+    if (instance == NULL)
+        instance = new ImageFileRegistry();
+    pthread_mutex_unlock(&instanceMutex);
+    return *instance;
+}
+
+ImageFileRegistry::ImageFileRegistry()
+{
+    capacity = STACK_REGISTRY_CAPACITY;
+}
+
+ImageFileRegistry::~ImageFileRegistry()
+{
+    clear();
+}
+
+bool ImageFileRegistry::registryFileName(const FileName &name, FileName &fileName, FileName &ext_name)
+{
+    // Same names as ImageBase::openFile
+    ext_name = name.getFileFormat();
+    fileName = name.removeAllPrefixes().removeFileFormat();
+    size_t found = fileName.find_first_of("%");
+    if (found != String::npos)
+        fileName = fileName.substr(0, found);
+
+    // Formats read by readSPIDER, readMRC and readXCS (in the order of ImageBase::_read)
+    return ext_name.contains("spi") || ext_name.contains("xmp") ||
+           ext_name.contains("stk") || ext_name.contains("vol") ||
+           ext_name.contains("mrcs") || ext_name.contains("st") ||
+           ext_name.contains("mrc") || ext_name.contains("map") ||
+           ext_name.contains("xcs");
+}
+
+StackFileHandle * ImageFileRegistry::open(const FileName &fileName)
+{
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+    {
+        ::close(fd);
+        return NULL;
+    }
+
+    StackFileHandle *handle = new StackFileHandle;
+    handle->fileName = fileName;
+    handle->fd = fd;
+    handle->fileSize = info.st_size;
+    handle->mtime = info.st_mtime;
+    handle->inode = info.st_ino;
+    handle->lastCheck = time(NULL);
+    handle->refCount = 0;
+    handle->detached = false;
+    handle->headerSize = 0;
+    handle->headerSize = handle->read(handle->header,
+                                      std::min((size_t) STACK_HEADER_CACHE_SIZE, handle->fileSize), 0);
+    return handle;
+}
+
+StackFileHandle * ImageFileRegistry::acquire(const FileName &name)
+{
+    FileName fileName, ext_name;
+    if (!registryFileName(name, fileName, ext_name))
+        return NULL;
+
+    mutex.lock();
+    if (capacity == 0)
+    {
+        mutex.unlock();
+        return NULL;
+    }
+    StackFileHandle *handle = NULL;
+    std::map<String, StackFileHandle *>::iterator it = handles.find(fileName);
+    if (it != handles.end())
+    {
+        handle = it->second;
+        // Check whether the file has changed
+        time_t now = time(NULL);
+        if (now != handle->lastCheck)
+        {
+            struct stat info;
+            if (stat(fileName.c_str(), &info) != 0 || (size_t) info.st_size != handle->fileSize ||
+                info.st_mtime != handle->mtime || info.st_ino != handle->inode)
+            {
+                detach(handle);
+                handle = NULL;
+            }
+            else
+                handle->lastCheck = now;
+        }
+    }
+    if (handle == NULL)
+    {
+        // Open and read the header without the lock, so that threads
+        // scanning different files do not wait for each other
+        mutex.unlock();
+        handle = open(fileName);
+        if (handle == NULL)
+            return NULL;
+        mutex.lock();
+        it = handles.find(fileName);
+        if (it != handles.end())
+        {
+            // Another thread opened it meanwhile
+            ::close(handle->fd);
+            delete handle;
+            handle = it->second;
+            if (handle->lruPosition != lru.begin())
+                lru.splice(lru.begin(), lru, handle->lruPosition);
+        }
+        else
+        {
+            handles[fileName] = handle;
+            lru.push_front(handle);
+            handle->lruPosition = lru.begin();
+        }
+    }
+    else if (handle->lruPosition != lru.begin())
+        lru.splice(lru.begin(), lru, handle->lruPosition);
+    handle->refCount++;
+    evict();
+    mutex.unlock();
+    return handle;
+}
+
+void ImageFileRegistry::release(StackFileHandle *handle)
+{
+    if (handle == NULL)
+        return;
+    mutex.lock();
+    handle->refCount--;
+    if (handle->detached && handle->refCount == 0)
+    {
+        ::close(handle->fd);
+        delete handle;
+    }
+    else
+        evict();
+    mutex.unlock();
+}
+
+void ImageFileRegistry::detach(StackFileHandle *handle)
+{
+    handles.erase(handle->fileName);
+    lru.erase(handle->lruPosition);
+    handle->detached = true;
+    if (handle->refCount == 0)
+    {
+        ::close(handle->fd);
+        delete handle;
+    }
+}
+
+void ImageFileRegistry::evict()
+{
+    std::list<StackFileHandle *>::iterator it = lru.end();
+    while (handles.size() > capacity && it != lru.begin())
+    {
+        --it;
+        StackFileHandle *handle = *it;
+        if (handle->refCount == 0)
+        {
+            // Erasing it invalidates the iterator
+            std::list<StackFileHandle *>::iterator next = it;
+            ++next;
+            detach(handle);
+            it = next;
+        }
+    }
+}
+
+void ImageFileRegistry::invalidate(const FileName &name)
+{
+    FileName fileName, ext_name;
+    registryFileName(name, fileName, ext_name);
+    mutex.lock();
+    std::map<String, StackFileHandle *>::iterator it = handles.find(fileName);
+    if (it != handles.end())
+        detach(it->second);
+    mutex.unlock();
+}
+
+void ImageFileRegistry::clear()
+{
+    mutex.lock();
+    size_t oldCapacity = capacity;
+    capacity = 0;
+    evict();
+    capacity = oldCapacity;
+    mutex.unlock();
+}
+
+size_t ImageFileRegistry::getCapacity() const
+{
+    return capacity;
+}
+
+void ImageFileRegistry::setCapacity(size_t _capacity)
+{
+    mutex.lock();
+    capacity = _capacity;
+    evict();
+    mutex.unlock();
+}
@@ -0,0 +1,145 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#ifndef XMIPP_IMAGE_REGISTRY_H_
+#define XMIPP_IMAGE_REGISTRY_H_
+
+#include <map>
+#include <list>
+#include <time.h>
+#include <sys/types.h>
+#include "xmipp_filename.h"
+#include "xmipp_threads.h"
+
+/** @defgroup ImageRegistry Registry of open stacks
+ *  @ingroup DataLibrary
+ *
+ *  Reading the images of a metadata one by one opens the stack file, parses
+ *  its header, reads one image and closes the file for every image. The
+ *  registry keeps the MRC, Spider and compressed (xcs) stacks open with
+ *  their first bytes (the main header), so that reading N@stack.mrcs only
+ *  needs a positioned read (pread) of the image. Descriptors are shared by all threads, since
+ *  pread does not move any file pointer.
+ *
+ *  Files opened by ImageBase for writing are removed from the registry.
+ *  Files modified by other processes are detected by their size,
+ *  modification time and inode, which are checked at most once per second.
+ */
+//@{
+
+/// Bytes of the beginning of the file kept in memory
+#define STACK_HEADER_CACHE_SIZE 1024
+
+/** Open stack file */
+struct StackFileHandle
+{
+    /// Physical file name (without image number nor format)
+    FileName fileName;
+    /// Read-only descriptor
+    int fd;
+    /// File size
+    size_t fileSize;
+    /// Modification time and inode of the file when it was opened
+    time_t mtime;
+    ino_t inode;
+    /// Last time the file was checked
+    time_t lastCheck;
+    /// Beginning of the file
+    char header[STACK_HEADER_CACHE_SIZE];
+    /// Valid bytes in header
+    size_t headerSize;
+    /// Number of readers using the handle
+    int refCount;
+    /// The handle is no longer in the registry and is closed by its last reader
+    bool detached;
+    /// Position in the LRU list
+    std::list<StackFileHandle *>::iterator lruPosition;
+
+    /** Read size bytes at position pos. The beginning of the file is served
+     *  from memory. Returns the number of bytes read. Thread-safe.
+     */
+    size_t read(void *buffer, size_t size, size_t pos) const;
+};
+
+/** Process-wide registry of open stacks.
+ *  Handles are acquired by ImageBase::read for the duration of a read and
+ *  the least recently used handles that are not in use are closed when
+ *  there are more than getCapacity() open files.
+ */
+class ImageFileRegistry
+{
+public:
+    /// The registry of the process
+    static ImageFileRegistry &getInstance();
+
+    /** Handle of the file of an image name (e.g., 3@stack.mrcs).
+     *  Returns NULL if the format is not handled by the registry (only MRC,
+     *  Spider and xcs files are) or the file cannot be opened, in which case the
+     *  caller should use the usual path. The handle must be released.
+     */
+    StackFileHandle *acquire(const FileName &name);
+
+    /// Release a handle returned by acquire
+    void release(StackFileHandle *handle);
+
+    /// Remove a file from the registry (e.g., because it is being written)
+    void invalidate(const FileName &name);
+
+    /// Close all files not in use
+    void clear();
+
+    /// Maximum number of open files (64 by default)
+    size_t getCapacity() const;
+
+    /// Set the maximum number of open files (0 disables the registry)
+    void setCapacity(size_t capacity);
+
+    /** Physical file name of an image name, and whether the registry handles its format.
+     *  Header reads (ImageBase::read with HEADER) of these files also go through the registry.
+     */
+    static bool registryFileName(const FileName &name, FileName &fileName, FileName &ext_name);
+
+private:
+    ImageFileRegistry();
+    ~ImageFileRegistry();
+    ImageFileRegistry(const ImageFileRegistry &);
+    ImageFileRegistry & operator=(const ImageFileRegistry &);
+
+    /// Open a file, NULL if it cannot be done. Does not need the lock
+    static StackFileHandle *open(const FileName &fileName);
+
+    /// Remove from the map and the LRU list, and close it if not in use. Must hold the lock
+    void detach(StackFileHandle *handle);
+
+    /// Close the least recently used files not in use. Must hold the lock
+    void evict();
+
+    Mutex mutex;
+    size_t capacity;
+    std::map<String, StackFileHandle *> handles;
+    std::list<StackFileHandle *> lru;
+};
+//@}
+#endif /* XMIPP_IMAGE_REGISTRY_H_ */
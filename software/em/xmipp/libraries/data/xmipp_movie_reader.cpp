@@ -0,0 +1,482 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#include <string.h>
+#include <algorithm>
+#include "xmipp_movie_reader.h"
+#include "xmipp_image_base.h"
+#include "xmipp_funcs.h"
+
+// Rows of an MRC frame read at once
+#define MOVIE_READ_ROWS 64
+// MRC header size without extended header
+#define MOVIE_MRC_HEADER 1024
+// IMOD mode of 4 bit packed data
+#define MOVIE_MRC_MODE_4BIT 101
+
+/* Raw pixels [first,first+n) of a row to float */
+template<typename T>
+static void rawRowToFloat(const unsigned char *src, size_t first, size_t n, bool swap, float *dst)
+{
+    const T *ptr = ((const T *) src) + first;
+    if (!swap)
+        for (size_t k = 0; k < n; ++k)
+            dst[k] = (float) ptr[k];
+    else
+        for (size_t k = 0; k < n; ++k)
+        {
+            T value = ptr[k];
+            swapbytes((char *) &value, sizeof(T));
+            dst[k] = (float) value;
+        }
+}
+
+/* 4 bit pixels [first,first+n) of a row to float */
+static void raw4RowToFloat(const unsigned char *src, size_t first, size_t n, bool lowNibbleFirst, float *dst)
+{
+    for (size_t k = 0; k < n; ++k)
+    {
+        size_t x = first + k;
+        unsigned char byte = src[x >> 1];
+        bool high = ((x & 1) != 0) == lowNibbleFirst;
+        dst[k] = (float) (high ? (byte >> 4) : (byte & 0x0F));
+    }
+}
+
+MovieReader::MovieReader()
+{
+    handle = NULL;
+    close();
+}
+
+MovieReader::~MovieReader()
+{
+    close();
+}
+
+void MovieReader::close()
+{
+    for (size_t t = 0; t < tiffHandles.size(); ++t)
+        if (tiffHandles[t] != NULL)
+            TIFFClose(tiffHandles[t]);
+    tiffHandles.clear();
+    if (handle != NULL)
+        ImageFileRegistry::getInstance().release(handle);
+    handle = NULL;
+    rawBuffers.clear();
+    rowBuffers.clear();
+    accumulators.clear();
+    directories.clear();
+    fnMovie = "";
+    isTIFF = swap = lowNibbleFirst = false;
+    Xdim = Ydim = Ndim = 0;
+    bitsPerPixel = 0;
+    sampleFormat = SAMPLEFORMAT_UINT;
+    offset = rowBytes = 0;
+    y0 = x0 = 0;
+    yF = xF = -1;
+    dark = gain = NULL;
+    bin = 1;
+}
+
+bool MovieReader::isSupported(const FileName &fnMovie)
+{
+    FileName ext = FileName(fnMovie.getFileFormat()).toLowercase();
+    return ext == "mrc" || ext == "mrcs" || ext == "st" || ext == "tif" || ext == "tiff";
+}
+
+void MovieReader::open(const FileName &_fnMovie)
+{
+    close();
+    if (!isSupported(_fnMovie))
+        REPORT_ERROR(ERR_IMG_UNKNOWN, formatString("MovieReader: unsupported movie format %s", _fnMovie.c_str()));
+    FileName ext = FileName(_fnMovie.getFileFormat()).toLowercase();
+    fnMovie = _fnMovie.removeAllPrefixes().removeFileFormat();
+    isTIFF = ext == "tif" || ext == "tiff";
+
+    int nThreads = ThreadPool::getInstance().getNumberOfThreads() + 1;
+    tiffHandles.resize(nThreads, (TIFF *) NULL);
+    rawBuffers.resize(nThreads);
+    rowBuffers.resize(nThreads);
+    accumulators.resize(nThreads);
+
+    if (isTIFF)
+    {
+        TIFF *tif = TIFFOpen(fnMovie.c_str(), "r");
+        if (tif == NULL)
+            REPORT_ERROR(ERR_IO_NOTOPEN, formatString("MovieReader: cannot open %s", fnMovie.c_str()));
+        tiffHandles[0] = tif;
+        // One frame per directory, remember where they are so that any frame is reached with one seek
+        do
+            directories.push_back(TIFFCurrentDirOffset(tif));
+        while (TIFFReadDirectory(tif));
+        TIFFSetSubDirectory(tif, directories[0]);
+
+        uint32 width, length;
+        uint16 bps, format, spp;
+        TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+        TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &length);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLEFORMAT, &format);
+        TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+        if (TIFFIsTiled(tif) || spp != 1)
+            REPORT_ERROR(ERR_IMG_UNKNOWN, formatString("MovieReader: %s is tiled or has several samples per pixel", fnMovie.c_str()));
+        Xdim = width;
+        Ydim = length;
+        Ndim = directories.size();
+        bitsPerPixel = bps;
+        sampleFormat = format;
+        rowBytes = TIFFScanlineSize(tif);
+        // The TIFF standard puts the first pixel in the high order bits
+        lowNibbleFirst = false;
+    }
+    else
+    {
+        handle = ImageFileRegistry::getInstance().acquire(_fnMovie);
+        if (handle == NULL)
+            REPORT_ERROR(ERR_IO_NOTOPEN, formatString("MovieReader: cannot open %s", fnMovie.c_str()));
+        if (handle->headerSize < MOVIE_MRC_HEADER)
+            REPORT_ERROR(ERR_IO_SIZE, formatString("MovieReader: %s is too small for an MRC file", fnMovie.c_str()));
+        int header[MOVIE_MRC_HEADER / sizeof(int)];
+        memcpy(header, handle->header, MOVIE_MRC_HEADER);
+        // Same criterion as readMRC
+        swap = abs(header[3]) > SWAPTRIG || abs(header[2]) > SWAPTRIG;
+        if (swap)
+            for (int i = 0; i < 24; ++i)
+                swapbytes((char *) &header[i], sizeof(int));
+        Xdim = header[0];
+        Ydim = header[1];
+        Ndim = header[2];
+        offset = MOVIE_MRC_HEADER + header[23];
+        switch (header[3])
+        {
+        case 0:
+            bitsPerPixel = 8;
+            sampleFormat = SAMPLEFORMAT_UINT;
+            break;
+        case 1:
+            bitsPerPixel = 16;
+            sampleFormat = SAMPLEFORMAT_INT;
+            break;
+        case 2:
+            bitsPerPixel = 32;
+            sampleFormat = SAMPLEFORMAT_IEEEFP;
+            break;
+        case 6:
+            bitsPerPixel = 16;
+            sampleFormat = SAMPLEFORMAT_UINT;
+            break;
+        case MOVIE_MRC_MODE_4BIT:
+            bitsPerPixel = 4;
+            sampleFormat = SAMPLEFORMAT_UINT;
+            break;
+        default:
+            REPORT_ERROR(ERR_TYPE_INCORRECT, formatString("MovieReader: MRC mode %d of %s is not supported",
+                         header[3], fnMovie.c_str()));
+        }
+        rowBytes = (Xdim * bitsPerPixel + 7) / 8;
+        lowNibbleFirst = true;
+        if (handle->fileSize < offset + Ndim * Ydim * rowBytes)
+            REPORT_ERROR(ERR_IO_SIZE, formatString("MovieReader: %s is smaller than its header says", fnMovie.c_str()));
+    }
+
+    bool supported = bitsPerPixel == 4 || bitsPerPixel == 8 || bitsPerPixel == 16 ||
+                     (bitsPerPixel == 32 && sampleFormat != SAMPLEFORMAT_COMPLEXIEEEFP);
+    if (!supported || (bitsPerPixel < 32 && sampleFormat == SAMPLEFORMAT_IEEEFP))
+        REPORT_ERROR(ERR_TYPE_INCORRECT, formatString("MovieReader: pixels of %d bits of %s are not supported",
+                     bitsPerPixel, fnMovie.c_str()));
+    setWindow(0, 0, Ydim - 1, Xdim - 1);
+}
+
+size_t MovieReader::getNumberOfFrames() const
+{
+    return Ndim;
+}
+
+void MovieReader::getFrameSize(size_t &_Xdim, size_t &_Ydim) const
+{
+    _Xdim = Xdim;
+    _Ydim = Ydim;
+}
+
+void MovieReader::setWindow(int _y0, int _x0, int _yF, int _xF)
+{
+    if (_yF < _y0 || _xF < _x0)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "MovieReader: empty window");
+    y0 = _y0;
+    x0 = _x0;
+    yF = _yF;
+    xF = _xF;
+}
+
+void MovieReader::setCorrection(const MultidimArray<double> *_dark, const MultidimArray<double> *_gain)
+{
+    dark = _dark;
+    gain = _gain;
+}
+
+void MovieReader::setBinning(int _bin)
+{
+    if (_bin < 1)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "MovieReader: the binning must be a positive integer");
+    bin = _bin;
+}
+
+void MovieReader::prepareThread(int thread_id)
+{
+    if (isTIFF && tiffHandles[thread_id] == NULL)
+    {
+        tiffHandles[thread_id] = TIFFOpen(fnMovie.c_str(), "r");
+        if (tiffHandles[thread_id] == NULL)
+            REPORT_ERROR(ERR_IO_NOTOPEN, formatString("MovieReader: cannot open %s", fnMovie.c_str()));
+    }
+    size_t wX = xF - x0 + 1;
+    rowBuffers[thread_id].resize(wX);
+    accumulators[thread_id].resize(wX / bin + 1);
+    if (isTIFF)
+        rawBuffers[thread_id].resize(TIFFStripSize(tiffHandles[thread_id]));
+    else
+        rawBuffers[thread_id].resize(MOVIE_READ_ROWS * rowBytes);
+}
+
+void MovieReader::readFrame(size_t n, MultidimArray<float> &frame)
+{
+    prepareThread(0);
+    decodeFrame(n, frame, 0);
+}
+
+/* Decode frames in parallel */
+class MovieReadBody: public ParallelForBody
+{
+public:
+    MovieReader *reader;
+    const std::vector<size_t> *frameNumbers;
+    std::vector< MultidimArray<float> > *frames;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        for (size_t i = first; i <= last; ++i)
+            reader->decodeFrame((*frameNumbers)[i], (*frames)[i], thread_id);
+    }
+};
+
+void MovieReader::readFrames(const std::vector<size_t> &frameNumbers, std::vector< MultidimArray<float> > &frames)
+{
+    frames.resize(frameNumbers.size());
+    if (frameNumbers.empty())
+        return;
+    MovieReadBody body;
+    body.reader = this;
+    body.frameNumbers = &frameNumbers;
+    body.frames = &frames;
+    ThreadPool::getInstance().parallelFor(0, frameNumbers.size() - 1, body, 1);
+}
+
+void MovieReader::decodeFrame(size_t n, MultidimArray<float> &frame, int thread_id)
+{
+    if (n >= Ndim)
+        REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, formatString("MovieReader: %s does not have frame %lu",
+                     fnMovie.c_str(), (unsigned long) n));
+    size_t wY = yF - y0 + 1, wX = xF - x0 + 1;
+    if ((dark != NULL && (YSIZE(*dark) != wY || XSIZE(*dark) != wX)) ||
+        (gain != NULL && (YSIZE(*gain) != wY || XSIZE(*gain) != wX)))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "MovieReader: the dark and gain images must have the size of the window");
+    if (wY / bin == 0 || wX / bin == 0)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, "MovieReader: the binning is larger than the window");
+
+    prepareThread(thread_id);
+    frame.resizeNoCopy(wY / bin, wX / bin);
+    if (bin == 1)
+    {
+        STARTINGY(frame) = y0;
+        STARTINGX(frame) = x0;
+    }
+    else
+        STARTINGY(frame) = STARTINGX(frame) = 0;
+    std::vector<float> &accumulator = accumulators[thread_id];
+    std::fill(accumulator.begin(), accumulator.end(), 0.f);
+
+    if (isTIFF)
+        decodeTIFF(n, frame, thread_id);
+    else
+        decodeMRC(n, frame, thread_id);
+}
+
+void MovieReader::processRows(const unsigned char *src, size_t srcRowBytes, int r0, int r1,
+                              MultidimArray<float> &frame, float *row, float *accumulator) const
+{
+    size_t wX = xF - x0 + 1;
+    // Columns of the window inside the frame
+    size_t j0 = std::max(0, -x0);
+    size_t j1 = (size_t) std::max(0, std::min((int) wX, (int) Xdim - x0));
+    size_t binnedX = XSIZE(frame);
+    size_t binnedY = YSIZE(frame);
+    float iBin2 = 1.f / (bin * bin);
+
+    for (int r = r0; r < r1; ++r)
+    {
+        // Rows that do not fill a whole bin are discarded
+        size_t ib = r / bin;
+        if (ib >= binnedY)
+            break;
+
+        // Raw pixels
+        if (j0 > 0 || j1 < wX || src == NULL)
+            memset(row, 0, wX * sizeof(float));
+        if (src != NULL && j1 > j0)
+        {
+            const unsigned char *rawRow = src + (r - r0) * srcRowBytes;
+            size_t first = x0 + j0, n = j1 - j0;
+            float *dst = row + j0;
+            switch (bitsPerPixel)
+            {
+            case 4:
+                raw4RowToFloat(rawRow, first, n, lowNibbleFirst, dst);
+                break;
+            case 8:
+                if (sampleFormat == SAMPLEFORMAT_INT)
+                    rawRowToFloat<signed char>(rawRow, first, n, false, dst);
+                else
+                    rawRowToFloat<unsigned char>(rawRow, first, n, false, dst);
+                break;
+            case 16:
+                if (sampleFormat == SAMPLEFORMAT_INT)
+                    rawRowToFloat<short>(rawRow, first, n, swap, dst);
+                else
+                    rawRowToFloat<unsigned short>(rawRow, first, n, swap, dst);
+                break;
+            case 32:
+                if (sampleFormat == SAMPLEFORMAT_IEEEFP)
+                    rawRowToFloat<float>(rawRow, first, n, swap, dst);
+                else if (sampleFormat == SAMPLEFORMAT_INT)
+                    rawRowToFloat<int>(rawRow, first, n, swap, dst);
+                else
+                    rawRowToFloat<unsigned int>(rawRow, first, n, swap, dst);
+                break;
+            }
+        }
+
+        // Corrections
+        if (dark != NULL)
+        {
+            const double *ptrDark = MULTIDIM_ARRAY(*dark) + r * wX;
+            for (size_t j = 0; j < wX; ++j)
+                row[j] -= (float) ptrDark[j];
+        }
+        if (gain != NULL)
+        {
+            const double *ptrGain = MULTIDIM_ARRAY(*gain) + r * wX;
+            for (size_t j = 0; j < wX; ++j)
+                row[j] *= (float) ptrGain[j];
+        }
+
+        // Binning
+        float *ptrOut = MULTIDIM_ARRAY(frame) + ib * binnedX;
+        if (bin == 1)
+            memcpy(ptrOut, row, wX * sizeof(float));
+        else
+        {
+            for (size_t jb = 0, j = 0; jb < binnedX; ++jb)
+                for (int k = 0; k < bin; ++k, ++j)
+                    accumulator[jb] += row[j];
+            if (r % bin == bin - 1)
+                for (size_t jb = 0; jb < binnedX; ++jb)
+                {
+                    ptrOut[jb] = accumulator[jb] * iBin2;
+                    accumulator[jb] = 0.f;
+                }
+        }
+    }
+}
+
+void MovieReader::decodeMRC(size_t n, MultidimArray<float> &frame, int thread_id)
+{
+    float *row = &(rowBuffers[thread_id][0]);
+    float *accumulator = &(accumulators[thread_id][0]);
+    unsigned char *buffer = &(rawBuffers[thread_id][0]);
+    size_t frameOffset = offset + n * Ydim * rowBytes;
+    int wY = yF - y0 + 1;
+    // Rows of the window inside the frame
+    int r0 = std::min(std::max(0, -y0), wY);
+    int r1 = std::max(r0, std::min(wY, (int) Ydim - y0));
+
+    if (r0 > 0)
+        processRows(NULL, 0, 0, r0, frame, row, accumulator);
+    for (int r = r0; r < r1; r += MOVIE_READ_ROWS)
+    {
+        int rF = std::min(r + MOVIE_READ_ROWS, r1);
+        size_t size = (rF - r) * rowBytes;
+        if (handle->read(buffer, size, frameOffset + (y0 + r) * rowBytes) != size)
+            REPORT_ERROR(ERR_IO_NOREAD, formatString("MovieReader: cannot read frame %lu of %s",
+                         (unsigned long) n, fnMovie.c_str()));
+        processRows(buffer, rowBytes, r, rF, frame, row, accumulator);
+    }
+    if (r1 < wY)
+        processRows(NULL, 0, r1, wY, frame, row, accumulator);
+}
+
+void MovieReader::decodeTIFF(size_t n, MultidimArray<float> &frame, int thread_id)
+{
+    TIFF *tif = tiffHandles[thread_id];
+    float *row = &(rowBuffers[thread_id][0]);
+    float *accumulator = &(accumulators[thread_id][0]);
+    if (!TIFFSetSubDirectory(tif, directories[n]))
+        REPORT_ERROR(ERR_IO_NOREAD, formatString("MovieReader: cannot read frame %lu of %s",
+                     (unsigned long) n, fnMovie.c_str()));
+    uint32 width, length, rowsPerStrip;
+    TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &length);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &rowsPerStrip);
+    if (width != Xdim || length != Ydim)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, formatString("MovieReader: frame %lu of %s has a different size",
+                     (unsigned long) n, fnMovie.c_str()));
+    rowsPerStrip = std::min(rowsPerStrip, length);
+    std::vector<unsigned char> &rawBuffer = rawBuffers[thread_id];
+    if (rawBuffer.size() < (size_t) TIFFStripSize(tif))
+        rawBuffer.resize(TIFFStripSize(tif));
+    unsigned char *buffer = &(rawBuffer[0]);
+
+    int wY = yF - y0 + 1;
+    int r0 = std::min(std::max(0, -y0), wY);
+    int r1 = std::max(r0, std::min(wY, (int) Ydim - y0));
+
+    if (r0 > 0)
+        processRows(NULL, 0, 0, r0, frame, row, accumulator);
+    // Only the strips with rows of the window are decoded
+    for (int r = r0; r < r1;)
+    {
+        int y = y0 + r;
+        tstrip_t strip = y / rowsPerStrip;
+        int stripY0 = strip * rowsPerStrip;
+        if (TIFFReadEncodedStrip(tif, strip, buffer, (tsize_t) -1) < 0)
+            REPORT_ERROR(ERR_IO_NOREAD, formatString("MovieReader: cannot decode frame %lu of %s",
+                         (unsigned long) n, fnMovie.c_str()));
+        int rF = std::min(r1, stripY0 + (int) rowsPerStrip - y0);
+        processRows(buffer + (y - stripY0) * rowBytes, rowBytes, r, rF, frame, row, accumulator);
+        r = rF;
+    }
+    if (r1 < wY)
+        processRows(NULL, 0, r1, wY, frame, row, accumulator);
+}
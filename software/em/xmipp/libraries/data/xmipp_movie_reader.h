@@ -0,0 +1,177 @@
+/***************************************************************************
+ *
+ * Authors:     Xmipp Team (xmipp@cnb.csic.es)
+ *
+ * Unidad de  Bioinformatica of Centro Nacional de Biotecnologia , CSIC
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ * 02111-1307  USA
+ *
+ *  All comments concerning this program package may be sent to the
+ *  e-mail address 'xmipp@cnb.csic.es'
+ ***************************************************************************/
+
+#ifndef XMIPP_MOVIE_READER_H_
+#define XMIPP_MOVIE_READER_H_
+
+#include <vector>
+#include <tiffio.h>
+#include "multidim_array.h"
+#include "xmipp_image_registry.h"
+#include "xmipp_threads.h"
+
+/** @defgroup MovieReader Movie reader
+ *  @ingroup DataLibrary
+ *
+ *  Direct reader of the frames of a movie (an MRC stack or a multipage
+ *  TIFF file) into float arrays. The raw pixels are decoded by blocks of
+ *  rows, and the dark subtraction, gain multiplication, cropping and
+ *  binning are applied to each block while it is in cache, so that no full
+ *  frame in the type of the file nor in double precision is built.
+ *
+ *  Supported pixel formats:
+ *  - MRC modes 0 (unsigned char), 1 (short), 2 (float), 6 (unsigned short)
+ *    and 101 (4 bits, two pixels per byte, the first one in the low order
+ *    bits and rows padded to a whole byte).
+ *  - TIFF with strips of 4, 8, 16 or 32 bit integers or 32 bit floats,
+ *    uncompressed or with any compression handled by libtiff (LZW,
+ *    deflate, ...).
+ *
+ *  readFrames decodes several frames in parallel with the thread pool.
+ *  MRC frames are read with pread from the registry of open stacks, TIFF
+ *  frames are decoded by each thread with its own libtiff handle.
+ *  @code
+ *  MovieReader reader;
+ *  reader.open("movie.mrcs");
+ *  reader.setWindow(0, 0, 3999, 3999);
+ *  reader.setCorrection(&dark, &gain);
+ *  std::vector<size_t> frames;
+ *  ...
+ *  std::vector< MultidimArray<float> > decoded;
+ *  reader.readFrames(frames, decoded);
+ *  @endcode
+ */
+//@{
+
+/** Reader of the frames of a movie */
+class MovieReader
+{
+public:
+    /// Empty constructor
+    MovieReader();
+
+    /// Destructor, closes the movie
+    ~MovieReader();
+
+    /** Open a movie (MRC if the extension is mrc, mrcs or st, and TIFF if
+     *  it is tif or tiff). The whole frame is read, without corrections
+     *  nor binning, until the setters below are called.
+     */
+    void open(const FileName &fnMovie);
+
+    /// Close the movie and forget the corrections
+    void close();
+
+    /// Whether the movie format is handled by this reader
+    static bool isSupported(const FileName &fnMovie);
+
+    /// Number of frames
+    size_t getNumberOfFrames() const;
+
+    /// Size of the frames in the file
+    void getFrameSize(size_t &Xdim, size_t &Ydim) const;
+
+    /** Read only the region (y0,x0)-(yF,xF) of the frames, both included,
+     *  with the same conventions as MultidimArray::window (the pixels out
+     *  of the frame are 0 and the origin of the output is (y0,x0) when
+     *  there is no binning).
+     */
+    void setWindow(int y0, int x0, int yF, int xF);
+
+    /** Corrected pixel = (raw - dark) * gain. The arrays (any of them may be
+     *  NULL) must have the size of the window and are not copied, so they
+     *  must exist while frames are read. Note that gain multiplies, it is
+     *  the inverse of a gain reference that divides.
+     */
+    void setCorrection(const MultidimArray<double> *dark, const MultidimArray<double> *gain);
+
+    /** Integer binning. Each output pixel is the average of bin x bin
+     *  corrected pixels; the last rows and columns of the window that do
+     *  not fill a whole bin are discarded.
+     */
+    void setBinning(int bin);
+
+    /// Read frame n (starting at 0)
+    void readFrame(size_t n, MultidimArray<float> &frame);
+
+    /** Read several frames in parallel with the thread pool.
+     *  frames is resized to the number of frame numbers.
+     */
+    void readFrames(const std::vector<size_t> &frameNumbers, std::vector< MultidimArray<float> > &frames);
+
+    /// Decode frame n using the buffers and handles of a thread. Used by the parallel read
+    void decodeFrame(size_t n, MultidimArray<float> &frame, int thread_id);
+
+private:
+    MovieReader(const MovieReader &);
+    MovieReader & operator=(const MovieReader &);
+
+    /// Prepare the state of a thread
+    void prepareThread(int thread_id);
+
+    /// Correct and bin rows [r0,r1) of the window, stored as raw rows in src
+    void processRows(const unsigned char *src, size_t srcRowBytes, int r0, int r1,
+                     MultidimArray<float> &frame, float *row, float *accumulator) const;
+
+    /// Decode an MRC frame
+    void decodeMRC(size_t n, MultidimArray<float> &frame, int thread_id);
+
+    /// Decode a TIFF frame
+    void decodeTIFF(size_t n, MultidimArray<float> &frame, int thread_id);
+
+    /// File name
+    FileName fnMovie;
+    /// TIFF (true) or MRC (false)
+    bool isTIFF;
+    /// Frame size and number of frames
+    size_t Xdim, Ydim, Ndim;
+    /// Bits per pixel
+    int bitsPerPixel;
+    /// Pixels are floats, signed or unsigned integers (SAMPLEFORMAT_* values)
+    int sampleFormat;
+    /// The bytes must be swapped (MRC only)
+    bool swap;
+    /// In 4 bit data, the first pixel of each byte is in the low order bits
+    bool lowNibbleFirst;
+    /// Offset of the first frame and bytes per row (MRC only)
+    size_t offset, rowBytes;
+    /// Offset of the directory of each frame (TIFF only)
+    std::vector<toff_t> directories;
+    /// Window
+    int y0, x0, yF, xF;
+    /// Corrections
+    const MultidimArray<double> *dark, *gain;
+    /// Binning
+    int bin;
+    /// Open MRC stack
+    StackFileHandle *handle;
+    /// libtiff handle of each thread
+    std::vector<TIFF *> tiffHandles;
+    /// Raw data, one row of the window and binned rows of each thread
+    std::vector< std::vector<unsigned char> > rawBuffers;
+    std::vector< std::vector<float> > rowBuffers, accumulators;
+};
+//@}
+#endif /* XMIPP_MOVIE_READER_H_ */
@@ -24,11 +24,13 @@
  ***************************************************************************/
 
 #include <stdio.h>
+#include <unistd.h>
 #include <iostream>
 
 #include "xmipp_threads.h"
 #include "xmipp_error.h"
 #include "xmipp_log.h"
+#include "xmipp_macros.h"
 
 
 // ================= MUTEX ==========================
@@ -362,6 +364,364 @@ bool ThreadTaskDistributor::distribute(size_t &first, size_t &last)
     return result;
 }
 
+// =================== THREAD POOL ============================
+
+TaskFuture::TaskFuture()
+{
+    pending = 0;
+    pool = NULL;
+}
+
+bool TaskFuture::isDone()
+{
+    condition.lock();
+    bool done = pending == 0;
+    condition.unlock();
+    return done;
+}
+
+void TaskFuture::wait()
+{
+    while (true)
+    {
+        // Help with the tasks of this future while they are queued
+        if (pool != NULL && pool->runPendingTask(this))
+            continue;
+        condition.lock();
+        if (pending == 0)
+        {
+            condition.unlock();
+            return;
+        }
+        // All our tasks are running in other threads
+        condition.wait();
+        condition.unlock();
+    }
+}
+
+ThreadPool::ThreadPool(int numberOfThreads)
+{
+    threads = numberOfThreads > 0 ? numberOfThreads : getNumberOfCores();
+    queued = 0;
+    nextQueue = 0;
+    stop = false;
+    pthread_key_create(&workerKey, NULL);
+    queues.resize(threads);
+    for (int i = 0; i < threads; ++i)
+        queues[i] = new WorkerQueue;
+    ids = new pthread_t[threads];
+    for (int i = 0; i < threads; ++i)
+    {
+        void ** args = new void*[2];
+        args[0] = this;
+        args[1] = (void *)(size_t)i;
+        if (pthread_create(ids + i, NULL, _poolThreadMain, (void *) args) != 0)
+        {
+            std::cerr << "ThreadPool: can't create threads." << std::endl;
+            exit(1);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    idle.lock();
+    stop = true;
+    idle.broadcast();
+    idle.unlock();
+    for (int i = 0; i < threads; ++i)
+        pthread_join(ids[i], NULL);
+    for (int i = 0; i < threads; ++i)
+        delete queues[i];
+    delete[] ids;
+    pthread_key_delete(workerKey);
+}
+
+ThreadPool & ThreadPool::getInstance()
+{
+    static pthread_mutex_t instanceMutex = PTHREAD_MUTEX_INITIALIZER;
+    static ThreadPool * instance = NULL;
+    pthread_mutex_lock(&instanceMutex);
+    if (instance == NULL)
+        instance = new ThreadPool();
+    pthread_mutex_unlock(&instanceMutex);
+    return *instance;
+}
+
+int ThreadPool::getNumberOfCores()
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int) cores : 1;
+}
+
+int ThreadPool::getWorkerIndex()
+{
+    return (int)(size_t) pthread_getspecific(workerKey) - 1;
+}
+
+void ThreadPool::submit(ThreadPoolTask * task, TaskFuture * future)
+{
+    PoolJob job;
+    job.task = task;
+    job.future = future;
+    if (future != NULL)
+    {
+        future->condition.lock();
+        future->pending++;
+        future->pool = this;
+        future->condition.unlock();
+    }
+
+    // Workers keep their own tasks, external threads go round robin
+    int worker = getWorkerIndex();
+    size_t q;
+    idle.lock();
+    q = (worker >= 0) ? worker : (nextQueue++) % threads;
+    idle.unlock();
+
+    WorkerQueue &queue = *queues[q];
+    queue.mutex.lock();
+    queue.jobs.push_back(job);
+    queue.mutex.unlock();
+
+    idle.lock();
+    queued++;
+    idle.signal();
+    idle.unlock();
+}
+
+bool ThreadPool::popJob(size_t q, bool own, TaskFuture * future, PoolJob &job)
+{
+    WorkerQueue &queue = *queues[q];
+    bool found = false;
+    queue.mutex.lock();
+    if (future == NULL)
+    {
+        if (!queue.jobs.empty())
+        {
+            if (own)
+            {
+                job = queue.jobs.back();
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                job = queue.jobs.front();
+                queue.jobs.pop_front();
+            }
+            found = true;
+        }
+    }
+    else
+    {
+        for (std::deque<PoolJob>::iterator it = queue.jobs.begin(); it != queue.jobs.end(); ++it)
+            if (it->future == future)
+            {
+                job = *it;
+                queue.jobs.erase(it);
+                found = true;
+                break;
+            }
+    }
+    queue.mutex.unlock();
+    if (found)
+    {
+        idle.lock();
+        queued--;
+        idle.unlock();
+    }
+    return found;
+}
+
+bool ThreadPool::findJob(int worker, TaskFuture * future, PoolJob &job)
+{
+    if (worker >= 0 && popJob(worker, true, future, job))
+        return true;
+    // Steal from the other queues
+    size_t start = (worker >= 0) ? worker + 1 : 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        size_t q = (start + i) % threads;
+        if ((int)q != worker && popJob(q, false, future, job))
+            return true;
+    }
+    return false;
+}
+
+void ThreadPool::execute(PoolJob &job)
+{
+    try
+    {
+        job.task->run();
+    }
+    catch (XmippError &xe)
+    {
+        std::cerr << xe << std::endl
+        << "In thread pool task" << std::endl;
+        exit(-1);
+    }
+    if (job.future != NULL)
+    {
+        TaskFuture &future = *job.future;
+        future.condition.lock();
+        if (--future.pending == 0)
+            future.condition.broadcast();
+        future.condition.unlock();
+    }
+}
+
+bool ThreadPool::runPendingTask(TaskFuture * future)
+{
+    PoolJob job;
+    if (!findJob(getWorkerIndex(), future, job))
+        return false;
+    execute(job);
+    return true;
+}
+
+void * _poolThreadMain(void * data)
+{
+    void ** args = (void **) data;
+    ThreadPool * pool = (ThreadPool *) args[0];
+    int worker = (int)(size_t) args[1];
+    delete[] args;
+    pthread_setspecific(pool->workerKey, (void *)(size_t)(worker + 1));
+
+    ThreadPool::PoolJob job;
+    while (true)
+    {
+        if (pool->findJob(worker, NULL, job))
+        {
+            pool->execute(job);
+            continue;
+        }
+        pool->idle.lock();
+        while (pool->queued == 0 && !pool->stop)
+            pool->idle.wait();
+        bool exitNow = pool->stop && pool->queued == 0;
+        pool->idle.unlock();
+        if (exitNow)
+            break;
+    }
+    return NULL;
+}
+
+/** Task used by parallelFor, each one keeps asking chunks
+ * to the distributor until the range is exhausted. */
+class ParallelForTask: public ThreadPoolTask
+{
+public:
+    ThreadPool * pool;
+    ThreadTaskDistributor * distributor;
+    ParallelForBody * body;
+    size_t offset;
+
+    void run()
+    {
+        int worker = pool->getWorkerIndex();
+        int thread_id = (worker >= 0) ? worker : pool->getNumberOfThreads();
+        size_t first, last;
+        while (distributor->getTasks(first, last))
+            (*body)(offset + first, offset + last, thread_id);
+    }
+};
+
+void ThreadPool::parallelFor(size_t first, size_t last, ParallelForBody &body,
+                             size_t grainSize, int maxThreads)
+{
+    if (last < first)
+        return;
+    size_t n = last - first + 1;
+    int workers = threads + 1; // The caller also works
+    if (maxThreads > 0 && maxThreads < workers)
+        workers = maxThreads;
+    if (grainSize == 0)
+        grainSize = XMIPP_MAX(n / (4 * workers), 1);
+    grainSize = XMIPP_MIN(grainSize, n);
+
+    // Too small to be worth distributing
+    if (workers == 1 || grainSize == n)
+    {
+        int worker = getWorkerIndex();
+        body(first, last, (worker >= 0) ? worker : threads);
+        return;
+    }
+
+    ThreadTaskDistributor distributor(n, grainSize);
+    size_t nchunks = (n + grainSize - 1) / grainSize;
+    size_t ntasks = XMIPP_MIN((size_t)workers, nchunks);
+    std::vector<ParallelForTask> tasks(ntasks);
+    TaskFuture future;
+    for (size_t i = 0; i < ntasks; ++i)
+    {
+        ParallelForTask &task = tasks[i];
+        task.pool = this;
+        task.distributor = &distributor;
+        task.body = &body;
+        task.offset = first;
+        submit(&task, &future);
+    }
+    future.wait();
+}
+
+int TaskGraph::addTask(ThreadPoolTask * task)
+{
+    Node node;
+    node.graph = this;
+    node.task = task;
+    node.dependencies = 0;
+    node.remaining = 0;
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+void TaskGraph::addDependency(int before, int after)
+{
+    if (before < 0 || after < 0 || before >= (int)nodes.size() || after >= (int)nodes.size())
+        REPORT_ERROR(ERR_INDEX_OUTOFBOUNDS, "TaskGraph::addDependency: unknown task");
+    nodes[before].successors.push_back(after);
+    nodes[after].dependencies++;
+}
+
+void TaskGraph::Node::run()
+{
+    task->run();
+    // Release the tasks waiting for this one
+    for (size_t i = 0; i < successors.size(); ++i)
+    {
+        Node &next = graph->nodes[successors[i]];
+        graph->mutex.lock();
+        bool ready = (--next.remaining == 0);
+        graph->mutex.unlock();
+        if (ready)
+            graph->pool->submit(&next, graph->future);
+    }
+}
+
+void TaskGraph::run(ThreadPool * pool)
+{
+    this->pool = (pool != NULL) ? pool : &ThreadPool::getInstance();
+    TaskFuture done;
+    future = &done;
+    size_t n = nodes.size();
+    std::vector<int> ready;
+    for (size_t i = 0; i < n; ++i)
+    {
+        nodes[i].remaining = nodes[i].dependencies;
+        if (nodes[i].dependencies == 0)
+            ready.push_back(i);
+    }
+    if (ready.empty() && n > 0)
+        REPORT_ERROR(ERR_VALUE_INCORRECT, "TaskGraph::run: the graph has cycles");
+    for (size_t i = 0; i < ready.size(); ++i)
+        this->pool->submit(&nodes[ready[i]], future);
+    future->wait();
+    future = NULL;
+    for (size_t i = 0; i < n; ++i)
+        if (nodes[i].remaining != 0)
+            REPORT_ERROR(ERR_VALUE_INCORRECT, "TaskGraph::run: the graph has cycles");
+}
+
 // =================== OLD THREADS IMPLEMENTATION ============================
 int barrier_init(barrier_t *barrier,int needed)
 {
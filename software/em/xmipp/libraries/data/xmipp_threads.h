@@ -29,6 +29,8 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <deque>
+#include <vector>
 
 class ThreadManager;
 class ThreadArgument;
@@ -466,6 +468,249 @@ public:
 }
 ;//end of class ThreadTaskDistributor
 
+/** Base class for the units of work executed by a ThreadPool.
+ * Subclasses implement run(). The pool never takes ownership of the
+ * task, so the caller must keep it alive until the associated
+ * TaskFuture reports completion.
+ */
+class ThreadPoolTask
+{
+public:
+    virtual ~ThreadPoolTask()
+    {}
+    ;
+    /** Work to be done by the task */
+    virtual void run() = 0;
+}
+;//end of class ThreadPoolTask
+
+/** Task wrapping a plain pthreads-like function.
+ * This is useful to move old code written as
+ * void * f(void * data) into the pool without rewriting it.
+ */
+class FunctionTask: public ThreadPoolTask
+{
+public:
+    void * (*function)(void *); ///< Function to call
+    void * data; ///< Argument passed to the function
+
+    FunctionTask(void * (*f)(void *) = NULL, void * d = NULL): function(f), data(d)
+    {}
+    virtual void run()
+    {
+        function(data);
+    }
+}
+;//end of class FunctionTask
+
+class ThreadPool;
+
+/** Completion counter for a group of tasks submitted to a ThreadPool.
+ * A future may be shared by any number of tasks; wait() returns
+ * when all of them have finished. While waiting, the calling thread
+ * executes pending tasks of the pool, so that nested parallel calls
+ * issued from inside a pool task never deadlock nor oversubscribe
+ * the machine.
+ */
+class TaskFuture
+{
+private:
+    size_t pending; ///< Tasks submitted and not finished yet
+    Condition condition; ///< Signaled when pending reaches 0
+    ThreadPool * pool; ///< Pool in which the tasks were submitted
+
+public:
+    /** Empty constructor */
+    TaskFuture();
+
+    /** True if all tasks have finished */
+    bool isDone();
+
+    /** Block until all tasks of this future have finished.
+     * The caller helps executing queued tasks meanwhile.
+     */
+    void wait();
+
+    friend class ThreadPool;
+}
+;//end of class TaskFuture
+
+/** Body of a parallel loop.
+ * Implement operator() to process the closed range [first, last].
+ * The same object is called concurrently from several threads,
+ * so any state modified in it should be indexed by thread_id or
+ * protected by a Mutex. thread_id goes from 0 to
+ * ThreadPool::getNumberOfThreads() included (the caller thread also works),
+ * so per thread buffers should have getNumberOfThreads()+1 elements.
+ */
+class ParallelForBody
+{
+public:
+    virtual ~ParallelForBody()
+    {}
+    ;
+    virtual void operator()(size_t first, size_t last, int thread_id) = 0;
+}
+;//end of class ParallelForBody
+
+/** Work stealing pool of persistent threads.
+ * Threads are created once and live until the pool is destroyed.
+ * Each worker owns a queue: tasks submitted from a worker are pushed
+ * into its own queue and taken in LIFO order, idle workers steal the
+ * oldest tasks from other queues. Tasks submitted from outside the pool
+ * are distributed round robin.
+ *
+ * Most code should use the process wide pool returned by getInstance(),
+ * so that different subsystems share the same threads.
+ * @code
+ * class ScaleRows: public ParallelForBody
+ * {
+ * public:
+ *     MultidimArray<double> *V;
+ *     void operator()(size_t first, size_t last, int thread_id)
+ *     {
+ *         for (size_t i = first; i <= last; ++i)
+ *             ...
+ *     }
+ * };
+ *
+ * ScaleRows body;
+ * body.V = &V;
+ * ThreadPool::getInstance().parallelFor(0, YSIZE(V) - 1, body);
+ * @endcode
+ */
+class ThreadPool
+{
+private:
+    struct PoolJob
+    {
+        ThreadPoolTask * task;
+        TaskFuture * future;
+    };
+    struct WorkerQueue
+    {
+        Mutex mutex;
+        std::deque<PoolJob> jobs;
+    };
+
+    int threads; ///< Number of working threads
+    pthread_t * ids; ///< pthreads identifiers
+    std::vector<WorkerQueue *> queues; ///< One queue per worker
+    Condition idle; ///< Workers sleep here when there is no work
+    size_t queued; ///< Total number of queued jobs, protected by idle
+    size_t nextQueue; ///< Round robin counter for external submissions
+    bool stop; ///< Tell workers to exit
+    pthread_key_t workerKey; ///< Index+1 of the worker running in this thread
+
+    /** Take a job from queue q. Own queue pops from the back,
+     * foreign queues from the front. If future is not NULL only
+     * jobs of that future are taken. */
+    bool popJob(size_t q, bool own, TaskFuture * future, PoolJob &job);
+
+    /** Find a job for the given worker (-1 for external threads) */
+    bool findJob(int worker, TaskFuture * future, PoolJob &job);
+
+    /** Execute a job and notify its future */
+    void execute(PoolJob &job);
+
+    friend void * _poolThreadMain(void * data);
+
+public:
+    /** Constructor. numberOfThreads <= 0 uses all available cores. */
+    ThreadPool(int numberOfThreads = 0);
+
+    /** Destructor. Pending tasks are finished before exiting. */
+    ~ThreadPool();
+
+    /** Process wide pool with one thread per available core. */
+    static ThreadPool & getInstance();
+
+    /** Number of available cores in this machine */
+    static int getNumberOfCores();
+
+    /** Number of working threads */
+    int getNumberOfThreads() const
+    {
+        return threads;
+    }
+
+    /** Index of the pool worker running the caller, -1 if the caller
+     * is not a worker of this pool. */
+    int getWorkerIndex();
+
+    /** Queue a task. If future is not NULL, it is notified when
+     * the task finishes. The task is not copied, it should be alive
+     * until it is executed. */
+    void submit(ThreadPoolTask * task, TaskFuture * future = NULL);
+
+    /** Run one queued task in the calling thread.
+     * If future is not NULL, only tasks belonging to it are considered,
+     * this is what TaskFuture::wait does so that a waiting thread never
+     * starts unrelated work. Returns false if there was nothing to do. */
+    bool runPendingTask(TaskFuture * future = NULL);
+
+    /** Parallel loop over the closed range [first, last].
+     * The range is split in chunks of grainSize indexes (if 0, a size
+     * giving about 4 chunks per thread is chosen) that are handed
+     * dynamically to the pool workers and to the calling thread.
+     * maxThreads, if > 0, limits the number of threads working on the
+     * loop, to preserve the semantics of programs with an explicit
+     * --thr argument.
+     * The call returns when the whole range has been processed.
+     */
+    void parallelFor(size_t first, size_t last, ParallelForBody &body,
+                     size_t grainSize = 0, int maxThreads = 0);
+}
+;//end of class ThreadPool
+
+/** Main function of the ThreadPool workers */
+void * _poolThreadMain(void * data);
+
+/** Set of tasks with dependencies between them.
+ * Tasks are added with addTask and ordered with addDependency. When
+ * run, every task is submitted to the pool as soon as all the tasks it
+ * depends on have finished. The graph does not own the tasks.
+ * @code
+ * TaskGraph graph;
+ * int read = graph.addTask(&readTask);
+ * int fft = graph.addTask(&fftTask);
+ * int ctf = graph.addTask(&ctfTask);
+ * graph.addDependency(read, fft);
+ * graph.addDependency(read, ctf);
+ * graph.run();
+ * @endcode
+ */
+class TaskGraph
+{
+private:
+    class Node: public ThreadPoolTask
+    {
+    public:
+        TaskGraph * graph;
+        ThreadPoolTask * task;
+        std::vector<int> successors;
+        int dependencies; ///< Number of tasks this one depends on
+        int remaining; ///< Dependencies not satisfied yet
+        void run();
+    };
+    std::vector<Node> nodes;
+    Mutex mutex; ///< Protect remaining counters during execution
+    TaskFuture * future;
+    ThreadPool * pool;
+
+public:
+    /** Add a task and return its index in the graph */
+    int addTask(ThreadPoolTask * task);
+
+    /** Task after will not start until task before has finished */
+    void addDependency(int before, int after);
+
+    /** Execute all tasks respecting the dependencies and wait for them.
+     * If pool is NULL the process wide pool is used. */
+    void run(ThreadPool * pool = NULL);
+}
+;//end of class TaskGraph
+
 /** @name Old parallel stuff. */
 /** Barrier structure */
 //@{
@@ -24,6 +24,7 @@
  ***************************************************************************/
 
 #include "dimred_tools.h"
+#include <data/xmipp_threads.h>
 
 void GenerateData::generateNewDataset(const String& method, int N, double noise)
 {
@@ -189,29 +190,223 @@ void insertNeighbour(Matrix2D<int> &idx, Matrix2D<double> &distance, int i1, int
 	}
 }
 
+// Same as insertNeighbour, but candidates may come in any order. Ties are
+// solved by the index of the neighbour, so that the result is the same as
+// when the candidates are inserted in increasing index order.
+static void insertNeighbourSorted(Matrix2D<int> &idx, Matrix2D<double> &distance, int i1, int i2, double d)
+{
+	int K=MAT_XSIZE(idx);
+	int kInsert=K;
+	for (int k=K-1; k>=0; --k)
+	{
+		double dk=MAT_ELEM(distance,i1,k);
+		if (dk>d || (dk==d && MAT_ELEM(idx,i1,k)>i2))
+			kInsert=k;
+		else
+			break;
+	}
+	if (kInsert<K)
+	{
+		for (int kp=K-1; kp>kInsert; --kp)
+		{
+			int kp_1=kp-1;
+			MAT_ELEM(distance,i1,kp)=MAT_ELEM(distance,i1,kp_1);
+			MAT_ELEM(idx,i1,kp)=MAT_ELEM(idx,i1,kp_1);
+		}
+		MAT_ELEM(distance,i1,kInsert)=d;
+		MAT_ELEM(idx,i1,kInsert)=i2;
+	}
+}
+
+static inline double squaredEuclideanDistance(const Matrix2D<double> &X, size_t i1, size_t i2)
+{
+	const double *ptr1=&MAT_ELEM(X,i1,0), *ptr2=&MAT_ELEM(X,i2,0);
+	double d=0;
+	for (size_t j=0; j<MAT_XSIZE(X); ++j)
+	{
+		double diff=ptr1[j]-ptr2[j];
+		d+=diff*diff;
+	}
+	return d;
+}
+
+// Observations with at most this number of variables are searched with a kd-tree
+#define KNN_KDTREE_MAX_DIM 16
+// Maximum number of observations in the leaves of the kd-tree
+#define KNN_KDTREE_BUCKET 16
+
+/* Exact nearest neighbour search with a kd-tree for the Euclidean distance.
+ * Each node splits its observations by the median of the variable with
+ * the largest spread. */
+class KNNTree: public ParallelForBody
+{
+public:
+	struct Node
+	{
+		// Range of the observations in order
+		size_t first, last;
+		// Split variable (-1 for leaves), split value and children
+		int splitVariable;
+		double splitValue;
+		size_t left, right;
+	};
+	const Matrix2D<double> *X;
+	std::vector<size_t> order;
+	std::vector<Node> nodes;
+	Matrix2D<int> *idx;
+	Matrix2D<double> *distance;
+
+	struct CompareVariable
+	{
+		const Matrix2D<double> *X;
+		int variable;
+		bool operator()(size_t i1, size_t i2) const
+		{
+			return MAT_ELEM(*X,i1,variable)<MAT_ELEM(*X,i2,variable);
+		}
+	};
+
+	void build(const Matrix2D<double> &_X)
+	{
+		X=&_X;
+		order.resize(MAT_YSIZE(_X));
+		for (size_t i=0; i<order.size(); ++i)
+			order[i]=i;
+		nodes.clear();
+		buildNode(0,order.size());
+	}
+
+	size_t buildNode(size_t first, size_t last)
+	{
+		size_t n=nodes.size();
+		nodes.push_back(Node());
+		nodes[n].first=first;
+		nodes[n].last=last;
+		nodes[n].splitVariable=-1;
+		if (last-first<=KNN_KDTREE_BUCKET)
+			return n;
+
+		// Variable with the largest spread
+		int bestVariable=0;
+		double bestSpread=-1;
+		for (size_t j=0; j<MAT_XSIZE(*X); ++j)
+		{
+			double minVal=1e38, maxVal=-1e38;
+			for (size_t i=first; i<last; ++i)
+			{
+				double v=MAT_ELEM(*X,order[i],j);
+				minVal=std::min(minVal,v);
+				maxVal=std::max(maxVal,v);
+			}
+			if (maxVal-minVal>bestSpread)
+			{
+				bestSpread=maxVal-minVal;
+				bestVariable=j;
+			}
+		}
+		if (bestSpread<=0)
+			return n; // All observations are equal
+
+		size_t middle=(first+last)/2;
+		CompareVariable compare;
+		compare.X=X;
+		compare.variable=bestVariable;
+		std::nth_element(order.begin()+first,order.begin()+middle,order.begin()+last,compare);
+		nodes[n].splitVariable=bestVariable;
+		nodes[n].splitValue=MAT_ELEM(*X,order[middle],bestVariable);
+		size_t left=buildNode(first,middle);
+		size_t right=buildNode(middle,last);
+		nodes[n].left=left;
+		nodes[n].right=right;
+		return n;
+	}
+
+	void search(size_t node, size_t i1, const double *x)
+	{
+		const Node &nd=nodes[node];
+		if (nd.splitVariable<0)
+		{
+			for (size_t i=nd.first; i<nd.last; ++i)
+			{
+				size_t i2=order[i];
+				if (i2!=i1)
+					insertNeighbourSorted(*idx,*distance,i1,i2,squaredEuclideanDistance(*X,i1,i2));
+			}
+			return;
+		}
+		double diff=x[nd.splitVariable]-nd.splitValue;
+		size_t nearChild=(diff<0) ? nd.left : nd.right;
+		size_t farChild=(diff<0) ? nd.right : nd.left;
+		search(nearChild,i1,x);
+		// The other side may only contain closer observations (or as close,
+		// with a smaller index) if the split is not farther than the K-th one
+		if (diff*diff<=MAT_ELEM(*distance,i1,MAT_XSIZE(*distance)-1))
+			search(farChild,i1,x);
+	}
+
+	void operator()(size_t first, size_t last, int thread_id)
+	{
+		for (size_t i1=first; i1<=last; ++i1)
+			search(0,i1,&MAT_ELEM(*X,i1,0));
+	}
+};
+
+// Brute force search of the nearest neighbours of a set of rows
+class KNNBruteForce: public ParallelForBody
+{
+public:
+	const Matrix2D<double> *X;
+	DimRedDistance2 f;
+	Matrix2D<int> *idx;
+	Matrix2D<double> *distance;
+
+	void operator()(size_t first, size_t last, int thread_id)
+	{
+		for (size_t i1=first; i1<=last; ++i1)
+			for (size_t i2=0; i2<MAT_YSIZE(*X); ++i2)
+			{
+				if (i2==i1)
+					continue;
+				double d;
+				if (f==NULL)
+					d=squaredEuclideanDistance(*X,i1,i2);
+				else
+					d=(i1<i2) ? (*f)(*X,i1,i2) : (*f)(*X,i2,i1);
+				insertNeighbour(*idx,*distance,i1,i2,d);
+			}
+	}
+};
+
 void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
 {
 	K=std::min(K,(int)MAT_YSIZE(X)-1);
 	idx.initConstant(MAT_YSIZE(X),K,-1);
 	distance.initConstant(MAT_YSIZE(X),K,1e38);
-	for (size_t i1=0; i1<MAT_YSIZE(X)-1; ++i1)
-		for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
+	if (K>0)
+	{
+		// Each observation is searched independently, and the candidates
+		// are given to insertNeighbour in increasing index order (or with
+		// the same tie breaking), so that the result does not depend on the
+		// number of threads
+		ThreadPool &pool=ThreadPool::getInstance();
+		if (f==NULL && MAT_XSIZE(X)<=KNN_KDTREE_MAX_DIM)
 		{
-			// Compute the distance between i1 and i2
-			double d=0;
-			if (f==NULL)
-				for (int j=0; j<MAT_XSIZE(X); ++j)
-				{
-					double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
-					d+=diff*diff;
-				}
-			else
-				d=(*f)(X,i1,i2);
-
-			// Check if they are nearest neighbours
-			insertNeighbour(idx,distance,i1,i2,d);
-			insertNeighbour(idx,distance,i2,i1,d);
+			KNNTree tree;
+			tree.build(X);
+			tree.idx=&idx;
+			tree.distance=&distance;
+			pool.parallelFor(0,MAT_YSIZE(X)-1,tree);
 		}
+		else
+		{
+			KNNBruteForce search;
+			search.X=&X;
+			search.f=f;
+			search.idx=&idx;
+			search.distance=&distance;
+			pool.parallelFor(0,MAT_YSIZE(X)-1,search);
+		}
+	}
 	if (computeSqrt)
 		FOR_ALL_ELEMENTS_IN_MATRIX2D(distance)
 			MAT_ELEM(distance,i,j)=sqrt(MAT_ELEM(distance,i,j));
@@ -244,27 +439,46 @@ void computeRandomPointsDistance(const Matrix2D<double> &X, Matrix1D<double> &di
 	}
 }
 
+// Rows of the all vs all distance matrix
+class DistanceMatrixRows: public ParallelForBody
+{
+public:
+	const Matrix2D<double> *X;
+	Matrix2D<double> *distance;
+	DimRedDistance2 f;
+	bool computeSqrt;
+
+	void operator()(size_t first, size_t last, int thread_id)
+	{
+		for (size_t i1=first; i1<=last; ++i1)
+			for (size_t i2=i1+1; i2<MAT_YSIZE(*X); ++i2)
+			{
+				// Compute the distance between i1 and i2
+				double d;
+				if (f==NULL)
+					d=squaredEuclideanDistance(*X,i1,i2);
+				else
+					d=(*f)(*X,i1,i2);
+
+				if (computeSqrt)
+					d=sqrt(d);
+				MAT_ELEM(*distance,i2,i1)=MAT_ELEM(*distance,i1,i2)=d;
+			}
+	}
+};
+
 void computeDistance(const Matrix2D<double> &X, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
 {
 	distance.initZeros(MAT_YSIZE(X),MAT_YSIZE(X));
-	for (size_t i1=0; i1<MAT_YSIZE(X)-1; ++i1)
-		for (size_t i2=i1+1; i2<MAT_YSIZE(X); ++i2)
-		{
-			// Compute the distance between i1 and i2
-			double d=0;
-			if (f==NULL)
-				for (int j=0; j<MAT_XSIZE(X); ++j)
-				{
-					double diff=MAT_ELEM(X,i1,j)-MAT_ELEM(X,i2,j);
-					d+=diff*diff;
-				}
-			else
-				d=(*f)(X,i1,i2);
-
-			if (computeSqrt)
-				d=sqrt(d);
-			MAT_ELEM(distance,i2,i1)=MAT_ELEM(distance,i1,i2)=d;
-		}
+	if (MAT_YSIZE(X)<2)
+		return;
+	DistanceMatrixRows rows;
+	rows.X=&X;
+	rows.distance=&distance;
+	rows.f=f;
+	rows.computeSqrt=computeSqrt;
+	// Row i1 has N-i1-1 elements, small chunks balance the work
+	ThreadPool::getInstance().parallelFor(0,MAT_YSIZE(X)-2,rows,16);
 }
 
 void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f, bool computeSqrt)
@@ -280,6 +494,34 @@ void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<doub
 	}
 }
 
+void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, SparseMatrix2D &distance, DimRedDistance2 f, bool computeSqrt)
+{
+	Matrix2D<int> idx;
+	Matrix2D<double> kDistance;
+	kNearestNeighbours(X, K, idx, kDistance, f, computeSqrt);
+
+	// Both directions of each edge, mutual neighbours appear only once
+	std::vector<SparseElement> elements;
+	elements.reserve(2*MAT_XSIZE(idx)*MAT_YSIZE(idx));
+	SparseElement e;
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(kDistance)
+	{
+		e.i=i;
+		e.j=MAT_ELEM(idx,i,j);
+		e.value=MAT_ELEM(kDistance,i,j);
+		elements.push_back(e);
+		std::swap(e.i,e.j);
+		elements.push_back(e);
+	}
+	std::sort(elements.begin(),elements.end());
+	size_t Nunique=0;
+	for (size_t n=0; n<elements.size(); ++n)
+		if (Nunique==0 || elements[Nunique-1].i!=elements[n].i || elements[Nunique-1].j!=elements[n].j)
+			elements[Nunique++]=elements[n];
+	elements.resize(Nunique);
+	distance=SparseMatrix2D(elements,MAT_YSIZE(X));
+}
+
 void computeSimilarityMatrix(Matrix2D<double> &D2, double sigma, bool skipZeros, bool normalize)
 {
 	double maxDistance=1.0;
@@ -311,6 +553,47 @@ void computeGraphLaplacian(const Matrix2D<double> &G, Matrix2D<double> &L)
 			MAT_ELEM(L,i,j)=-MAT_ELEM(G,i,j);
 }
 
+void computeSimilarityMatrix(SparseMatrix2D &D2, double sigma, bool normalize)
+{
+	double maxDistance=1.0;
+	if (normalize)
+		maxDistance=D2.values.computeMax();
+	double K=-0.5/(sigma*sigma*maxDistance);
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(D2.values)
+		DIRECT_MULTIDIM_ELEM(D2.values,n)=exp(DIRECT_MULTIDIM_ELEM(D2.values,n)*K);
+}
+
+void computeGraphLaplacian(const SparseMatrix2D &G, SparseMatrix2D &L)
+{
+	std::vector<SparseElement> elements;
+	elements.reserve(XSIZE(G.values)+G.N);
+	SparseElement e;
+	for (int i=0; i<G.N; ++i)
+	{
+		int rowBeg, rowEnd;
+		G.getRowRange(i,rowBeg,rowEnd);
+		double d=0, gii=0;
+		e.i=i;
+		for (int n=rowBeg; n<rowEnd; ++n)
+		{
+			e.j=DIRECT_MULTIDIM_ELEM(G.jIdx,n)-1;
+			double gij=DIRECT_MULTIDIM_ELEM(G.values,n);
+			d+=gij;
+			if ((int)e.j==i)
+				gii=gij;
+			else
+			{
+				e.value=-gij;
+				elements.push_back(e);
+			}
+		}
+		e.j=i;
+		e.value=d-gii;
+		elements.push_back(e);
+	}
+	L=SparseMatrix2D(elements,G.N);
+}
+
 double intrinsicDimensionalityMLE(const Matrix2D<double> &X, DimRedDistance2 f)
 {
 	int k1=5;
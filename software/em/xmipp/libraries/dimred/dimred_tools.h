@@ -27,6 +27,7 @@
 
 #include <data/matrix2d.h>
 #include <data/matrix1d.h>
+#include <data/sparse_matrix2d.h>
 
 /**@defgroup DimRedTools Tools for dimensionality reduction
    @ingroup DimRedLibrary */
@@ -86,17 +87,36 @@ void computeRandomPointsDistance(const Matrix2D<double> &X, Matrix1D<double> &di
  */
 void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true);
 
+/** Sparse graph of the distances to the K nearest neighbours.
+ * Same as the dense version, but only the nonzero distances are stored,
+ * so that it can be used with hundreds of thousands of observations.
+ */
+void computeDistanceToNeighbours(const Matrix2D<double> &X, int K, SparseMatrix2D &distance, DimRedDistance2 f=NULL, bool computeSqrt=true);
+
 /** Compute a similarity matrix from a squared distance matrix.
  * dij=exp(-dij/(2*sigma^2))
  * The distance matrix can be previously normalized so that the maximum distance is 1
  */
 void computeSimilarityMatrix(Matrix2D<double> &D2, double sigma, bool skipZeros=false, bool normalize=false);
 
+/** Compute a similarity matrix from a sparse squared distance matrix.
+ * As the dense version with skipZeros=true.
+ */
+void computeSimilarityMatrix(SparseMatrix2D &D2, double sigma, bool normalize=false);
+
 /** Compute graph laplacian.
  * L=D-G where D is a diagonal matrix with the row sums of G.
  */
 void computeGraphLaplacian(const Matrix2D<double> &G, Matrix2D<double> &L);
 
+/** Compute the graph laplacian of a sparse graph. */
+void computeGraphLaplacian(const SparseMatrix2D &G, SparseMatrix2D &L);
+
+/** Number of observations from which the neighbourhood graphs of
+ * LaplacianEigenmap and LPP are handled as sparse matrices.
+ */
+#define DIMRED_SPARSE_GRAPH_SIZE 5000
+
 /** Estimate the intrinsic dimensionality.
  * Performs an estimation of the intrinsic dimensionality of dataset X based
  * on the method specified by method. Possible values for method are 'CorrDim'
@@ -121,6 +141,9 @@ double intrinsicDimensionality(Matrix2D<double> &X, const String &method="MLE",
  * The element i,j of the output matrices is the index(distance) of the j-th nearest neighbor to the i-th sample.
  *
  * You can provide a distance function of your own. If not, Euclidean distance is used.
+ * With the Euclidean distance and few variables the neighbours are found with
+ * a kd-tree, otherwise all pairs are compared. In both cases observations are
+ * processed in parallel.
  */
 void kNearestNeighbours(const Matrix2D<double> &X, int K, Matrix2D<int> &idx, Matrix2D<double> &distance, DimRedDistance2 f=NULL, bool computeSqrt=true);
 
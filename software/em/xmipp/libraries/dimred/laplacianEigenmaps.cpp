@@ -34,6 +34,11 @@ void LaplacianEigenmap::setSpecificParameters(double sigma, size_t numberOfNeigh
 
 void LaplacianEigenmap::reduceDimensionality()
 {
+	if (MAT_YSIZE(*X)>DIMRED_SPARSE_GRAPH_SIZE)
+	{
+		reduceDimensionalitySparse();
+		return;
+	}
 	Matrix2D<double> G,L,D;
 	Matrix1D<double> mappedX;
 	//Construct neighborhood graph
@@ -50,3 +55,41 @@ void LaplacianEigenmap::reduceDimensionality()
 	generalizedEigs(L,D,mappedX,Y);
 	keepColumns(Y,1,(int)outputDim);
 }
+
+void LaplacianEigenmap::reduceDimensionalitySparse()
+{
+	//Construct neighborhood graph
+	SparseMatrix2D G;
+	computeDistanceToNeighbours(*X,numberOfNeighbours,G,distance,false);
+	//Compute Gaussian kernel(heat kernel based weights)
+	computeSimilarityMatrix(G,sigma,true);
+
+	//L*y=lambda*D*y is solved as D^-1/2*G*D^-1/2*z=(1-lambda)*z with y=D^-1/2*z,
+	//so that the smallest eigenvalues of L are the largest of the normalized G
+	int rowBeg, rowEnd;
+	Matrix1D<double> iSqrtDegree(G.N);
+	for (int i=0; i<G.N; ++i)
+	{
+		G.getRowRange(i,rowBeg,rowEnd);
+		double degree=0;
+		for (int n=rowBeg; n<rowEnd; ++n)
+			degree+=DIRECT_MULTIDIM_ELEM(G.values,n);
+		if (degree>0)
+			VEC_ELEM(iSqrtDegree,i)=1/sqrt(degree);
+	}
+	for (int i=0; i<G.N; ++i)
+	{
+		G.getRowRange(i,rowBeg,rowEnd);
+		for (int n=rowBeg; n<rowEnd; ++n)
+			DIRECT_MULTIDIM_ELEM(G.values,n)*=VEC_ELEM(iSqrtDegree,i)*
+				VEC_ELEM(iSqrtDegree,DIRECT_MULTIDIM_ELEM(G.jIdx,n)-1);
+	}
+
+	//Construct eigenmaps, the first eigenvector is constant and it is skipped
+	Matrix1D<double> mappedX;
+	Matrix2D<double> Z;
+	firstEigs(G,outputDim+1,mappedX,Z);
+	Y.resizeNoCopy(G.N,outputDim);
+	FOR_ALL_ELEMENTS_IN_MATRIX2D(Y)
+		MAT_ELEM(Y,i,j)=MAT_ELEM(Z,i,j+1)*VEC_ELEM(iSqrtDegree,i);
+}
@@ -45,6 +45,11 @@ public:
 
 	/// Reduce dimensionality
 	void reduceDimensionality();
+
+	/** Reduce dimensionality with a sparse neighbourhood graph.
+	 * Used for more than DIMRED_SPARSE_GRAPH_SIZE observations.
+	 */
+	void reduceDimensionalitySparse();
 };
 //@}
 #endif
@@ -36,20 +36,37 @@ void LPP::setSpecificParameters(int k, double sigma)
  */
 void LPP::reduceDimensionality()
 {
-	// Compute the distance to the k nearest neighbors
-	Matrix2D<double> D2;
-	computeDistanceToNeighbours(*X, k, D2, distance, false);
+	Matrix2D<double> DP, LP;
+	if (MAT_YSIZE(*X)>DIMRED_SPARSE_GRAPH_SIZE)
+	{
+		// Same computations with sparse matrices
+		SparseMatrix2D D2, L;
+		computeDistanceToNeighbours(*X, k, D2, distance, false);
+		computeSimilarityMatrix(D2,sigma,true);
+		computeGraphLaplacian(D2,L);
 
-	// Compute similarity matrix
-	computeSimilarityMatrix(D2,sigma,true,true);
+		Matrix2D<double> AX;
+		D2.multMM(*X,AX);
+		matrixOperation_AtB(*X,AX,DP);
+		L.multMM(*X,AX);
+		matrixOperation_AtB(*X,AX,LP);
+	}
+	else
+	{
+		// Compute the distance to the k nearest neighbors
+		Matrix2D<double> D2;
+		computeDistanceToNeighbours(*X, k, D2, distance, false);
 
-	// Compute graph laplacian
-	Matrix2D<double> L;
-	computeGraphLaplacian(D2,L);
+		// Compute similarity matrix
+		computeSimilarityMatrix(D2,sigma,true,true);
 
-	Matrix2D<double> DP, LP;
-	matrixOperation_XtAX_symmetric(*X,D2,DP);
-	matrixOperation_XtAX_symmetric(*X,L,LP);
+		// Compute graph laplacian
+		Matrix2D<double> L;
+		computeGraphLaplacian(D2,L);
+
+		matrixOperation_XtAX_symmetric(*X,D2,DP);
+		matrixOperation_XtAX_symmetric(*X,L,LP);
+	}
 
 	// Compute eigenvalues and eigenvectors resolving the generalized eigenvector problem
 	Matrix2D<double> Peigvec, eigvector;
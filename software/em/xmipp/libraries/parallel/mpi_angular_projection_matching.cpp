@@ -23,6 +23,7 @@
  *  e-mail address 'xmipp@cnb.csic.es'
  ***************************************************************************/
 
+#include <sys/mman.h>
 #include "mpi_angular_projection_matching.h"
 
 /*Some constast to message passing tags */
@@ -34,6 +35,9 @@ MpiProgAngularProjectionMatching::MpiProgAngularProjectionMatching()
 {
     imagesBuffer = NULL;
     last_chunk = NULL;
+    nodeComm = MPI_COMM_NULL;
+    sharedGallery = NULL;
+    sharedGallerySize = 0;
 }
 /* Destructor */
 MpiProgAngularProjectionMatching::~MpiProgAngularProjectionMatching()
@@ -43,6 +47,10 @@ MpiProgAngularProjectionMatching::~MpiProgAngularProjectionMatching()
         delete[] imagesBuffer;
         delete[] last_chunk;
     }
+    if (sharedGallery != NULL)
+        munmap(sharedGallery, sharedGallerySize);
+    if (nodeComm != MPI_COMM_NULL)
+        MPI_Comm_free(&nodeComm);
     delete node; //this calls MPI_Finalize
 }
 
@@ -236,12 +244,87 @@ void MpiProgAngularProjectionMatching::writeOutputFiles()
 void MpiProgAngularProjectionMatching::produceSideInfo()
 {
     ProgAngularProjectionMatching::produceSideInfo();
+    createSharedGallery();
 
     if (node->isMaster())
         computeChunks();
     node->barrierWait();
 }
 
+void MpiProgAngularProjectionMatching::createSharedGallery()
+{
+    // Group the processes running in the same computer
+    char name[MPI_MAX_PROCESSOR_NAME];
+    int length;
+    memset(name, 0, MPI_MAX_PROCESSOR_NAME);
+    MPI_Get_processor_name(name, &length);
+    std::vector<char> names(node->size * MPI_MAX_PROCESSOR_NAME);
+    MPI_Allgather(name, MPI_MAX_PROCESSOR_NAME, MPI_CHAR, &names[0],
+                  MPI_MAX_PROCESSOR_NAME, MPI_CHAR, MPI_COMM_WORLD);
+    int color = 0;
+    while (strncmp(&names[color * MPI_MAX_PROCESSOR_NAME], name, MPI_MAX_PROCESSOR_NAME) != 0)
+        ++color;
+    MPI_Comm_split(MPI_COMM_WORLD, color, (int)node->rank, &nodeComm);
+    MPI_Comm_rank(nodeComm, &nodeRank);
+    MPI_Comm_size(nodeComm, &nodeSize);
+
+    // All the processes of the computer take the same decision
+    if ((double)max_nr_imgs_in_memory * nodeSize < total_nr_refs)
+        return;
+
+    // The first process creates a file in memory that all of them map
+    sharedGallerySize = (size_t)total_nr_refs * galleryStride * sizeof(double);
+    char fnGallery[256];
+    int fd = -1, created = 1;
+    if (nodeRank == 0)
+    {
+        strcpy(fnGallery, "/dev/shm/xmipp_gallery_XXXXXX");
+        fd = mkstemp(fnGallery);
+        if (fd == -1 || posix_fallocate(fd, 0, sharedGallerySize) != 0)
+            created = 0;
+    }
+    MPI_Bcast(&created, 1, MPI_INT, 0, nodeComm);
+    if (!created)
+    {
+        if (fd != -1)
+        {
+            close(fd);
+            unlink(fnGallery);
+        }
+        return;
+    }
+    MPI_Bcast(fnGallery, sizeof(fnGallery), MPI_CHAR, 0, nodeComm);
+    if (nodeRank != 0)
+        fd = open(fnGallery, O_RDWR);
+    void *ptr = MAP_FAILED;
+    if (fd != -1)
+    {
+        ptr = mmap(NULL, sharedGallerySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    int mapped = (ptr != MAP_FAILED), allMapped;
+    MPI_Allreduce(&mapped, &allMapped, 1, MPI_INT, MPI_MIN, nodeComm);
+    // The memory is released when the last process unmaps it
+    if (nodeRank == 0)
+        unlink(fnGallery);
+    if (!allMapped)
+    {
+        if (mapped)
+            munmap(ptr, sharedGallerySize);
+        return;
+    }
+    sharedGallery = (double *)ptr;
+
+    fillGallery(sharedGallery, nodeRank, nodeSize);
+    MPI_Barrier(nodeComm);
+    setGallery(sharedGallery);
+    max_nr_imgs_in_memory = XMIPP_MAX(max_nr_imgs_in_memory, total_nr_refs);
+
+    if (verbose)
+        std::cout << "Reference gallery shared by " << nodeSize
+        << " processes per computer (" << sharedGallerySize / (1024 * 1024) << " Mb)" << std::endl;
+}
+
 void MpiProgAngularProjectionMatching::computeChunks()
 {
 	size_t max_number_of_images_in_around_a_sampling_point = 0;
@@ -65,6 +65,15 @@ private:
     /** For infinite groups symmetry order*/
     int sym_order;
 
+    /** Communicator of the processes running in the same computer */
+    MPI_Comm nodeComm;
+    /** Rank in nodeComm and number of processes in the computer */
+    int nodeRank, nodeSize;
+    /** Reference gallery shared by the processes of the computer */
+    double *sharedGallery;
+    /** Size in bytes of the shared gallery */
+    size_t sharedGallerySize;
+
 public:
     /** Redefine read */
     void read(int argc, char** argv);
@@ -93,6 +102,13 @@ public:
 
     /** Redefine produceSideInfo */
     void produceSideInfo();
+    /** Compute the reference gallery once per computer in shared memory.
+     * The processes of each computer compute different references of the
+     * gallery. If the gallery does not fit in the memory of all of them
+     * (--mem for each process) or the shared memory cannot be created,
+     * each process reads the references on demand as in the sequential
+     * program. */
+    void createSharedGallery();
     /** These two function will be executed only by master */
     void computeChunks();
     void computeChunkAngularDistance(int symmetry, int sym_order);
@@ -66,55 +66,21 @@ void MpiProgImageRotationalPCA::comunicateMatrix(Matrix2D<double> &W)
     MPI_Bcast(&MAT_ELEM(W,0,0),MAT_XSIZE(W)*MAT_YSIZE(W),MPI_DOUBLE,0,MPI_COMM_WORLD);
 }
 
-void MpiProgImageRotationalPCA::createMutexes(size_t Nimgs)
+void MpiProgImageRotationalPCA::createTaskDistributor(size_t Nimgs)
 {
-  fileMutex = new MpiFileMutex(node);
-  threadMutex = new Mutex();
-  taskDistributor = new MpiTaskDistributor(Nimgs, XMIPP_MAX(1,Nimgs/(5*node->size)), node);
+  taskDistributor = new MpiTaskDistributor(Nimgs, XMIPP_MAX(1,Nimgs/(5*node->size*Nthreads)), node);
 }
 
-/** Last part of function applyT */
-void  MpiProgImageRotationalPCA::allReduceApplyT(Matrix2D<double> &Wnode_0)
+/** Sum the PCA accumulators of all nodes */
+void MpiProgImageRotationalPCA::allReducePass()
 {
-    MPI_Allreduce(MPI_IN_PLACE, MATRIX2D_ARRAY(Wnode_0), MAT_XSIZE(Wnode_0)*MAT_YSIZE(Wnode_0),
+    MPI_Allreduce(MPI_IN_PLACE, &(pca.accumulator[0]), pca.accumulator.size(),
         MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
 }
 
-void MpiProgImageRotationalPCA::comunicateQrDim(int &qrDim)
+void MpiProgImageRotationalPCA::writeBasis()
 {
   if (IS_MASTER)
-    ProgImageRotationalPCA::comunicateQrDim(qrDim);
+    ProgImageRotationalPCA::writeBasis();
   node->barrierWait();
-  MPI_Bcast(&qrDim,1,MPI_INT,0,MPI_COMM_WORLD);
 }
-
-void MpiProgImageRotationalPCA::mapMatrix(int qrDim)
-{
-// Load the first qrDim columns of F in matrix H
-  if (IS_MASTER)
-  {
-    ProgImageRotationalPCA::mapMatrix(qrDim);
-    node->barrierWait();
-  }
-  else
-  {
-    node->barrierWait();
-    H.mapToFile(fnRoot+"_matrixH.raw",MAT_XSIZE(F),qrDim);
-  }
-}
-
-void MpiProgImageRotationalPCA::applySVD()
-{
-  if (IS_MASTER)
-    ProgImageRotationalPCA::applySVD();
-  node->barrierWait();
-}
-
-// Copy H to F ============================================================
-void MpiProgImageRotationalPCA::copyHtoF(int block)
-{
-  if (IS_MASTER)
-    ProgImageRotationalPCA::copyHtoF(block);
-  node->barrierWait();
-}
-
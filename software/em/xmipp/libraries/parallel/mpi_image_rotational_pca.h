@@ -39,7 +39,6 @@ class MpiProgImageRotationalPCA: public ProgImageRotationalPCA
 public:
     // Mpi node
     MpiNode *node;
-    // H buffer
 
     /// Empty constructor
     MpiProgImageRotationalPCA(int argc, char **argv);
@@ -53,23 +52,14 @@ public:
     /** Comunicate matrix, only meanful for MPI */
     virtual void comunicateMatrix(Matrix2D<double> &W);
 
-    /** Create mutexes and distributor */
-    virtual void createMutexes(size_t Nimgs);
+    /** Create task distributor */
+    virtual void createTaskDistributor(size_t Nimgs);
 
-    /** Last part of function applyT */
-    virtual void allReduceApplyT(Matrix2D<double> &Wnode_0);
+    /** Sum the PCA accumulators of all nodes */
+    virtual void allReducePass();
 
-    /** Comunicate int param */
-    virtual void comunicateQrDim(int &qrDim);
-
-    /** Map matrix */
-    virtual void mapMatrix(int qrDim);
-
-    /** Apply SVD */
-    virtual void applySVD();
-
-    /** Copy H to F. */
-    virtual void copyHtoF(int block);
+    /** Write the eigenimages */
+    virtual void writeBasis();
 };
 //@}
 #endif
@@ -68,6 +68,9 @@ void ProgMPIRecFourier::readParams()
 {
     ProgRecFourier::readParams();
     mpi_job_size=getIntParam("--mpi_job_size");
+    if (!fn_accumulators.empty() || !fn_accumulator_out.empty() || noFinalize || updateEvery > 0)
+        REPORT_ERROR(ERR_ARG_INCORRECT, "Incremental reconstruction options are not available with MPI, "
+                     "save the accumulators of independent runs and merge them with xmipp_reconstruct_fourier");
 }
 
 /* Pre Run PreRun for all nodes but not for all works */
@@ -300,6 +303,7 @@ void ProgMPIRecFourier::run()
             barrier_init( &barrier, numThreads+1);
             pthread_mutex_init( &workLoadMutex, NULL );
             statusArray = NULL;
+            imageDistributor = NULL;
             th_ids = (pthread_t *)malloc(numThreads * sizeof(pthread_t));
             th_args = (ImageThreadParams *)malloc(numThreads * sizeof(ImageThreadParams));
 
@@ -35,6 +35,7 @@ ProgAngularContinuousAssign2::ProgAngularContinuousAssign2()
     each_image_produces_an_output = true;
     projector = NULL;
     ctfImage = NULL;
+    invalidateCostCache();
 }
 
 ProgAngularContinuousAssign2::~ProgAngularContinuousAssign2()
@@ -218,21 +219,42 @@ void ProgAngularContinuousAssign2::updateCTFImage(double defocusU, double defocu
 	if (phaseFlipped)
 		FOR_ALL_ELEMENTS_IN_ARRAY2D(*ctfImage)
 			A2D_ELEM(*ctfImage,i,j)=fabs(A2D_ELEM(*ctfImage,i,j));
+	validCTFImage=true;
+	validProjection=false;
+}
+
+void ProgAngularContinuousAssign2::invalidateCostCache()
+{
+	validCTFImage=false;
+	validProjection=false;
+	validTransformedImage=false;
 }
 
 //#define DEBUG
 double tranformImage(ProgAngularContinuousAssign2 *prm, double rot, double tilt, double psi,
 		double a, double b, Matrix2D<double> &A, double deltaDefocusU, double deltaDefocusV, double deltaDefocusAngle, int degree)
 {
+	// The cost is computed in stages, each one is only recomputed if its
+	// parameters change: CTF image (defoci), projection (angles and CTF)
+	// and transformed experimental image (shift and scale). The gray values
+	// only enter in the final comparison.
     if (prm->hasCTF)
     {
     	double defocusU=prm->old_defocusU+deltaDefocusU;
     	double defocusV=prm->old_defocusV+deltaDefocusV;
     	double angle=prm->old_defocusAngle+deltaDefocusAngle;
-    	if (defocusU!=prm->currentDefocusU || defocusV!=prm->currentDefocusV || angle!=prm->currentAngle)
+    	if (!prm->validCTFImage || defocusU!=prm->currentDefocusU || defocusV!=prm->currentDefocusV || angle!=prm->currentAngle)
     		prm->updateCTFImage(defocusU,defocusV,angle);
     }
-	projectVolume(*(prm->projector), prm->P, (int)XSIZE(prm->I()), (int)XSIZE(prm->I()),  rot, tilt, psi, (const MultidimArray<double> *)prm->ctfImage);
+    if (!prm->validProjection || rot!=prm->projRot || tilt!=prm->projTilt || psi!=prm->projPsi)
+    {
+    	projectVolume(*(prm->projector), prm->P, (int)XSIZE(prm->I()), (int)XSIZE(prm->I()),  rot, tilt, psi,
+    			prm->hasCTF ? (const MultidimArray<double> *)prm->ctfImage : NULL);
+    	prm->projRot=rot;
+    	prm->projTilt=tilt;
+    	prm->projPsi=psi;
+    	prm->validProjection=true;
+    }
     double cost=0;
 	if (prm->old_flip)
 	{
@@ -241,39 +263,35 @@ double tranformImage(ProgAngularContinuousAssign2 *prm, double rot, double tilt,
 		MAT_ELEM(A,0,2)*=-1;
 	}
 
-	applyGeometry(degree,prm->Ifilteredp(),prm->Ifiltered(),A,IS_NOT_INV,DONT_WRAP,0.);
-	const MultidimArray<double> &mP=prm->P();
 	const MultidimArray<int> &mMask2D=prm->mask2D;
 	MultidimArray<double> &mIfilteredp=prm->Ifilteredp();
+	if (!prm->validTransformedImage || !A.equal(prm->transformedA,0.))
+	{
+		applyGeometry(degree,mIfilteredp,prm->Ifiltered(),A,IS_NOT_INV,DONT_WRAP,0.);
+		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mMask2D)
+			if (!DIRECT_MULTIDIM_ELEM(mMask2D,n))
+				DIRECT_MULTIDIM_ELEM(mIfilteredp,n)=0;
+		prm->transformedA=A;
+		prm->validTransformedImage=true;
+	}
+	const MultidimArray<double> &mP=prm->P();
 	MultidimArray<double> &mE=prm->E();
 	mE.initZeros();
 	if (prm->contCost==CONTCOST_L1)
 	{
 		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mMask2D)
-		{
 			if (DIRECT_MULTIDIM_ELEM(mMask2D,n))
 			{
-				DIRECT_MULTIDIM_ELEM(mIfilteredp,n)=DIRECT_MULTIDIM_ELEM(mIfilteredp,n);
 				double val=(a*DIRECT_MULTIDIM_ELEM(mP,n)+b)-DIRECT_MULTIDIM_ELEM(mIfilteredp,n);
 				DIRECT_MULTIDIM_ELEM(mE,n)=val;
 				cost+=fabs(val);
 			}
-			else
-				DIRECT_MULTIDIM_ELEM(mIfilteredp,n)=0;
-		}
 	}
 	else
 	{
 		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mMask2D)
-		{
 			if (DIRECT_MULTIDIM_ELEM(mMask2D,n))
-			{
-				double val=DIRECT_MULTIDIM_ELEM(mP,n)-DIRECT_MULTIDIM_ELEM(mIfilteredp,n);
-				DIRECT_MULTIDIM_ELEM(mE,n)=val;
-			}
-			else
-				DIRECT_MULTIDIM_ELEM(mIfilteredp,n)=0;
-		}
+				DIRECT_MULTIDIM_ELEM(mE,n)=DIRECT_MULTIDIM_ELEM(mP,n)-DIRECT_MULTIDIM_ELEM(mIfilteredp,n);
 	}
 	if (prm->contCost==CONTCOST_L1)
 		cost*=prm->iMask2Dsum;
@@ -406,6 +424,7 @@ void ProgAngularContinuousAssign2::processImage(const FileName &fnImg, const Fil
 	}
 	else
 		hasCTF=false;
+	invalidateCostCache();
 
 	if (verbose>=2)
 		std::cout << "Processing " << fnImg << std::endl;
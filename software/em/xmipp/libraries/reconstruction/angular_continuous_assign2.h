@@ -125,6 +125,16 @@ public:
 	double currentDefocusU, currentDefocusV, currentAngle;
 	// CTF image
 	MultidimArray<double> *ctfImage;
+	// The CTF image corresponds to the current defoci
+	bool validCTFImage;
+	// Parameters of the projection in P
+	double projRot, projTilt, projPsi;
+	// P is the projection of the current image with its parameters
+	bool validProjection;
+	// Geometry used to compute Ifilteredp
+	Matrix2D<double> transformedA;
+	// Ifilteredp is Ifiltered transformed with transformedA
+	bool validTransformedImage;
 public:
     /// Empty constructor
     ProgAngularContinuousAssign2();
@@ -156,6 +166,10 @@ public:
     /** Update CTF image */
     void updateCTFImage(double defocusU, double defocusV, double angle);
 
+    /** Discard the CTF image, projection and transformed image computed
+        for the previous image by the cost function */
+    void invalidateCostCache();
+
     /** Post process */
     void postProcess();
 };
@@ -26,6 +26,9 @@
 
 #include "angular_project_library.h"
 
+// Orientations projected at once with the Fourier projector
+#define ANGULAR_PROJECT_LIBRARY_BLOCK 64
+
 /* Empty constructor ------------------------------------------------------- */
 ProgAngularProjectLibrary::ProgAngularProjectLibrary()
 {
@@ -224,6 +227,44 @@ void ProgAngularProjectLibrary::project_angle_vector (int my_init, int my_end, b
         		                      maxFrequency,
         		                      BSplineDeg);
 
+    if (projType == FOURIER)
+    {
+        // The Fourier projector computes blocks of orientations in parallel
+        const size_t blockSize=ANGULAR_PROJECT_LIBRARY_BLOCK;
+        std::vector<double> blockRot, blockTilt, blockPsi;
+        std::vector<size_t> blockIdx;
+        std::vector< MultidimArray<double> > blockProjections;
+        for (double mypsi=0;mypsi<360;mypsi += psi_sampling)
+            for (int i=my_init;i<=my_end;i++)
+            {
+                blockPsi.push_back(mypsi+ZZ(mysampling.no_redundant_sampling_points_angles[i]));
+                blockTilt.push_back(YY(mysampling.no_redundant_sampling_points_angles[i]));
+                blockRot.push_back(XX(mysampling.no_redundant_sampling_points_angles[i]));
+                blockIdx.push_back((size_t) (numberStepsPsi * i + mypsi +1));
+                bool lastOne=(mypsi+psi_sampling>=360 && i==my_end);
+                if (blockRot.size()<blockSize && !lastOne)
+                    continue;
+
+                Vfourier->project(blockRot,blockTilt,blockPsi,blockProjections);
+                for (size_t k=0;k<blockRot.size();k++)
+                {
+                    P()=blockProjections[k];
+                    P.setEulerAngles(blockRot[k],blockTilt[k],blockPsi[k]);
+                    P.setDataMode(_DATA_ALL);
+                    P.write(output_file,blockIdx[k],true,WRITE_REPLACE);
+                }
+                if (verbose)
+                    progress_bar(i-my_init);
+                blockRot.clear();
+                blockTilt.clear();
+                blockPsi.clear();
+                blockIdx.clear();
+            }
+        if (verbose)
+            progress_bar(mySize);
+        return;
+    }
+
     for (double mypsi=0;mypsi<360;mypsi += psi_sampling)
     {
         for (int i=my_init;i<=my_end;i++)
@@ -280,6 +280,10 @@ void ProgAngularProjectionMatching::produceSideInfo()
         memory_per_ref += (double) fP.getSampleNo(i) * 2 * sizeof(double);
     }
     memory_per_ref += dim * dim * sizeof(double);
+    // Layout of a reference in a gallery: stddev, rings and image
+    fP_layout = fP;
+    galleryStride = 1 + (size_t) (memory_per_ref / sizeof(double));
+    gallery = NULL;
     max_nr_imgs_in_memory = ROUND( 1024 * 1024 * 1024 * avail_memory / memory_per_ref);
 
     // Set up angular sampling
@@ -401,15 +405,15 @@ void ProgAngularProjectionMatching::produceSideInfo()
     DFexp.findObjects(ids);
 }
 
-void ProgAngularProjectionMatching::getCurrentReference(int refno,
-        Polar_fftw_plans &local_plans)
+void ProgAngularProjectionMatching::computeReference(int refno,
+        Polar_fftw_plans &local_plans, MultidimArray<double> &proj,
+        Polar<std::complex <double> > &fP, double &stddev)
 {
     FileName                      fnt;
     Image<double>                 img;
-    double                        mean,stddev;
+    double                        mean;
     MultidimArray<double>         Maux;
     Polar<double>                 P;
-    Polar<std::complex <double> > fP;
     FourierTransformer                     local_transformer;
 
     // Image was not stored yet: read it from disc and store
@@ -483,6 +487,18 @@ void ProgAngularProjectionMatching::getCurrentReference(int refno,
     P -= mean;
     fourierTransformRings(P,fP,local_plans,true);
 
+    proj = img();
+}
+
+void ProgAngularProjectionMatching::getCurrentReference(int refno,
+        Polar_fftw_plans &local_plans)
+{
+    double                        stddev;
+    MultidimArray<double>         proj;
+    Polar<std::complex <double> > fP;
+
+    computeReference(refno, local_plans, proj, fP, stddev);
+
     pthread_mutex_lock(  &update_refs_in_memory_mutex );
 
     int counter = counter_refs_in_memory % max_nr_refs_in_memory;
@@ -497,7 +513,7 @@ void ProgAngularProjectionMatching::getCurrentReference(int refno,
     pointer_refsinmem2allrefs[counter] = refno;
     fP_ref[counter] = fP;
     stddev_ref[counter] = stddev;
-    proj_ref[counter] = img();
+    proj_ref[counter] = proj;
     //#define DEBUG
 #ifdef DEBUG
 
@@ -523,6 +539,75 @@ void ProgAngularProjectionMatching::getCurrentReference(int refno,
     //    local_transformer.cleanup();
 }
 
+void ProgAngularProjectionMatching::fillGallery(double *_gallery, size_t first, size_t step)
+{
+    double                        stddev;
+    MultidimArray<double>         proj;
+    Polar<std::complex <double> > fP;
+
+    for (size_t k = first; k < (size_t)total_nr_refs; k += step)
+    {
+        computeReference(mysampling.no_redundant_sampling_points_index[k], global_plans, proj, fP, stddev);
+        double *ptr = _gallery + k * galleryStride;
+        *ptr++ = stddev;
+        for (int i = 0; i < fP.getRingNo(); i++)
+        {
+            size_t nbytes = fP.getSampleNo(i) * sizeof(std::complex<double>);
+            memcpy(ptr, MULTIDIM_ARRAY(fP.rings[i]), nbytes);
+            ptr += nbytes / sizeof(double);
+        }
+        memcpy(ptr, MULTIDIM_ARRAY(proj), dim * dim * sizeof(double));
+    }
+}
+
+void ProgAngularProjectionMatching::setGallery(double *_gallery)
+{
+    gallery = _gallery;
+    delete [] fP_ref;
+    delete [] proj_ref;
+    delete [] stddev_ref;
+    max_nr_refs_in_memory = total_nr_refs;
+    try
+    {
+        fP_ref = new Polar<std::complex<double> >[max_nr_refs_in_memory];
+        proj_ref = new MultidimArray<double>[max_nr_refs_in_memory];
+        stddev_ref = new double[max_nr_refs_in_memory];
+    }
+    catch (std::bad_alloc&)
+    {
+        REPORT_ERROR(ERR_MEM_BADREQUEST,"Error allocating memory in setGallery");
+    }
+    pointer_refsinmem2allrefs.resize(max_nr_refs_in_memory);
+
+    // The references are not copied, rings and images point to the gallery
+    for (size_t k = 0; k < (size_t)total_nr_refs; k++)
+    {
+        size_t refno = mysampling.no_redundant_sampling_points_index[k];
+        pointer_allrefs2refsinmem[refno] = k;
+        pointer_refsinmem2allrefs[k] = refno;
+
+        double *ptr = gallery + k * galleryStride;
+        stddev_ref[k] = *ptr++;
+        fP_ref[k] = fP_layout;
+        for (int i = 0; i < fP_layout.getRingNo(); i++)
+        {
+            MultidimArray<std::complex<double> > &ring = fP_ref[k].rings[i];
+            ring.coreDeallocate();
+            ring.data = (std::complex<double> *) ptr;
+            ring.nzyxdimAlloc = ring.nzyxdim;
+            ring.destroyData = false;
+            ptr += 2 * ring.nzyxdim;
+        }
+        MultidimArray<double> &proj = proj_ref[k];
+        proj.setDimensions(dim, dim, 1, 1);
+        proj.data = ptr;
+        proj.nzyxdimAlloc = proj.nzyxdim;
+        proj.destroyData = false;
+        proj.setXmippOrigin();
+    }
+    counter_refs_in_memory = total_nr_refs;
+}
+
 void * threadRotationallyAlignOneImage( void * data )
 {
     structThreadRotationallyAlignOneImage * thread_data = (structThreadRotationallyAlignOneImage *) data;
@@ -112,6 +112,13 @@ public:
     Polar<std::complex<double> >   *fP_ref, *fP_img, *fPm_img;
     /** Array with reference images */
     MultidimArray<double> *proj_ref;
+    /** Gallery with all the references in a single block of memory, NULL
+     * if the references are read on demand. fP_ref and proj_ref point to it */
+    double *gallery;
+    /** Size (in doubles) of each reference in the gallery */
+    size_t galleryStride;
+    /** Ring layout of the references */
+    Polar<std::complex<double> > fP_layout;
     /** Global plans for fftw transformers of all polar rings */
     Polar_fftw_plans global_plans;
     /** vector with stddevs for all reference projections */
@@ -190,6 +197,21 @@ public:
       store FT of the polar transform as well as the original image */
     void getCurrentReference(int refno, Polar_fftw_plans &local_plans);
 
+    /** Read a reference from disc, apply the CTF and compute the FT of
+      its polar transform and its stddev */
+    void computeReference(int refno, Polar_fftw_plans &local_plans,
+                          MultidimArray<double> &proj, Polar<std::complex <double> > &fP, double &stddev);
+
+    /** Compute the references first, first+step, ... (in stack order)
+     * into a gallery of total_nr_refs*galleryStride doubles.
+     * The gallery may be shared by several processes that compute
+     * different references. */
+    void fillGallery(double *_gallery, size_t first, size_t step);
+
+    /** Use a filled gallery for all the references, they are not read
+     * from disc any longer */
+    void setGallery(double *_gallery);
+
     /** Get images to process.
      * This function will return the id's of images to process.
      * It will be specially useful for MPI case when images will be distributed
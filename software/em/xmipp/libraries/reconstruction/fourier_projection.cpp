@@ -25,6 +25,8 @@
 
 #include "fourier_projection.h"
 #include <data/xmipp_fft.h>
+#include <data/xmipp_threads.h>
+#include <algorithm>
 
 FourierProjector::FourierProjector(MultidimArray<double> &V, double paddFactor, double maxFreq, int degree)
 {
@@ -36,41 +38,67 @@ FourierProjector::FourierProjector(MultidimArray<double> &V, double paddFactor,
     produceSideInfo();
 }
 
+FourierProjector::~FourierProjector()
+{
+    for (size_t t=0; t<threadAux.size(); ++t)
+        delete threadAux[t];
+}
+
 void FourierProjector::project(double rot, double tilt, double psi, const MultidimArray<double> *ctf)
 {
-    double freqy, freqx;
-    std::complex< double > f;
     Euler_angles2matrix(rot,tilt,psi,E);
+    projectFourier(rot,tilt,psi,projectionFourier,ctf);
+    transformer2D.inverseFourierTransform();
+}
+
+void FourierProjector::projectFourier(double rot, double tilt, double psi, MultidimArray< std::complex<double> > &Fprojection,
+                                      const MultidimArray<double> *ctf) const
+{
+    double freqy, freqx;
+    Matrix2D<double> Euler;
+    Euler_angles2matrix(rot,tilt,psi,Euler);
 
-    projectionFourier.initZeros();
+    if (!Fprojection.sameShape(phaseShiftImgA))
+        Fprojection.initZeros(phaseShiftImgA);
     double maxFreq2=maxFrequency*maxFrequency;
-    int Xdim=(int)XSIZE(VfourierRealCoefs);
-    int Ydim=(int)YSIZE(VfourierRealCoefs);
-    int Zdim=(int)ZSIZE(VfourierRealCoefs);
+    int Xdim=(int)XSIZE(VfourierCoefs);
+    int Ydim=(int)YSIZE(VfourierCoefs);
+    int Zdim=(int)ZSIZE(VfourierCoefs);
 
-    for (size_t i=0; i<YSIZE(projectionFourier); ++i)
+    for (size_t i=0; i<YSIZE(Fprojection); ++i)
     {
+        // Frequencies beyond maxFrequency are not interpolated
+        size_t jmax=rowLength[i];
+        if (jmax<XSIZE(Fprojection))
+            std::fill(&DIRECT_A2D_ELEM(Fprojection,i,jmax),&DIRECT_A2D_ELEM(Fprojection,i,0)+XSIZE(Fprojection),
+                      std::complex<double>(0.,0.));
+        if (jmax==0)
+            continue;
+
         FFT_IDX2DIGFREQ(i,volumeSize,freqy);
         double freqy2=freqy*freqy;
 
-        double freqYvol_X=MAT_ELEM(E,1,0)*freqy;
-        double freqYvol_Y=MAT_ELEM(E,1,1)*freqy;
-        double freqYvol_Z=MAT_ELEM(E,1,2)*freqy;
-        for (size_t j=0; j<XSIZE(projectionFourier); ++j)
+        double freqYvol_X=MAT_ELEM(Euler,1,0)*freqy;
+        double freqYvol_Y=MAT_ELEM(Euler,1,1)*freqy;
+        double freqYvol_Z=MAT_ELEM(Euler,1,2)*freqy;
+        for (size_t j=0; j<jmax; ++j)
         {
             // The frequency of pairs (i,j) in 2D
             FFT_IDX2DIGFREQ(j,volumeSize,freqx);
 
             // Do not consider pixels with high frequency
             if ((freqy2+freqx*freqx)>maxFreq2)
+            {
+                DIRECT_A2D_ELEM(Fprojection,i,j)=0.;
                 continue;
+            }
 
             // Compute corresponding frequency in the volume
-            double freqvol_X=freqYvol_X+MAT_ELEM(E,0,0)*freqx;
-            double freqvol_Y=freqYvol_Y+MAT_ELEM(E,0,1)*freqx;
-            double freqvol_Z=freqYvol_Z+MAT_ELEM(E,0,2)*freqx;
+            double freqvol_X=freqYvol_X+MAT_ELEM(Euler,0,0)*freqx;
+            double freqvol_Y=freqYvol_Y+MAT_ELEM(Euler,0,1)*freqx;
+            double freqvol_Z=freqYvol_Z+MAT_ELEM(Euler,0,2)*freqx;
 
-            double c,d;
+            std::complex<double> coef;
             if (BSplineDeg==0)
             {
                 // 0 order interpolation
@@ -78,93 +106,104 @@ void FourierProjector::project(double rot, double tilt, double psi, const Multid
                 int kVolume=(int)round(freqvol_Z*volumePaddedSize);
                 int iVolume=(int)round(freqvol_Y*volumePaddedSize);
                 int jVolume=(int)round(freqvol_X*volumePaddedSize);
-                c = A3D_ELEM(VfourierRealCoefs,kVolume,iVolume,jVolume);
-                d = A3D_ELEM(VfourierImagCoefs,kVolume,iVolume,jVolume);
+                coef = A3D_ELEM(VfourierCoefs,kVolume,iVolume,jVolume);
             }
             else if (BSplineDeg==1)
             {
-                // B-spline linear interpolation
+                // B-spline linear interpolation (as interpolatedElement3D)
                 double kVolume=freqvol_Z*volumePaddedSize;
                 double iVolume=freqvol_Y*volumePaddedSize;
                 double jVolume=freqvol_X*volumePaddedSize;
-                c=VfourierRealCoefs.interpolatedElement3D(jVolume,iVolume,kVolume);
-                d=VfourierImagCoefs.interpolatedElement3D(jVolume,iVolume,kVolume);
+                int x0 = FLOOR(jVolume);
+                double fx = jVolume - x0;
+                int x1 = x0 + 1;
+                int y0 = FLOOR(iVolume);
+                double fy = iVolume - y0;
+                int y1 = y0 + 1;
+                int z0 = FLOOR(kVolume);
+                double fz = kVolume - z0;
+                int z1 = z0 + 1;
+
+                std::complex<double> zero=0.;
+                std::complex<double> d000 = VfourierCoefs.outside(z0, y0, x0) ? zero : A3D_ELEM(VfourierCoefs, z0, y0, x0);
+                std::complex<double> d001 = VfourierCoefs.outside(z0, y0, x1) ? zero : A3D_ELEM(VfourierCoefs, z0, y0, x1);
+                std::complex<double> d010 = VfourierCoefs.outside(z0, y1, x0) ? zero : A3D_ELEM(VfourierCoefs, z0, y1, x0);
+                std::complex<double> d011 = VfourierCoefs.outside(z0, y1, x1) ? zero : A3D_ELEM(VfourierCoefs, z0, y1, x1);
+                std::complex<double> d100 = VfourierCoefs.outside(z1, y0, x0) ? zero : A3D_ELEM(VfourierCoefs, z1, y0, x0);
+                std::complex<double> d101 = VfourierCoefs.outside(z1, y0, x1) ? zero : A3D_ELEM(VfourierCoefs, z1, y0, x1);
+                std::complex<double> d110 = VfourierCoefs.outside(z1, y1, x0) ? zero : A3D_ELEM(VfourierCoefs, z1, y1, x0);
+                std::complex<double> d111 = VfourierCoefs.outside(z1, y1, x1) ? zero : A3D_ELEM(VfourierCoefs, z1, y1, x1);
+
+                std::complex<double> dx00 = LIN_INTERP(fx, d000, d001);
+                std::complex<double> dx01 = LIN_INTERP(fx, d100, d101);
+                std::complex<double> dx10 = LIN_INTERP(fx, d010, d011);
+                std::complex<double> dx11 = LIN_INTERP(fx, d110, d111);
+                std::complex<double> dxy0 = LIN_INTERP(fy, dx00, dx10);
+                std::complex<double> dxy1 = LIN_INTERP(fy, dx01, dx11);
+                coef = LIN_INTERP(fz, dxy0, dxy1);
             }
             else
             {
                 // B-spline cubic interpolation
-                double kVolume=freqvol_Z*volumePaddedSize;
-                double iVolume=freqvol_Y*volumePaddedSize;
-                double jVolume=freqvol_X*volumePaddedSize;
-
-                // Commented for speed-up, the corresponding code is below
-                // c=VfourierRealCoefs.interpolatedElementBSpline3D(jVolume,iVolume,kVolume);
-                // d=VfourierImagCoefs.interpolatedElementBSpline3D(jVolume,iVolume,kVolume);
-
                 // The code below is a replicate for speed reasons of interpolatedElementBSpline3D
-                double z=kVolume;
-                double y=iVolume;
-                double x=jVolume;
+                // with the weights and the mirrored indexes of each dimension
+                // computed once per pixel
+                double z=freqvol_Z*volumePaddedSize;
+                double y=freqvol_Y*volumePaddedSize;
+                double x=freqvol_X*volumePaddedSize;
 
                 // Logical to physical
-                z -= STARTINGZ(VfourierRealCoefs);
-                y -= STARTINGY(VfourierRealCoefs);
-                x -= STARTINGX(VfourierRealCoefs);
+                z -= STARTINGZ(VfourierCoefs);
+                y -= STARTINGY(VfourierCoefs);
+                x -= STARTINGX(VfourierCoefs);
 
                 int l1 = (int)ceil(x - 2);
-                int l2 = l1 + 3;
-
                 int m1 = (int)ceil(y - 2);
-                int m2 = m1 + 3;
-
                 int n1 = (int)ceil(z - 2);
-                int n2 = n1 + 3;
 
-                c = d = 0.0;
-                double aux;
-                for (int nn = n1; nn <= n2; nn++)
+                double wx[4], wy[4], wz[4];
+                int equivalent_l[4], equivalent_m[4], equivalent_nn[4];
+                for (int s=0; s<4; ++s)
                 {
-                    int equivalent_nn=nn;
+                    int l=l1+s, m=m1+s, nn=n1+s;
+                    BSPLINE03(wx[s],x - (double) l);
+                    BSPLINE03(wy[s],y - (double) m);
+                    BSPLINE03(wz[s],z - (double) nn);
+                    if      (l<0)
+                        l=-l-1;
+                    else if (l>=Xdim)
+                        l=2*Xdim-l-1;
+                    if      (m<0)
+                        m=-m-1;
+                    else if (m>=Ydim)
+                        m=2*Ydim-m-1;
                     if      (nn<0)
-                        equivalent_nn=-nn-1;
+                        nn=-nn-1;
                     else if (nn>=Zdim)
-                        equivalent_nn=2*Zdim-nn-1;
-                    double yxsumRe = 0.0, yxsumIm = 0.0;
-                    for (int m = m1; m <= m2; m++)
+                        nn=2*Zdim-nn-1;
+                    equivalent_l[s]=l;
+                    equivalent_m[s]=m;
+                    equivalent_nn[s]=nn;
+                }
+
+                coef = 0.0;
+                for (int n = 0; n < 4; n++)
+                {
+                    std::complex<double> yxsum = 0.0;
+                    for (int m = 0; m < 4; m++)
                     {
-                        int equivalent_m=m;
-                        if      (m<0)
-                            equivalent_m=-m-1;
-                        else if (m>=Ydim)
-                            equivalent_m=2*Ydim-m-1;
-                        double xsumRe = 0.0, xsumIm = 0.0;
-                        for (int l = l1; l <= l2; l++)
-                        {
-                            double xminusl = x - (double) l;
-                            int equivalent_l=l;
-                            if      (l<0)
-                                equivalent_l=-l-1;
-                            else if (l>=Xdim)
-                                equivalent_l=2*Xdim-l-1;
-                            double CoeffRe = (double) DIRECT_A3D_ELEM(VfourierRealCoefs,equivalent_nn,equivalent_m,equivalent_l);
-                            double CoeffIm = (double) DIRECT_A3D_ELEM(VfourierImagCoefs,equivalent_nn,equivalent_m,equivalent_l);
-                            BSPLINE03(aux,xminusl);
-                            xsumRe += CoeffRe * aux;
-                            xsumIm += CoeffIm * aux;
-                        }
-
-                        double yminusm = y - (double) m;
-                        BSPLINE03(aux,yminusm);
-						yxsumRe += xsumRe * aux;
-						yxsumIm += xsumIm * aux;
+                        const std::complex<double> *ptrCoef=
+                            &DIRECT_A3D_ELEM(VfourierCoefs,equivalent_nn[n],equivalent_m[m],0);
+                        std::complex<double> xsum = 0.0;
+                        for (int l = 0; l < 4; l++)
+                            xsum += ptrCoef[equivalent_l[l]] * wx[l];
+                        yxsum += xsum * wy[m];
                     }
-
-                    double zminusn = z - (double) nn;
-                    BSPLINE03(aux,zminusn);
-					c += yxsumRe * aux;
-					d += yxsumIm * aux;
+                    coef += yxsum * wz[n];
                 }
             }
+            double c=coef.real();
+            double d=coef.imag();
 
             // Phase shift to move the origin of the image to the corner
             double a=DIRECT_A2D_ELEM(phaseShiftImgA,i,j);
@@ -182,12 +221,81 @@ void FourierProjector::project(double rot, double tilt, double psi, const Multid
             double ab_cd = (a + b) * (c + d);
 
             // And store the multiplication
-            double *ptrI_ij=(double *)&DIRECT_A2D_ELEM(projectionFourier,i,j);
+            double *ptrI_ij=(double *)&DIRECT_A2D_ELEM(Fprojection,i,j);
             *ptrI_ij = ac - bd;
             *(ptrI_ij+1) = ab_cd - ac - bd;
         }
     }
-    transformer2D.inverseFourierTransform();
+}
+
+/* Projection of a range of orientations */
+class FourierProjectorBody: public ParallelForBody
+{
+public:
+    FourierProjector *projector;
+    const std::vector<double> *rot, *tilt, *psi;
+    const MultidimArray<double> *ctf;
+    std::vector< MultidimArray<double> > *projections;
+    std::vector< MultidimArray< std::complex<double> > > *projectionsFourier;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        for (size_t k=first; k<=last; ++k)
+            if (projectionsFourier!=NULL)
+                projector->projectFourier((*rot)[k],(*tilt)[k],(*psi)[k],(*projectionsFourier)[k],ctf);
+            else
+            {
+                FourierProjectorAux &aux=*(projector->threadAux[thread_id]);
+                if (XSIZE(aux.projection)==0)
+                {
+                    aux.projection.initZeros(projector->volumeSize,projector->volumeSize);
+                    aux.projection.setXmippOrigin();
+                    aux.transformer2D.FourierTransform(aux.projection,aux.projectionFourier,false);
+                }
+                projector->projectFourier((*rot)[k],(*tilt)[k],(*psi)[k],aux.projectionFourier,ctf);
+                aux.transformer2D.inverseFourierTransform();
+                (*projections)[k]=aux.projection;
+            }
+    }
+};
+
+void FourierProjector::project(const std::vector<double> &rot, const std::vector<double> &tilt, const std::vector<double> &psi,
+                               std::vector< MultidimArray<double> > &projections, const MultidimArray<double> *ctf)
+{
+    projections.resize(rot.size());
+    if (rot.empty())
+        return;
+    size_t nThreads=ThreadPool::getInstance().getNumberOfThreads()+1;
+    while (threadAux.size()<nThreads)
+        threadAux.push_back(new FourierProjectorAux);
+
+    FourierProjectorBody body;
+    body.projector=this;
+    body.rot=&rot;
+    body.tilt=&tilt;
+    body.psi=&psi;
+    body.ctf=ctf;
+    body.projections=&projections;
+    body.projectionsFourier=NULL;
+    ThreadPool::getInstance().parallelFor(0,rot.size()-1,body,1);
+}
+
+void FourierProjector::projectFourier(const std::vector<double> &rot, const std::vector<double> &tilt, const std::vector<double> &psi,
+                                      std::vector< MultidimArray< std::complex<double> > > &projectionsFourier,
+                                      const MultidimArray<double> *ctf) const
+{
+    projectionsFourier.resize(rot.size());
+    if (rot.empty())
+        return;
+    FourierProjectorBody body;
+    body.projector=const_cast<FourierProjector *>(this);
+    body.rot=&rot;
+    body.tilt=&tilt;
+    body.psi=&psi;
+    body.ctf=ctf;
+    body.projections=NULL;
+    body.projectionsFourier=&projectionsFourier;
+    ThreadPool::getInstance().parallelFor(0,rot.size()-1,body,1);
 }
 
 void FourierProjector::produceSideInfo()
@@ -214,6 +322,8 @@ void FourierProjector::produceSideInfo()
     DIRECT_MULTIDIM_ELEM(Vfourier,n)*=K;
     Vpadded.clear();
     // Compute Bspline coefficients
+    volumePaddedSize=XSIZE(Vfourier);
+    MultidimArray< double > VfourierRealCoefs, VfourierImagCoefs;
     if (BSplineDeg==3)
     {
         MultidimArray< double > VfourierRealAux, VfourierImagAux;
@@ -225,7 +335,6 @@ void FourierProjector::produceSideInfo()
         VfourierRealAux.clear();
 
         // Remove all those coefficients we are sure we will not use during the projections
-        volumePaddedSize=XSIZE(VfourierRealCoefs);
         int idxMax=maxFrequency*XSIZE(VfourierRealCoefs)+10; // +10 is a safety guard
         idxMax=std::min(FINISHINGX(VfourierRealCoefs),idxMax);
         int idxMin=std::max(-idxMax,STARTINGX(VfourierRealCoefs));
@@ -234,9 +343,11 @@ void FourierProjector::produceSideInfo()
         produceSplineCoefficients(BSPLINE3,VfourierImagCoefs,VfourierImagAux);
         VfourierImagAux.clear();
         VfourierImagCoefs.selfWindow(idxMin,idxMin,idxMin,idxMax,idxMax,idxMax);
+        RealImag2Complex(VfourierRealCoefs, VfourierImagCoefs, VfourierCoefs);
     }
     else
-        Complex2RealImag(Vfourier, VfourierRealCoefs, VfourierImagCoefs);
+        VfourierCoefs=Vfourier;
+    Vfourier.clear();
 
     // Allocate memory for the 2D Fourier transform
     projection().initZeros(volumeSize,volumeSize);
@@ -258,6 +369,22 @@ void FourierProjector::produceSideInfo()
             sincos(dotp,&DIRECT_A2D_ELEM(phaseShiftImgB,i,j),&DIRECT_A2D_ELEM(phaseShiftImgA,i,j));
         }
     }
+
+    // Pixels of each row up to the maximum frequency
+    double maxFreq2=maxFrequency*maxFrequency;
+    rowLength.resize(YSIZE(projectionFourier));
+    for (size_t i=0; i<YSIZE(projectionFourier); ++i)
+    {
+        double freqy, freqx;
+        FFT_IDX2DIGFREQ(i,volumeSize,freqy);
+        rowLength[i]=0;
+        for (size_t j=0; j<XSIZE(projectionFourier); ++j)
+        {
+            FFT_IDX2DIGFREQ(j,volumeSize,freqx);
+            if (freqy*freqy+freqx*freqx<=maxFreq2)
+                rowLength[i]=j+1;
+        }
+    }
 }
 
 void projectVolume(FourierProjector &projector, Projection &P, int Ydim, int Xdim,
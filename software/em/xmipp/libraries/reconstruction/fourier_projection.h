@@ -35,7 +35,26 @@
    @ingroup ReconsLibrary */
 //@{
 
-/** Program class to create projections in Fourier space */
+/** Scratch of a thread projecting with a FourierProjector.
+ * Each thread calling the batch methods of the projector has its own one.
+ */
+class FourierProjectorAux
+{
+public:
+    // Projection in real space
+    MultidimArray<double> projection;
+    // Projection in Fourier space (aliased to the transformer)
+    MultidimArray< std::complex<double> > projectionFourier;
+    // FFT transformer of the projection
+    FourierTransformer transformer2D;
+};
+
+/** Program class to create projections in Fourier space.
+ * The projections of many orientations can be computed at once with the
+ * batch methods, that split the orientations among the threads of the pool.
+ * projectFourier does not modify the projector and can be called from
+ * several threads.
+ */
 class FourierProjector
 {
 public:
@@ -53,8 +72,9 @@ public:
     // Volume to project
     MultidimArray<double> *volume;
 
-    // Real and imaginary B-spline coefficients for Fourier of the volume
-    MultidimArray< double > VfourierRealCoefs, VfourierImagCoefs;
+    // B-spline coefficients for Fourier of the volume (real and imaginary
+    // parts are interpolated together)
+    MultidimArray< std::complex<double> > VfourierCoefs;
 
     // Projection in Fourier space
     MultidimArray< std::complex<double> > projectionFourier;
@@ -65,6 +85,9 @@ public:
     // Phase shift image
     MultidimArray<double> phaseShiftImgB, phaseShiftImgA;
 
+    // Number of pixels of each row of projectionFourier up to maxFrequency
+    std::vector<int> rowLength;
+
     // Original volume size
     int volumeSize;
 
@@ -73,21 +96,56 @@ public:
 
     // Euler matrix
     Matrix2D<double> E;
+
+    // Scratch of the threads for the batch methods
+    std::vector<FourierProjectorAux *> threadAux;
 public:
     /*
      * The constructor of the class
      */
     FourierProjector(MultidimArray<double> &V, double paddFactor, double maxFreq, int BSplinedegree);
 
+    /// Destructor
+    ~FourierProjector();
+
     /**
      * This method gets the volume's Fourier and the Euler's angles as the inputs and interpolates the related projection
      */
     void project(double rot, double tilt, double psi, const MultidimArray<double> *ctf=NULL);
+
+    /**
+     * Projection in Fourier space (with the origin at the corner, as given by
+     * FourierTransformer for an image of the volume size). Frequencies beyond
+     * maxFrequency are set to 0. Thread-safe.
+     */
+    void projectFourier(double rot, double tilt, double psi, MultidimArray< std::complex<double> > &Fprojection,
+                        const MultidimArray<double> *ctf=NULL) const;
+
+    /**
+     * Projections in real space of a set of orientations. projections is
+     * resized to the number of orientations, each one has its logical
+     * origin at the center.
+     */
+    void project(const std::vector<double> &rot, const std::vector<double> &tilt, const std::vector<double> &psi,
+                 std::vector< MultidimArray<double> > &projections, const MultidimArray<double> *ctf=NULL);
+
+    /**
+     * Projections in Fourier space of a set of orientations (see projectFourier).
+     * It saves the inverse FFTs when the projections are going to be
+     * compared in Fourier space.
+     */
+    void projectFourier(const std::vector<double> &rot, const std::vector<double> &tilt, const std::vector<double> &psi,
+                        std::vector< MultidimArray< std::complex<double> > > &projectionsFourier,
+                        const MultidimArray<double> *ctf=NULL) const;
 private:
     /*
      * This is a private method which provides the values for the class variable
      */
     void produceSideInfo();
+
+    // Copy is not allowed (the transformers point to the member arrays)
+    FourierProjector(const FourierProjector &);
+    FourierProjector & operator=(const FourierProjector &);
 };
 
 /*
@@ -28,6 +28,7 @@
 #include <data/metadata.h>
 #include <data/xmipp_program.h>
 #include <data/xmipp_threads.h>
+#include <data/basic_pca.h>
 #include <classification/pca.h>
 
 #define IS_MASTER (rank == 0)
@@ -73,22 +74,8 @@ public:
     size_t Xdim;
     // Number of pixels
     int Npixels;
-    // Mpi node
-    //MpiNode *node;
-    // H buffer
-    std::vector<double *> Hbuffer;
-    // H buffer destination addresses
-    std::vector<double *> HbufferDestination;
-    // Buffer maximum length
-    static const int HbufferMax=20;
-    // Mpi file lock
-    Mutex *fileMutex;
-    // Thread mutex
-    Mutex *threadMutex;
-    // SVD matrix
-    Matrix2D<double> H;
-    // SVD matrix
-    Matrix2D<double> F;
+    // Streaming PCA of all rotated, shifted and mirrored images
+    StreamingRandomizedPCA pca;
 public:
     // Input image
     std::vector< Image<double> > I;
@@ -96,12 +83,8 @@ public:
     std::vector< MultidimArray<double> > Iaux;
     // Geometric transformation
     std::vector< Matrix2D<double> > A;
-    // H block
-    std::vector< Matrix2D<double> > Hblock;
-    // W node
-    std::vector< Matrix2D<double> > Wnode;
-    // W transpose
-    Matrix2D<double> Wtranspose;
+    // Pixels inside the mask
+    std::vector< std::vector<double> > pixels;
     // Mask
     MultidimArray< unsigned char > mask;
     // FileTaskDistributor
@@ -129,30 +112,11 @@ public:
     /// Produce side info
     void produceSideInfo();
 
-    /** Write to H buffer */
-    void writeToHBuffer(int idx, double *dest);
-
-    /** Flush buffer */
-    void flushHBuffer();
-
-    /** Clear H buffer */
-    void clearHbuffer();
-
-    /** Apply T.
-     * W=T(H).
-     */
-    void applyT();
-
-    /** Apply Tt.
-     * H=Tt(W).
+    /** Pass over all images.
+     * All the rotated, shifted and mirrored versions of each image are
+     * added to the PCA.
      */
-    void applyTt();
-
-    /** QR decomposition.
-     * In fact, only Q is computed. It returns the number of columns
-     * of Q different from 0.
-     */
-    int QR();
+    void applyPass();
 
     /** Run. */
     void run();
@@ -164,23 +128,14 @@ public:
     /** Comunicate matrix, only meanful for MPI */
     virtual void comunicateMatrix(Matrix2D<double> &W);
 
-    /** Create mutexes and distributor */
-    virtual void createMutexes(size_t Nimgs);
-
-    /** Last part of function applyT */
-    virtual void allReduceApplyT(Matrix2D<double> &Wnode_0);
-
-    /** Comunicate int param */
-    virtual void comunicateQrDim(int &qrDim);
-
-    /** Map matrix */
-    virtual void mapMatrix(int qrDim);
+    /** Create task distributor */
+    virtual void createTaskDistributor(size_t Nimgs);
 
-    /** Apply SVD */
-    virtual void applySVD();
+    /** Sum the PCA accumulators of all nodes, only meanful for MPI */
+    virtual void allReducePass();
 
-    /** Copy H to F. */
-    virtual void copyHtoF(int block);
+    /** Write the eigenimages */
+    virtual void writeBasis();
 };
 //@}
 #endif
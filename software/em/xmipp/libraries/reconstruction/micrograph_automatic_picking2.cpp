@@ -130,33 +130,56 @@ void AutoParticlePicking2::readMic(const FileName &fn_micrograph, int keepPrev)
     }
 }
 
+/* Band pass filtering of the micrograph for a range of filters of the bank */
+class FilterBankBody: public ParallelForBody
+{
+public:
+    const MultidimArray<std::complex<double> > *micrographFourier;
+    const MultidimArray<double> *micrograph;
+    MultidimArray<double> *filterBankStack;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        MultidimArray<double> band, Iaux;
+        FourierTransformer transformer;
+        band.resizeNoCopy(*micrograph);
+        transformer.setReal(band);
+        for (size_t i=first;i<=last;i++)
+        {
+            FourierFilter filter;
+            filter.raised_w=0.02;
+            filter.FilterShape=RAISED_COSINE;
+            filter.FilterBand=BANDPASS;
+            filter.w1=0.025*i;
+            filter.w2=(filter.w1)+0.025;
+            transformer.setFourier(*micrographFourier);
+            filter.applyMaskFourierSpace(*micrograph,transformer.fFourier);
+            transformer.inverseFourierTransform();
+            Iaux.aliasImageInStack(*filterBankStack,i);
+            Iaux=band;
+        }
+    }
+};
+
 // Generate filter bank from the micrograph image (this is for supervised mode)
 void AutoParticlePicking2::filterBankGenerator()
 {
     MultidimArray<double> inputMicrograph;
-    MultidimArray<double> Iaux;
 
     inputMicrograph = microImage();
     filterBankStack.resize(size_t(filter_num), 1,
                            size_t(YSIZE(inputMicrograph)),
                            size_t(XSIZE(inputMicrograph)));
-    FourierFilter filter;
-    filter.raised_w=0.02;
-    filter.FilterShape=RAISED_COSINE;
-    filter.FilterBand=BANDPASS;
     MultidimArray<std::complex<double> > micrographFourier;
     FourierTransformer transformer;
     transformer.FourierTransform(inputMicrograph,micrographFourier,true);
-    for (int i=0;i<filter_num;i++)
-    {
-        filter.w1=0.025*i;
-        filter.w2=(filter.w1)+0.025;
-        transformer.setFourier(micrographFourier);
-        filter.applyMaskFourierSpace(microImage(),transformer.fFourier);
-        transformer.inverseFourierTransform();
-        Iaux.aliasImageInStack(filterBankStack,i);
-        Iaux=inputMicrograph;
-    }
+
+    // The filters of the bank are independent
+    FilterBankBody body;
+    body.micrographFourier=&micrographFourier;
+    body.micrograph=&microImage();
+    body.filterBankStack=&filterBankStack;
+    ThreadPool::getInstance().parallelFor(0,filter_num-1,body,1);
 }
 
 void AutoParticlePicking2::buildInvariant(const std::vector<MDRow> &MD)
@@ -544,9 +567,6 @@ int AutoParticlePicking2::automaticallySelectParticles(FileName fnmicrograph, in
     auto_candidates.clear();
     //    md.clear();
 
-    double label, score;
-    Particle2 p;
-    MultidimArray<double> featVec, featVecNN;
     std::vector<Particle2> positionArray;
 
     if (thread == NULL)
@@ -569,78 +589,10 @@ int AutoParticlePicking2::automaticallySelectParticles(FileName fnmicrograph, in
         positionArray = thread->positionArray;
     }
 
-    // Read the SVM model
-    //    generateFeatVec(fnmicrograph,proc_prec,positionArray);
-    //    classifier.LoadModel(fnSVMModel);
     int num=(int)(positionArray.size()*(proc_prec/100.0));
-    featVec.resize(num_features);
-    //    negative_candidates.clear();
-
-    for (int k=0;k<num;k++)
-    {
-        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(featVec)
-        DIRECT_A1D_ELEM(featVec,i)=DIRECT_A2D_ELEM(autoFeatVec,k,i);
-        featVecNN=featVec;
-        double max=featVec.computeMax();
-        double min=featVec.computeMin();
-        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(featVec)
-        DIRECT_A1D_ELEM(featVec,i)=0+((1)*((DIRECT_A1D_ELEM(featVec,i)-min)/(max-min)));
-        int j=positionArray[k].x;
-        int i=positionArray[k].y;
-        label= classifier.predict(featVec, score);
-        if (label==1)
-        {
-            p.x=j;
-            p.y=i;
-            p.status=1;
-            p.cost=score;
-            p.vec=featVecNN;
-            auto_candidates.push_back(p);
-
-        }
-        //        else
-        //        {
-        //            p.x=j;
-        //            p.y=i;
-        //            p.status=1;
-        //            p.cost=score;
-        //            p.vec=featVecNN;
-        //            negative_candidates.push_back(p);
-        //        }
-    }
+    classifyCandidates(positionArray,num);
     if (auto_candidates.size() == 0)
         return 0;
-    // Remove the occluded particles
-    for (size_t i=0;i<auto_candidates.size();++i)
-        for (size_t j=0;j<auto_candidates.size()-i-1;j++)
-            if (auto_candidates[j].cost<auto_candidates[j+1].cost)
-            {
-                p=auto_candidates[j+1];
-                auto_candidates[j+1]=auto_candidates[j];
-                auto_candidates[j]=p;
-            }
-    for (size_t i=0;i<auto_candidates.size()-1;++i)
-    {
-        if (auto_candidates[i].status==-1)
-            continue;
-        p=auto_candidates[i];
-        for (size_t j=i+1;j<auto_candidates.size();j++)
-        {
-            if (auto_candidates[j].x>p.x-particle_radius
-                && auto_candidates[j].x<p.x+particle_radius
-                && auto_candidates[j].y>p.y-particle_radius
-                && auto_candidates[j].y<p.y+particle_radius)
-            {
-                if (p.cost<auto_candidates[j].cost)
-                {
-                    auto_candidates[i].status=-1;
-                    p=auto_candidates[j];
-                }
-                else
-                    auto_candidates[j].status=-1;
-            }
-        }
-    }
     saveAutoParticles(md);
     if (readNextMic(fnmicrograph))
         thread->workOnMicrograph(fnmicrograph, proc_prec);
@@ -649,54 +601,105 @@ int AutoParticlePicking2::automaticallySelectParticles(FileName fnmicrograph, in
 
 int AutoParticlePicking2::automaticWithouThread(FileName fnmicrograph, int proc_prec, const FileName &fn)
 {
-    // Read the SVM model
-    //    classifier.LoadModel(fnSVMModel);
-
-    double label, score;
-    Particle2 p;
-    MultidimArray<double> featVec, featVecNN;
     std::vector<Particle2> positionArray;
     MetaData md;
 
+    auto_candidates.clear();
     generateFeatVec(fnmicrograph,proc_prec,positionArray);
 
     int num=(int)(positionArray.size()*(proc_prec/100.0));
-    featVec.resize(num_features);
-    for (int k=0;k<num;k++)
+    classifyCandidates(positionArray,num);
+    if (auto_candidates.size() == 0)
+        return 0;
+    saveAutoParticles(md);
+    md.write(fn,MD_OVERWRITE);
+    return auto_candidates.size();
+}
+
+
+/* Features of a range of candidates */
+class CandidateFeaturesBody: public ParallelForBody
+{
+public:
+    AutoParticlePicking2 *picker;
+    const std::vector<Particle2> *positionArray;
+
+    void operator()(size_t first, size_t last, int thread_id)
     {
-        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(featVec)
-        DIRECT_A1D_ELEM(featVec,i)=DIRECT_A2D_ELEM(autoFeatVec,k,i);
-        featVecNN=featVec;
-        double max=featVec.computeMax();
-        double min=featVec.computeMin();
-        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(featVec)
-        DIRECT_A1D_ELEM(featVec,i)=0+((1)*((DIRECT_A1D_ELEM(featVec,i)-min)/(max-min)));
-        int j=positionArray[k].x;
-        int i=positionArray[k].y;
-        label= classifier.predict(featVec, score);
-        if (label==1)
+        PickingFeaturesAux &aux=*(picker->featuresAux[thread_id]);
+        for (size_t k=first;k<=last;k++)
         {
-            p.x=j;
-            p.y=i;
-            p.status=1;
-            p.cost=score;
-            p.vec=featVecNN;
-            auto_candidates.push_back(p);
+            if (flagAbort)
+                return;
+            const Particle2 &p=(*positionArray)[k];
+            picker->computeFeatures(p.x,p.y,aux);
+            // Keep the features on memory to classify later on
+            FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(aux.featVec)
+            DIRECT_A2D_ELEM(picker->autoFeatVec,k,i)=DIRECT_A1D_ELEM(aux.featVec,i);
+        }
+    }
+};
 
+void AutoParticlePicking2::generateFeatVec(const FileName &fnmicrograph, int proc_prec, std::vector<Particle2> &positionArray)
+{
+    readMic(fnmicrograph,1);
+    buildSearchSpace(positionArray,true);
+
+    int num=(int)(positionArray.size()*(proc_prec/100.0));
+    autoFeatVec.resize(num,num_features);
+    if (num==0)
+        return;
+    allocateFeaturesAux();
+    CandidateFeaturesBody body;
+    body.picker=this;
+    body.positionArray=&positionArray;
+    ThreadPool::getInstance().parallelFor(0,num-1,body);
+}
+
+/* Sort candidates by decreasing cost */
+static bool higherCost(const Particle2 &p1, const Particle2 &p2)
+{
+    return p1.cost>p2.cost;
+}
+
+void AutoParticlePicking2::classifyCandidates(const std::vector<Particle2> &positionArray, int num)
+{
+    // Normalize the features of each candidate to [0,1]
+    MultidimArray<double> featNorm(num,num_features), label, score;
+    for (int k=0;k<num;k++)
+    {
+        double max=-1e38, min=1e38;
+        for (int i=0;i<num_features;i++)
+        {
+            double f=DIRECT_A2D_ELEM(autoFeatVec,k,i);
+            if (f>max)
+                max=f;
+            if (f<min)
+                min=f;
         }
+        for (int i=0;i<num_features;i++)
+            DIRECT_A2D_ELEM(featNorm,k,i)=0+((1)*((DIRECT_A2D_ELEM(autoFeatVec,k,i)-min)/(max-min)));
     }
+    classifier.predict(featNorm,label,score);
 
+    Particle2 p;
+    for (int k=0;k<num;k++)
+        if (DIRECT_A1D_ELEM(label,k)==1)
+        {
+            p.x=positionArray[k].x;
+            p.y=positionArray[k].y;
+            p.status=1;
+            p.cost=DIRECT_A1D_ELEM(score,k);
+            p.vec.resizeNoCopy(num_features);
+            FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(p.vec)
+            DIRECT_A1D_ELEM(p.vec,i)=DIRECT_A2D_ELEM(autoFeatVec,k,i);
+            auto_candidates.push_back(p);
+        }
     if (auto_candidates.size() == 0)
-        return 0;
+        return;
+
     // Remove the occluded particles
-    for (size_t i=0;i<auto_candidates.size();++i)
-        for (size_t j=0;j<auto_candidates.size()-i-1;j++)
-            if (auto_candidates[j].cost<auto_candidates[j+1].cost)
-            {
-                p=auto_candidates[j+1];
-                auto_candidates[j+1]=auto_candidates[j];
-                auto_candidates[j]=p;
-            }
+    std::stable_sort(auto_candidates.begin(),auto_candidates.end(),higherCost);
     for (size_t i=0;i<auto_candidates.size()-1;++i)
     {
         if (auto_candidates[i].status==-1)
@@ -719,40 +722,6 @@ int AutoParticlePicking2::automaticWithouThread(FileName fnmicrograph, int proc_
             }
         }
     }
-    saveAutoParticles(md);
-    md.write(fn,MD_OVERWRITE);
-    return auto_candidates.size();
-}
-
-
-void AutoParticlePicking2::generateFeatVec(const FileName &fnmicrograph, int proc_prec, std::vector<Particle2> &positionArray)
-{
-    MultidimArray<double> IpolarCorr;
-    MultidimArray<double> featVec;
-    MultidimArray<double> pieceImage;
-    MultidimArray<double> staticVec;
-
-    readMic(fnmicrograph,1);
-    IpolarCorr.initZeros(num_correlation,1,NangSteps,NRsteps);
-    buildSearchSpace(positionArray,true);
-
-    int num=(int)(positionArray.size()*(proc_prec/100.0));
-    autoFeatVec.resize(num,num_features);
-    for (int k=0;k<num;k++)
-    {
-        if (flagAbort)
-            return;
-        int j=positionArray[k].x;
-        int i=positionArray[k].y;
-        buildInvariant(IpolarCorr,j,i,0);
-        extractParticle(j,i,microImage(),pieceImage,false);
-        pieceImage.resize(1,1,1,XSIZE(pieceImage)*YSIZE(pieceImage));
-        extractStatics(pieceImage,staticVec);
-        buildVector(IpolarCorr,staticVec,featVec,pieceImage);
-        // Keep the features on memory to classify later on
-        FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(featVec)
-        DIRECT_A2D_ELEM(autoFeatVec,k,i)=DIRECT_A1D_ELEM(featVec,i);
-    }
 }
 
 FeaturesThread::FeaturesThread(AutoParticlePicking2 * picker)
@@ -937,10 +906,10 @@ void AutoParticlePicking2::add2Dataset(const MetaData &removedParticlesMD)
 void correlationBetweenPolarChannels(int n1,int n2,int nF,
                                      const MultidimArray< std::complex< double > > &fourierPolarStack,
                                      MultidimArray<double> &mIpolarCorr,
-                                     CorrelationAux &aux)
+                                     CorrelationAux &aux, MultidimArray<double> &corr2D)
 {
     MultidimArray< std::complex< double > > fourierPolar1, fourierPolar2;
-    MultidimArray<double> imgPolarCorr, corr2D;
+    MultidimArray<double> imgPolarCorr;
     fourierPolar1.aliasImageInStack(fourierPolarStack, n1);
     fourierPolar2.aliasImageInStack(fourierPolarStack, n2);
     imgPolarCorr.aliasImageInStack(mIpolarCorr,nF);
@@ -1003,19 +972,35 @@ bool isLocalMaxima(MultidimArray<double> &inputArray, int x, int y)
 
 void AutoParticlePicking2::polarCorrelation(const MultidimArray< std::complex< double > > &fourierPolarStack,
         MultidimArray<double> &IpolarCorr)
+{
+    PickingFeaturesAux aux;
+    polarCorrelation(fourierPolarStack,IpolarCorr,aux);
+}
+
+void AutoParticlePicking2::polarCorrelation(const MultidimArray< std::complex< double > > &fourierPolarStack,
+        MultidimArray<double> &IpolarCorr, PickingFeaturesAux &aux)
 {
     int nF = NSIZE(fourierPolarStack);
-    CorrelationAux aux;
 
     for (int n=0; n<nF;++n)
-        correlationBetweenPolarChannels(n,n,n,fourierPolarStack,IpolarCorr,aux);
+        correlationBetweenPolarChannels(n,n,n,fourierPolarStack,IpolarCorr,aux.corrAux,aux.corr2D);
     for (int i=0; i<(filter_num-corr_num);i++)
         for (int j=1;j<=corr_num;j++)
-            correlationBetweenPolarChannels(i,i+j,nF++,fourierPolarStack,IpolarCorr,aux);
+            correlationBetweenPolarChannels(i,i+j,nF++,fourierPolarStack,IpolarCorr,aux.corrAux,aux.corr2D);
 }
 
 AutoParticlePicking2::~AutoParticlePicking2()
-{}
+{
+    for (size_t t=0;t<featuresAux.size();t++)
+        delete featuresAux[t];
+}
+
+void AutoParticlePicking2::allocateFeaturesAux()
+{
+    size_t nThreads=ThreadPool::getInstance().getNumberOfThreads()+1;
+    while (featuresAux.size()<nThreads)
+        featuresAux.push_back(new PickingFeaturesAux);
+}
 
 void AutoParticlePicking2::extractStatics(MultidimArray<double> &inputVec,
         MultidimArray<double> &features)
@@ -1074,14 +1059,17 @@ void AutoParticlePicking2::buildVector(MultidimArray<double> &inputVec,
 
 void AutoParticlePicking2::buildInvariant(MultidimArray<double> &invariantChannel,int x,int y,int pre)
 {
-    MultidimArray<double> pieceImage;
-    MultidimArray< std::complex< double > > fourierPolarStack, fourierPolar;
+    PickingFeaturesAux aux;
+    buildInvariant(invariantChannel,x,y,pre,aux);
+}
+
+void AutoParticlePicking2::buildInvariant(MultidimArray<double> &invariantChannel,int x,int y,int pre,
+        PickingFeaturesAux &aux)
+{
+    MultidimArray< std::complex< double > > fourierPolar;
     MultidimArray<double> filter;
-    MultidimArray< std::complex<double> > tmpFourier;
-    FourierTransformer transformer;
-    pieceImage.resize(NangSteps,NRsteps);
-    transformer.FourierTransform(pieceImage,tmpFourier);
-    fourierPolarStack.initZeros(filter_num,1,YSIZE(tmpFourier),XSIZE(tmpFourier));
+    // The Fourier transform of a polar image has NangSteps x (NRsteps/2+1) coefficients
+    aux.fourierPolarStack.initZeros(filter_num,1,NangSteps,NRsteps/2+1);
     // First put the polar channels in a stack
     for (int j=0;j<filter_num;++j)
     {
@@ -1089,12 +1077,23 @@ void AutoParticlePicking2::buildInvariant(MultidimArray<double> &invariantChanne
             filter.aliasImageInStack(micrographStackPre(),j);
         else
             filter.aliasImageInStack(micrographStack(),j);
-        extractParticle(x,y,filter,pieceImage,true);
-        fourierPolar.aliasImageInStack(fourierPolarStack,j);
-        convert2PolarFourier(pieceImage,fourierPolar);
+        extractParticle(x,y,filter,aux.pieceImage,true);
+        fourierPolar.aliasImageInStack(aux.fourierPolarStack,j);
+        convert2PolarFourier(aux.pieceImage,fourierPolar,aux);
     }
     // Obtain the correlation between different channels
-    polarCorrelation(fourierPolarStack,invariantChannel);
+    polarCorrelation(aux.fourierPolarStack,invariantChannel,aux);
+}
+
+void AutoParticlePicking2::computeFeatures(int x, int y, PickingFeaturesAux &aux)
+{
+    if (NSIZE(aux.IpolarCorr)!=(size_t)num_correlation)
+        aux.IpolarCorr.initZeros(num_correlation,1,NangSteps,NRsteps);
+    buildInvariant(aux.IpolarCorr,x,y,0,aux);
+    extractParticle(x,y,microImage(),aux.pieceImage,false);
+    aux.pieceImage.resize(1,1,1,XSIZE(aux.pieceImage)*YSIZE(aux.pieceImage));
+    extractStatics(aux.pieceImage,aux.staticVec);
+    buildVector(aux.IpolarCorr,aux.staticVec,aux.featVec,aux.pieceImage);
 }
 
 double AutoParticlePicking2::PCAProject(MultidimArray<double> &pcaBasis,
@@ -1452,14 +1451,19 @@ void AutoParticlePicking2::extractNonParticle(std::vector<Particle2> &negativePo
 }
 void AutoParticlePicking2::convert2PolarFourier(MultidimArray<double> &particleImage,
         MultidimArray< std::complex< double > > &polarFourier)
+{
+    PickingFeaturesAux aux;
+    convert2PolarFourier(particleImage,polarFourier,aux);
+}
+
+void AutoParticlePicking2::convert2PolarFourier(MultidimArray<double> &particleImage,
+        MultidimArray< std::complex< double > > &polarFourier, PickingFeaturesAux &aux)
 {
     Matrix1D<double> R;
-    MultidimArray<double> polar;
-    FourierTransformer transformer;
     particleImage.setXmippOrigin();
-    image_convertCartesianToPolar_ZoomAtCenter(particleImage,polar,R,1,3,
+    image_convertCartesianToPolar_ZoomAtCenter(particleImage,aux.polar,R,1,3,
             XSIZE(particleImage)/2,NRsteps,0,2*PI,NangSteps);
-    transformer.FourierTransform(polar,polarFourier,true);
+    aux.polarTransformer.FourierTransform(aux.polar,polarFourier,true);
 }
 
 void AutoParticlePicking2::loadTrainingSet(const FileName &fn)
@@ -1642,39 +1646,101 @@ void AutoParticlePicking2::normalizeDataset(int a,int b)
     }
 }
 
+/* Local maxima of a band of rows of the convolution. Each row keeps its
+   own list so that the candidates are merged in raster order. */
+class LocalMaximaBody: public ParallelForBody
+{
+public:
+    MultidimArray<double> *convolveRes;
+    int startY, startX, endX;
+    std::vector< std::vector<Particle2> > rowMaxima;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        Particle2 p;
+        p.status=0;
+        for (size_t k=first;k<=last;k++)
+        {
+            int i=startY+(int)k;
+            std::vector<Particle2> &row=rowMaxima[k];
+            for (int j=startX;j<endX;j++)
+                if (isLocalMaxima(*convolveRes,j,i))
+                {
+                    p.y=i;
+                    p.x=j;
+                    p.cost=DIRECT_A2D_ELEM(*convolveRes,i,j);
+                    row.push_back(p);
+                }
+        }
+    }
+};
+
 void AutoParticlePicking2::buildSearchSpace(std::vector<Particle2> &positionArray,bool fast)
 {
     int endX,endY;
-    Particle2 p;
 
     endX=XSIZE(microImage())-particle_radius;
     endY=YSIZE(microImage())-particle_radius;
     applyConvolution(fast);
 
-    for (int i=particle_radius;i<endY;i++)
-        for (int j=particle_radius;j<endX;j++)
-            if (isLocalMaxima(convolveRes,j,i))
-            {
-                p.y=i;
-                p.x=j;
-                p.cost=DIRECT_A2D_ELEM(convolveRes,i,j);
-                p.status=0;
-                positionArray.push_back(p);
-            }
-    for (size_t i=0;i<positionArray.size();++i)
-        for (size_t j=0;j<positionArray.size()-i-1;j++)
-            if (positionArray[j].cost<positionArray[j + 1].cost)
-            {
-                p=positionArray[j+1];
-                positionArray[j+1]=positionArray[j];
-                positionArray[j]=p;
-            }
+    if (endY>particle_radius)
+    {
+        LocalMaximaBody body;
+        body.convolveRes=&convolveRes;
+        body.startY=particle_radius;
+        body.startX=particle_radius;
+        body.endX=endX;
+        body.rowMaxima.resize(endY-particle_radius);
+        ThreadPool::getInstance().parallelFor(0,endY-particle_radius-1,body,16);
+        for (size_t k=0;k<body.rowMaxima.size();k++)
+            positionArray.insert(positionArray.end(),body.rowMaxima[k].begin(),body.rowMaxima[k].end());
+    }
+    std::stable_sort(positionArray.begin(),positionArray.end(),higherCost);
 }
 
+/* Correlation of the micrograph with a range of rotations of the template
+   (in steps of 3 degrees). The correlation is band pass filtered in Fourier
+   space before the inverse transform. */
+class TemplateRotationsBody: public ParallelForBody
+{
+public:
+    const MultidimArray<double> *particleAvg;
+    const MultidimArray<std::complex<double> > *micrographFourier;
+    FourierFilter *filter;
+    int sizeX, sizeY;
+    std::vector< MultidimArray<double> > maxCorrelation;
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        MultidimArray<double> avgRotated, corr;
+        MultidimArray<std::complex<double> > FFTtemplate;
+        FourierTransformer transformer;
+        MultidimArray<double> &maxThread=maxCorrelation[thread_id];
+        for (size_t k=first;k<=last;k++)
+        {
+            // We first rotate the template and then put it in the big image in order to
+            // the convolution
+            rotate(LINEAR,avgRotated,*particleAvg,3.0*k);
+            avgRotated.setXmippOrigin();
+            avgRotated.window(corr,FIRST_XMIPP_INDEX(sizeY),FIRST_XMIPP_INDEX(sizeX),
+                              LAST_XMIPP_INDEX(sizeY),LAST_XMIPP_INDEX(sizeX));
+            transformer.FourierTransform(corr,FFTtemplate,false);
+            correlationInFourier(*micrographFourier,FFTtemplate,MULTIDIM_SIZE(corr));
+            filter->applyMaskFourierSpace(corr,FFTtemplate);
+            transformer.inverseFourierTransform();
+            if (XSIZE(maxThread)==0)
+                maxThread=corr;
+            else
+                FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(maxThread)
+                if (DIRECT_A2D_ELEM(corr,i,j)>DIRECT_A2D_ELEM(maxThread,i,j))
+                    DIRECT_A2D_ELEM(maxThread,i,j)=DIRECT_A2D_ELEM(corr,i,j);
+        }
+    }
+};
+
 void AutoParticlePicking2::applyConvolution(bool fast)
 {
 
-    MultidimArray<double> tempConvolve;
     MultidimArray<double> avgRotated, avgRotatedLarge;
     MultidimArray<int> mask;
     CorrelationAux aux;
@@ -1724,20 +1790,24 @@ void AutoParticlePicking2::applyConvolution(bool fast)
         filter.generateMask(convolveRes);
         filter.applyMaskSpace(convolveRes);
 
-        for (int deg=3;deg<360;deg+=3)
+        // The rest of rotations are distributed among the threads, each one
+        // keeps the maximum of its correlations
+        TemplateRotationsBody body;
+        body.particleAvg=&particleAvg;
+        body.micrographFourier=&aux.FFT1;
+        body.filter=&filter;
+        body.sizeX=sizeX;
+        body.sizeY=sizeY;
+        body.maxCorrelation.resize(ThreadPool::getInstance().getNumberOfThreads()+1);
+        ThreadPool::getInstance().parallelFor(1,119,body,1);
+        for (size_t t=0;t<body.maxCorrelation.size();t++)
         {
-            // We first rotate the template and then put it in the big image in order to
-            // the convolution
-            rotate(LINEAR,avgRotated,particleAvg,double(deg));
-            avgRotatedLarge=avgRotated;
-            avgRotatedLarge.setXmippOrigin();
-            avgRotatedLarge.selfWindow(FIRST_XMIPP_INDEX(sizeY),FIRST_XMIPP_INDEX(sizeX),
-                                       LAST_XMIPP_INDEX(sizeY),LAST_XMIPP_INDEX(sizeX));
-            correlation_matrix(aux.FFT1,avgRotatedLarge,tempConvolve,aux,false);
-            filter.applyMaskSpace(tempConvolve);
+            const MultidimArray<double> &maxThread=body.maxCorrelation[t];
+            if (XSIZE(maxThread)==0)
+                continue;
             FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY2D(convolveRes)
-            if (DIRECT_A2D_ELEM(tempConvolve,i,j)>DIRECT_A2D_ELEM(convolveRes,i,j))
-                DIRECT_A2D_ELEM(convolveRes,i,j)=DIRECT_A2D_ELEM(tempConvolve,i,j);
+            if (DIRECT_A2D_ELEM(maxThread,i,j)>DIRECT_A2D_ELEM(convolveRes,i,j))
+                DIRECT_A2D_ELEM(convolveRes,i,j)=DIRECT_A2D_ELEM(maxThread,i,j);
         }
     }
     CenterFFT(convolveRes,true);
@@ -1774,8 +1844,8 @@ void AutoParticlePicking2::readParams(XmippProgram * program)
 
 void AutoParticlePicking2::defineParams(XmippProgram * program)
 {
-    program->addParamsLine("  -i <micrograph>               : Micrograph image");
-    program->addParamsLine("  --outputRoot <rootname>       : Output rootname");
+    program->addParamsLine("  -i <micrograph>               : Micrograph image or metadata with a list of micrographs (autoselect mode)");
+    program->addParamsLine("  --outputRoot <rootname>       : Output rootname (output directory if the input is a list of micrographs)");
     program->addParamsLine("  --mode <mode>                 : Operation mode");
     program->addParamsLine("         where <mode>");
     program->addParamsLine("                    try              : Try to autoselect within the training phase.");
@@ -1818,5 +1888,20 @@ void ProgMicrographAutomaticPicking2::run()
     MD.getValue( MDL_PICKING_AUTOPICKPERCENT,proc_prec,MD.firstObject());
 
     autoPicking = new AutoParticlePicking2(autoPicking->particle_size,autoPicking->filter_num,autoPicking->corr_num,autoPicking->NPCA,fn_model,std::vector<MDRow>());
-    autoPicking->automaticWithouThread(fn_micrograph,proc_prec,fnAutoParticles);
+    if (fn_micrograph.isMetaData())
+    {
+        // A list of micrographs is picked by the same process, so that the
+        // model is only loaded once
+        MetaData mdMicrographs(fn_micrograph);
+        FileName fnMicrograph;
+        FOR_ALL_OBJECTS_IN_METADATA(mdMicrographs)
+        {
+            mdMicrographs.getValue(MDL_MICROGRAPH,fnMicrograph,__iter.objId);
+            fnAutoParticles=formatString("particles_auto@%s/%s.pos",fn_root.c_str(),
+                                         fnMicrograph.getBaseName().c_str());
+            autoPicking->automaticWithouThread(fnMicrograph,proc_prec,fnAutoParticles);
+        }
+    }
+    else
+        autoPicking->automaticWithouThread(fn_micrograph,proc_prec,fnAutoParticles);
 }
@@ -65,8 +65,26 @@ public:
     void read(std::istream &_in, int _vec_size);
 };
 
+/* Auxiliary variables of the feature extraction -------------------------- */
+/** Buffers and FFT plans used to compute the features of a candidate.
+ * Every thread has its own copy, so that they are reused from one
+ * candidate to the next.
+ */
+class PickingFeaturesAux
+{
+public:
+    MultidimArray<double> pieceImage, polar, corr2D, IpolarCorr, staticVec, featVec;
+    MultidimArray< std::complex< double > > fourierPolarStack;
+    FourierTransformer polarTransformer;
+    CorrelationAux corrAux;
+};
+
 /* Automatic particle picking ---------------------------------------------- */
-/** Class to perform the automatic particle picking */
+/** Class to perform the automatic particle picking.
+ * The filter bank, the convolution with the rotated templates, the
+ * feature extraction of the candidates and their classification are
+ * distributed among the threads of ThreadPool::getInstance().
+ */
 class AutoParticlePicking2
 {
 public:
@@ -100,6 +118,9 @@ public:
     MultidimArray<double> pcaModel, pcaRotModel, particleAvg, dataSet, dataSet1, classLabel;
     MultidimArray<double> classLabel1, labelSet, dataSetNormal;
 
+    // Auxiliary variables of the feature extraction of each thread
+    std::vector<PickingFeaturesAux *> featuresAux;
+
 public:
     /// Constructor
 //    AutoParticlePicking2(int particle_size, int filter_num = 6, int corr_num = 2, int NPCA = 4,
@@ -178,10 +199,19 @@ public:
     void convert2PolarFourier(MultidimArray<double> &particleImage,
     				   MultidimArray< std::complex< double > > &polar);
 
+    /// Same as the previous one with the buffers of a thread
+    void convert2PolarFourier(MultidimArray<double> &particleImage,
+                              MultidimArray< std::complex< double > > &polar,
+                              PickingFeaturesAux &aux);
+
     /// Calculate the correlation of different polar channels
     void polarCorrelation(const MultidimArray< std::complex< double > > &fourierPolarStack,
                           MultidimArray<double> &IpolarCorr);
 
+    /// Same as the previous one with the buffers of a thread
+    void polarCorrelation(const MultidimArray< std::complex< double > > &fourierPolarStack,
+                          MultidimArray<double> &IpolarCorr, PickingFeaturesAux &aux);
+
     /// Convolve the micrograph with the different templates
     void applyConvolution(bool fast);
 
@@ -247,6 +277,26 @@ public:
     void buildInvariant(MultidimArray<double> &invariantChannel,
                         int x,int y, int pre);
 
+    /// Same as the previous one with the buffers of a thread
+    void buildInvariant(MultidimArray<double> &invariantChannel,
+                        int x,int y, int pre, PickingFeaturesAux &aux);
+
+    /// Allocate the auxiliary variables of all the threads
+    void allocateFeaturesAux();
+
+    /*
+     * Compute the feature vector (aux.featVec) of the candidate
+     * at x,y of the current micrograph.
+     */
+    void computeFeatures(int x, int y, PickingFeaturesAux &aux);
+
+    /*
+     * Classify the first num candidates (their features are in autoFeatVec)
+     * and keep in auto_candidates those that are particles and are not
+     * occluded by a better one.
+     */
+    void classifyCandidates(const std::vector<Particle2> &positionArray, int num);
+
     /*
      * This method does a convolution in order to find an approximation
      * about the place of the particles.
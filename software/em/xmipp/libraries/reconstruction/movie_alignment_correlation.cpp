@@ -24,6 +24,7 @@
  ***************************************************************************/
 
 #include "movie_alignment_correlation.h"
+#include "movie_filter_dose.h"
 #include <data/metadata_extension.h>
 #include <data/xmipp_fftw.h>
 #include <data/filters.h>
@@ -58,6 +59,9 @@ void ProgMovieAlignmentCorrelation::readParams()
     useInputShifts = checkParam("--useInputShifts");
     bin = getDoubleParam("--bin");
     BsplineOrder = getIntParam("--Bspline");
+    dosePerFrame = getDoubleParam("--doseWeighting",0);
+    accVoltage = getDoubleParam("--doseWeighting",1);
+    preExposure = getDoubleParam("--doseWeighting",2);
     show();
 
     String outside=getParam("--outside");
@@ -96,6 +100,9 @@ void ProgMovieAlignmentCorrelation::show()
 	<< "Use input shifts:    " << useInputShifts     << std::endl
 	<< "Binning factor:      " << bin                << std::endl
 	<< "Bspline:             " << BsplineOrder       << std::endl
+	<< "Dose per frame:      " << dosePerFrame       << std::endl
+	<< "Voltage:             " << accVoltage         << std::endl
+	<< "Pre-exposure:        " << preExposure        << std::endl
     ;
 }
 
@@ -131,6 +138,10 @@ void ProgMovieAlignmentCorrelation::defineParams()
     addParamsLine("             wrap              : Wrap the image to deal with borders");
     addParamsLine("             avg               : Fill borders with the average of the frame");
     addParamsLine("             value             : Fill borders with a specific value v");
+    addParamsLine("  [--doseWeighting <dose=0> <voltage=300> <preExposure=0>]: Weight the frames of the aligned micrograph by their dose");
+    addParamsLine("                               :+Dose per frame and pre-exposure in e/A^2, voltage (200 or 300) in kV.");
+    addParamsLine("                               :+Each frame is Fourier transformed once, and shifted in Fourier space (the border");
+    addParamsLine("                               :+is wrapped), filtered as in xmipp_movie_filter_dose and added to the weighted average");
     addExampleLine("A typical example",false);
     addExampleLine("xmipp_movie_alignment_correlation -i movie.xmd --oaligned alignedMovie.stk --oavg alignedMicrograph.mrc");
     addSeeAlsoLine("xmipp_movie_optical_alignment_cpu");
@@ -158,6 +169,104 @@ void computeTotalShift(int iref, int j, const Matrix1D<double> &shiftX, const Ma
     }
 }
 
+void ProgMovieAlignmentCorrelation::setupMovieReader(MetaData &movie)
+{
+    useMovieReader=false;
+    movieFrames.clear();
+    frameBlock.clear();
+    blockFirst=-1;
+
+    FileName fnFrame, fnStack;
+    String fnFile;
+    size_t no;
+    FOR_ALL_OBJECTS_IN_METADATA(movie)
+    {
+        movie.getValue(MDL_IMAGE,fnFrame,__iter.objId);
+        fnFrame.decompose(no,fnFile);
+        if (no==ALL_IMAGES || (fnStack!="" && fnFile!=fnStack))
+            return;
+        fnStack=fnFile;
+        movieFrames.push_back(no-FIRST_IMAGE);
+    }
+    if (fnStack=="" || !MovieReader::isSupported(fnStack))
+        return;
+
+    movieReader.open(fnStack);
+    if (yDRcorner!=-1)
+        movieReader.setWindow(yLTcorner, xLTcorner, yDRcorner, xDRcorner);
+    movieReader.setCorrection(XSIZE(dark())>0 ? &dark() : NULL, XSIZE(gain())>0 ? &gain() : NULL);
+    useMovieReader=true;
+}
+
+void ProgMovieAlignmentCorrelation::loadFrame(int n, int nmax, const FileName &fnFrame, MultidimArray<double> &croppedFrame)
+{
+    if (useMovieReader)
+    {
+        if (blockFirst<0 || n<blockFirst || n>=blockFirst+(int)frameBlock.size())
+        {
+            int blockSize=ThreadPool::getInstance().getNumberOfThreads()+1;
+            int blockLast=std::min(std::min(n+blockSize-1,nmax),(int)movieFrames.size()-1);
+            std::vector<size_t> frameNumbers(movieFrames.begin()+n,movieFrames.begin()+blockLast+1);
+            movieReader.readFrames(frameNumbers,frameBlock);
+            blockFirst=n;
+        }
+        typeCast(frameBlock[n-blockFirst],croppedFrame);
+        STARTINGY(croppedFrame)=STARTINGY(frameBlock[n-blockFirst]);
+        STARTINGX(croppedFrame)=STARTINGX(frameBlock[n-blockFirst]);
+        return;
+    }
+
+    Image<double> frame;
+    frame.read(fnFrame);
+    if (yDRcorner==-1)
+        croppedFrame=frame();
+    else
+        frame().window(croppedFrame, yLTcorner, xLTcorner, yDRcorner, xDRcorner);
+    if (XSIZE(dark())>0)
+        croppedFrame-=dark();
+    if (XSIZE(gain())>0)
+        croppedFrame*=gain();
+}
+
+/* Shift a frame in Fourier space and add it, weighted, to the sum of frames.
+ * The unshifted frame is added to initialSum if it is not NULL. Xdim is the
+ * size of the frames in real space. F is left shifted.
+ */
+static void shiftWeightAndAccumulate(MultidimArray< std::complex<double> > &F, int Xdim,
+                                     const Matrix1D<double> &shift, const MultidimArray<double> &weights,
+                                     MultidimArray< std::complex<double> > &sum, MultidimArray<double> &sumWeights,
+                                     MultidimArray< std::complex<double> > *initialSum)
+{
+    // The phase ramp is separable
+    std::vector< std::complex<double> > phaseX(XSIZE(F));
+    double w;
+    for (size_t j=0; j<XSIZE(F); ++j)
+    {
+        FFT_IDX2DIGFREQ(j,Xdim,w);
+        double arg=-2*PI*w*XX(shift);
+        phaseX[j]=std::complex<double>(cos(arg),sin(arg));
+    }
+    for (size_t i=0; i<YSIZE(F); ++i)
+    {
+        FFT_IDX2DIGFREQ(i,YSIZE(F),w);
+        double arg=-2*PI*w*YY(shift);
+        std::complex<double> phaseY(cos(arg),sin(arg));
+        std::complex<double> *ptrF=&DIRECT_A2D_ELEM(F,i,0);
+        std::complex<double> *ptrSum=&DIRECT_A2D_ELEM(sum,i,0);
+        double *ptrSumWeights=&DIRECT_A2D_ELEM(sumWeights,i,0);
+        const double *ptrWeights=&DIRECT_A2D_ELEM(weights,i,0);
+        std::complex<double> *ptrInitial=initialSum==NULL ? NULL : &DIRECT_A2D_ELEM(*initialSum,i,0);
+        for (size_t j=0; j<XSIZE(F); ++j)
+        {
+            if (ptrInitial!=NULL)
+                ptrInitial[j]+=ptrF[j];
+            ptrF[j]*=phaseY*phaseX[j];
+            ptrSum[j]+=ptrWeights[j]*ptrF[j];
+            ptrSumWeights[j]+=ptrWeights[j];
+        }
+    }
+}
+
 void ProgMovieAlignmentCorrelation::run()
 {
     MetaData movie;
@@ -194,7 +303,7 @@ void ProgMovieAlignmentCorrelation::run()
         nlastSum=movie.size();
 
 	FileName fnFrame;
-	Image<double> frame, croppedFrame, reducedFrame, shiftedFrame, averageMicrograph, dark, gain;
+	Image<double> croppedFrame, reducedFrame, shiftedFrame, averageMicrograph;
     Matrix1D<double> shift(2);
     if (!useInputShifts)
     {
@@ -248,6 +357,7 @@ void ProgMovieAlignmentCorrelation::run()
 		}
 		int n=0;
 		FourierTransformer transformer;
+		MultidimArray< std::complex<double> > frameFourierFull;
 		Matrix1D<double> w(2);
 		std::complex<double> zero=0;
 
@@ -268,6 +378,8 @@ void ProgMovieAlignmentCorrelation::run()
 				REPORT_ERROR(ERR_ARG_INCORRECT,"The input gain image is incorrect, its inverse produces infinite or nan");
 		}
 
+		setupMovieReader(movie);
+
 		MultidimArray<double> filter;
 		bool firstImage=true;
 		FOR_ALL_OBJECTS_IN_METADATA(movie)
@@ -275,23 +387,15 @@ void ProgMovieAlignmentCorrelation::run()
 			if (n>=nfirst && n<=nlast)
 			{
 				movie.getValue(MDL_IMAGE,fnFrame,__iter.objId);
-				if (yDRcorner==-1)
-					croppedFrame.read(fnFrame);
-				else
-				{
-					frame.read(fnFrame);
-					frame().window(croppedFrame(), yLTcorner, xLTcorner, yDRcorner, xDRcorner);
-				}
-				if (XSIZE(dark())>0)
-					croppedFrame()-=dark();
-				if (XSIZE(gain())>0)
-					croppedFrame()*=gain();
-				// Reduce the size of the input frame
-				scaleToSizeFourier(1,newYdim,newXdim,croppedFrame(),reducedFrame());
-
-				// Now do the Fourier transform and filter
+				loadFrame(n,nlast,fnFrame,croppedFrame());
+				// Fourier transform of the frame, reduced to the target size
+				// (as scaleToSizeFourier, without going back to real space)
+				transformer.FourierTransform(croppedFrame(),frameFourierFull,false);
 				MultidimArray< std::complex<double> > *reducedFrameFourier=new MultidimArray< std::complex<double> >;
-				transformer.FourierTransform(reducedFrame(),*reducedFrameFourier,true);
+				reducedFrameFourier->resizeNoCopy(newYdim,newXdim/2+1);
+				windowFourierTransform(frameFourierFull,*reducedFrameFourier);
+
+				// Now filter
 				if (firstImage)
 				{
 					filter.initZeros(*reducedFrameFourier);
@@ -325,9 +429,8 @@ void ProgMovieAlignmentCorrelation::run()
 
 		// Free useless memory
 		filter.clear();
-		reducedFrame.clear();
 		croppedFrame.clear();
-		frame.clear();
+		frameBlock.clear();
 
 		// Now compute all shifts
 		size_t N=frameFourier.size();
@@ -474,10 +577,21 @@ void ProgMovieAlignmentCorrelation::run()
     }
 
     // Apply shifts and compute average
+    setupMovieReader(movie);
 	int n=0;
     int j=0;
 	size_t N=0, Ninitial=0;
 	Image<double> initialMic;
+
+	// With dose weighting the frames are transformed once and the sums are done in Fourier space
+	bool doseWeighting=dosePerFrame>0;
+	ProgMovieFilterDose doseFilter;
+	FourierTransformer transformerFrame, transformerSum;
+	MultidimArray< std::complex<double> > frameFourierFull, shiftedFourier, sumFourier, initialFourier;
+	MultidimArray<double> doseWeights, sumWeights;
+	int sumXdim=0, sumYdim=0;
+	if (doseWeighting)
+		doseFilter.initVoltage(accVoltage);
     FOR_ALL_OBJECTS_IN_METADATA(movie)
     {
         if (n>=nfirstSum && n<=nlastSum)
@@ -487,15 +601,48 @@ void ProgMovieAlignmentCorrelation::run()
             movie.getValue(MDL_SHIFT_Y,YY(shift),__iter.objId);
             std::cout << fnFrame << " shiftX=" << XX(shift) << " shiftY=" << YY(shift) << std::endl;
 
-            frame.read(fnFrame);
-            if (XSIZE(dark())>0)
-            	frame()-=dark();
-            if (XSIZE(gain())>0)
-            	frame()*=gain();
-            if (yDRcorner!=-1)
-                frame().window(croppedFrame(), yLTcorner, xLTcorner, yDRcorner, xDRcorner);
-            else
-            	croppedFrame()=frame();
+            loadFrame(n,nlastSum,fnFrame,croppedFrame());
+            if (doseWeighting)
+            {
+            	transformerFrame.FourierTransform(croppedFrame(),frameFourierFull,false);
+            	if (j==0)
+            	{
+            		sumYdim=YSIZE(croppedFrame());
+            		sumXdim=XSIZE(croppedFrame());
+            		doseFilter.pixel_size=Ts;
+            		if (bin>0)
+            		{
+            			sumYdim=floor(sumYdim/bin);
+            			sumXdim=floor(sumXdim/bin);
+            			doseFilter.pixel_size=Ts*bin;
+            		}
+            		shiftedFrame().resizeNoCopy(sumYdim,sumXdim);
+            		transformerSum.setReal(shiftedFrame());
+            		transformerSum.getFourierAlias(shiftedFourier);
+            		sumFourier.initZeros(shiftedFourier);
+            		sumWeights.initZeros(YSIZE(shiftedFourier),XSIZE(shiftedFourier));
+            		if (fnInitialAvg!="")
+            			initialFourier.initZeros(shiftedFourier);
+            	}
+            	if (bin>0)
+            		shift/=bin;
+            	windowFourierTransform(frameFourierFull,shiftedFourier);
+            	doseFilter.computeDoseWeights(sumYdim,sumXdim,n*dosePerFrame+preExposure,(n+1)*dosePerFrame+preExposure,
+            			doseWeights);
+            	shiftWeightAndAccumulate(shiftedFourier,sumXdim,shift,doseWeights,sumFourier,sumWeights,
+            			fnInitialAvg!="" ? &initialFourier : NULL);
+            	if (fnAligned!="")
+            	{
+            		transformerSum.inverseFourierTransform();
+            		shiftedFrame.write(fnAligned,j+1,true,WRITE_REPLACE);
+            	}
+            	if (fnInitialAvg!="")
+            		Ninitial++;
+            	N++;
+            	j++;
+            	n++;
+            	continue;
+            }
             if (bin>0)
             {
             	scaleToSizeFourier(1,floor(YSIZE(croppedFrame())/bin),floor(XSIZE(croppedFrame())/bin),croppedFrame(),reducedFrame());
@@ -536,6 +683,27 @@ void ProgMovieAlignmentCorrelation::run()
         }
         n++;
     }
+    if (doseWeighting && N>0)
+    {
+    	// Back to real space
+    	if (fnInitialAvg!="")
+    	{
+    		FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(initialFourier)
+    			DIRECT_MULTIDIM_ELEM(shiftedFourier,n)=DIRECT_MULTIDIM_ELEM(initialFourier,n);
+    		transformerSum.inverseFourierTransform();
+    		initialMic()=shiftedFrame();
+    	}
+    	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(sumFourier)
+    	{
+    		double weight=DIRECT_MULTIDIM_ELEM(sumWeights,n);
+    		DIRECT_MULTIDIM_ELEM(shiftedFourier,n)=weight>0 ? DIRECT_MULTIDIM_ELEM(sumFourier,n)/weight : std::complex<double>(0.);
+    	}
+    	transformerSum.inverseFourierTransform();
+    	averageMicrograph()=shiftedFrame();
+    	// The weighted average is already normalized
+    	N=1;
+    }
+
     if (fnInitialAvg!="")
     {
     	initialMic()/=Ninitial;
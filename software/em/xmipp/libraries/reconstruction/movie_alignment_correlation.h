@@ -27,6 +27,7 @@
 #define _PROG_MOVIE_ALIGNMENT_CORRELATION
 
 #include <data/xmipp_program.h>
+#include <data/xmipp_movie_reader.h>
 
 /**@defgroup MovieAlignmentCorrelation Movie alignment by correlation
    @ingroup ReconsLibrary */
@@ -70,6 +71,12 @@ public:
     int outsideMode;
     /** Outside value */
     double outsideValue;
+    /** Dose per frame (e/A^2), 0 for no dose weighting of the average */
+    double dosePerFrame;
+    /** Acceleration voltage (kV) */
+    double accVoltage;
+    /** Pre-exposure (e/A^2) */
+    double preExposure;
 
     /*****************************/
     /** crop corner **/
@@ -92,6 +99,18 @@ public:
 
 	// Target size of the frames
 	int newXdim, newYdim;
+
+	// Dark and inverse of the gain (cropped as the frames)
+	Image<double> dark, gain;
+
+	// Direct reader of the movie, if all the frames are in one MRC or TIFF file
+	MovieReader movieReader;
+	bool useMovieReader;
+	// Frame number in the file of each frame of the movie metadata
+	std::vector<size_t> movieFrames;
+	// Frames decoded in parallel, starting at frame blockFirst of the metadata
+	std::vector< MultidimArray<float> > frameBlock;
+	int blockFirst;
 public:
     /// Read argument from command line
     void readParams();
@@ -102,6 +121,15 @@ public:
     /// Define parameters
     void defineParams();
 
+    /// Open the movie reader if all the frames of the movie are in the same file
+    void setupMovieReader(MetaData &movie);
+
+    /** Cropped frame n of the movie corrected by dark and gain. With the movie
+     *  reader, the frames from n to nmax are read in blocks of frames decoded
+     *  in parallel.
+     */
+    void loadFrame(int n, int nmax, const FileName &fnFrame, MultidimArray<double> &croppedFrame);
+
     /// Run
     void run();
 
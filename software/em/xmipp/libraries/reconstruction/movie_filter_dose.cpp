@@ -103,6 +103,7 @@ void ProgMovieFilterDose::init(void) {
 	critical_dose_c = 2.8141;
 	// init with a very large number
 	critical_dose_at_dc = std::numeric_limits<double>::max() * 0.001;
+	criticalDoseSampling = -1;
 
 }
 ProgMovieFilterDose::ProgMovieFilterDose(void) {
@@ -128,49 +129,59 @@ ProgMovieFilterDose::ProgMovieFilterDose(double accelerationVoltage) {
 }
 
 
-void ProgMovieFilterDose::applyDoseFilterToImage(
-		int Ydim, int Xdim,
-		const MultidimArray<std::complex<double> > &FFT1,
-		const double dose_start, const double dose_finish) {
-	double * ptrv = (double *) MULTIDIM_ARRAY(FFT1);
-	std::complex<double> complex_zero = 0;
-	double x, y;
-	double xx, yy;
+void ProgMovieFilterDose::computeDoseWeights(
+		int Ydim, int Xdim, const double dose_start, const double dose_finish,
+		MultidimArray<double> &weights) {
+	if (YSIZE(criticalDoseTable) != Ydim || XSIZE(criticalDoseTable) != Xdim / 2 + 1
+			|| criticalDoseSampling != pixel_size) {
+		criticalDoseTable.resizeNoCopy(Ydim, Xdim / 2 + 1);
+		criticalDoseSampling = pixel_size;
+		double x, y;
+		double yy;
+		int sizeX_2 = Xdim / 2;
+		double ixsize = 1.0 / Xdim;
+		int sizeY_2 = Ydim / 2;
+		double iysize = 1.0 / Ydim;
+		for (long int i = 0; i < YSIZE(criticalDoseTable); i++) { //i->y,j->x xmipp convention is oposite summove
+			FFT_IDX2DIGFREQ_FAST(i, Ydim, sizeY_2, iysize, y);
+			yy = y * y;
+			for (long int j = 0; j < XSIZE(criticalDoseTable); j++) {
+				FFT_IDX2DIGFREQ_FAST(j, Xdim, sizeX_2, ixsize, x);
+				if (i == 0 && j == 0)
+					//ROB: I do not understand this step
+					//It forces the origin to 0
+					//Why not keep the value?
+					DIRECT_A2D_ELEM(criticalDoseTable, i, j) = critical_dose_at_dc;
+				else
+					DIRECT_A2D_ELEM(criticalDoseTable, i, j) = criticalDose(
+							sqrt(x * x + yy) / pixel_size);
+			}
+		}
+	}
+
+	weights.resizeNoCopy(criticalDoseTable);
 	double current_critical_dose, current_optimal_dose;
-	int sizeX_2 = Xdim / 2;
-	double ixsize = 1.0 / Xdim;
-	int sizeY_2 = Ydim / 2;
-	double iysize = 1.0 / Ydim;
-	for (long int i = 0; i < YSIZE(FFT1); i++) { //i->y,j->x xmipp convention is oposite summove
-		FFT_IDX2DIGFREQ_FAST(i, Ydim, sizeY_2, iysize, y);
-		yy = y * y;
-		for (long int j = 0; j < XSIZE(FFT1); j++) {
-			FFT_IDX2DIGFREQ_FAST(j, Xdim, sizeX_2, ixsize, x);
-#ifdef DEBUG_FFT_FREQ
-			std::cerr << "(j+1,i+1)(x,y)=" << j +1 << "," << i + 1<< " "
-					                       << x    << " " << y << " = "
-										   << DIRECT_A2D_ELEM(FFT1, i, j) << std::endl;
-#endif
-			if (i == 0 && j == 0)
-				//ROB: I do not understand this step
-				//It forces the origin to 0
-				//Why not keep the value?
-				current_critical_dose = critical_dose_at_dc;
-			else
-				current_critical_dose = criticalDose(
-						sqrt(x * x + yy) / pixel_size);
-		    current_optimal_dose = optimalDoseGivenCriticalDose(
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(criticalDoseTable) {
+		current_critical_dose = DIRECT_MULTIDIM_ELEM(criticalDoseTable, n);
+		current_optimal_dose = optimalDoseGivenCriticalDose(
+				current_critical_dose);
+		if (fabs(dose_finish - current_optimal_dose)
+				< fabs(dose_start - current_optimal_dose))
+			DIRECT_MULTIDIM_ELEM(weights, n) = doseFilter(dose_finish,
 					current_critical_dose);
-			if (abs(dose_finish - current_optimal_dose)
-					< abs(dose_start - current_optimal_dose)) {
-				DIRECT_A2D_ELEM(FFT1, i, j ) *= doseFilter(dose_finish,
-						current_critical_dose);
-			} else
-				DIRECT_A2D_ELEM(FFT1, i, j ) = complex_zero;
-
-		}
+		else
+			DIRECT_MULTIDIM_ELEM(weights, n) = 0.;
 	}
+}
 
+void ProgMovieFilterDose::applyDoseFilterToImage(
+		int Ydim, int Xdim,
+		const MultidimArray<std::complex<double> > &FFT1,
+		const double dose_start, const double dose_finish) {
+	MultidimArray<double> weights;
+	computeDoseWeights(Ydim, Xdim, dose_start, dose_finish, weights);
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(FFT1)
+		DIRECT_MULTIDIM_ELEM(FFT1, n) *= DIRECT_MULTIDIM_ELEM(weights, n);
 }
 void ProgMovieFilterDose::run() {
 	show();
@@ -103,8 +103,10 @@ public:
 	/// Restore noise power after filtering?', 'Renormalise the summed image after filtering
     bool restore_power;
 
-    // Fourier transforms of the input images
-	std::vector< MultidimArray<std::complex<double> > * > frameFourierVec;
+    // Critical dose of each frequency of the Fourier transform of the frames
+	MultidimArray<double> criticalDoseTable;
+	// Sampling rate used to compute criticalDoseTable
+	double criticalDoseSampling;
 
 public:
     /// Read argument from command line
@@ -136,6 +138,13 @@ public:
    /// Given the critical dose, return an estimate of the optimal dose (at which the SNR is maximised)
    double optimalDoseGivenCriticalDose(double critical_dose);
 
+   /** Attenuation of each frequency of a frame with the given dose range.
+    *  weights has the size of the Fourier transform of a Ydim x Xdim image.
+    *  The critical dose of each frequency is computed once for all frames.
+    */
+   void computeDoseWeights(int Ydim, int Xdim, const double dose_start, const double dose_finish,
+		   MultidimArray<double> &weights);
+
    /// Apply a dose filter to the image Fourier transform
    void applyDoseFilterToImage(
 		int Ydim, int Xdim,
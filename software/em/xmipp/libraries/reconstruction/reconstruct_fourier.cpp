@@ -35,7 +35,8 @@ void ProgRecFourier::defineParams()
     addUsageLine("Generate 3D reconstructions from projections using direct Fourier interpolation with arbitrary geometry.");
     addUsageLine("Kaisser-windows are used for interpolation in Fourier space.");
     //params
-    addParamsLine("   -i <md_file>                : Metadata file with input projections");
+    addParamsLine("  [-i <md_file>]                 : Metadata file with input projections");
+    addParamsLine("                                 : It may be omitted if accumulators are loaded");
     addParamsLine("  [-o <volume_file=\"rec_fourier.vol\">]  : Filename for output volume");
     addParamsLine("  [--iter <iterations=1>]      : Number of iterations for weight correction");
     addParamsLine("  [--sym <symfile=c1>]              : Enforce symmetry in projections");
@@ -44,6 +45,9 @@ void ProgRecFourier::defineParams()
     addParamsLine("  [--max_resolution <p=0.5>]     : Max resolution (Nyquist=0.5)");
     addParamsLine("  [--weight]                     : Use weights stored in the image metadata");
     addParamsLine("  [--thr <threads=1> <rows=1>]   : Number of concurrent threads and rows processed at time by a thread");
+    addParamsLine("  [--threadAccumulators]         : Each thread processes whole images on its own Fourier volume");
+    addParamsLine("                                 : Threads do not wait for each other on every image, but one extra");
+    addParamsLine("                                 : Fourier volume per thread is needed");
     addParamsLine("  [--blob <radius=1.9> <order=0> <alpha=15>] : Blob parameters");
     addParamsLine("                                 : radius in pixels, order of Bessel function in blob and parameter alpha");
     addParamsLine("  [--useCTF]                     : Use CTF information if present");
@@ -52,14 +56,29 @@ void ProgRecFourier::defineParams()
     addParamsLine("  [--phaseFlipped]               : Give this flag if images have been already phase flipped");
     addParamsLine("  [--minCTF <ctf=0.01>]          : Minimum value of the CTF that will be inverted");
     addParamsLine("                                 : CTF values (in absolute value) below this one will not be corrected");
+    addParamsLine("  == Incremental reconstruction ==");
+    addParamsLine("  [--loadAccumulators <...>]     : Add the Fourier accumulators saved by previous runs before processing the images");
+    addParamsLine("                                 : Each accumulator is given by its rootname (see --saveAccumulator)");
+    addParamsLine("  [--saveAccumulator <rootname>] : Save the Fourier sums and weights before computing the volume");
+    addParamsLine("                                 : rootname_Fourier.mrc, rootname_Weights.vol and rootname.xmd are written.");
+    addParamsLine("                                 : Runs with new images can resume from it, and accumulators computed");
+    addParamsLine("                                 : on different machines can be merged. Symmetry, padding, blob and max resolution must agree");
+    addParamsLine("  [--noFinalize]                 : Do not compute the output volume, only update the accumulator");
+    addParamsLine("  [--updateEvery <N=0>]          : Write an intermediate volume each N images (0 for no intermediate volumes)");
+    addParamsLine("                                 : They are named as the output volume plus the number of images");
     addExampleLine("For reconstruct enforcing i3 symmetry and using stored weights:", false);
     addExampleLine("   xmipp_reconstruct_fourier  -i reconstruction.sel --sym i3 --weight");
+    addExampleLine("Add new particles to a previous reconstruction and update the accumulator:", false);
+    addExampleLine("   xmipp_reconstruct_fourier  -i new_particles.xmd --loadAccumulators acc --saveAccumulator acc -o rec.vol");
+    addExampleLine("Merge the accumulators of two runs:", false);
+    addExampleLine("   xmipp_reconstruct_fourier  --loadAccumulators run1/acc run2/acc -o rec.vol");
 }
 
 // Read arguments ==========================================================
 void ProgRecFourier::readParams()
 {
-    fn_sel = getParam("-i");
+    if (checkParam("-i"))
+        fn_sel = getParam("-i");
     fn_out = getParam("-o");
     fn_sym = getParam("--sym");
     if(checkParam("--prepare_fsc"))
@@ -73,12 +92,27 @@ void ProgRecFourier::readParams()
     maxResolution = getDoubleParam("--max_resolution");
     numThreads = getIntParam("--thr");
     thrWidth = getIntParam("--thr", 1);
+    threadAccumulators = checkParam("--threadAccumulators");
     NiterWeight = getIntParam("--iter");
     useCTF = checkParam("--useCTF");
     phaseFlipped = checkParam("--phaseFlipped");
     minCTF = getDoubleParam("--minCTF");
     if (useCTF)
         Ts=getDoubleParam("--sampling");
+    fn_accumulators.clear();
+    if (checkParam("--loadAccumulators"))
+        getListParam("--loadAccumulators", fn_accumulators);
+    if (checkParam("--saveAccumulator"))
+        fn_accumulator_out = getParam("--saveAccumulator");
+    noFinalize = checkParam("--noFinalize");
+    updateEvery = getIntParam("--updateEvery");
+    if (fn_sel.empty() && fn_accumulators.empty())
+        REPORT_ERROR(ERR_ARG_MISSING, "Input images (-i) or accumulators (--loadAccumulators) must be given");
+    if (NiterWeight > 1 && (!fn_accumulators.empty() || !fn_accumulator_out.empty() || updateEvery > 0))
+        REPORT_ERROR(ERR_ARG_INCORRECT, "Incremental reconstruction needs --iter 0 or 1, "
+                     "more weight iterations would have to revisit all images");
+    if (updateEvery > 0 && !fn_fsc.empty())
+        REPORT_ERROR(ERR_ARG_INCORRECT, "--updateEvery cannot be used with --prepare_fsc");
 }
 
 // Show ====================================================================
@@ -97,6 +131,14 @@ void ProgRecFourier::show()
             std::cout << " Symmetry file for projections : "  << fn_sym << std::endl;
         if (fn_fsc != "")
             std::cout << " File root for FSC files: " << fn_fsc << std::endl;
+        if (threadAccumulators)
+            std::cout << " Using one Fourier accumulator per thread" << std::endl;
+        for (size_t n = 0; n < fn_accumulators.size(); ++n)
+            std::cout << " Load accumulator        : " << fn_accumulators[n] << std::endl;
+        if (!fn_accumulator_out.empty())
+            std::cout << " Save accumulator        : " << fn_accumulator_out << std::endl;
+        if (updateEvery > 0)
+            std::cout << " Intermediate volume every " << updateEvery << " images" << std::endl;
         if (do_weights)
             std::cout << " Use weights stored in the image headers or doc file" << std::endl;
         else
@@ -129,10 +171,17 @@ void ProgRecFourier::run()
         else
             init_progress_bar(SF.size());
     }
+    // Start from previous reconstructions, before creating the threads
+    // so that incompatible accumulators are reported right away
+    accumulatedImages = 0;
+    for (size_t n = 0; n < fn_accumulators.size(); ++n)
+        loadAccumulator(fn_accumulators[n]);
+
     // Create threads stuff
     barrier_init( &barrier, numThreads+1 );
     pthread_mutex_init( &workLoadMutex, NULL );
     statusArray = NULL;
+    imageDistributor = NULL;
     th_ids = (pthread_t *)malloc( numThreads * sizeof( pthread_t));
     th_args = (ImageThreadParams *) malloc ( numThreads * sizeof( ImageThreadParams ) );
 
@@ -147,13 +196,32 @@ void ProgRecFourier::run()
     }
 
     //Computing interpolated volume
-    processImages(0, SF.size() - 1, !fn_fsc.empty(), false);
+    if (updateEvery > 0)
+    {
+        for (size_t first = 0; first < SF.size(); first += updateEvery)
+        {
+            size_t last = XMIPP_MIN(first + updateEvery, SF.size()) - 1;
+            processImages(first, last, false, false);
+            if (last + 1 < SF.size())
+                writeIntermediateVolume(fn_out.insertBeforeExtension(formatString("_%06lu",
+                                        accumulatedImages + last + 1)));
+        }
+    }
+    else if (SF.size() > 0)
+        processImages(0, SF.size() - 1, !fn_fsc.empty(), false);
+    accumulatedImages += SF.size();
 
-    // Correcting the weights
-    correctWeight();
+    if (!fn_accumulator_out.empty())
+        saveAccumulator(fn_accumulator_out);
 
-    //Saving the volume
-    finishComputations(fn_out);
+    if (!noFinalize)
+    {
+        // Correcting the weights
+        correctWeight();
+
+        //Saving the volume
+        finishComputations(fn_out);
+    }
 
     threadOpCode = EXIT_THREAD;
 
@@ -174,6 +242,8 @@ void ProgRecFourier::run()
     }
     free(th_ids);
     free(th_args);
+    threadVoutFourier.clear();
+    threadFourierWeights.clear();
 }
 
 
@@ -184,19 +254,35 @@ void ProgRecFourier::produceSideinfo()
     maxResolution2=maxResolution*maxResolution;
 
     // Read the input images
-    SF.read(fn_sel);
-    SF.removeDisabled();
-
-    // Ask for memory for the output volume and its Fourier transform
-    size_t objId = SF.firstObject();
-    FileName fnImg;
-    SF.getValue(MDL_IMAGE,fnImg,objId);
-    Image<double> I;
-    I.read(fnImg, HEADER);
-    int Ydim=YSIZE(I());
-    int Xdim=XSIZE(I());
-    if (Ydim!=Xdim)
-        REPORT_ERROR(ERR_MULTIDIM_SIZE,"This algorithm only works for squared images");
+    int Xdim;
+    if (!fn_sel.empty())
+    {
+        SF.read(fn_sel);
+        SF.removeDisabled();
+    }
+    if (SF.size() > 0)
+    {
+        // Ask for memory for the output volume and its Fourier transform
+        size_t objId = SF.firstObject();
+        FileName fnImg;
+        SF.getValue(MDL_IMAGE,fnImg,objId);
+        Image<double> I;
+        I.read(fnImg, HEADER);
+        int Ydim=YSIZE(I());
+        Xdim=XSIZE(I());
+        if (Ydim!=Xdim)
+            REPORT_ERROR(ERR_MULTIDIM_SIZE,"This algorithm only works for squared images");
+    }
+    else if (!fn_accumulators.empty())
+    {
+        // The image size is taken from the first accumulator
+        MetaData MDacc(fn_accumulators[0] + ".xmd");
+        size_t accSize;
+        MDacc.getValue(MDL_XSIZE, accSize, MDacc.firstObject());
+        Xdim=(int)accSize;
+    }
+    else
+        REPORT_ERROR(ERR_MD_NOOBJ, "There are no images to reconstruct");
     imgSize=Xdim;
     volPadSizeX = volPadSizeY = volPadSizeZ=(int)(Xdim*padding_factor_vol);
     Vout().initZeros(volPadSizeZ,volPadSizeY,volPadSizeX);
@@ -265,21 +351,146 @@ void ProgRecFourier::produceSideinfo()
     iDeltaFourier = 1/deltaFourier;
 
     // Get symmetries
-    Matrix2D<double>  Identity(3,3);
-    Identity.initIdentity();
-    R_repository.push_back(Identity);
+    SymList SL;
     if (fn_sym != "")
-    {
-        SymList SL;
         SL.readSymmetryFile(fn_sym);
-        for (int isym = 0; isym < SL.symsNo(); isym++)
+    R_repository.initialize(SL.__R, true);
+}
+
+void GriddingBuffers::initialize(int volPadSizeZ, int volPadSizeY, int volPadSizeX)
+{
+    zWrapped.initZeros(3*volPadSizeZ);
+    yWrapped.initZeros(3*volPadSizeY);
+    xWrapped.initZeros(3*volPadSizeX);
+    zWrapped.initConstant(-1);
+    yWrapped.initConstant(-1);
+    xWrapped.initConstant(-1);
+    zWrapped.setXmippOrigin();
+    yWrapped.setXmippOrigin();
+    xWrapped.setXmippOrigin();
+    zNegWrapped=zWrapped;
+    yNegWrapped=yWrapped;
+    xNegWrapped=xWrapped;
+
+    x2precalculated.initZeros(XSIZE(xWrapped));
+    y2precalculated.initZeros(XSIZE(yWrapped));
+    z2precalculated.initZeros(XSIZE(zWrapped));
+    x2precalculated.initConstant(-1);
+    y2precalculated.initConstant(-1);
+    z2precalculated.initConstant(-1);
+    x2precalculated.setXmippOrigin();
+    y2precalculated.setXmippOrigin();
+    z2precalculated.setXmippOrigin();
+}
+
+/* Read an image, compute its Fourier transform and its projection direction.
+ * On exit threadParams->read is 1 if the image has to be processed.
+ */
+static void preloadImage(ImageThreadParams * threadParams, const std::vector<size_t> &objId,
+                         const ApplyGeoParams &params, bool hasCTF,
+                         MultidimArray<double> &localPaddedImg, FourierTransformer &localTransformerImg,
+                         MultidimArray< std::complex<double> > &localPaddedFourier,
+                         Matrix2D<double> &localA, Matrix2D<double> &localAinv)
+{
+    ProgRecFourier * parent = threadParams->parent;
+    threadParams->read = 0;
+
+    if ( threadParams->imageIndex < 0 )
+        return;
+
+    // Read input image
+    double rot, tilt, psi, weight;
+    Projection proj;
+
+    //Read projection from selfile, read also angles and shifts if present
+    //but only apply shifts
+
+    proj.readApplyGeo(*(threadParams->selFile), objId[threadParams->imageIndex], params);
+    rot  = proj.rot();
+    tilt = proj.tilt();
+    psi  = proj.psi();
+    weight = proj.weight();
+    if (hasCTF)
+    {
+        threadParams->ctf.readFromMetadataRow(*(threadParams->selFile),objId[threadParams->imageIndex]);
+        // threadParams->ctf.Tm=threadParams->parent->Ts;
+        threadParams->ctf.produceSideInfo();
+    }
+
+    threadParams->weight = 1.;
+
+    if(parent->do_weights)
+        threadParams->weight = weight;
+    else if (!parent->do_weights)
+    {
+        weight=1.0;
+    }
+    else if (weight==0.0)
+    {
+        threadParams->read = 2;
+        return;
+    }
+
+    // Copy the projection to the center of the padded image
+    // and compute its Fourier transform
+    proj().setXmippOrigin();
+    size_t localPaddedImgSize=(size_t)(parent->imgSize*parent->padding_factor_proj);
+    if (threadParams->reprocessFlag)
+        localPaddedFourier.initZeros(localPaddedImgSize,localPaddedImgSize/2+1);
+    else
+    {
+        localPaddedImg.initZeros(localPaddedImgSize,localPaddedImgSize);
+        localPaddedImg.setXmippOrigin();
+        const MultidimArray<double> &mProj=proj();
+        FOR_ALL_ELEMENTS_IN_ARRAY2D(mProj)
+        A2D_ELEM(localPaddedImg,i,j)=A2D_ELEM(mProj,i,j);
+        // COSS A2D_ELEM(localPaddedImg,i,j)=weight*A2D_ELEM(mProj,i,j);
+        CenterFFT(localPaddedImg,true);
+
+        // Fourier transformer for the images
+        localTransformerImg.setReal(localPaddedImg);
+        localTransformerImg.FourierTransform();
+        localTransformerImg.getFourierAlias(localPaddedFourier);
+    }
+
+    // Compute the coordinate axes associated to this image
+    Euler_angles2matrix(rot, tilt, psi, localA);
+    localAinv=localA.transpose();
+
+    threadParams->localweight = weight;
+    threadParams->localAInv = &localAinv;
+    threadParams->localPaddedFourier = &localPaddedFourier;
+    //#define DEBUG22
+#ifdef DEBUG22
+
+    {//CORRECTO
+
+        if(threadParams->myThreadID%1==0)
         {
-            Matrix2D<double>  L(4, 4), R(4, 4);
-            SL.getMatrices(isym, L, R);
-            R.resize(3, 3);
-            R_repository.push_back(R);
+            proj.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
+                       integerToString(threadParams->imageIndex) + "proj.spi");
+
+            ImageXmipp save44;
+            save44()=localPaddedImg;
+            save44.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
+                         integerToString(threadParams->imageIndex) + "local_padded_img.spi");
+
+            FourierImage save33;
+            save33()=localPaddedFourier;
+            save33.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
+                         integerToString(threadParams->imageIndex) + "local_padded_fourier.spi");
+            FourierImage save22;
+            //save22()=*paddedFourier;
+            save22().alias(*(threadParams->localPaddedFourier));
+            save22.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
+                         integerToString(threadParams->imageIndex) + "_padded_fourier.spi");
         }
+
     }
+#endif
+    #undef DEBUG22
+
+    threadParams->read = 1;
 }
 
 void * ProgRecFourier::processImageThread( void * threadArgs )
@@ -299,6 +510,8 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
     minSeparation+=1;
 
     Matrix2D<double>  localA(3, 3), localAinv(3, 3);
+    Matrix2D<double>  A_SL(3, 3);
+    SymRotationTable  localA_SL;
     MultidimArray< std::complex<double> > localPaddedFourier;
     MultidimArray<double> localPaddedImg;
     FourierTransformer localTransformerImg;
@@ -308,25 +521,8 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
     threadParams->selFile->findObjects(objId);
     ApplyGeoParams params;
     params.only_apply_shifts = true;
-    MultidimArray<int> zWrapped(3*parent->volPadSizeZ),yWrapped(3*parent->volPadSizeY),xWrapped(3*parent->volPadSizeX),
-    zNegWrapped, yNegWrapped, xNegWrapped;
-    zWrapped.initConstant(-1);
-    yWrapped.initConstant(-1);
-    xWrapped.initConstant(-1);
-    zWrapped.setXmippOrigin();
-    yWrapped.setXmippOrigin();
-    xWrapped.setXmippOrigin();
-    zNegWrapped=zWrapped;
-    yNegWrapped=yWrapped;
-    xNegWrapped=xWrapped;
-
-    MultidimArray<double> x2precalculated(XSIZE(xWrapped)), y2precalculated(XSIZE(yWrapped)), z2precalculated(XSIZE(zWrapped));
-    x2precalculated.initConstant(-1);
-    y2precalculated.initConstant(-1);
-    z2precalculated.initConstant(-1);
-    x2precalculated.setXmippOrigin();
-    y2precalculated.setXmippOrigin();
-    z2precalculated.setXmippOrigin();
+    GriddingBuffers buffers;
+    buffers.initialize(parent->volPadSizeZ, parent->volPadSizeY, parent->volPadSizeX);
 
     bool hasCTF=(threadParams->selFile->containsLabel(MDL_CTF_MODEL) || threadParams->selFile->containsLabel(MDL_CTF_DEFOCUSU)) &&
                 parent->useCTF;
@@ -343,105 +539,8 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
         {
         case PRELOAD_IMAGE:
             {
-
-                threadParams->read = 0;
-
-                if ( threadParams->imageIndex >= 0 )
-                {
-                    // Read input image
-                    double rot, tilt, psi, weight;
-                    Projection proj;
-
-                    //Read projection from selfile, read also angles and shifts if present
-                    //but only apply shifts
-
-                    proj.readApplyGeo(*(threadParams->selFile), objId[threadParams->imageIndex], params);
-                    rot  = proj.rot();
-                    tilt = proj.tilt();
-                    psi  = proj.psi();
-                    weight = proj.weight();
-                    if (hasCTF)
-                    {
-                        threadParams->ctf.readFromMetadataRow(*(threadParams->selFile),objId[threadParams->imageIndex]);
-                        // threadParams->ctf.Tm=threadParams->parent->Ts;
-                        threadParams->ctf.produceSideInfo();
-                    }
-
-                    threadParams->weight = 1.;
-
-                    if(parent->do_weights)
-                        threadParams->weight = weight;
-                    else if (!parent->do_weights)
-                    {
-                        weight=1.0;
-                    }
-                    else if (weight==0.0)
-                    {
-                        threadParams->read = 2;
-                        break;
-                    }
-
-                    // Copy the projection to the center of the padded image
-                    // and compute its Fourier transform
-                    proj().setXmippOrigin();
-                    size_t localPaddedImgSize=(size_t)(parent->imgSize*parent->padding_factor_proj);
-                    if (threadParams->reprocessFlag)
-                        localPaddedFourier.initZeros(localPaddedImgSize,localPaddedImgSize/2+1);
-                    else
-                    {
-                        localPaddedImg.initZeros(localPaddedImgSize,localPaddedImgSize);
-                        localPaddedImg.setXmippOrigin();
-                        const MultidimArray<double> &mProj=proj();
-                        FOR_ALL_ELEMENTS_IN_ARRAY2D(mProj)
-                        A2D_ELEM(localPaddedImg,i,j)=A2D_ELEM(mProj,i,j);
-                        // COSS A2D_ELEM(localPaddedImg,i,j)=weight*A2D_ELEM(mProj,i,j);
-                        CenterFFT(localPaddedImg,true);
-
-                        // Fourier transformer for the images
-                        localTransformerImg.setReal(localPaddedImg);
-                        localTransformerImg.FourierTransform();
-                        localTransformerImg.getFourierAlias(localPaddedFourier);
-                    }
-
-                    // Compute the coordinate axes associated to this image
-                    Euler_angles2matrix(rot, tilt, psi, localA);
-                    localAinv=localA.transpose();
-
-                    threadParams->localweight = weight;
-                    threadParams->localAInv = &localAinv;
-                    threadParams->localPaddedFourier = &localPaddedFourier;
-                    //#define DEBUG22
-#ifdef DEBUG22
-
-                    {//CORRECTO
-
-                        if(threadParams->myThreadID%1==0)
-                        {
-                            proj.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
-                                       integerToString(threadParams->imageIndex) + "proj.spi");
-
-                            ImageXmipp save44;
-                            save44()=localPaddedImg;
-                            save44.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
-                                         integerToString(threadParams->imageIndex) + "local_padded_img.spi");
-
-                            FourierImage save33;
-                            save33()=localPaddedFourier;
-                            save33.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
-                                         integerToString(threadParams->imageIndex) + "local_padded_fourier.spi");
-                            FourierImage save22;
-                            //save22()=*paddedFourier;
-                            save22().alias(*(threadParams->localPaddedFourier));
-                            save22.write((std::string) integerToString(threadParams->myThreadID)  + "_" +\
-                                         integerToString(threadParams->imageIndex) + "_padded_fourier.spi");
-                        }
-
-                    }
-#endif
-                    #undef DEBUG22
-
-                    threadParams->read = 1;
-                }
+                preloadImage(threadParams, objId, params, hasCTF, localPaddedImg, localTransformerImg,
+                             localPaddedFourier, localA, localAinv);
                 break;
             }
         case EXIT_THREAD:
@@ -486,10 +585,6 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                 bool breakCase;
                 bool assigned;
 
-                // Get the inverse of the sampling rate
-                // double iTs=parent->padding_factor_proj/parent->Ts;
-                double iTs=1.0/parent->Ts; // The padding factor is not considered here, but later when the indexes
-                //                         // are converted to digital frequencies
                 do
                 {
                     minAssignedRow = -1;
@@ -562,231 +657,9 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                         break;
                     }
 
-                    Matrix2D<double> * A_SL = threadParams->symmetry;
-
-                    // Loop over all Fourier coefficients in the padded image
-                    Matrix1D<double> freq(3), gcurrent(3), real_position(3), contFreq(3);
-                    Matrix1D<int> corner1(3), corner2(3);
-
-                    // Some alias and calculations moved from heavy loops
-                    double wCTF=1, wModulator=1.0;
-                    double blobRadiusSquared = parent->blob.radius * parent->blob.radius;
-                    double iDeltaSqrt = parent->iDeltaSqrt;
-                    Matrix1D<double> & blobTableSqrt = parent->blobTableSqrt;
-                    int xsize_1 = XSIZE(parent->VoutFourier) - 1;
-                    int zsize_1 = ZSIZE(parent->VoutFourier) - 1;
-                    MultidimArray< std::complex<double> > &VoutFourier=parent->VoutFourier;
-                    MultidimArray<double> &fourierWeights = parent->FourierWeights;
-                    //                    MultidimArray<double> &prefourierWeights = parent->preFourierWeights;
-                    // Get i value for the thread
-                    for (int i = minAssignedRow; i <= maxAssignedRow ; i ++ )
-                    {
-                        // Discarded rows can be between minAssignedRow and maxAssignedRow, check
-                        if ( statusArray[i] == -1 )
-                            for (int j=STARTINGX(*paddedFourier); j<=FINISHINGX(*paddedFourier); j++)
-                            {
-                                // Compute the frequency of this coefficient in the
-                                // universal coordinate system
-                                FFT_IDX2DIGFREQ(j,XSIZE(parent->paddedImg),XX(freq));
-                                FFT_IDX2DIGFREQ(i,YSIZE(parent->paddedImg),YY(freq));
-                                ZZ(freq)=0;
-                                if (XX(freq)*XX(freq)+YY(freq)*YY(freq)>parent->maxResolution2)
-                                    continue;
-                                wModulator=1.0;
-                                if (hasCTF && !reprocessFlag)
-                                {
-                                    XX(contFreq)=XX(freq)*iTs;
-                                    YY(contFreq)=YY(freq)*iTs;
-                                    threadParams->ctf.precomputeValues(XX(contFreq),YY(contFreq));
-                                    //wCTF=threadParams->ctf.getValueAt();
-                                    wCTF=threadParams->ctf.getValuePureNoKAt();
-                                    //wCTF=threadParams->ctf.getValuePureWithoutDampingAt();
-
-                                    if (std::isnan(wCTF))
-                                    {
-                                    	if (i==0 && j==0)
-                                    		wModulator=wCTF=1.0;
-                                    	else
-                                    		wModulator=wCTF=0.0;
-                                    }
-                                    if (fabs(wCTF)<parent->minCTF)
-                                    {
-                                        wModulator=fabs(wCTF);
-                                        wCTF=SGN(wCTF);
-                                    }
-                                    else
-                                        wCTF=1.0/wCTF;
-                                    if (parent->phaseFlipped)
-                                        wCTF=fabs(wCTF);
-                                }
-
-                                SPEED_UP_temps012;
-                                M3x3_BY_V3x1(freq,*A_SL,freq);
-
-                                // Look for the corresponding index in the volume Fourier transform
-                                DIGFREQ2FFT_IDX_DOUBLE(XX(freq),parent->volPadSizeX,XX(real_position));
-                                DIGFREQ2FFT_IDX_DOUBLE(YY(freq),parent->volPadSizeY,YY(real_position));
-                                DIGFREQ2FFT_IDX_DOUBLE(ZZ(freq),parent->volPadSizeZ,ZZ(real_position));
-
-                                // Put a box around that coefficient
-                                XX(corner1)=CEIL (XX(real_position)-parent->blob.radius);
-                                YY(corner1)=CEIL (YY(real_position)-parent->blob.radius);
-                                ZZ(corner1)=CEIL (ZZ(real_position)-parent->blob.radius);
-                                XX(corner2)=FLOOR(XX(real_position)+parent->blob.radius);
-                                YY(corner2)=FLOOR(YY(real_position)+parent->blob.radius);
-                                ZZ(corner2)=FLOOR(ZZ(real_position)+parent->blob.radius);
-
-#ifdef DEBUG
-
-                                std::cout << "Idx Img=(0," << i << "," << j << ") -> Freq Img=("
-                                << freq.transpose() << ") ->\n    Idx Vol=("
-                                << real_position.transpose() << ")\n"
-                                << "   Corner1=" << corner1.transpose() << std::endl
-                                << "   Corner2=" << corner2.transpose() << std::endl;
-#endif
-                                // Loop within the box
-                                double *ptrIn=(double *)&(A2D_ELEM(*paddedFourier, i,j));
-
-                                // Some precalculations
-                                for (int intz = ZZ(corner1); intz <= ZZ(corner2); ++intz)
-                                {
-                                    double z = intz - ZZ(real_position);
-                                    A1D_ELEM(z2precalculated,intz)=z*z;
-                                    if (A1D_ELEM(zWrapped,intz)<0)
-                                    {
-                                        int iz, izneg;
-                                        fastIntWRAP(iz, intz, 0, zsize_1);
-                                        A1D_ELEM(zWrapped,intz)=iz;
-                                        int miz=-iz;
-                                        fastIntWRAP(izneg, miz,0,zsize_1);
-                                        A1D_ELEM(zNegWrapped,intz)=izneg;
-                                    }
-                                }
-                                for (int inty = YY(corner1); inty <= YY(corner2); ++inty)
-                                {
-                                    double y = inty - YY(real_position);
-                                    A1D_ELEM(y2precalculated,inty)=y*y;
-                                    if (A1D_ELEM(yWrapped,inty)<0)
-                                    {
-                                        int iy, iyneg;
-                                        fastIntWRAP(iy, inty, 0, zsize_1);
-                                        A1D_ELEM(yWrapped,inty)=iy;
-                                        int miy=-iy;
-                                        fastIntWRAP(iyneg, miy,0,zsize_1);
-                                        A1D_ELEM(yNegWrapped,inty)=iyneg;
-                                    }
-                                }
-                                for (int intx = XX(corner1); intx <= XX(corner2); ++intx)
-                                {
-                                    double x = intx - XX(real_position);
-                                    A1D_ELEM(x2precalculated,intx)=x*x;
-                                    if (A1D_ELEM(xWrapped,intx)<0)
-                                    {
-                                        int ix, ixneg;
-                                        fastIntWRAP(ix, intx, 0, zsize_1);
-                                        A1D_ELEM(xWrapped,intx)=ix;
-                                        int mix=-ix;
-                                        fastIntWRAP(ixneg, mix,0,zsize_1);
-                                        A1D_ELEM(xNegWrapped,intx)=ixneg;
-                                    }
-                                }
-
-                                // Actually compute
-                                for (int intz = ZZ(corner1); intz <= ZZ(corner2); ++intz)
-                                {
-                                    double z2 = A1D_ELEM(z2precalculated,intz);
-                                    int iz=A1D_ELEM(zWrapped,intz);
-                                    int izneg=A1D_ELEM(zNegWrapped,intz);
-
-                                    for (int inty = YY(corner1); inty <= YY(corner2); ++inty)
-                                    {
-                                        double y2z2 = A1D_ELEM(y2precalculated,inty) + z2;
-                                        if (y2z2 > blobRadiusSquared)
-                                            continue;
-                                        int iy=A1D_ELEM(yWrapped,inty);
-                                        int iyneg=A1D_ELEM(yNegWrapped,inty);
-
-                                        int	size1=YXSIZE(VoutFourier)*(izneg)+((iyneg)*XSIZE(VoutFourier));
-                                        int	size2=YXSIZE(VoutFourier)*(iz)+((iy)*XSIZE(VoutFourier));
-                                        int	fixSize=0;
-
-                                        for (int intx = XX(corner1); intx <= XX(corner2); ++intx)
-                                        {
-                                            // Compute distance to the center of the blob
-                                            // Compute blob value at that distance
-                                            double d2 = A1D_ELEM(x2precalculated,intx) + y2z2;
-
-                                            if (d2 > blobRadiusSquared)
-                                                continue;
-                                            int aux = (int)(d2 * iDeltaSqrt + 0.5);//Same as ROUND but avoid comparison
-                                            double w = VEC_ELEM(blobTableSqrt, aux)*threadParams->weight *wModulator;
-
-                                            // Look for the location of this logical index
-                                            // in the physical layout
-#ifdef DEBUG
-
-                                            std::cout << "   gcurrent=" << gcurrent.transpose()
-                                            << " d=" << d << std::endl;
-                                            std::cout << "   1: intx=" << intx
-                                            << " inty=" << inty
-                                            << " intz=" << intz << std::endl;
-#endif
-
-                                            int ix=A1D_ELEM(xWrapped,intx);
-#ifdef DEBUG
-
-                                            std::cout << "   2: ix=" << ix << " iy=" << iy
-                                            << " iz=" << iz << std::endl;
-#endif
-
-                                            bool conjugate=false;
-                                            int izp, iyp, ixp;
-                                            if (ix > xsize_1)
-                                            {
-                                                izp = izneg;
-                                                iyp = iyneg;
-                                                ixp = A1D_ELEM(xNegWrapped,intx);
-                                                conjugate=true;
-                                                fixSize = size1;
-                                            }
-                                            else
-                                            {
-                                                izp=iz;
-                                                iyp=iy;
-                                                ixp=ix;
-                                                fixSize = size2;
-                                            }
-#ifdef DEBUG
-                                            std::cout << "   3: ix=" << ix << " iy=" << iy
-                                            << " iz=" << iz << " conj="
-                                            << conjugate << std::endl;
-#endif
-
-                                            // Add the weighted coefficient
-                                            if (reprocessFlag)
-                                            {
-                                                // Use VoutFourier as temporary to save the memory
-                                                double *ptrOut=(double *)&(DIRECT_A3D_ELEM(VoutFourier, izp,iyp,ixp));
-                                                DIRECT_A3D_ELEM(fourierWeights, izp,iyp,ixp) += (w * ptrOut[0]);
-                                            }
-                                            else
-                                            {
-                                                double wEffective=w*wCTF;
-                                                size_t memIdx=fixSize + ixp;//YXSIZE(VoutFourier)*(izp)+((iyp)*XSIZE(VoutFourier))+(ixp);
-                                                double *ptrOut=(double *)&(DIRECT_A1D_ELEM(VoutFourier, memIdx));
-                                                ptrOut[0] += wEffective * ptrIn[0];
-                                                DIRECT_A1D_ELEM(fourierWeights, memIdx) += w;
-
-                                                if (conjugate)
-                                                    ptrOut[1]-=wEffective*ptrIn[1];
-                                                else
-                                                    ptrOut[1]+=wEffective*ptrIn[1];
-                                            }
-                                        }
-                                    }
-                                }
-                            }
-                    }
+                    parent->gridImageRows(*paddedFourier, *(threadParams->symmetry), minAssignedRow, maxAssignedRow,
+                                          statusArray, threadParams->weight, reprocessFlag, hasCTF, threadParams->ctf,
+                                          buffers, parent->VoutFourier, parent->FourierWeights);
 
                     pthread_mutex_lock( &(parent->workLoadMutex) );
 
@@ -818,6 +691,89 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
                 while (!breakCase);
                 break;
             }
+        case PROCESS_IMAGES_PRIVATE:
+            {
+                // Thread 0 works directly on the output volume
+                int id = threadParams->myThreadID;
+                bool reprocessFlag = threadParams->reprocessFlag;
+                MultidimArray< std::complex<double> > &myVoutFourier =
+                    (id == 0 || reprocessFlag) ? parent->VoutFourier : parent->threadVoutFourier[id-1];
+                MultidimArray<double> &myFourierWeights =
+                    (id == 0) ? parent->FourierWeights : parent->threadFourierWeights[id-1];
+
+                size_t first, last;
+                while (parent->imageDistributor->getTasks(first, last))
+                    for (size_t n = first; n <= last; ++n)
+                    {
+                        threadParams->imageIndex = parent->firstDistributedImage + n;
+                        preloadImage(threadParams, objId, params, hasCTF, localPaddedImg, localTransformerImg,
+                                     localPaddedFourier, localA, localAinv);
+
+                        if ( threadParams->read == 1 && threadParams->localweight != 0.0 )
+                        {
+                            // Only the rows below the maximum resolution are visited,
+                            // the positive frequencies first and then the negative
+                            // ones that are not among them
+                            int ydim = (int)YSIZE(localPaddedFourier);
+                            int conserveRows=(int)ceil((double)ydim * parent->maxResolution * 2.0);
+                            conserveRows=(int)ceil((double)conserveRows/2.0);
+                            conserveRows=XMIPP_MIN(conserveRows, ydim);
+                            int firstNegativeRow=XMIPP_MAX(conserveRows, ydim-conserveRows);
+
+                            // Coordinate axes of all the symmetrized projections
+                            parent->R_repository.compose(localAinv, localA_SL);
+                            for (int isym = 0; isym < localA_SL.symsNo; isym++)
+                            {
+                                localA_SL.getMatrix(isym, A_SL);
+                                parent->gridImageRows(localPaddedFourier, A_SL, 0, conserveRows-1, NULL,
+                                                      threadParams->localweight, reprocessFlag, hasCTF,
+                                                      threadParams->ctf, buffers, myVoutFourier, myFourierWeights);
+                                if (firstNegativeRow < ydim)
+                                    parent->gridImageRows(localPaddedFourier, A_SL, firstNegativeRow, ydim-1, NULL,
+                                                          threadParams->localweight, reprocessFlag, hasCTF,
+                                                          threadParams->ctf, buffers, myVoutFourier, myFourierWeights);
+                            }
+                        }
+
+                        pthread_mutex_lock( &(parent->workLoadMutex) );
+                        int imgno = ++parent->imagesProcessed;
+                        pthread_mutex_unlock( &(parent->workLoadMutex) );
+                        int repaint = (int)ceil((double)parent->SF.size()/60);
+                        if (id == 0 && parent->verbose && imgno%repaint==0)
+                            progress_bar(imgno);
+                    }
+                break;
+            }
+        case MERGE_ACCUMULATORS:
+            {
+                // Each thread adds a set of slices of the private volumes
+                bool reprocessFlag = threadParams->reprocessFlag;
+                MultidimArray<double> &mFourierWeights=parent->FourierWeights;
+                MultidimArray< std::complex<double> > &mVoutFourier=parent->VoutFourier;
+                size_t sliceSize=YXSIZE(mFourierWeights);
+                for (size_t k=threadParams->myThreadID; k<ZSIZE(mFourierWeights); k+=parent->numThreads)
+                    for (size_t t=0; t<parent->threadFourierWeights.size(); ++t)
+                    {
+                        double *ptrWeights=&DIRECT_A3D_ELEM(parent->threadFourierWeights[t],k,0,0);
+                        double *ptrOutWeights=&DIRECT_A3D_ELEM(mFourierWeights,k,0,0);
+                        for (size_t n=0; n<sliceSize; ++n)
+                        {
+                            ptrOutWeights[n]+=ptrWeights[n];
+                            ptrWeights[n]=0;
+                        }
+                        if (!reprocessFlag)
+                        {
+                            std::complex<double> *ptrFourier=&DIRECT_A3D_ELEM(parent->threadVoutFourier[t],k,0,0);
+                            std::complex<double> *ptrOutFourier=&DIRECT_A3D_ELEM(mVoutFourier,k,0,0);
+                            for (size_t n=0; n<sliceSize; ++n)
+                            {
+                                ptrOutFourier[n]+=ptrFourier[n];
+                                ptrFourier[n]=0;
+                            }
+                        }
+                    }
+                break;
+            }
         default:
             break;
         }
@@ -827,6 +783,252 @@ void * ProgRecFourier::processImageThread( void * threadArgs )
     while ( 1 );
 }
 
+void ProgRecFourier::gridImageRows(const MultidimArray< std::complex<double> > &paddedFourier,
+                                   const Matrix2D<double> &A_SL, int minRow, int maxRow, const int * statusArray,
+                                   double weight, bool reprocessFlag, bool hasCTF, CTFDescription &ctf,
+                                   GriddingBuffers &buffers, MultidimArray< std::complex<double> > &VoutFourier,
+                                   MultidimArray<double> &fourierWeights)
+{
+    // Get the inverse of the sampling rate
+    // double iTs=padding_factor_proj/Ts;
+    double iTs=1.0/Ts; // The padding factor is not considered here, but later when the indexes
+    //                         // are converted to digital frequencies
+    double iDeltaSqrt = this->iDeltaSqrt;
+
+    MultidimArray<int> &zWrapped=buffers.zWrapped, &yWrapped=buffers.yWrapped, &xWrapped=buffers.xWrapped;
+    MultidimArray<int> &zNegWrapped=buffers.zNegWrapped, &yNegWrapped=buffers.yNegWrapped, &xNegWrapped=buffers.xNegWrapped;
+    MultidimArray<double> &x2precalculated=buffers.x2precalculated;
+    MultidimArray<double> &y2precalculated=buffers.y2precalculated;
+    MultidimArray<double> &z2precalculated=buffers.z2precalculated;
+
+    // Loop over all Fourier coefficients in the padded image
+    Matrix1D<double> freq(3), gcurrent(3), real_position(3), contFreq(3);
+    Matrix1D<int> corner1(3), corner2(3);
+
+    // Some alias and calculations moved from heavy loops
+    double wCTF=1, wModulator=1.0;
+    double blobRadiusSquared = blob.radius * blob.radius;
+    int xsize_1 = XSIZE(VoutFourier) - 1;
+    int zsize_1 = ZSIZE(VoutFourier) - 1;
+    // Blob weights along X for the current (z,y) of the neighbourhood
+    size_t maxRun = 2 * (size_t)ceil(blob.radius) + 2;
+    if (buffers.runWeights.size() < maxRun)
+        buffers.runWeights.resize(maxRun);
+    double *runWeights = &buffers.runWeights[0];
+    const double *blobTable = MATRIX1D_ARRAY(blobTableSqrt);
+    for (int i = minRow; i <= maxRow ; i ++ )
+    {
+        // Discarded rows can be between minRow and maxRow, check
+        if ( statusArray != NULL && statusArray[i] != -1 )
+            continue;
+
+        // Only the columns within the maximum resolution are visited.
+        // The image is half complex, so all column frequencies are positive
+        double rowFreq;
+        FFT_IDX2DIGFREQ(i,YSIZE(paddedImg),rowFreq);
+        double rowFreq2 = rowFreq * rowFreq;
+        if (rowFreq2 > maxResolution2)
+            continue;
+        int lastColumn = XMIPP_MIN(FINISHINGX(paddedFourier),
+                                   (int)(sqrt(maxResolution2 - rowFreq2) * XSIZE(paddedImg)) + 1);
+            for (int j=STARTINGX(paddedFourier); j<=lastColumn; j++)
+            {
+                // Compute the frequency of this coefficient in the
+                // universal coordinate system
+                FFT_IDX2DIGFREQ(j,XSIZE(paddedImg),XX(freq));
+                YY(freq)=rowFreq;
+                ZZ(freq)=0;
+                if (XX(freq)*XX(freq)+YY(freq)*YY(freq)>maxResolution2)
+                    continue;
+                wModulator=1.0;
+                if (hasCTF && !reprocessFlag)
+                {
+                    XX(contFreq)=XX(freq)*iTs;
+                    YY(contFreq)=YY(freq)*iTs;
+                    ctf.precomputeValues(XX(contFreq),YY(contFreq));
+                    //wCTF=ctf.getValueAt();
+                    wCTF=ctf.getValuePureNoKAt();
+                    //wCTF=ctf.getValuePureWithoutDampingAt();
+
+                    if (std::isnan(wCTF))
+                    {
+                    	if (i==0 && j==0)
+                    		wModulator=wCTF=1.0;
+                    	else
+                    		wModulator=wCTF=0.0;
+                    }
+                    if (fabs(wCTF)<minCTF)
+                    {
+                        wModulator=fabs(wCTF);
+                        wCTF=SGN(wCTF);
+                    }
+                    else
+                        wCTF=1.0/wCTF;
+                    if (phaseFlipped)
+                        wCTF=fabs(wCTF);
+                }
+
+                SPEED_UP_temps012;
+                M3x3_BY_V3x1(freq,A_SL,freq);
+
+                // Look for the corresponding index in the volume Fourier transform
+                DIGFREQ2FFT_IDX_DOUBLE(XX(freq),volPadSizeX,XX(real_position));
+                DIGFREQ2FFT_IDX_DOUBLE(YY(freq),volPadSizeY,YY(real_position));
+                DIGFREQ2FFT_IDX_DOUBLE(ZZ(freq),volPadSizeZ,ZZ(real_position));
+
+                // Put a box around that coefficient
+                XX(corner1)=CEIL (XX(real_position)-blob.radius);
+                YY(corner1)=CEIL (YY(real_position)-blob.radius);
+                ZZ(corner1)=CEIL (ZZ(real_position)-blob.radius);
+                XX(corner2)=FLOOR(XX(real_position)+blob.radius);
+                YY(corner2)=FLOOR(YY(real_position)+blob.radius);
+                ZZ(corner2)=FLOOR(ZZ(real_position)+blob.radius);
+
+#ifdef DEBUG
+
+                std::cout << "Idx Img=(0," << i << "," << j << ") -> Freq Img=("
+                << freq.transpose() << ") ->\n    Idx Vol=("
+                << real_position.transpose() << ")\n"
+                << "   Corner1=" << corner1.transpose() << std::endl
+                << "   Corner2=" << corner2.transpose() << std::endl;
+#endif
+                // Loop within the box
+                const double *ptrIn=(const double *)&(A2D_ELEM(paddedFourier, i,j));
+
+                // Some precalculations
+                for (int intz = ZZ(corner1); intz <= ZZ(corner2); ++intz)
+                {
+                    double z = intz - ZZ(real_position);
+                    A1D_ELEM(z2precalculated,intz)=z*z;
+                    if (A1D_ELEM(zWrapped,intz)<0)
+                    {
+                        int iz, izneg;
+                        fastIntWRAP(iz, intz, 0, zsize_1);
+                        A1D_ELEM(zWrapped,intz)=iz;
+                        int miz=-iz;
+                        fastIntWRAP(izneg, miz,0,zsize_1);
+                        A1D_ELEM(zNegWrapped,intz)=izneg;
+                    }
+                }
+                for (int inty = YY(corner1); inty <= YY(corner2); ++inty)
+                {
+                    double y = inty - YY(real_position);
+                    A1D_ELEM(y2precalculated,inty)=y*y;
+                    if (A1D_ELEM(yWrapped,inty)<0)
+                    {
+                        int iy, iyneg;
+                        fastIntWRAP(iy, inty, 0, zsize_1);
+                        A1D_ELEM(yWrapped,inty)=iy;
+                        int miy=-iy;
+                        fastIntWRAP(iyneg, miy,0,zsize_1);
+                        A1D_ELEM(yNegWrapped,inty)=iyneg;
+                    }
+                }
+                for (int intx = XX(corner1); intx <= XX(corner2); ++intx)
+                {
+                    double x = intx - XX(real_position);
+                    A1D_ELEM(x2precalculated,intx)=x*x;
+                    if (A1D_ELEM(xWrapped,intx)<0)
+                    {
+                        int ix, ixneg;
+                        fastIntWRAP(ix, intx, 0, zsize_1);
+                        A1D_ELEM(xWrapped,intx)=ix;
+                        int mix=-ix;
+                        fastIntWRAP(ixneg, mix,0,zsize_1);
+                        A1D_ELEM(xNegWrapped,intx)=ixneg;
+                    }
+                }
+
+                // The CTF correction is the same for the whole neighbourhood
+                double inRe = wCTF * ptrIn[0];
+                double inIm = wCTF * ptrIn[1];
+                double imageWeight = weight * wModulator;
+                size_t xyVolSize = YXSIZE(VoutFourier);
+                size_t xVolSize = XSIZE(VoutFourier);
+                double *ptrVout = (double *)MULTIDIM_ARRAY(VoutFourier);
+                double *ptrWeights = MULTIDIM_ARRAY(fourierWeights);
+
+                // Actually compute
+                for (int intz = ZZ(corner1); intz <= ZZ(corner2); ++intz)
+                {
+                    double z2 = A1D_ELEM(z2precalculated,intz);
+                    int iz=A1D_ELEM(zWrapped,intz);
+                    int izneg=A1D_ELEM(zNegWrapped,intz);
+
+                    for (int inty = YY(corner1); inty <= YY(corner2); ++inty)
+                    {
+                        double y2z2 = A1D_ELEM(y2precalculated,inty) + z2;
+                        if (y2z2 > blobRadiusSquared)
+                            continue;
+                        int iy=A1D_ELEM(yWrapped,inty);
+                        int iyneg=A1D_ELEM(yNegWrapped,inty);
+
+                        size_t size1=xyVolSize*(izneg)+((iyneg)*xVolSize);
+                        size_t size2=xyVolSize*(iz)+((iy)*xVolSize);
+
+                        // The blob only covers a run of X around the center
+                        double halfRun = sqrt(blobRadiusSquared - y2z2);
+                        int x0 = XMIPP_MAX(XX(corner1), (int)CEIL(XX(real_position) - halfRun));
+                        int xF = XMIPP_MIN(XX(corner2), (int)FLOOR(XX(real_position) + halfRun));
+                        int runLength = xF - x0 + 1;
+                        if (runLength <= 0)
+                            continue;
+
+                        // Blob values along the run. This loop has no dependencies
+                        // between iterations and no branches, so it can be vectorized
+                        const double *x2 = &A1D_ELEM(x2precalculated, x0);
+                        for (int n = 0; n < runLength; ++n)
+                        {
+                            double d2 = x2[n] + y2z2;
+                            // Rounding may put the extremes slightly outside the blob
+                            d2 = XMIPP_MIN(d2, blobRadiusSquared);
+                            runWeights[n] = blobTable[(int)(d2 * iDeltaSqrt + 0.5)] * imageWeight;
+                        }
+
+                        const int *xIdx = &A1D_ELEM(xWrapped, x0);
+                        const int *xNegIdx = &A1D_ELEM(xNegWrapped, x0);
+                        if (reprocessFlag)
+                        {
+                            // Use VoutFourier as temporary to save the memory
+                            for (int n = 0; n < runLength; ++n)
+                            {
+                                int ix = xIdx[n];
+                                size_t memIdx = (ix > xsize_1) ? size1 + xNegIdx[n] : size2 + ix;
+                                ptrWeights[memIdx] += runWeights[n] * ptrVout[2 * memIdx];
+                            }
+                        }
+                        else
+                        {
+                            for (int n = 0; n < runLength; ++n)
+                            {
+                                // Look for the location of this logical index
+                                // in the physical layout
+                                int ix = xIdx[n];
+                                double w = runWeights[n];
+                                size_t memIdx;
+                                double sign;
+                                if (ix > xsize_1)
+                                {
+                                    memIdx = size1 + xNegIdx[n];
+                                    sign = -1;
+                                }
+                                else
+                                {
+                                    memIdx = size2 + ix;
+                                    sign = 1;
+                                }
+                                double *ptrOut = ptrVout + 2 * memIdx;
+                                ptrOut[0] += w * inRe;
+                                ptrOut[1] += sign * w * inIm;
+                                ptrWeights[memIdx] += w;
+                            }
+                        }
+                    }
+                }
+            }
+    }
+}
+
 //#define DEBUG
 void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, bool saveFSC, bool reprocessFlag)
 {
@@ -845,165 +1047,166 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
     // FSC purposes
     int current_index;
 
-    do
+    if (threadAccumulators)
     {
-        threadOpCode = PRELOAD_IMAGE;
-
-        for ( int nt = 0 ; nt < numThreads ; nt ++ )
+        imagesProcessed = 0;
+        if (saveFSC)
         {
-            if ( imgIndex <= lastImageIndex )
-            {
-                th_args[nt].imageIndex = imgIndex;
-                th_args[nt].reprocessFlag = reprocessFlag;
-                imgIndex++;
-            }
-            else
+            processImagesThreadAccumulators(firstImageIndex, FSCIndex, reprocessFlag);
+            saveFirstHalfFSC();
+            processImagesThreadAccumulators(FSCIndex + 1, lastImageIndex, reprocessFlag);
+        }
+        else
+            processImagesThreadAccumulators(firstImageIndex, lastImageIndex, reprocessFlag);
+    }
+    else
+    {
+        do
+        {
+            threadOpCode = PRELOAD_IMAGE;
+
+            for ( int nt = 0 ; nt < numThreads ; nt ++ )
             {
-                th_args[nt].imageIndex = -1;
+                if ( imgIndex <= lastImageIndex )
+                {
+                    th_args[nt].imageIndex = imgIndex;
+                    th_args[nt].reprocessFlag = reprocessFlag;
+                    imgIndex++;
+                }
+                else
+                {
+                    th_args[nt].imageIndex = -1;
+                }
             }
-        }
 
-        // Awaking sleeping threads
-        barrier_wait( &barrier );
-        // here each thread is reading a different image and compute fft
-        // Threads are working now, wait for them to finish
-        // processing current projection
-        barrier_wait( &barrier );
+            // Awaking sleeping threads
+            barrier_wait( &barrier );
+            // here each thread is reading a different image and compute fft
+            // Threads are working now, wait for them to finish
+            // processing current projection
+            barrier_wait( &barrier );
 
-        // each threads have read a different image and now
-        // all the thread will work in a different part of a single image.
-        threadOpCode = PROCESS_IMAGE;
+            // each threads have read a different image and now
+            // all the thread will work in a different part of a single image.
+            threadOpCode = PROCESS_IMAGE;
 
-        processed = false;
+            processed = false;
 
-        for ( int nt = 0 ; nt < numThreads ; nt ++ )
-        {
-            if ( th_args[nt].read == 2 )
-                processed = true;
-            else if ( th_args[nt].read == 1 )
+            for ( int nt = 0 ; nt < numThreads ; nt ++ )
             {
-                processed = true;
-                if (verbose && imgno++%repaint==0)
-                    progress_bar(imgno);
+                if ( th_args[nt].read == 2 )
+                    processed = true;
+                else if ( th_args[nt].read == 1 )
+                {
+                    processed = true;
+                    if (verbose && imgno++%repaint==0)
+                        progress_bar(imgno);
 
-                double weight = th_args[nt].localweight;
-                paddedFourier = th_args[nt].localPaddedFourier;
-                current_index = th_args[nt].imageIndex;
-                Matrix2D<double> *Ainv = th_args[nt].localAInv;
+                    double weight = th_args[nt].localweight;
+                    paddedFourier = th_args[nt].localPaddedFourier;
+                    current_index = th_args[nt].imageIndex;
+                    Matrix2D<double> *Ainv = th_args[nt].localAInv;
 
-                //#define DEBUG22
-#ifdef DEBUG22
+                    //#define DEBUG22
+    #ifdef DEBUG22
 
-                {
-                    static int ii=0;
-                    if(ii%1==0)
                     {
-                        FourierImage save22;
-                        //save22()=*paddedFourier;
-                        save22().alias(*paddedFourier);
-                        save22.write((std::string) integerToString(ii)  + "_padded_fourier.spi");
+                        static int ii=0;
+                        if(ii%1==0)
+                        {
+                            FourierImage save22;
+                            //save22()=*paddedFourier;
+                            save22().alias(*paddedFourier);
+                            save22.write((std::string) integerToString(ii)  + "_padded_fourier.spi");
+                        }
+                        ii++;
                     }
-                    ii++;
-                }
-#endif
-                #undef DEBUG22
-
-                // Initialized just once
-                if ( statusArray == NULL )
-                {
-                    statusArray = (int *) malloc ( sizeof(int) * paddedFourier->ydim );
-                }
+    #endif
+                    #undef DEBUG22
 
-                // Determine how many rows of the fourier
-                // transform are of interest for us. This is because
-                // the user can avoid to explore at certain resolutions
-                size_t conserveRows=(size_t)ceil((double)paddedFourier->ydim * maxResolution * 2.0);
-                conserveRows=(size_t)ceil((double)conserveRows/2.0);
+                    // Initialized just once
+                    if ( statusArray == NULL )
+                    {
+                        statusArray = (int *) malloc ( sizeof(int) * paddedFourier->ydim );
+                    }
 
-                // Loop over all symmetries
-                for (size_t isym = 0; isym < R_repository.size(); isym++)
-                {
-                    rowsProcessed = 0;
+                    // Determine how many rows of the fourier
+                    // transform are of interest for us. This is because
+                    // the user can avoid to explore at certain resolutions
+                    size_t conserveRows=(size_t)ceil((double)paddedFourier->ydim * maxResolution * 2.0);
+                    conserveRows=(size_t)ceil((double)conserveRows/2.0);
 
-                    // Compute the coordinate axes of the symmetrized projection
-                    Matrix2D<double> A_SL=R_repository[isym]*(*Ainv);
+                    // Compute the coordinate axes of all the symmetrized projections
+                    SymRotationTable A_SLtable;
+                    Matrix2D<double> A_SL(3, 3);
+                    R_repository.compose(*Ainv, A_SLtable);
 
-                    // Fill the thread arguments for each thread
-                    for ( int th = 0 ; th < numThreads ; th ++ )
+                    // Loop over all symmetries
+                    for (int isym = 0; isym < A_SLtable.symsNo; isym++)
                     {
-                        // Passing parameters to each thread
-                        th_args[th].symmetry = &A_SL;
-                        th_args[th].paddedFourier = paddedFourier;
-                        th_args[th].weight = weight;
-                        th_args[th].reprocessFlag = reprocessFlag;
-                    }
+                        rowsProcessed = 0;
+                        A_SLtable.getMatrix(isym, A_SL);
 
-                    // Init status array
-                    for (size_t i = 0 ; i < paddedFourier->ydim ; i ++ )
-                    {
-                        if ( i >= conserveRows && i < (paddedFourier->ydim-conserveRows))
+                        // Fill the thread arguments for each thread
+                        for ( int th = 0 ; th < numThreads ; th ++ )
                         {
-                            // -2 means "discarded"
-                            statusArray[i] = -2;
-                            rowsProcessed++;
+                            // Passing parameters to each thread
+                            th_args[th].symmetry = &A_SL;
+                            th_args[th].paddedFourier = paddedFourier;
+                            th_args[th].weight = weight;
+                            th_args[th].reprocessFlag = reprocessFlag;
                         }
-                        else
+
+                        // Init status array
+                        for (size_t i = 0 ; i < paddedFourier->ydim ; i ++ )
                         {
-                            statusArray[i] = 0;
+                            if ( i >= conserveRows && i < (paddedFourier->ydim-conserveRows))
+                            {
+                                // -2 means "discarded"
+                                statusArray[i] = -2;
+                                rowsProcessed++;
+                            }
+                            else
+                            {
+                                statusArray[i] = 0;
+                            }
                         }
-                    }
 
-                    // Awaking sleeping threads
-                    barrier_wait( &barrier );
-                    // Threads are working now, wait for them to finish
-                    // processing current projection
-                    barrier_wait( &barrier );
+                        // Awaking sleeping threads
+                        barrier_wait( &barrier );
+                        // Threads are working now, wait for them to finish
+                        // processing current projection
+                        barrier_wait( &barrier );
 
-                    //#define DEBUG2
-#ifdef DEBUG2
+                        //#define DEBUG2
+    #ifdef DEBUG2
 
-                    {
-                        static int ii=0;
-                        if(ii%1==0)
                         {
-                            Image<double> save;
-                            save().alias( FourierWeights );
-                            save.write((std::string) integerToString(ii)  + "_1_Weights.vol");
+                            static int ii=0;
+                            if(ii%1==0)
+                            {
+                                Image<double> save;
+                                save().alias( FourierWeights );
+                                save.write((std::string) integerToString(ii)  + "_1_Weights.vol");
 
-                            Image< std::complex<double> > save2;
-                            save2().alias( VoutFourier );
-                            save2.write((std::string) integerToString(ii)  + "_1_Fourier.vol");
+                                Image< std::complex<double> > save2;
+                                save2().alias( VoutFourier );
+                                save2.write((std::string) integerToString(ii)  + "_1_Fourier.vol");
+                            }
+                            ii++;
                         }
-                        ii++;
-                    }
-#endif
-                    #undef DEBUG2
+    #endif
+                        #undef DEBUG2
 
-                }
+                    }
 
-                if ( current_index == FSCIndex && saveFSC )
-                {
-                    // Save Current Fourier, Reconstruction and Weights
-                    Image<double> save;
-                    save().alias( FourierWeights );
-                    save.write((std::string)fn_fsc + "_1_Weights.vol");
-
-                    Image< std::complex<double> > save2;
-                    save2().alias( VoutFourier );
-                    save2.write((std::string) fn_fsc + "_1_Fourier.vol");
-
-                    finishComputations(FileName((std::string) fn_fsc + "_1_recons.vol"));
-                    Vout().initZeros(volPadSizeZ, volPadSizeY, volPadSizeX);
-                    transformerVol.setReal(Vout());
-                    Vout().clear();
-                    transformerVol.getFourierAlias(VoutFourier);
-                    FourierWeights.initZeros(VoutFourier);
-                    VoutFourier.initZeros();
+                    if ( current_index == FSCIndex && saveFSC )
+                        saveFirstHalfFSC();
                 }
             }
         }
+        while ( processed );
     }
-    while ( processed );
 
     if( saveFSC )
     {
@@ -1046,6 +1249,156 @@ void ProgRecFourier::processImages( int firstImageIndex, int lastImageIndex, boo
     }
 }
 
+void ProgRecFourier::processImagesThreadAccumulators( int firstImageIndex, int lastImageIndex, bool reprocessFlag)
+{
+    if (lastImageIndex < firstImageIndex)
+        return;
+
+    // Private accumulators are allocated on first use and kept at zero
+    // between calls, thread 0 uses the output volume
+    size_t nPrivate = numThreads - 1;
+    if (threadFourierWeights.size() != nPrivate)
+    {
+        threadFourierWeights.resize(nPrivate);
+        for (size_t t = 0; t < nPrivate; ++t)
+            threadFourierWeights[t].initZeros(FourierWeights);
+    }
+    if (!reprocessFlag && threadVoutFourier.size() != nPrivate)
+    {
+        threadVoutFourier.resize(nPrivate);
+        for (size_t t = 0; t < nPrivate; ++t)
+            threadVoutFourier[t].initZeros(VoutFourier);
+    }
+
+    firstDistributedImage = firstImageIndex;
+    imageDistributor = new ThreadTaskDistributor(lastImageIndex - firstImageIndex + 1, 1);
+    for ( int nt = 0 ; nt < numThreads ; nt ++ )
+        th_args[nt].reprocessFlag = reprocessFlag;
+
+    threadOpCode = PROCESS_IMAGES_PRIVATE;
+    // Awake threads and wait until all images have been gridded
+    barrier_wait( &barrier );
+    barrier_wait( &barrier );
+
+    threadOpCode = MERGE_ACCUMULATORS;
+    barrier_wait( &barrier );
+    barrier_wait( &barrier );
+
+    delete imageDistributor;
+    imageDistributor = NULL;
+}
+
+void ProgRecFourier::saveFirstHalfFSC()
+{
+    // Save Current Fourier, Reconstruction and Weights
+    Image<double> save;
+    save().alias( FourierWeights );
+    save.write((std::string)fn_fsc + "_1_Weights.vol");
+
+    Image< std::complex<double> > save2;
+    save2().alias( VoutFourier );
+    save2.write((std::string) fn_fsc + "_1_Fourier.vol");
+
+    finishComputations(FileName((std::string) fn_fsc + "_1_recons.vol"));
+    Vout().initZeros(volPadSizeZ, volPadSizeY, volPadSizeX);
+    transformerVol.setReal(Vout());
+    Vout().clear();
+    transformerVol.getFourierAlias(VoutFourier);
+    FourierWeights.initZeros(VoutFourier);
+    VoutFourier.initZeros();
+}
+
+void ProgRecFourier::saveAccumulator(const FileName &fnRoot)
+{
+    Image<double> auxWeights;
+    auxWeights().alias( FourierWeights );
+    auxWeights.write(fnRoot + "_Weights.vol");
+
+    Image< std::complex<double> > auxFourier;
+    auxFourier().alias( VoutFourier );
+    auxFourier.write(fnRoot + "_Fourier.mrc");
+
+    MetaData MD;
+    size_t id = MD.addObject();
+    MD.setValue(MDL_XSIZE, (size_t)imgSize, id);
+    MD.setValue(MDL_ZSIZE, (size_t)volPadSizeZ, id);
+    MD.setValue(MDL_COUNT, accumulatedImages, id);
+    MD.setValue(MDL_BLOB_RADIUS, blob.radius, id);
+    MD.setValue(MDL_BLOB_ORDER, blob.order, id);
+    MD.setValue(MDL_BLOB_ALPHA, blob.alpha, id);
+    MD.setValue(MDL_MAX_RESOLUTION, maxResolution, id);
+    MD.setValue(MDL_SYMMETRY, (String)fn_sym, id);
+    MD.write(fnRoot + ".xmd");
+}
+
+void ProgRecFourier::loadAccumulator(const FileName &fnRoot)
+{
+    MetaData MD(fnRoot + ".xmd");
+    size_t id = MD.firstObject();
+    size_t accImgSize, accVolSize, accImages;
+    MD.getValue(MDL_XSIZE, accImgSize, id);
+    MD.getValue(MDL_ZSIZE, accVolSize, id);
+    MD.getValue(MDL_COUNT, accImages, id);
+    if ((int)accImgSize != imgSize || (int)accVolSize != volPadSizeZ)
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, formatString("Accumulator %s was computed for images of size %lu "
+                     "and padded volumes of size %lu", fnRoot.c_str(), accImgSize, accVolSize));
+
+    // The sums of runs with other interpolation or symmetry cannot be added
+    double accBlobRadius, accBlobAlpha, accMaxResolution;
+    int accBlobOrder;
+    String accSymmetry;
+    MD.getValue(MDL_BLOB_RADIUS, accBlobRadius, id);
+    MD.getValue(MDL_BLOB_ORDER, accBlobOrder, id);
+    MD.getValue(MDL_BLOB_ALPHA, accBlobAlpha, id);
+    MD.getValue(MDL_MAX_RESOLUTION, accMaxResolution, id);
+    MD.getValue(MDL_SYMMETRY, accSymmetry, id);
+    if (!XMIPP_EQUAL_REAL(accBlobRadius, blob.radius) || accBlobOrder != blob.order ||
+        !XMIPP_EQUAL_REAL(accBlobAlpha, blob.alpha))
+        REPORT_ERROR(ERR_ARG_INCORRECT, formatString("Accumulator %s was computed with blob radius %f, "
+                     "order %d and alpha %f", fnRoot.c_str(), accBlobRadius, accBlobOrder, accBlobAlpha));
+    if (!XMIPP_EQUAL_REAL(accMaxResolution, maxResolution))
+        REPORT_ERROR(ERR_ARG_INCORRECT, formatString("Accumulator %s was computed with maximum resolution %f",
+                     fnRoot.c_str(), accMaxResolution));
+    if (accSymmetry != fn_sym)
+        REPORT_ERROR(ERR_ARG_INCORRECT, formatString("Accumulator %s was computed with symmetry %s",
+                     fnRoot.c_str(), accSymmetry.c_str()));
+
+    Image<double> auxWeights;
+    auxWeights.read(fnRoot + "_Weights.vol");
+    if (!auxWeights().sameShape(FourierWeights))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, fnRoot + "_Weights.vol does not have the size of the Fourier volume");
+    FourierWeights += auxWeights();
+
+    Image< std::complex<double> > auxFourier;
+    auxFourier.read(fnRoot + "_Fourier.mrc");
+    if (!auxFourier().sameShape(VoutFourier))
+        REPORT_ERROR(ERR_MULTIDIM_SIZE, fnRoot + "_Fourier.mrc does not have the size of the Fourier volume");
+    const MultidimArray< std::complex<double> > &mAuxFourier = auxFourier();
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(VoutFourier)
+    DIRECT_MULTIDIM_ELEM(VoutFourier, n) += DIRECT_MULTIDIM_ELEM(mAuxFourier, n);
+
+    accumulatedImages += accImages;
+}
+
+void ProgRecFourier::writeIntermediateVolume(const FileName &fnVol)
+{
+    // The weight correction and the inverse transform destroy the
+    // accumulators, so keep a copy to go on adding images
+    MultidimArray< std::complex<double> > VoutFourierCopy = VoutFourier;
+    MultidimArray<double> FourierWeightsCopy = FourierWeights;
+
+    correctWeight();
+    finishComputations(fnVol);
+
+    Vout().initZeros(volPadSizeZ, volPadSizeY, volPadSizeX);
+    transformerVol.setReal(Vout());
+    Vout().clear();
+    transformerVol.getFourierAlias(VoutFourier);
+    FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(VoutFourier)
+    DIRECT_MULTIDIM_ELEM(VoutFourier, n) = DIRECT_MULTIDIM_ELEM(VoutFourierCopy, n);
+    FourierWeights = FourierWeightsCopy;
+}
+
 void ProgRecFourier::correctWeight()
 {
     // If NiterWeight=0 then set the weights to one
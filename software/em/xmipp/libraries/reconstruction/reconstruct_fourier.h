@@ -58,6 +58,8 @@
 #define PROCESS_IMAGE 1
 #define PROCESS_WEIGHTS 2
 #define PRELOAD_IMAGE 3
+#define PROCESS_IMAGES_PRIVATE 4
+#define MERGE_ACCUMULATORS 5
 
 /**@defgroup FourierReconstruction Fourier reconstruction
    @ingroup ReconsLibrary */
@@ -83,6 +85,21 @@ struct ImageThreadParams
     MetaData * selFile;
 };
 
+/** Tables used by a thread to grid a Fourier image in the volume.
+ * They cache the wrapped indexes of the logical coordinates
+ * and the squared distances of the current blob neighbourhood.
+ */
+struct GriddingBuffers
+{
+    MultidimArray<int> zWrapped, yWrapped, xWrapped, zNegWrapped, yNegWrapped, xNegWrapped;
+    MultidimArray<double> x2precalculated, y2precalculated, z2precalculated;
+    /// Blob values along a run of X of the neighbourhood
+    std::vector<double> runWeights;
+
+    /// Allocate the tables for a padded volume
+    void initialize(int volPadSizeZ, int volPadSizeY, int volPadSizeX);
+};
+
 /** Fourier reconstruction parameters. */
 class ProgRecFourier : public ProgReconsBase
 {
@@ -125,6 +142,21 @@ public:
     /// Number of iterations for the weight
     int NiterWeight;
 
+    /// Rootnames of the accumulators to add before processing the images
+    StringVector fn_accumulators;
+
+    /// Rootname of the accumulator to save, empty for not saving
+    FileName fn_accumulator_out;
+
+    /// Do not compute the final volume
+    bool noFinalize;
+
+    /// Write an intermediate volume each this number of images (0 for none)
+    int updateEvery;
+
+    /// Number of images in the accumulators, including the loaded ones
+    size_t accumulatedImages;
+
     /// Number of threads to use in parallel to process a single image
     int numThreads;
 
@@ -155,6 +187,28 @@ public:
     /// How many image rows are processed at a time by a single thread.
     int thrWidth;
 
+    /** Each thread accumulates whole images in its own Fourier volume.
+     * Threads do not synchronize for each image, the volumes are
+     * merged at the end of processImages. Thread 0 accumulates directly
+     * on VoutFourier and FourierWeights.
+     */
+    bool threadAccumulators;
+
+    /// Distributes the images among threads when threadAccumulators is set
+    ThreadTaskDistributor * imageDistributor;
+
+    /// First image handled by imageDistributor
+    int firstDistributedImage;
+
+    /// Number of images already processed, for the progress bar
+    int imagesProcessed;
+
+    /// Fourier volumes of threads 1...numThreads-1
+    std::vector< MultidimArray< std::complex<double> > > threadVoutFourier;
+
+    /// Fourier weights of threads 1...numThreads-1
+    std::vector< MultidimArray<double> > threadFourierWeights;
+
 public: // Internal members
     // Size of the original images
     int imgSize;
@@ -180,8 +234,8 @@ public: // Internal members
     // Definition of the blob
     struct blobtype blob;
 
-    // vector with R symmetry matrices
-    std::vector <Matrix2D<double> > R_repository;
+    // R symmetry matrices (the first one is the identity)
+    SymRotationTable R_repository;
 
     // Fourier transformer for the volume
     FourierTransformer transformerVol;
@@ -222,6 +276,45 @@ public:
     /// Process one image
     void processImages( int firstImageIndex, int lastImageIndex, bool saveFSC=false, bool reprocessFlag=false);
 
+    /** Process images with one accumulator per thread.
+     * Each thread reads, transforms and grids whole images for all
+     * symmetries. The thread volumes are added to VoutFourier and
+     * FourierWeights before returning.
+     */
+    void processImagesThreadAccumulators( int firstImageIndex, int lastImageIndex, bool reprocessFlag);
+
+    /** Add the contribution of rows [minRow,maxRow] of a Fourier image.
+     * A_SL is the symmetrized projection direction and weight the image
+     * weight. Coefficients are added to Vout and weights (when reprocessFlag
+     * is set, Vout is only read and the weights are accumulated). Rows whose
+     * statusArray value is not -1 are skipped, unless statusArray is NULL.
+     */
+    void gridImageRows(const MultidimArray< std::complex<double> > &paddedFourier,
+                       const Matrix2D<double> &A_SL, int minRow, int maxRow, const int * statusArray,
+                       double weight, bool reprocessFlag, bool hasCTF, CTFDescription &ctf,
+                       GriddingBuffers &buffers, MultidimArray< std::complex<double> > &Vout,
+                       MultidimArray<double> &weights);
+
+    /// Save the first half of the images for FSC and restart the accumulation
+    void saveFirstHalfFSC();
+
+    /** Save the current Fourier sums and weights.
+     * The files rootname_Fourier.mrc (MRC stores complex values),
+     * rootname_Weights.vol and rootname.xmd (image size, padded volume size,
+     * number of images, blob, maximum resolution and symmetry) are written.
+     * Weights are saved before correctWeight is applied.
+     */
+    void saveAccumulator(const FileName &fnRoot);
+
+    /** Add an accumulator saved by saveAccumulator to the current one.
+     * It must have been computed with the same sizes, blob, maximum
+     * resolution and symmetry.
+     */
+    void loadAccumulator(const FileName &fnRoot);
+
+    /// Compute the volume of the current accumulator without modifying it
+    void writeIntermediateVolume(const FileName &fnVol);
+
     /// Method for the correction of the fourier coefficients
     void correctWeight();
 	
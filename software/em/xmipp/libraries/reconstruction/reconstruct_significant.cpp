@@ -143,12 +143,8 @@ void ProgReconstructSignificant::show()
 //#define DEBUG
 void ProgReconstructSignificant::alignImagesToGallery()
 {
-    AlignmentAux aux;
-    CorrelationAux aux2;
-    RotationalCorrelationAux aux3;
-
-	Matrix2D<double> M;
 	std::vector< Matrix2D<double> > allM;
+	std::vector<MultireferenceAlignment> alignments;
 
 	size_t Nvols=YSIZE(cc);
 	size_t Ndirs=XSIZE(cc);
@@ -167,7 +163,9 @@ void ProgReconstructSignificant::alignImagesToGallery()
 	FileName fnImg;
 	size_t nImg=0;
 	Image<double> I;
-	MultidimArray<double> mCurrentImageAligned, mGalleryProjection;
+	aligner.imed=&imgimed;
+	aligner.wrap=DONT_WRAP;
+	aligner.considerMirrors=!dontCheckMirrors;
 	if (rank==0)
 	{
 		std::cout << "Current significance: " << one_alpha << std::endl;
@@ -196,63 +194,37 @@ void ProgReconstructSignificant::alignImagesToGallery()
 			int bestVolume=-1;
 
 			// Compute all correlations
-	    	for (size_t nVolume=0; nVolume<Nvols; ++nVolume)
-	    	{
-	    		AlignmentTransforms *transforms=galleryTransforms[nVolume];
-		    	for (size_t nDir=0; nDir<Ndirs; ++nDir)
-				{
-					mCurrentImageAligned=mCurrentImage;
-					mGalleryProjection.aliasImageInStack(gallery[nVolume](),nDir);
-					mGalleryProjection.setXmippOrigin();
-					double corr;
-					if (! dontCheckMirrors)
-						corr=alignImagesConsideringMirrors(mGalleryProjection,transforms[nDir],
-								mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-					else
-						corr = alignImages(mGalleryProjection, mCurrentImageAligned,
-						                   M, DONT_WRAP);
-
-//					double corr=alignImagesConsideringMirrors(mGalleryProjection,
-//							mCurrentImageAligned,M,aux,aux2,aux3,DONT_WRAP);
-					M=M.inv();
-					double imed=imedDistance(mGalleryProjection, mCurrentImageAligned);
-
-//					//if (corr>0.99)
-//					//{
-//					//std::cout << prm.mdGallery[nVolume][nDir].fnImg << " corr= " << corr << " imed= " << imed << std::endl;
-//					//std::cout << "Matrix=" << M << std::endl;
-//					//Image<double> save;
-//					//save()=mGalleryProjection;
-//					//save.write("PPPgallery.xmp");
-//					//save()=mCurrentImage;
-//					//save.write("PPPcurrentImage.xmp");
-//					//save()=mCurrentImageAligned;
-//					//save.write("PPPcurrentImageAligned.xmp");
-//					//char c; std::cin >> c;
-//					//}
-
-					DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
-					// For the paper plot: std::cout << corr << " " << imed << std::endl;
-					size_t idx=nVolume*Ndirs+nDir;
-					DIRECT_A1D_ELEM(imgcc,idx)=corr;
-					DIRECT_A1D_ELEM(imgimed,idx)=imed;
-					allM.push_back(M);
+			aligner.align(mCurrentImage,alignments,0);
+			allM.resize(Nvols*Ndirs);
+			for (size_t n=0; n<alignments.size(); ++n)
+			{
+				const MultireferenceAlignment &alignment=alignments[n];
+				size_t idx=alignment.refno;
+				size_t nVolume=idx/Ndirs;
+				size_t nDir=idx%Ndirs;
+				double corr=alignment.corr;
+				allM[idx]=alignment.M.inv();
 
-					if (corr>bestCorr)
-					{
-						bestM=M;
-						bestCorr=corr;
-						bestVolume=(int)nVolume;
-						bestRot=mdGallery[nVolume][nDir].rot;
-						bestTilt=mdGallery[nVolume][nDir].tilt;
-					}
+				DIRECT_A3D_ELEM(cc,nImg,nVolume,nDir)=corr;
+				DIRECT_A1D_ELEM(imgcc,idx)=corr;
 
-					if (imed<bestImed)
-						bestImed=imed;
-					else if (imed>worstImed)
-						worstImed=imed;
+				if (corr>bestCorr)
+				{
+					bestM=allM[idx];
+					bestCorr=corr;
+					bestVolume=(int)nVolume;
+					bestRot=mdGallery[nVolume][nDir].rot;
+					bestTilt=mdGallery[nVolume][nDir].tilt;
 				}
-	    	}
+			}
+			FOR_ALL_DIRECT_ELEMENTS_IN_ARRAY1D(imgimed)
+			{
+				double imed=DIRECT_A1D_ELEM(imgimed,i);
+				if (imed<bestImed)
+					bestImed=imed;
+				else if (imed>worstImed)
+					worstImed=imed;
+			}
 
 	    	// Keep the best assignment for the projection matching
 	    	// Each process keeps a list of the images for each volume
@@ -644,9 +616,8 @@ void ProgReconstructSignificant::generateProjections()
 	std::vector<GalleryImage> galleryNames;
 	mdGallery.clear();
 
-	CorrelationAux aux;
-	AlignmentAux aux2;
 	MultidimArray<double> mGalleryProjection;
+	aligner.clearReferences();
 	for (int n=0; n<Nvolumes; n++)
 	{
 		mdGallery.push_back(galleryNames);
@@ -672,23 +643,16 @@ void ProgReconstructSignificant::generateProjections()
 		}
 		gallery[n].read(fnGallery);
 
-		// Calculate transforms of this gallery
+		// The transforms of the gallery are computed by the aligner
 		size_t kmax=NSIZE(gallery[n]());
-		if (galleryTransforms[n]==NULL)
-		{
-			delete galleryTransforms[n];
-			galleryTransforms[n]=new AlignmentTransforms[kmax];
-		}
-		AlignmentTransforms *transforms=galleryTransforms[n];
 		for (size_t k=0; k<kmax; ++k)
 		{
 			mGalleryProjection.aliasImageInStack(gallery[n](),k);
 			mGalleryProjection.setXmippOrigin();
-			aux.transformer1.FourierTransform((MultidimArray<double> &)mGalleryProjection, transforms[k].FFTI, true);
-		    normalizedPolarFourierTransform(mGalleryProjection, transforms[k].polarFourierI, false,
-		                                    XSIZE(mGalleryProjection) / 5, XSIZE(mGalleryProjection) / 2, aux2.plans, 1);
+			aligner.addReference(mGalleryProjection);
 		}
 	}
+	aligner.computeReferenceTransforms();
 }
 
 void ProgReconstructSignificant::numberOfProjections()
@@ -850,7 +814,6 @@ void ProgReconstructSignificant::produceSideinfo()
 			mdIn.write(fnAngles);
 		}
 		gallery.push_back(galleryDummy);
-		galleryTransforms.push_back(NULL);
 		mdReconstructionPartial.push_back(mdPartial);
 		mdReconstructionProjectionMatching.push_back(mdProjMatch);
 	}
@@ -34,6 +34,21 @@
    @ingroup ReconsLibrary */
 //@{
 
+/** Alignment of an image with all the gallery projections.
+ * The IMED distance of the aligned image to each projection is stored in imed.
+ */
+class SignificantAligner: public MultireferenceAligner
+{
+public:
+    MultidimArray<double> *imed;
+
+    void processAlignment(const MultireferenceAlignment &alignment,
+                          const MultidimArray<double> &Ialigned, int thread_id)
+    {
+        DIRECT_A1D_ELEM(*imed,alignment.refno)=imedDistance(reference(alignment.refno),Ialigned);
+    }
+};
+
 /** Significant reconstruction parameters. */
 class ProgReconstructSignificant: public XmippProgram
 {
@@ -124,7 +139,7 @@ public: // Internal members
     // Images
     // COSS Image<double> inputImages;
     std::vector< Image<double> > gallery;
-    std::vector< AlignmentTransforms* > galleryTransforms;
+    SignificantAligner aligner;
 
 	// Current iteration
 	int iter;
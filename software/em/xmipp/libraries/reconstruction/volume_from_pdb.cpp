@@ -27,9 +27,199 @@
 #include "volume_from_pdb.h"
 
 #include <data/args.h>
+#include <data/xmipp_threads.h>
 
 #include <fstream>
 
+// Samples per voxel of the tabulated atomic profiles
+#define PDB_PROFILE_TABLE_SAMPLING 100
+
+/* Atom splatting ---------------------------------------------------------- */
+// Atom in the coordinates of the volume (voxels)
+struct SplatAtom
+{
+    double x, y, z;
+    // Half size of the box that is updated
+    double radius;
+    // Weight of the atom (Gaussians and blobs)
+    double weight;
+    // Variance (Angstroms^2) and normalization of the Gaussian
+    double sigma2, normalization;
+    // Element index (scattering profiles)
+    int element;
+};
+
+#define SPLAT_GAUSSIAN 0
+#define SPLAT_BLOB 1
+#define SPLAT_PROFILE 2
+
+/* The volume is split into slabs of Z planes and each atom is assigned to
+   the slabs its box intersects. Slabs are processed in parallel, each one
+   by a single thread that adds its atoms in the order of the PDB file, so
+   that the result does not depend on the number of threads. */
+class AtomSplattingBody: public ParallelForBody
+{
+public:
+    // Output volume (logical indexes)
+    MultidimArray<double> *V;
+    // Atoms to splat
+    const std::vector<SplatAtom> *atoms;
+    // SPLAT_GAUSSIAN, SPLAT_BLOB or SPLAT_PROFILE
+    int kind;
+    // Voxel size (Angstroms) for Gaussians and blobs
+    double Ts;
+    // Blob (its radius is the one of each atom)
+    struct blobtype blob;
+    // Radial profiles of the elements (PDB_PROFILE_TABLE_SAMPLING samples per voxel)
+    const std::vector< std::vector<double> > *profiles;
+    // Planes per slab
+    int slabSize;
+    // Atoms of slab s are slabAtoms[slabFirst[s]...slabFirst[s+1]-1]
+    std::vector<size_t> slabFirst, slabAtoms;
+
+    // Assign atoms to slabs and add them to the volume
+    void run()
+    {
+        int nThreads = ThreadPool::getInstance().getNumberOfThreads() + 1;
+        int nSlabs0 = 4 * nThreads;
+        slabSize = XMIPP_MAX(1, (int)(ZSIZE(*V) + nSlabs0 - 1) / nSlabs0);
+        size_t nSlabs = (ZSIZE(*V) + slabSize - 1) / slabSize;
+
+        // Count the atoms of each slab and then fill the lists
+        slabFirst.assign(nSlabs + 1, 0);
+        size_t nAtoms = atoms->size();
+        for (int pass = 0; pass < 2; pass++)
+        {
+            std::vector<size_t> next;
+            if (pass == 1)
+            {
+                for (size_t s = 0; s < nSlabs; s++)
+                    slabFirst[s + 1] += slabFirst[s];
+                slabAtoms.resize(slabFirst[nSlabs]);
+                next.assign(slabFirst.begin(), slabFirst.end() - 1);
+            }
+            for (size_t n = 0; n < nAtoms; n++)
+            {
+                const SplatAtom &atom = (*atoms)[n];
+                int k0 = XMIPP_MAX(FLOOR(atom.z - atom.radius), STARTINGZ(*V));
+                int kF = XMIPP_MIN(CEIL(atom.z + atom.radius), FINISHINGZ(*V));
+                if (k0 > kF)
+                    continue;
+                size_t s0 = (k0 - STARTINGZ(*V)) / slabSize;
+                size_t sF = (kF - STARTINGZ(*V)) / slabSize;
+                for (size_t s = s0; s <= sF; s++)
+                    if (pass == 0)
+                        slabFirst[s + 1]++;
+                    else
+                        slabAtoms[next[s]++] = n;
+            }
+        }
+        if (nSlabs > 0)
+            ThreadPool::getInstance().parallelFor(0, nSlabs - 1, *this, 1);
+    }
+
+    void operator()(size_t first, size_t last, int thread_id)
+    {
+        MultidimArray<double> &mV = *V;
+        std::vector<double> ex, ey, ez;
+        for (size_t s = first; s <= last; s++)
+        {
+            int kS = STARTINGZ(mV) + (int)s * slabSize;
+            int kE = XMIPP_MIN(kS + slabSize - 1, (int)FINISHINGZ(mV));
+            for (size_t a = slabFirst[s]; a < slabFirst[s + 1]; a++)
+            {
+                const SplatAtom &atom = (*atoms)[slabAtoms[a]];
+                double radius = atom.radius;
+
+                // Find the part of the slab that must be updated
+                int k0 = XMIPP_MAX(FLOOR(atom.z - radius), kS);
+                int kF = XMIPP_MIN(CEIL(atom.z + radius), kE);
+                int i0 = XMIPP_MAX(FLOOR(atom.y - radius), STARTINGY(mV));
+                int iF = XMIPP_MIN(CEIL(atom.y + radius), FINISHINGY(mV));
+                int j0 = XMIPP_MAX(FLOOR(atom.x - radius), STARTINGX(mV));
+                int jF = XMIPP_MIN(CEIL(atom.x + radius), FINISHINGX(mV));
+                if (k0 > kF || i0 > iF || j0 > jF)
+                    continue;
+
+                if (kind == SPLAT_GAUSSIAN)
+                {
+                    // The Gaussian is separable
+                    double K = -1.0 / (2 * atom.sigma2);
+                    ex.resize(jF - j0 + 1);
+                    ey.resize(iF - i0 + 1);
+                    ez.resize(kF - k0 + 1);
+                    for (int j = j0; j <= jF; j++)
+                    {
+                        double d = (atom.x - j) * Ts;
+                        ex[j - j0] = exp(K * d * d);
+                    }
+                    for (int i = i0; i <= iF; i++)
+                    {
+                        double d = (atom.y - i) * Ts;
+                        ey[i - i0] = exp(K * d * d);
+                    }
+                    for (int k = k0; k <= kF; k++)
+                    {
+                        double d = (atom.z - k) * Ts;
+                        ez[k - k0] = atom.weight * atom.normalization * exp(K * d * d);
+                    }
+                    for (int k = k0; k <= kF; k++)
+                        for (int i = i0; i <= iF; i++)
+                        {
+                            double ezy = ez[k - k0] * ey[i - i0];
+                            double *ptrV = &A3D_ELEM(mV, k, i, j0);
+                            for (int j = j0; j <= jF; j++)
+                                *ptrV++ += ezy * ex[j - j0];
+                        }
+                }
+                else if (kind == SPLAT_BLOB)
+                {
+                    struct blobtype atomBlob = blob;
+                    atomBlob.radius = radius;
+                    for (int k = k0; k <= kF; k++)
+                        for (int i = i0; i <= iF; i++)
+                            for (int j = j0; j <= jF; j++)
+                            {
+                                double dx = (atom.x - j) * Ts;
+                                double dy = (atom.y - i) * Ts;
+                                double dz = (atom.z - k) * Ts;
+                                A3D_ELEM(mV, k, i, j) += atom.weight *
+                                                         blob_val(sqrt(dx * dx + dy * dy + dz * dz), atomBlob);
+                            }
+                }
+                else
+                {
+                    const double *profile = &((*profiles)[atom.element][0]);
+                    double radius2 = radius * radius;
+                    for (int k = k0; k <= kF; k++)
+                    {
+                        double zdiff = atom.z - k;
+                        double zdiff2 = zdiff * zdiff;
+                        for (int i = i0; i <= iF; i++)
+                        {
+                            double ydiff = atom.y - i;
+                            double zydiff2 = zdiff2 + ydiff * ydiff;
+                            double *ptrV = &A3D_ELEM(mV, k, i, j0);
+                            for (int j = j0; j <= jF; j++, ptrV++)
+                            {
+                                double xdiff = atom.x - j;
+                                double rdiffModule2 = zydiff2 + xdiff * xdiff;
+                                if (rdiffModule2 < radius2)
+                                {
+                                    double t = sqrt(rdiffModule2) * PDB_PROFILE_TABLE_SAMPLING;
+                                    int idx = (int)t;
+                                    double w = t - idx;
+                                    *ptrV += profile[idx] + w * (profile[idx + 1] - profile[idx]);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+};
+
 /* Empty constructor ------------------------------------------------------- */
 ProgPdbConverter::ProgPdbConverter()
 {
@@ -73,33 +263,25 @@ ProgPdbConverter::ProgPdbConverter()
 /* Produce Side Info ------------------------------------------------------- */
 void ProgPdbConverter::produceSideInfo()
 {
+    // The PDB file is only parsed here
+    model.read(fn_pdb);
+
     if (useFixedGaussian && sigmaGaussian<0)
     {
         // Check if it is a pseudodensity volume
-        std::ifstream fh_pdb;
-        fh_pdb.open(fn_pdb.c_str());
-        if (!fh_pdb)
-            REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
-        while (!fh_pdb.eof())
+        for (size_t n = 0; n < model.remarks.size(); n++)
         {
-            // Read an ATOM line
-            std::string line;
-            getline(fh_pdb, line);
-            if (line == "")
-                continue;
-            std::string kind = line.substr(0,6);
-            if (kind!="REMARK")
-                continue;
             std::vector< std::string > results;
-            splitString(line," ",results);
+            splitString(model.remarks[n]," ",results);
+            if (results.size() < 2)
+                continue;
             if (results[1]=="xmipp_convert_vol2pseudo")
                 useFixedGaussian=true;
-            if (useFixedGaussian && results[1]=="fixedGaussian")
+            if (useFixedGaussian && results[1]=="fixedGaussian" && results.size()>2)
                 sigmaGaussian=textToFloat(results[2]);
-            if (useFixedGaussian && results[1]=="intensityColumn")
+            if (useFixedGaussian && results[1]=="intensityColumn" && results.size()>2)
                 intensityColumn=results[2];
         }
-        fh_pdb.close();
     }
 
     if (!useBlobs && !usePoorGaussian && !useFixedGaussian)
@@ -211,7 +393,7 @@ void ProgPdbConverter::show()
 void ProgPdbConverter::computeProteinGeometry()
 {
     Matrix1D<double> limit0(3), limitF(3);
-    computePDBgeometry(fn_pdb, centerOfMass, limit0, limitF, intensityColumn);
+    model.computeGeometry(centerOfMass, limit0, limitF, intensityColumn);
     if (doCenter)
     {
         limit0-=centerOfMass;
@@ -249,94 +431,67 @@ void ProgPdbConverter::createProteinAtHighSamplingRate()
     	std::cout << "The highly sampled volume is of size " << XSIZE(Vhigh())
     	<< std::endl;
 
-    // Fill the volume with the different atoms
-    std::ifstream fh_pdb;
-    fh_pdb.open(fn_pdb.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
-
-    // Process all lines of the file
+    // Atoms in voxels of the highly sampled volume
     int col=1;
     if (intensityColumn=="Bfactor")
         col=2;
-    while (!fh_pdb.eof())
+    size_t nAtoms = model.getNumberOfAtoms();
+    std::vector<SplatAtom> atoms;
+    atoms.reserve(nAtoms);
+    for (size_t n = 0; n < nAtoms; n++)
     {
-        // Read an ATOM line
-        std::string line;
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        std::string kind = line.substr(0,4);
-        if (kind != "ATOM" && kind !="HETA")
-            continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        std::string atom_type = line.substr(13,2);
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
-
-        // Correct position
-        Matrix1D<double> r(3);
-        VECTOR_R3(r, x, y, z);
+        SplatAtom atom;
+        atom.x = model.x[n];
+        atom.y = model.y[n];
+        atom.z = model.z[n];
         if (doCenter)
-            r -= centerOfMass;
-        r /= highTs;
+        {
+            atom.x -= XX(centerOfMass);
+            atom.y -= YY(centerOfMass);
+            atom.z -= ZZ(centerOfMass);
+        }
+        atom.x /= highTs;
+        atom.y /= highTs;
+        atom.z /= highTs;
 
         // Characterize atom
         double weight, radius;
         if (!useFixedGaussian)
-        {
-            if (atom_type=="HETA")
-                continue;
-            atomBlobDescription(atom_type, weight, radius);
-        }
+            atomBlobDescription(model.getAtomName(n), weight, radius);
         else
         {
             radius=4.5*sigmaGaussian;
             if (col==1)
-                weight=textToFloat(line.substr(54,6));
+                weight=model.occupancy[n];
             else
-                weight=textToFloat(line.substr(60,6));
+                weight=model.bfactor[n];
         }
-        blob.radius = radius;
+        // Unknown atoms do not contribute
+        if (weight == 0)
+            continue;
         if (usePoorGaussian)
             radius=XMIPP_MAX(radius/Ts,4.5);
         double GaussianSigma2=(radius/(3*sqrt(2.0)));
         if (useFixedGaussian)
             GaussianSigma2=sigmaGaussian;
         GaussianSigma2*=GaussianSigma2;
-        double GaussianNormalization = 1.0/pow(2*PI*GaussianSigma2,1.5);
-
-        // Find the part of the volume that must be updated
-        int k0 = XMIPP_MAX(FLOOR(ZZ(r) - radius), STARTINGZ(Vhigh()));
-        int kF = XMIPP_MIN(CEIL(ZZ(r) + radius), FINISHINGZ(Vhigh()));
-        int i0 = XMIPP_MAX(FLOOR(YY(r) - radius), STARTINGY(Vhigh()));
-        int iF = XMIPP_MIN(CEIL(YY(r) + radius), FINISHINGY(Vhigh()));
-        int j0 = XMIPP_MAX(FLOOR(XX(r) - radius), STARTINGX(Vhigh()));
-        int jF = XMIPP_MIN(CEIL(XX(r) + radius), FINISHINGX(Vhigh()));
-
-        // Fill the volume with this atom
-        Matrix1D<double> rdiff(3);
-        for (int k = k0; k <= kF; k++)
-            for (int i = i0; i <= iF; i++)
-                for (int j = j0; j <= jF; j++)
-                {
-                    VECTOR_R3(rdiff, XX(r) - j, YY(r) - i, ZZ(r) - k);
-                    rdiff*=highTs;
-                    if (useBlobs)
-                        Vhigh(k, i, j) += weight * blob_val(rdiff.module(), blob);
-                    else if (usePoorGaussian || useFixedGaussian)
-                        Vhigh(k, i, j) += weight *
-                                          exp(-rdiff.module()*rdiff.module()/(2*GaussianSigma2))*
-                                          GaussianNormalization;
-                }
+        atom.radius = radius;
+        atom.weight = weight;
+        atom.sigma2 = GaussianSigma2;
+        atom.normalization = 1.0/pow(2*PI*GaussianSigma2,1.5);
+        atom.element = 0;
+        atoms.push_back(atom);
     }
 
-    // Close file
-    fh_pdb.close();
+    // Fill the volume with the different atoms
+    AtomSplattingBody body;
+    body.V = &Vhigh();
+    body.atoms = &atoms;
+    body.kind = useBlobs ? SPLAT_BLOB : SPLAT_GAUSSIAN;
+    body.Ts = highTs;
+    body.blob = blob;
+    body.profiles = NULL;
+    body.run();
 }
 
 /* Create protein at a low sampling rate ----------------------------------- */
@@ -389,88 +544,62 @@ void ProgPdbConverter::createProteinUsingScatteringProfiles()
     Vlow().initZeros(output_dim,output_dim,output_dim);
     Vlow().setXmippOrigin();
 
-    // Fill the volume with the different atoms
-    std::ifstream fh_pdb;
-    fh_pdb.open(fn_pdb.c_str());
-    if (!fh_pdb)
-        REPORT_ERROR(ERR_IO_NOTEXIST, fn_pdb);
+    // Radial profiles of the elements
+    const char elements[] = "HCNOPSF";
+    std::vector< std::vector<double> > profiles(7);
+    for (int e = 0; e < 7; e++)
+    {
+        size_t nSamples = (size_t)CEIL(atomProfiles.radii[e] * PDB_PROFILE_TABLE_SAMPLING) + 2;
+        profiles[e].resize(nSamples);
+        for (size_t n = 0; n < nSamples; n++)
+            profiles[e][n] = atomProfiles.volumeAtDistance(elements[e],
+                             (double)n / PDB_PROFILE_TABLE_SAMPLING);
+    }
 
-    // Process all lines of the file
-    std::string line, kind, atom_type;
+    // Atoms in voxels of the volume
     double iTs=1.0/Ts;
-    Matrix1D<double> r(3), rdiff(3);
-    while (!fh_pdb.eof())
+    size_t nAtoms = model.getNumberOfAtoms();
+    std::vector<SplatAtom> atoms;
+    atoms.reserve(nAtoms);
+    for (size_t n = 0; n < nAtoms; n++)
     {
-        // Read an ATOM line
-        getline(fh_pdb, line);
-        if (line == "")
-            continue;
-        kind =line.substr(0,4);
-        if (kind != "ATOM")
+        if (model.hetero[n])
             continue;
-
-        // Extract atom type and position
-        // Typical line:
-        // ATOM    909  CA  ALA A 161      58.775  31.984 111.803  1.00 34.78
-        atom_type = line.substr(13,2);
-        char atom_type0=atom_type[0];
-        double x = textToFloat(line.substr(30,8));
-        double y = textToFloat(line.substr(38,8));
-        double z = textToFloat(line.substr(46,8));
-
-        // Correct position
-        VECTOR_R3(r, x, y, z);
-        if (doCenter)
-            r -= centerOfMass;
-        r *= iTs;
-
-        // Characterize atom
-        try
+        int e = model.element[n];
+        if (e < 0 || e >= 7)
         {
-            double radius=atomProfiles.atomRadius(atom_type[0]);
-            double radius2=radius*radius;
-
-            // Find the part of the volume that must be updated
-            const MultidimArray<double> &mVlow=Vlow();
-            int k0 = XMIPP_MAX(FLOOR(ZZ(r) - radius), STARTINGZ(mVlow));
-            int kF = XMIPP_MIN(CEIL(ZZ(r) + radius), FINISHINGZ(mVlow));
-            int i0 = XMIPP_MAX(FLOOR(YY(r) - radius), STARTINGY(mVlow));
-            int iF = XMIPP_MIN(CEIL(YY(r) + radius), FINISHINGY(mVlow));
-            int j0 = XMIPP_MAX(FLOOR(XX(r) - radius), STARTINGX(mVlow));
-            int jF = XMIPP_MIN(CEIL(XX(r) + radius), FINISHINGX(mVlow));
-
-            // Fill the volume with this atom
-            for (int k = k0; k <= kF; k++)
-            {
-                double zdiff=ZZ(r) - k;
-                double zdiff2=zdiff*zdiff;
-                for (int i = i0; i <= iF; i++)
-                {
-                    double ydiff=YY(r) - i;
-                    double zydiff2=zdiff2+ydiff*ydiff;
-                    for (int j = j0; j <= jF; j++)
-                    {
-                        double xdiff=XX(r) - j;
-                        double rdiffModule2=zydiff2+xdiff*xdiff;
-                        if (rdiffModule2<radius2)
-                        {
-                            double rdiffModule=sqrt(rdiffModule2);
-                            A3D_ELEM(mVlow,k, i, j) += atomProfiles.volumeAtDistance(
-                                                 atom_type0,rdiffModule);
-                        }
-                    }
-                }
-            }
+            if (verbose)
+                std::cerr << "Ignoring atom of type *" << model.getAtomName(n) << "*" << std::endl;
+            continue;
         }
-        catch (XmippError XE)
+        SplatAtom atom;
+        atom.x = model.x[n];
+        atom.y = model.y[n];
+        atom.z = model.z[n];
+        if (doCenter)
         {
-        	if (verbose)
-        		std::cerr << "Ignoring atom of type *" << atom_type << "*" << std::endl;
+            atom.x -= XX(centerOfMass);
+            atom.y -= YY(centerOfMass);
+            atom.z -= ZZ(centerOfMass);
         }
+        atom.x *= iTs;
+        atom.y *= iTs;
+        atom.z *= iTs;
+        atom.radius = atomProfiles.radii[e];
+        atom.weight = 1;
+        atom.element = e;
+        atoms.push_back(atom);
     }
 
-    // Close file
-    fh_pdb.close();
+    // Fill the volume with the different atoms
+    AtomSplattingBody body;
+    body.V = &Vlow();
+    body.atoms = &atoms;
+    body.kind = SPLAT_PROFILE;
+    body.Ts = Ts;
+    body.blob = blob;
+    body.profiles = &profiles;
+    body.run();
 }
 
 /* Run --------------------------------------------------------------------- */
@@ -104,6 +104,9 @@ public:
     /* Atom interpolator. */
     AtomInterpolator atomProfiles;
 
+    // Atoms of the PDB file
+    AtomicModel model;
+
     // Protein geometry
     Matrix1D<double> centerOfMass, limit;
 
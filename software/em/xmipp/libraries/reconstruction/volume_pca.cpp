@@ -92,6 +92,26 @@ void ProgVolumePCA::produce_side_info()
 	}
 }
 
+// Number of passes over the volumes to compute the PCA basis
+#define VOLUME_PCA_PASSES 3
+
+void ProgVolumePCA::readMaskedVolume(size_t objId, MultidimArray<double> &v)
+{
+	FileName fnVol;
+	mdVols.getValue(MDL_IMAGE,fnVol,objId);
+	V.read(fnVol);
+
+	// Construct vector
+	const MultidimArray<int> &imask=mask.imask;
+	const MultidimArray<double> &mV=V();
+	size_t idx=0;
+	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mV)
+	{
+		if (DIRECT_MULTIDIM_ELEM(imask,n))
+			DIRECT_MULTIDIM_ELEM(v,idx++)=DIRECT_MULTIDIM_ELEM(mV,n);
+	}
+}
+
 void ProgVolumePCA::run()
 {
     show();
@@ -99,41 +119,45 @@ void ProgVolumePCA::run()
 
     const MultidimArray<int> &imask=mask.imask;
     size_t Nvoxels=imask.sum();
-    MultidimArray<float> v;
+    MultidimArray<double> v;
     v.initZeros(Nvoxels);
 
-    // Add all volumes to the analyzer
-    FileName fnVol;
-    FOR_ALL_OBJECTS_IN_METADATA(mdVols)
+    // Construct PCA basis. The volumes are read once per pass instead
+    // of being kept in memory. In the last pass, their coordinates in the
+    // subspace are kept to project them onto the basis without reading
+    // them again
+    analyzer.initialize(Nvoxels,NPCA,5);
+    NPCA=std::min(NPCA,(int)analyzer.NPCA);
+    size_t Nvols=mdVols.size();
+    Matrix2D<double> subspaceCoords;
+    for (int pass=0; pass<VOLUME_PCA_PASSES; pass++)
     {
-    	mdVols.getValue(MDL_IMAGE,fnVol,__iter.objId);
-    	V.read(fnVol);
-
-    	// Construct vector
-    	const MultidimArray<double> &mV=V();
-    	size_t idx=0;
-    	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mV)
+    	bool lastPass=pass==VOLUME_PCA_PASSES-1;
+    	if (lastPass)
+    		subspaceCoords.resizeNoCopy(Nvols,analyzer.Nsub);
+    	analyzer.startPass();
+    	size_t i=0;
+    	FOR_ALL_OBJECTS_IN_METADATA(mdVols)
     	{
-    		if (DIRECT_MULTIDIM_ELEM(imask,n))
-    			DIRECT_MULTIDIM_ELEM(v,idx++)=DIRECT_MULTIDIM_ELEM(mV,n);
+    		readMaskedVolume(__iter.objId,v);
+    		analyzer.addVector(MULTIDIM_ARRAY(v));
+    		if (lastPass)
+    			analyzer.projectOntoSubspace(MULTIDIM_ARRAY(v),&MAT_ELEM(subspaceCoords,i++,0));
     	}
-
-    	analyzer.addVector(v);
+    	analyzer.endPass();
     }
 
-    // Construct PCA basis
-    analyzer.subtractAvg();
-    analyzer.learnPCABasis(NPCA,100);
-
     // Project onto the PCA basis
     Matrix2D<double> proj;
-    analyzer.projectOnPCABasis(proj);
+    proj.initZeros(NPCA,Nvols);
     std::vector<double> dimredProj;
     dimredProj.resize(NPCA);
     int i=0;
     FOR_ALL_OBJECTS_IN_METADATA(mdVols)
     {
-        memcpy(&dimredProj[0],&MAT_ELEM(proj,i,0),NPCA*sizeof(double));
+    	analyzer.projectFromSubspace(&MAT_ELEM(subspaceCoords,i,0),&dimredProj[0]);
+    	for (int k=0; k<NPCA; k++)
+    		MAT_ELEM(proj,k,i)=dimredProj[k];
         mdVols.setValue(MDL_DIMRED,dimredProj,__iter.objId);
         i++;
     }
@@ -148,11 +172,11 @@ void ProgVolumePCA::run()
 	{
 	    V().initZeros();
     	size_t idx=0;
-    	const MultidimArray<double> &mPCA=analyzer.PCAbasis[i];
+    	const double *ptrPCA=&MAT_ELEM(analyzer.PCAbasis,i,0);
     	FOR_ALL_DIRECT_ELEMENTS_IN_MULTIDIMARRAY(mV)
     	{
     		if (DIRECT_MULTIDIM_ELEM(imask,n))
-    			DIRECT_MULTIDIM_ELEM(mV,n)=DIRECT_MULTIDIM_ELEM(mPCA,idx++);
+    			DIRECT_MULTIDIM_ELEM(mV,n)=ptrPCA[idx++];
     	}
     	if (fnBasis!="")
     		V.write(fnBasis,i+1,true,WRITE_OVERWRITE);
@@ -62,7 +62,7 @@ public:
     Image<double> V;
 
     // PCA analyzer
-    PCAMahalanobisAnalyzer analyzer;
+    StreamingRandomizedPCA analyzer;
 public:
     /// Read arguments
     void readParams();
@@ -76,6 +76,9 @@ public:
     /** Produce side info.*/
     void produce_side_info();
 
+    /** Read a volume and copy the voxels inside the mask into v */
+    void readMaskedVolume(size_t objId, MultidimArray<double> &v);
+
     /** Run */
     void run();
 };